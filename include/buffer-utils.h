@@ -97,6 +97,7 @@ typedef struct {
 
 int block_realloc(MemoryBlock*, size_t, JSContext*);
 void block_free(MemoryBlock*, JSRuntime*);
+int block_mmap_fd(MemoryBlock*, int, BOOL);
 MemoryBlock block_mmap(const char*, BOOL);
 void block_munmap(MemoryBlock*);
 int block_from_file(MemoryBlock*, const char*, JSContext*);
@@ -0,0 +1,71 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include "queue.h"
+
+/**
+ * \defgroup channel channel: Lock-free message channels between runtimes
+ * @{
+ */
+
+enum {
+  CHANNEL_BINARY = 0,
+  CHANNEL_VALUE,
+};
+
+typedef struct channel_slot {
+  atomic_size_t seq;
+  Chunk* chunk;
+  int type;
+} ChannelSlot;
+
+/* Bounded ring of message slots (Vyukov MPMC queue). Every slot carries a
+ * sequence number which tells producers and consumers whether it is free
+ * or filled for their lap, so neither side ever takes a lock. With 'spsc'
+ * set the head/tail claims are plain stores instead of compare-and-swap.
+ *
+ * 'fd_recv' and 'fd_send' are eventfds, signalled when data resp. space
+ * becomes available and somebody has announced waiting for it. */
+typedef struct channel {
+  atomic_int ref_count;
+  struct channel* next;
+  char* name;
+  size_t capacity, mask;
+  int spsc;
+  atomic_int closed;
+  int fd_recv, fd_send;
+  atomic_int waiting_recv, waiting_send;
+  _Alignas(64) atomic_size_t head;
+  _Alignas(64) atomic_size_t tail;
+  _Alignas(64) ChannelSlot slots[];
+} Channel;
+
+Channel* channel_open(const char* name, size_t capacity, int spsc);
+Channel* channel_dup(Channel*);
+void channel_free(Channel*);
+int channel_send(Channel*, Chunk* chunk, int type);
+Chunk* channel_recv(Channel*, int* type);
+void channel_close(Channel*);
+void channel_signal(int fd);
+void channel_drain(int fd);
+
+static inline size_t
+channel_size(Channel* chan) {
+  size_t head = atomic_load_explicit(&chan->head, memory_order_acquire);
+  size_t tail = atomic_load_explicit(&chan->tail, memory_order_acquire);
+
+  /* tail may have moved past the head we read before it */
+  return (ptrdiff_t)(head - tail) > 0 ? head - tail : 0;
+}
+
+static inline int
+channel_closed(Channel* chan) {
+  return atomic_load_explicit(&chan->closed, memory_order_acquire);
+}
+
+/**
+ * @}
+ */
+#endif /* defined(CHANNEL_H) */
@@ -19,12 +19,14 @@ typedef struct ChildProcess {
   intptr_t pid;
 
   int status, exitcode, termsig, stopsig;
-  bool use_path : 1, exited : 1, signaled : 1, stopped : 1, continued : 1, killed : 1;
+  bool use_path : 1, exited : 1, signaled : 1, stopped : 1, continued : 1, killed : 1, watched : 1;
   int uid, gid;
+  int pidfd;
   int num_fds;
   int *child_fds, *parent_fds, *pipe_fds;
   struct list_head link;
   JSValue onexit;
+  JSValue done, done_resolve;
 } ChildProcess;
 
 ChildProcess* child_process_get(int);
@@ -34,6 +36,12 @@ int child_process_spawn(ChildProcess*);
 bool child_process_status(ChildProcess*, int);
 int child_process_wait(ChildProcess*, int);
 int child_process_kill(ChildProcess*, int);
+int child_process_pidfd(ChildProcess*);
+bool child_process_reap(ChildProcess*, JSContext*);
+void child_process_lost(ChildProcess*, JSContext*);
+void child_process_sigchld_handler(JSContext*);
+JSValue child_process_done(JSContext*, ChildProcess*);
+JSValue child_process_exitstatus(JSContext*, ChildProcess*);
 void child_process_free(ChildProcess*, JSContext*);
 void child_process_free_rt(ChildProcess*, JSRuntime*);
 void child_process_remove(ChildProcess*, JSContext*);
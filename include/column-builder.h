@@ -0,0 +1,48 @@
+#ifndef COLUMN_BUILDER_H
+#define COLUMN_BUILDER_H
+
+#include <quickjs.h>
+#include <cutils.h>
+#include <stdint.h>
+
+/**
+ * \defgroup column-builder column-builder: Columnar result buffers
+ * @{
+ */
+
+/* Storage type of a column, widened as values come in:
+ * INT32 -> INT64 -> FLOAT64, and any number mixed with text makes TEXT */
+typedef enum {
+  COLUMN_KIND_EMPTY = 0,
+  COLUMN_KIND_INT32,
+  COLUMN_KIND_INT64,
+  COLUMN_KIND_FLOAT64,
+  COLUMN_KIND_TEXT,
+} ColumnKind;
+
+/* Accumulates the values of one result column for a batch of rows.
+ * Numbers are packed into 'values', text into 'bytes' with 'rows + 1'
+ * uint32 'offsets'. 'nulls' has one byte per row and is only filled once
+ * the first NULL was seen. All memory comes from the JSRuntime so
+ * column_value() can hand it to ArrayBuffers without copying. */
+typedef struct column_builder {
+  ColumnKind kind;
+  BOOL binary, has_nulls;
+  uint32_t rows;
+  DynBuf values, offsets, bytes, nulls;
+} ColumnBuilder;
+
+void column_init(ColumnBuilder*, JSContext*);
+void column_reset(ColumnBuilder*);
+void column_free(ColumnBuilder*);
+int column_put_null(ColumnBuilder*);
+int column_put_int64(ColumnBuilder*, int64_t);
+int column_put_float64(ColumnBuilder*, double);
+int column_put_text(ColumnBuilder*, const void*, size_t, BOOL binary);
+int column_put_number(ColumnBuilder*, const char*, size_t);
+JSValue column_value(ColumnBuilder*, JSContext*);
+
+/**
+ * @}
+ */
+#endif /* defined(COLUMN_BUILDER_H) */
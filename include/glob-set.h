@@ -0,0 +1,37 @@
+#ifndef GLOB_SET_H
+#define GLOB_SET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \defgroup glob-set glob-set: Compiled sets of glob patterns
+ * @{
+ */
+
+/* Patterns are compiled into one automaton: a trie over pattern tokens,
+ * so patterns sharing a literal prefix share states, simulated over the
+ * path in a single pass. Patterns without a '/' match the last path
+ * component, those with a '/' the whole path. Patterns of the form
+ * '*<literal>' (like '*.c') are kept in a separate suffix trie.
+ *
+ * Syntax: '?', '*' (doesn't cross '/'), '[...]' ('!' or '^' negates,
+ * ranges), '\' escapes, '{a,b}' alternatives and '**' as a whole path
+ * component, which matches any number of directories.
+ *
+ * Patterns are added incrementally, once complete the set is read-only
+ * and can be matched from any thread. Memory comes from malloc(), not
+ * from a JSRuntime. */
+typedef struct glob_set GlobSet;
+
+GlobSet* globset_new(void);
+void globset_free(GlobSet*);
+int globset_add(GlobSet*, const char*, size_t);
+uint32_t globset_count(const GlobSet*);
+int globset_match(const GlobSet*, const char*, size_t, uint8_t* hits);
+int globset_test(const GlobSet*, const char*, size_t);
+
+/**
+ * @}
+ */
+#endif /* defined(GLOB_SET_H) */
@@ -78,6 +78,7 @@ void path_append3(const char* x, size_t len, DynBuf* db);
 size_t path_normalize3(const char* path, size_t n, DynBuf* db);
 size_t path_normalize1(char* path);
 size_t path_normalize2(char* path, size_t nb);
+size_t path_normalize4(const char* path, size_t len, char* out, size_t size);
 SizePair path_common4(const char* s1, size_t n1, const char* s2, size_t n2);
 size_t path_components3(const char* p, size_t len, uint32_t n);
 const char* path_at4(const char* p, size_t plen, size_t* len_ptr, int i);
@@ -121,6 +122,7 @@ int path_issymlink1(const char* p);
 int path_issymlink2(const char* p, size_t plen);
 int path_resolve3(const char* path, DynBuf* db, int symbolic);
 char* path_resolve2(const char* path, int symbolic);
+size_t path_resolve5(const char* const parts[], const size_t lens[], int n, char* out, size_t size);
 int path_realpath3(const char*, size_t len, DynBuf* buf);
 char* path_realpath2(const char*, size_t len);
 char* path_realpath1(const char*);
@@ -6,10 +6,30 @@
 #include <stdint.h>
 #include <list.h>
 
+#ifdef _WIN32
+struct iovec {
+  void* iov_base;
+  size_t iov_len;
+};
+#else
+#include <sys/uio.h>
+#endif
+
 /**
  * \defgroup queue queue: I/O queueing
  * @{
  */
+
+/* Contiguous power-of-two ring buffer. 'rpos' and 'wpos' are free-running
+ * offsets, masked with (size - 1) on access. When 'mirror' is set the
+ * storage is mapped twice back-to-back, so every readable and writable
+ * region is a single contiguous span even across the wrap-around point. */
+typedef struct ring {
+  uint8_t* data;
+  size_t size, rpos, wpos;
+  int mirror;
+} Ring;
+
 typedef struct queue {
   size_t nbytes, nchunks;
   union {
@@ -18,6 +38,7 @@ typedef struct queue {
     };
     struct list_head list;
   };
+  Ring ring;
 } Queue;
 
 typedef struct block {
@@ -43,21 +64,50 @@ chunk_dup(Chunk* ch) {
 }
 
 void queue_init(Queue*);
+int queue_ring(Queue*, size_t size, int mirror);
+void queue_reset(Queue*);
 ssize_t queue_write(Queue*, const void* x, size_t n);
 ssize_t queue_read(Queue*, void* x, size_t n);
 ssize_t queue_peek(Queue*, void* x, size_t n);
 ssize_t queue_skip(Queue*, size_t n);
 Chunk* queue_next(Queue*);
 void queue_clear(Queue*);
+int queue_segments(Queue*, struct iovec*, int);
+int queue_reserve(Queue*, struct iovec*, int);
+ssize_t queue_commit(Queue*, size_t n);
+#ifndef _WIN32
+ssize_t queue_readv(Queue*, int fd, size_t n);
+ssize_t queue_writev(Queue*, int fd);
+#endif
+
+static inline int
+queue_is_ring(Queue* q) {
+  return q->ring.data != 0;
+}
 
 static inline size_t
 queue_size(Queue* q) {
   return q->nbytes;
 }
 
+static inline size_t
+queue_capacity(Queue* q) {
+  return q->ring.size;
+}
+
+static inline size_t
+queue_space(Queue* q) {
+  return q->ring.size - q->nbytes;
+}
+
 static inline int
 queue_empty(Queue* q) {
-  return list_empty(&q->list);
+  return queue_is_ring(q) ? q->nbytes == 0 : list_empty(&q->list);
+}
+
+static inline size_t
+queue_nchunks(Queue* q) {
+  return queue_is_ring(q) ? queue_segments(q, 0, 0) : q->nchunks;
 }
 
 static inline Chunk*
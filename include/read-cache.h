@@ -0,0 +1,43 @@
+#ifndef READ_CACHE_H
+#define READ_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \defgroup read-cache read-cache: Cache of file contents from layered file systems
+ * @{
+ */
+
+/* Two tables: paths map to the address of their contents, a layer and an
+ * offset in it (the entry in an archive, the inode in a directory), and
+ * addresses map to the contents. Paths which resolve to the same address
+ * share the contents. Contents are evicted least recently used first when
+ * they exceed the byte budget, paths stay until they are removed or their
+ * layer is invalidated.
+ *
+ * Not thread-safe. Memory comes from malloc(), not from a JSRuntime. */
+typedef struct read_cache ReadCache;
+
+typedef struct {
+  uint64_t hits, misses, evictions;
+  size_t bytes, budget;
+  uint32_t paths, bodies;
+} ReadCacheStats;
+
+ReadCache* readcache_new(size_t budget);
+void readcache_free(ReadCache*);
+int readcache_locate(ReadCache*, const char* path, size_t len, int32_t layer, int64_t offset);
+int readcache_location(const ReadCache*, const char* path, size_t len, int32_t* layer, int64_t* offset);
+int readcache_put(ReadCache*, const char* path, size_t len, const void* data, size_t size);
+const void* readcache_get(ReadCache*, const char* path, size_t len, size_t* size);
+int readcache_remove(ReadCache*, const char* path, size_t len);
+uint32_t readcache_invalidate(ReadCache*, int32_t layer);
+void readcache_clear(ReadCache*);
+void readcache_budget(ReadCache*, size_t budget);
+void readcache_stats(const ReadCache*, ReadCacheStats*);
+
+/**
+ * @}
+ */
+#endif /* defined(READ_CACHE_H) */
@@ -0,0 +1,42 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <quickjs.h>
+#include <list.h>
+#include <pthread.h>
+#include <stdint.h>
+
+/**
+ * \defgroup thread-pool thread-pool: Worker threads for blocking calls
+ * @{
+ */
+
+struct thread_queue;
+typedef struct thread_job ThreadJob;
+typedef void ThreadWorkFunc(ThreadJob*);
+typedef void ThreadDoneFunc(JSContext*, ThreadJob*);
+
+/* 'work' runs on a worker thread and must not touch the JSRuntime, 'done'
+ * runs afterwards on the thread which submitted the job, from its event
+ * loop. Jobs are embedded into bigger structures by the submitter. */
+struct thread_job {
+  struct list_head link;
+  ThreadWorkFunc* work;
+  ThreadDoneFunc* done;
+  struct thread_queue* queue;
+};
+
+/* Jobs submitted to the same lane run one after the other on the same
+ * worker thread, in submission order. THREAD_LANE_ANY picks whichever
+ * worker is free first. */
+#define THREAD_LANE_ANY (-1)
+
+int thread_pool_size(void);
+int thread_pool_lane(void);
+int thread_pool_submit(JSContext*, ThreadJob*, int lane);
+uint32_t thread_pool_pending(void);
+
+/**
+ * @}
+ */
+#endif /* defined(THREAD_POOL_H) */
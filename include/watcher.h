@@ -0,0 +1,55 @@
+#ifndef WATCHER_H
+#define WATCHER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \defgroup watcher watcher: Recursive inotify watches with coalesced events
+ * @{
+ */
+
+/* Watches directory trees (or single files) with one inotify instance.
+ * Events are decoded and merged per path: created and then modified is a
+ * creation, created and then deleted is nothing, the halves of a rename
+ * are paired by their cookie, and a file created and then renamed over
+ * another one (what editors do on save) is a change of the latter. A path
+ * is due when no event came for it for 'delay' ms, or 'max_delay' ms after
+ * its first one. The timer fd becomes readable when something is due.
+ * When the kernel queue overflows, the trees are scanned again and a
+ * WATCH_RESCAN event is reported for every root.
+ *
+ * Not thread-safe. Memory comes from malloc(), not from a JSRuntime. */
+typedef struct watcher Watcher;
+
+typedef enum {
+  WATCH_CREATE = 1,
+  WATCH_CHANGE,
+  WATCH_DELETE,
+  WATCH_RENAME,
+  WATCH_RESCAN,
+} WatchEventType;
+
+typedef struct {
+  WatchEventType type;
+  int directory;
+  char *path, *from;
+} WatchEvent;
+
+Watcher* watcher_new(uint32_t delay, uint32_t max_delay);
+void watcher_free(Watcher*);
+int watcher_fd(const Watcher*);
+int watcher_timer(const Watcher*);
+int watcher_add(Watcher*, const char* path);
+int watcher_remove(Watcher*, const char* path);
+int watcher_read(Watcher*);
+size_t watcher_take(Watcher*, WatchEvent** events);
+void watcher_events_free(WatchEvent*, size_t);
+uint32_t watcher_count(const Watcher*);
+uint32_t watcher_pending(const Watcher*);
+uint32_t watcher_roots(const Watcher*, const char*** roots);
+
+/**
+ * @}
+ */
+#endif /* defined(WATCHER_H) */
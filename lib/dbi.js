@@ -6,6 +6,8 @@
  * native module's calls.
  */
 
+import { clearTimeout, setTimeout } from 'os';
+
 const ADAPTERS = Object.create(null);
 
 export class Database {
@@ -21,22 +23,50 @@ export class Database {
     const adapter = new Adapter();
     await adapter.connect(options ?? {});
 
-    return new Database(driver, adapter);
+    const db = new Database(driver, adapter);
+    db.batching = !!options?.batch;
+    return db;
+  }
+
+  /** Create a Pool of connections, see Pool for the options. */
+  static async pool(driver, options, poolOptions) {
+    const pool = new Pool(driver, options, poolOptions);
+    await pool.fill();
+    return pool;
   }
 
   constructor(driver, adapter) {
     this.driver = driver;
     this._adapter = adapter;
-  }
+    this._statements = new Map();
+    this.statementCacheSize = 64;
+    this._queue = null;
+    this._flushing = false;
+    this.batching = false;
+    this.batchStats = { queries: 0, roundTrips: 0, batches: 0 };
+  }
+
+  /**
+   * Run a SQL statement and return a Result (rows + metadata). With params,
+   * the statement is prepared and cached, see prepare().
+   */
+  async query(sql, params) {
+    if(params !== undefined) return (await this.prepare(sql)).query(params);
+    if(this.batching) return new Result((await this._enqueue(sql)).raw, this._adapter);
 
-  /** Run a SQL statement and return a Result (rows + metadata). */
-  async query(sql) {
     const raw = await this._adapter.query(sql);
     return new Result(raw, this._adapter);
   }
 
   /** Run a SQL statement and return the affected row count. */
-  async exec(sql) {
+  async exec(sql, params) {
+    if(params !== undefined) return (await this.prepare(sql)).exec(params);
+
+    if(this.batching) {
+      const { raw, affectedRows } = await this._enqueue(sql);
+      return typeof raw === 'number' ? raw : affectedRows;
+    }
+
     const raw = await this._adapter.query(sql);
 
     /* sqlite's sync query returns the number directly for non-SELECT */
@@ -45,7 +75,128 @@ export class Database {
     return this._adapter.affectedRows;
   }
 
+  /**
+   * Run a SELECT and iterate over arrays of up to batchSize rows, without
+   * the client library holding the whole result set (pgsql: single-row
+   * mode, mysql: mysql_use_result()).
+   */
+  async *stream(sql, batchSize = 1000) {
+    if(typeof this._adapter.stream === 'function') {
+      yield* this._adapter.stream(sql, batchSize);
+      return;
+    }
+
+    yield* (await this.query(sql)).rows(batchSize);
+  }
+
+  /**
+   * Prepare sql as a server-side statement. Statements are cached per
+   * connection (least recently used ones are closed beyond
+   * statementCacheSize), so a pooled connection keeps them across acquires.
+   */
+  prepare(sql) {
+    let stmt = this._statements.get(sql);
+
+    if(stmt) {
+      this._statements.delete(sql);
+      this._statements.set(sql, stmt);
+      return stmt;
+    }
+
+    stmt = Promise.resolve(this._adapter.prepare(sql)).then(native => new Statement(native, this._adapter));
+    stmt.catch(() => this._statements.get(sql) === stmt && this._statements.delete(sql));
+
+    this._statements.set(sql, stmt);
+
+    if(this._statements.size > this.statementCacheSize) {
+      const [key, old] = this._statements.entries().next().value;
+
+      this._statements.delete(key);
+      old.then(st => st.close(), () => {});
+    }
+
+    return stmt;
+  }
+
+  /*
+   * With batching on, query() and exec() calls made before the next
+   * microtask are sent together: as one multi-statement query on mysql
+   * (connect with { batch: true }), in pipeline mode on pgsql. Queries
+   * issued while a batch is in flight form the next one.
+   */
+  _enqueue(sql) {
+    return new Promise((resolve, reject) => {
+      const queue = this._queue ?? (this._queue = []);
+
+      queue.push({ sql, resolve, reject });
+
+      if(queue.length == 1 && !this._flushing) Promise.resolve().then(() => this._flush());
+    });
+  }
+
+  async _flush() {
+    let queue;
+
+    this._flushing = true;
+
+    try {
+      while((queue = this._queue)) {
+        this._queue = null;
+        await this._run(queue);
+      }
+    } finally {
+      this._flushing = false;
+    }
+  }
+
+  async _run(queue) {
+    const adapter = this._adapter,
+      stats = this.batchStats;
+
+    while(queue.length) {
+      const sqls = queue.map(({ sql }) => sql.replace(/[\s;]*$/, ''));
+
+      stats.roundTrips++;
+
+      /* statements which contain ';' themselves can't be told apart */
+      if(queue.length == 1 || typeof adapter.batch !== 'function' || sqls.some(sql => sql.includes(';'))) {
+        const { sql, resolve, reject } = queue.shift();
+
+        stats.queries++;
+
+        try {
+          const raw = await adapter.query(sql);
+          resolve({ raw, affectedRows: adapter.affectedRows, insertId: adapter.insertId });
+        } catch(e) {
+          reject(e);
+        }
+
+        continue;
+      }
+
+      /* the statements after a failing one may not have run, they go again */
+      const results = await adapter.batch(sqls).catch(error => [{ error }]);
+
+      stats.batches++;
+      stats.queries += results.length;
+
+      results.forEach((result, i) => ('error' in result ? queue[i].reject(result.error) : queue[i].resolve(result)));
+      queue = queue.slice(results.length);
+    }
+  }
+
+  /** Cheap round trip to check the connection is usable. */
+  async ping() {
+    return this._adapter.ping();
+  }
+
+  /** Give a connection obtained from Pool.acquire() back to its pool. */
+  release() {
+    if(this._pool) this._pool.release(this);
+  }
+
   async close() {
+    this._statements.clear();
     return this._adapter.close();
   }
 
@@ -68,6 +219,296 @@ export class Database {
   }
 }
 
+/** A prepared statement, obtained from Database.prepare(). */
+export class Statement {
+  constructor(native, adapter) {
+    this._native = native;
+    this._adapter = adapter;
+  }
+
+  /** Execute with an array of parameters and return a Result. */
+  async query(params = []) {
+    return new Result(await this._native.query(params), this._adapter);
+  }
+
+  /** Execute with an array of parameters and return the affected row count. */
+  async exec(params = []) {
+    return this._native.exec(params);
+  }
+
+  close() {
+    return this._native.close();
+  }
+}
+
+/**
+ * A set of connections to one database.
+ *
+ *   min             connections opened by fill() and kept when idle (0)
+ *   max             upper limit of open connections (10)
+ *   idleTimeout     ms after which surplus idle connections are closed (30000)
+ *   acquireTimeout  ms acquire() waits before rejecting, 0 = forever (0)
+ *   pingAfter       ms of idleness after which acquire() pings first (1000)
+ *
+ * Waiting acquire() calls are served first come, first served. The most
+ * recently released connection is handed out first, so its prepared
+ * statements stay warm and the others can time out.
+ */
+export class Pool {
+  constructor(driver, options, { min = 0, max = 10, idleTimeout = 30000, acquireTimeout = 0, pingAfter = 1000 } = {}) {
+    if(!ADAPTERS[driver]) throw new Error(`dbi: unknown driver '${driver}' (available: ${Object.keys(ADAPTERS).join(', ')})`);
+    if(!(max >= 1) || min > max) throw new RangeError(`dbi: invalid pool size (min ${min}, max ${max})`);
+
+    Object.assign(this, { driver, options, min, max, idleTimeout, acquireTimeout, pingAfter });
+
+    this._idle = [];
+    this._waiters = [];
+    this._size = 0;
+    this._busy = 0;
+    this._timer = null;
+    this._closed = false;
+    this._counters = { acquires: 0, timeouts: 0, created: 0, destroyed: 0, pingFailures: 0, waitTime: 0, maxWaitTime: 0 };
+  }
+
+  /** Open connections until there are 'min' of them. */
+  async fill() {
+    const pending = [];
+
+    while(this._size < this.min) pending.push(this._create().then(db => this._put(db)));
+
+    await Promise.all(pending);
+  }
+
+  /** Resolves to a Database which must be given back with release(). */
+  async acquire() {
+    const start = Date.now();
+
+    for(;;) {
+      if(this._closed) throw new Error('dbi: pool is closed');
+
+      let db;
+
+      if(this._waiters.length) {
+        db = await this._wait();
+      } else if(this._idle.length) {
+        const { db: idle, since } = this._idle.pop();
+
+        if(Date.now() - since < this.pingAfter || (await this._ping(idle))) db = idle;
+      } else if(this._size < this.max) {
+        db = await this._create();
+      } else {
+        db = await this._wait();
+      }
+
+      if(db) return this._lend(db, start);
+    }
+  }
+
+  /** Give 'db' back; with destroy = true it is closed instead of reused. */
+  release(db, destroy = false) {
+    if(db._pool !== this || !db._lent) throw new Error('dbi: connection was not acquired from this pool');
+
+    db._lent = false;
+    this._busy--;
+
+    if(destroy || this._closed) return this._destroy(db);
+
+    this._put(db);
+  }
+
+  /** Run fn(db) with an acquired connection and release it afterwards. */
+  async use(fn) {
+    const db = await this.acquire();
+
+    try {
+      return await fn(db);
+    } finally {
+      this.release(db);
+    }
+  }
+
+  /** Rejects waiting acquire() calls and closes the idle connections. */
+  async close() {
+    this._closed = true;
+
+    if(this._timer) clearTimeout(this._timer), (this._timer = null);
+
+    for(const waiter of this._waiters.splice(0)) waiter.reject(new Error('dbi: pool is closed'));
+
+    await Promise.all(this._idle.splice(0).map(({ db }) => this._destroy(db)));
+  }
+
+  /**
+   * Counters since the pool was created. waitTime is the time acquire()
+   * spent waiting for a connection in ms, utilization the share of 'max'
+   * connections currently lent out.
+   */
+  get stats() {
+    const { acquires, waitTime } = this._counters;
+
+    return {
+      size: this._size,
+      idle: this._idle.length,
+      busy: this._busy,
+      waiting: this._waiters.length,
+      ...this._counters,
+      meanWaitTime: acquires ? waitTime / acquires : 0,
+      utilization: this._busy / this.max,
+    };
+  }
+
+  _lend(db, start) {
+    const wait = Date.now() - start;
+
+    db._lent = true;
+    this._busy++;
+    this._counters.acquires++;
+    this._counters.waitTime += wait;
+
+    if(wait > this._counters.maxWaitTime) this._counters.maxWaitTime = wait;
+
+    return db;
+  }
+
+  async _create() {
+    this._size++;
+
+    try {
+      const db = await Database.connect(this.driver, this.options);
+
+      db._pool = this;
+      this._counters.created++;
+      return db;
+    } catch(e) {
+      this._size--;
+      this._wake();
+      throw e;
+    }
+  }
+
+  async _destroy(db) {
+    this._size--;
+    this._counters.destroyed++;
+    this._wake();
+
+    try {
+      await db.close();
+    } catch(e) {}
+  }
+
+  async _ping(db) {
+    try {
+      await db.ping();
+      return true;
+    } catch(e) {
+      this._counters.pingFailures++;
+      this._destroy(db);
+      return false;
+    }
+  }
+
+  /* hands 'db' to the first waiter, or parks it as idle */
+  _put(db) {
+    const waiter = this._waiters.shift();
+
+    if(waiter) return waiter.resolve(db);
+
+    this._idle.push({ db, since: Date.now() });
+    this._schedule();
+  }
+
+  /* a waiter which timed out is 'settled', a connection opened for it in
+   * the meantime goes back to the pool */
+  _wait() {
+    return new Promise((resolve, reject) => {
+      const waiter = { resolve, reject, timer: null, settled: false };
+
+      if(this.acquireTimeout > 0)
+        waiter.timer = setTimeout(() => {
+          const index = this._waiters.indexOf(waiter);
+
+          if(index >= 0) this._waiters.splice(index, 1);
+
+          waiter.settled = true;
+          this._counters.timeouts++;
+          reject(new Error(`dbi: no connection available within ${this.acquireTimeout}ms`));
+        }, this.acquireTimeout);
+
+      waiter.resolve = db => {
+        if(waiter.settled) return this._put(db);
+
+        waiter.settled = true;
+        if(waiter.timer) clearTimeout(waiter.timer);
+        resolve(db);
+      };
+
+      waiter.reject = e => {
+        if(waiter.settled) return;
+
+        waiter.settled = true;
+        if(waiter.timer) clearTimeout(waiter.timer);
+        reject(e);
+      };
+
+      this._waiters.push(waiter);
+    });
+  }
+
+  /* a slot got free: let the first waiter open a new connection */
+  _wake() {
+    const waiter = this._waiters[0];
+
+    if(!waiter || this._closed || this._size >= this.max) return;
+
+    this._waiters.shift();
+    this._create().then(waiter.resolve, waiter.reject);
+  }
+
+  /* closes connections idle for idleTimeout, oldest first, down to 'min' */
+  _schedule() {
+    if(this._timer || this._closed || this._size <= this.min || !this._idle.length) return;
+
+    const delay = Math.max(0, this._idle[0].since + this.idleTimeout - Date.now());
+
+    this._timer = setTimeout(() => {
+      const now = Date.now();
+
+      this._timer = null;
+
+      while(this._idle.length && this._size > this.min && now - this._idle[0].since >= this.idleTimeout) this._destroy(this._idle.shift().db);
+
+      this._schedule();
+    }, delay);
+  }
+}
+
+/* rows read ahead of time, because the connection is needed for the next result */
+class BufferedResult {
+  constructor(rows, fields) {
+    this._rows = rows;
+    this._fields = fields;
+    this._pos = 0;
+  }
+
+  get numFields() {
+    return this._fields.length;
+  }
+
+  fetchFields() {
+    return this._fields;
+  }
+
+  async fetchRows(batchSize = 1000) {
+    if(this._pos >= this._rows.length) return null;
+
+    return this._rows.slice(this._pos, (this._pos += batchSize));
+  }
+
+  [Symbol.iterator]() {
+    return this._rows[Symbol.iterator]();
+  }
+}
+
 /** Driver-agnostic wrapper around a single result set. */
 export class Result {
   constructor(raw, adapter) {
@@ -78,7 +519,7 @@ export class Result {
   get numFields() {
     const r = this._raw;
     if(!r || typeof r !== 'object') return 0;
-    return r.numFields ?? 0;
+    return r.numFields ?? r.fieldCount ?? 0;
   }
 
   fetchFields() {
@@ -87,6 +528,49 @@ export class Result {
     return r.fetchFields();
   }
 
+  /**
+   * Fetch up to batchSize rows column-wise. Resolves to an object keyed by
+   * column name holding an Int32Array, BigInt64Array or Float64Array per
+   * numeric column (NULL becomes NaN), and { offsets, bytes, nulls? } per
+   * text/blob column, where value i spans bytes[offsets[i]..offsets[i + 1]].
+   * Resolves to null once all rows have been fetched.
+   */
+  async fetchColumns(batchSize) {
+    const r = this._raw;
+    if(!r || typeof r !== 'object' || typeof r.fetchColumns !== 'function') return null;
+    return r.fetchColumns(batchSize);
+  }
+
+  /** Async iterator over the column batches of fetchColumns(). */
+  async *columns(batchSize = 65536) {
+    let batch;
+    while((batch = await this.fetchColumns(batchSize))) yield batch;
+  }
+
+  /** Async iterator over arrays of up to batchSize rows. */
+  async *rows(batchSize = 1000) {
+    const r = this._raw;
+
+    if(r && typeof r === 'object' && typeof r.fetchRows === 'function') {
+      let batch;
+      while((batch = await r.fetchRows(batchSize))) yield batch;
+      return;
+    }
+
+    let batch = [];
+
+    for await(const row of this) {
+      batch.push(row);
+
+      if(batch.length >= batchSize) {
+        yield batch;
+        batch = [];
+      }
+    }
+
+    if(batch.length) yield batch;
+  }
+
   /** Async iterator that works for sync (sqlite, pgsql) and async (mysql) raw results. */
   async *[Symbol.asyncIterator]() {
     const r = this._raw;
@@ -94,6 +578,7 @@ export class Result {
 
     if(typeof r[Symbol.asyncIterator] === 'function') for await(const row of r) yield row;
     else if(typeof r[Symbol.iterator] === 'function') for(const row of r) yield row;
+    else if(typeof r.fetchRows === 'function') for await(const batch of this.rows()) yield* batch;
   }
 
   /** Collect all rows into an array. */
@@ -120,6 +605,20 @@ class SQLiteAdapter {
     return this.db.query(sql);
   }
 
+  prepare(sql) {
+    const stmt = this.db.prepare(sql);
+
+    return {
+      query: async params => stmt.all(params),
+      exec: async params => (await stmt.run(params)).changes,
+      close() {},
+    };
+  }
+
+  async ping() {
+    this.db.query('SELECT 1');
+  }
+
   async close() {
     this.db.close();
   }
@@ -154,12 +653,56 @@ class PGSQLAdapter {
 
     if(typeof options === 'string') await this.db.connect(options);
     else await this.db.connect(options.host ?? 'localhost', options.user ?? '', options.password ?? '', options.database ?? options.dbname ?? '', options.port ?? 5432, options.timeout ?? 10);
+
+    /* pipeline mode needs a nonblocking connection */
+    if(options.batch) this.db.nonblocking = true;
+  }
+
+  /* one pipeline, every query gets its own sync point so errors stay isolated */
+  async batch(sqls) {
+    const { db } = this;
+
+    db.pipeline = true;
+
+    try {
+      return await Promise.all(
+        sqls.map(sql =>
+          db.query(sql, []).then(
+            raw => ({ raw, affectedRows: raw?.affectedRows }),
+            error => ({ error }),
+          ),
+        ),
+      );
+    } finally {
+      db.pipeline = false;
+    }
   }
 
   async query(sql) {
     return this.db.query(sql);
   }
 
+  stream(sql, batchSize) {
+    return this.db.stream(sql, null, batchSize);
+  }
+
+  async prepare(sql) {
+    const { db } = this,
+      name = `dbi_${(this._prepared = (this._prepared ?? 0) + 1)}`;
+
+    await db.prepare(name, sql);
+
+    return {
+      query: params => db.execPrepared(name, params),
+      exec: async params => (await db.execPrepared(name, params))?.affectedRows,
+      close: () => db.query(`DEALLOCATE ${name}`),
+    };
+  }
+
+  async ping() {
+    await this.db.query('SELECT 1');
+  }
+
   async close() {
     this.db.close();
   }
@@ -197,13 +740,70 @@ class MySQLAdapter {
     this.db.setOption(MySQL.OPT_NONBLOCK, true);
     this.db.resultType |= MySQL.RESULT_OBJECT;
 
-    await this.db.connect(options.host ?? 'localhost', options.user ?? '', options.password ?? '', options.database ?? options.dbname ?? '');
+    await this.db.connect(options.host ?? 'localhost', options.user ?? '', options.password ?? '', options.database ?? options.dbname ?? '', options.port ?? 3306, options.socket, options.batch ? MySQL.CLIENT_MULTI_STATEMENTS : 0);
+  }
+
+  /* one multi-statement query, each result is read completely before the
+   * next one can be fetched. MySQL stops at the first failing statement */
+  async batch(sqls) {
+    const { db } = this,
+      results = [];
+    let res;
+
+    try {
+      res = await db.query(sqls.join(';\n'));
+    } catch(error) {
+      return [{ error }];
+    }
+
+    for(;;) {
+      results.push({ raw: res && (await this._buffer(res)), affectedRows: db.affectedRows, insertId: db.insertId });
+
+      if(results.length == sqls.length || !db.moreResults) break;
+
+      try {
+        res = await db.nextResult();
+      } catch(error) {
+        results.push({ error });
+        break;
+      }
+    }
+
+    return results;
+  }
+
+  async _buffer(res) {
+    const fields = res.fetchFields(),
+      names = fields.map(([name]) => name),
+      rows = [];
+
+    for(let batch; (batch = await res.fetchRows()); ) rows.push(...batch);
+
+    if(this.db.resultType & this._MySQL.RESULT_OBJECT) return new BufferedResult(rows.map(row => Object.fromEntries(names.map((name, i) => [name, row[i]]))), fields);
+
+    return new BufferedResult(rows, fields);
   }
 
   async query(sql) {
     return this.db.query(sql);
   }
 
+  /* rows come in the binary protocol, as arrays */
+  async prepare(sql) {
+    const stmt = await this.db.prepare(sql);
+
+    return {
+      query: params => stmt.execute(params),
+      exec: async params => (await stmt.execute(params)).affectedRows,
+      close: () => stmt.close(),
+    };
+  }
+
+  async ping() {
+    const res = await this.db.query('SELECT 1');
+    if(res) while(await res.fetchRows());
+  }
+
   async close() {
     this.db.close();
   }
@@ -1,4 +1,5 @@
 import { Blob } from 'blob';
+import { stat } from 'os';
 
 export class File extends Blob {
   #name;
@@ -10,6 +11,12 @@ export class File extends Blob {
     this.#lastModified = options.lastModified !== undefined ? Number(options.lastModified) : Date.now();
   }
 
+  /* backed by a mapping of the file, see Blob.fromFile() */
+  static fromFile(filename, options = {}) {
+    const [st] = stat(filename);
+    return new File([Blob.fromFile(filename, options)], filename.replace(/.*\//, ''), { lastModified: st?.mtime, ...options });
+  }
+
   get name() {
     return this.#name;
   }
@@ -1,7 +1,7 @@
 import { EventEmitter } from 'events';
 import * as os from 'os';
 import { basename, extname } from 'path';
-import { access as sys_access, error as sys_error, fchmod as sys_fchmod, fchown as sys_fchown, fdatasync as sys_fdatasync, fstat as sys_fstat, fsync as sys_fsync, ftruncate as sys_ftruncate, futimes as sys_futimes, IN_ISDIR, IN_ALL_EVENTS, IN_ATTRIB, IN_CLOSE_WRITE, IN_CLOSE_NOWRITE, IN_CLOSE, IN_CREATE, IN_DELETE, IN_DELETE_SELF, IN_MODIFY, IN_MOVE_SELF, IN_MOVED_TO, IN_MOVED_FROM, isArrayBuffer, isNumber, isObject, isString, link as sys_link, mkstemp, symlink as sys_symlink, tempnam, toArrayBuffer, toString, watch as iwatch, } from 'misc';
+import { access as sys_access, asyncFsync, asyncLstat, asyncOpen, asyncRead, asyncReadFile, asyncStat, asyncWrite, asyncWriteFile, error as sys_error, fchmod as sys_fchmod, fchown as sys_fchown, fdatasync as sys_fdatasync, fstat as sys_fstat, fsync as sys_fsync, ftruncate as sys_ftruncate, futimes as sys_futimes, IN_ISDIR, IN_ALL_EVENTS, IN_ATTRIB, IN_CLOSE_WRITE, IN_CLOSE_NOWRITE, IN_CLOSE, IN_CREATE, IN_DELETE, IN_DELETE_SELF, IN_MODIFY, IN_MOVE_SELF, IN_MOVED_TO, IN_MOVED_FROM, isArrayBuffer, isNumber, isObject, isString, link as sys_link, mkstemp, symlink as sys_symlink, tempnam, toArrayBuffer, toString, watch as iwatch, } from 'misc';
 import { filename, mmap, munmap } from 'mmap';
 import * as std from 'std';
 import { SyscallError } from 'syscallerror';
@@ -153,7 +153,8 @@ export class Stats {
         this[prop] = value;
       }
 
-    for(const prop in statsFields) if(prop.endsWith('time')) this[prop] = new Date(this[prop + 'Ms']);
+    /* with { bigint: true } the fields are BigInts, which Date doesn't take */
+    for(const prop in statsFields) if(prop.endsWith('time')) this[prop] = new Date(Number(this[prop + 'Ms']));
   }
 
   /* prettier-ignore */ isDirectory() { return (this.mode & os.S_IFMT) == os.S_IFDIR; }
@@ -662,8 +663,36 @@ export function readFileSync(file, options = {}) {
   return syscallerr(`fs.readFileSync('${file}')`, -res.errno);
 }
 
+/* The async functions below run the system calls on the thread pool of the
+ * 'misc' module, the event loop keeps running meanwhile */
 export async function readFile(file, options = {}) {
-  return readFileSync(file, options);
+  options = isString(options) ? { encoding: options } : options;
+
+  if(!isString(file)) return readFileSync(file, options);
+
+  const data = await asyncReadFile(file);
+
+  return options?.encoding != null ? toString(data) : data;
+}
+
+function openFlags(flag = 'w') {
+  if(isNumber(flag)) return flag;
+
+  const flags = { r: O_RDONLY, w: O_WRONLY | O_CREAT | O_TRUNC, a: O_WRONLY | O_CREAT | O_APPEND }[flag[0]];
+
+  if(flags === undefined) throw new TypeError(`invalid flags '${flag}'`);
+
+  return (flag.includes('+') ? (flags & ~O_WRONLY) | O_RDWR : flags) | (flag.includes('x') ? O_EXCL : 0);
+}
+
+export async function writeFile(file, data, options = {}) {
+  options = isString(options) ? { encoding: options } : options;
+
+  if(!isString(file)) return writeFileSync(file, data, options);
+
+  if(!isString(data)) throwIfNull(InvalidBuffer(2), bufferArgument, data);
+
+  return await asyncWriteFile(file, data, openFlags(options?.flag), options?.mode ?? 0o666);
 }
 
 export function writeFileSync(file, data, options = { overwrite: true }) {
@@ -933,6 +962,9 @@ export async function readFully(input, buf, start = 0, n) {
 }
 
 export async function open(filename, flags = 'file', mode = 0o644) {
+  /* numeric flags open a descriptor, like os.open() */
+  if(isNumber(flags)) return await asyncOpen(filename, flags, mode);
+
   const errorObj = { errno: 0 };
   const file = std.open(filename, flags, errorObj);
 
@@ -987,15 +1019,19 @@ export async function exists(path) {
   return existsSync(path);
 }
 
-export async function lstat(path) {
-  return lstatSync(path);
+export async function lstat(path, options) {
+  return new Stats(await asyncLstat(path, options));
 }
 
 export async function mkdir(path) {
   return mkdirSync(path);
 }
 
-export async function read(fd, buf, offset, length) {
+export async function read(fd, buf, offset, length, position) {
+  /* a positioned read on a descriptor is a regular file, which never
+   * becomes readable in the poll() sense */
+  if(isNumber(fd) && isNumber(position)) return await asyncRead(fd, buf, offset, length, position);
+
   const args = throwIfNull(InvalidBuffer(2), bufferArguments, buf, offset, length);
   let ret;
 
@@ -1008,8 +1044,16 @@ export async function read(fd, buf, offset, length) {
   return ret;
 }
 
-export async function stat(path) {
-  return statSync(path);
+export async function stat(path, options) {
+  return new Stats(await asyncStat(path, options));
+}
+
+export async function fsync(fd) {
+  return await asyncFsync(fd);
+}
+
+export async function fdatasync(fd) {
+  return await asyncFsync(fd, true);
 }
 
 export async function symlink(target, path) {
@@ -1020,7 +1064,9 @@ export async function tmpfile() {
   return tmpfileSync();
 }
 
-export async function write(fd, buf, offset, length) {
+export async function write(fd, buf, offset, length, position) {
+  if(isNumber(fd) && isNumber(position)) return await asyncWrite(fd, buf, offset, length, position);
+
   const args = throwIfNull(InvalidBuffer(2), stringOrBufferArguments, buf, offset, length);
   let ret;
 
@@ -1256,9 +1302,11 @@ export default {
   createWriteStream,
   exists,
   existsSync,
+  fdatasync,
   fdopenSync,
   fileno,
   fopenSync,
+  fsync,
   getcwd,
   gets,
   isatty,
@@ -1277,6 +1325,7 @@ export default {
   read,
   readAll,
   readAllSync,
+  readFile,
   readFileSync,
   readSync,
   readdirSync,
@@ -1303,6 +1352,7 @@ export default {
   waitWrite,
   watch,
   write,
+  writeFile,
   writeFileSync,
   writeSync,
 };
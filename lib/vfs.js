@@ -2,10 +2,15 @@ import * as fs from 'fs';
 import { closeSync, flushSync, nameSync, read, readAll, readAllSync, reader, readerSync, readSync, write, writeSync } from 'fs';
 import { absolute, isAbsolute, isRelative, join, length, resolve, slice } from 'path';
 import { define, nonenumerable, toString } from 'util';
-import { Archive, ArchiveEntry } from 'archive';
+import { Archive, ArchiveCache, ArchiveEntry, ArchiveIndex } from 'archive';
 import { ArrayExtensions } from 'extendArray';
 import { IOReadDecorator, IOWriteDecorator } from 'io';
+import { IN_ATTRIB, IN_CLOSE_WRITE, IN_DELETE_SELF, IN_IGNORED, IN_MODIFY, IN_MOVE_SELF, watch } from 'misc';
+import * as os from 'os';
 import { Queue } from 'queue';
+
+const WATCH_MASK = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF;
+
 function contains(dir, entry, res = true) {
   if(res) {
     dir = resolve(dir);
@@ -15,13 +20,119 @@ function contains(dir, entry, res = true) {
   return length(entry) >= len && dir == slice(entry, 0, len);
 }
 
+/* the low 32 bits of the inode, and a hash of the device and the upper
+ * bits above them: stays an exact integer, and files on different mounts
+ * don't share an address unless their hashes collide */
+function fileOffset(dev, ino) {
+  const hi = Math.floor(ino / 0x100000000),
+    lo = ino % 0x100000000;
+  let h = Math.imul(dev % 0x100000000 ^ Math.imul(Math.floor(dev / 0x100000000), 0x9e3779b1), 0x85ebca6b);
+
+  h = Math.imul(h ^ hi ^ (h >>> 15), 0xc2b2ae35);
+  h ^= h >>> 16;
+
+  return (h & 0x1fffff) * 0x100000000 + lo;
+}
+
+/* An ArchiveCache, with inotify watches on the files it has contents from.
+ * Pending events are read before every lookup, so nothing stale is returned
+ * and no read handler keeps the event loop running. */
+class WatchedCache {
+  #cache = null;
+  #fd = -1;
+  #buf = new ArrayBuffer(4096);
+  #watches = new Map();
+  #files = new Map();
+
+  constructor(cache) {
+    this.#cache = cache instanceof ArchiveCache ? cache : new ArchiveCache(typeof cache == 'number' ? cache : undefined);
+  }
+
+  get cache() {
+    return this.#cache;
+  }
+
+  get(key) {
+    this.#poll();
+    return this.#cache.get(key);
+  }
+
+  set(key, layer, offset, data) {
+    this.#cache.set(key, layer, offset, data);
+  }
+
+  delete(key) {
+    return this.#cache.delete(key);
+  }
+
+  /* onChange(), registered under 'id', runs once when 'file' changes.
+   * called before 'file' is read, so a change during the read is not missed */
+  watch(file, id, onChange) {
+    let wd = this.#files.get(file);
+
+    if(wd === undefined) {
+      try {
+        if(this.#fd == -1) this.#fd = watch();
+        wd = watch(this.#fd, file, WATCH_MASK);
+      } catch(e) {
+        return false;
+      }
+
+      this.#files.set(file, wd);
+      this.#watches.set(wd, { file, handlers: new Map() });
+    }
+
+    this.#watches.get(wd).handlers.set(id, onChange);
+    return true;
+  }
+
+  #poll() {
+    let r;
+
+    if(this.#fd == -1) return;
+
+    while((r = os.read(this.#fd, this.#buf, 0, this.#buf.byteLength)) > 0)
+      for(const { wd, mask } of watch(this.#buf, 0, r)) {
+        const w = this.#watches.get(wd);
+
+        if(!w) continue;
+
+        for(const onChange of w.handlers.values()) onChange();
+        w.handlers.clear();
+
+        if(mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+          if(!(mask & IN_IGNORED))
+            try {
+              watch(this.#fd, wd);
+            } catch(e) {}
+
+          this.#watches.delete(wd);
+          this.#files.delete(w.file);
+        }
+      }
+  }
+}
+
 export class UnionFS {
   #paths = [];
   #impl = [];
+  #layers = [];
+  #nextLayer = 0;
+  #nextFile = 0;
+  #cache = null;
+
+  constructor(options = {}) {
+    if(options.cache) this.#cache = new WatchedCache(options.cache === true ? undefined : options.cache);
+  }
+
+  get cache() {
+    return this.#cache?.cache;
+  }
 
   appendPath(p, impl = fs) {
     if(ArrayExtensions.pushUnique.call(this.#paths, resolve(p))) {
       this.#impl.push(impl);
+      this.#layers.push(this.#nextLayer++);
       return true;
     }
   }
@@ -29,16 +140,21 @@ export class UnionFS {
   prependPath(p, impl = fs) {
     if(ArrayExtensions.unshiftUnique.call(this.#paths, resolve(p))) {
       this.#impl.unshift(impl);
+      this.#layers.unshift(this.#nextLayer++);
+      /* may hide files of the other layers */
+      this.#cache?.cache.clear();
       return true;
     }
   }
 
   removePath(p) {
-    let i, dir, fs;
+    let i, dir, fs, layer;
 
     while((i = Array.prototype.indexOf.call(this.#paths, resolve(p))) != -1) {
-      [dir] = this.#paths.splice(i, i + 1);
-      [fs] = this.#impl.splice(i, i + 1);
+      [dir] = this.#paths.splice(i, 1);
+      [fs] = this.#impl.splice(i, 1);
+      [layer] = this.#layers.splice(i, 1);
+      this.#cache?.cache.invalidate(layer);
     }
 
     return [dir, fs];
@@ -119,8 +235,55 @@ export class UnionFS {
   }
 
   readFileSync(p, options = {}) {
-    const path = this.#basePath(p, true, true);
-    return this.#baseImpl(path).readFileSync(path, options);
+    if(!this.#cache) {
+      const path = this.#basePath(p, true, true);
+      return this.#baseImpl(path).readFileSync(path, options);
+    }
+
+    options = typeof options == 'string' ? { encoding: options } : options ?? {};
+
+    const key = isAbsolute(p) ? resolve(p) : p;
+    let data = this.#cache.get(key);
+
+    if(data === undefined) {
+      const path = this.#basePath(p, true, true);
+      const i = this.#baseIndex(path);
+      const impl = this.#impl[i];
+      const [layer, offset] = this.#cacheWatch(key, path, this.#layers[i], impl);
+
+      data = impl.readFileSync(path);
+
+      if(offset !== undefined && data instanceof ArrayBuffer) this.#cache.set(key, layer, offset, data);
+    }
+
+    return options.encoding != null && data instanceof ArrayBuffer ? toString(data) : data;
+  }
+
+  /* entries of an archive are addressed by their position in it, and the
+   * whole layer goes when the archive changes. files by device and inode.
+   * returns the address, or none when no watch could be added */
+  #cacheWatch(key, path, layer, impl) {
+    if(impl instanceof ArchiveFS) {
+      const ok = this.#cache.watch(impl.file, 'layer', () => {
+        impl.invalidate();
+        this.#cache.cache.invalidate(layer);
+      });
+
+      return ok ? [layer, impl.index.indexOf(path)] : [];
+    }
+
+    let offset;
+
+    try {
+      const { dev, ino } = impl.statSync(path);
+      offset = fileOffset(dev, ino);
+    } catch(e) {}
+
+    return this.#cache.watch(path, key, () => this.#cache.delete(key)) ? [layer, offset ?? -++this.#nextFile] : [];
+  }
+
+  #forget(p) {
+    this.#cache?.delete(isAbsolute(p) ? resolve(p) : p);
   }
 
   readdirSync(dir) {
@@ -154,6 +317,7 @@ export class UnionFS {
 
   renameSync(p, ...args) {
     const path = this.#basePath(p, true, true);
+    this.#forget(p);
     return this.#baseImpl(path).renameSync(path, ...args);
   }
 
@@ -164,6 +328,7 @@ export class UnionFS {
 
   symlinkSync(p, ...args) {
     const path = this.#basePath(p, true, true);
+    this.#forget(p);
     return this.#baseImpl(path).symlinkSync(path, ...args);
   }
 
@@ -174,11 +339,13 @@ export class UnionFS {
 
   unlinkSync(p) {
     const path = this.#basePath(p, true, true);
+    this.#forget(p);
     return this.#baseImpl(path).unlinkSync(path);
   }
 
   writeFileSync(p, ...args) {
     const path = this.#basePath(p, false, true);
+    this.#forget(p);
     return this.#baseImpl(path).writeFileSync(path, ...args);
   }
 
@@ -211,8 +378,10 @@ define(
 export class ArchiveFS {
   #archive = null;
   #mode = undefined;
+  #index = null;
+  #cache = null;
 
-  constructor(ar, rw) {
+  constructor(ar, rw, options = {}) {
     let file, mode;
 
     if(typeof ar == 'string') {
@@ -225,70 +394,82 @@ export class ArchiveFS {
 
     this.#mode = mode ? Archive.WRITE : Archive.READ;
     this.#archive = this.#mode == Archive.WRITE ? Archive.write(file) : file;
+
+    if(options.cache && this.#mode == Archive.READ) this.#cache = new WatchedCache(options.cache === true ? undefined : options.cache);
   }
 
   get archive() {
     if(typeof this.#archive == 'object') return this.#archive;
   }
 
-  readdirSync(dir) {
-    if(this.#mode != Archive.READ) throw new Error(`archive is not in read mode`);
+  get file() {
+    if(typeof this.#archive == 'string') return this.#archive;
+  }
+
+  get cache() {
+    return this.#cache?.cache;
+  }
+
+  /* lists the entries again on the next access */
+  invalidate() {
+    this.#index = null;
+    this.#cache?.cache.clear();
+  }
 
-    const a = [],
-      instance = new Archive();
+  /* entries are listed once, later lookups don't read the archive */
+  get index() {
+    if(this.#mode != Archive.READ) throw new Error(`archive is not in read mode`);
 
-    for(const entry of instance.open(this.#archive)) if(contains(dir, entry.pathname)) a.push(entry.pathname);
+    return (this.#index ??= new ArchiveIndex(this.#archive));
+  }
 
-    return a;
+  readdirSync(dir) {
+    return this.index.paths.filter(pathname => contains(dir, pathname));
   }
 
   #find(path) {
-    const instance = new Archive().open(this.#archive);
-    let entry;
+    const instance = this.index.open(path);
 
-    while((entry = instance.next())) if(entry.pathname == path) return [instance, entry];
-    return [,];
+    return instance ? [instance, instance.entry] : [,];
   }
 
   existsSync(path) {
-    const [ar, ent] = this.#find(path);
-    ar?.close();
-    return !!ent;
+    return this.index.has(path);
   }
 
   sizeSync(path) {
-    const [ar, ent] = this.#find(path);
-    ar?.close();
-    return ent?.size;
+    return this.index.get(path)?.size;
   }
 
   statSync(path) {
-    const [ar, ent] = this.#find(path);
-    ar?.close();
-    return ent;
+    return this.index.get(path);
   }
 
   lstatSync(path) {
-    const [ar, ent] = this.#find(path);
-    ar?.close();
-    return ent;
+    return this.index.get(path);
   }
 
   readFileSync(path, options = {}) {
     if(this.#mode != Archive.READ) throw new Error(`archive is not in read mode`);
 
-    let b;
+    let b, r;
     options = typeof options == 'string' ? { encoding: options } : options;
-    const [ar, entry] = this.#find(path);
 
-    if(entry) {
-      const { size, pathname } = entry;
-      b = new ArrayBuffer(size);
-      let r = ar.read(b);
-      if(options.encoding == 'utf-8') b = toString(b, 0, r);
+    if((b = this.#cache?.get(path)) === undefined) {
+      const watched = this.#cache?.watch(this.#archive, 'archive', () => this.invalidate());
+      const [ar, entry] = this.#find(path);
+
+      if(entry) {
+        const { size, pathname } = entry;
+        b = new ArrayBuffer(size);
+        r = ar.read(b);
+        if(r === size && watched) this.#cache.set(path, 0, this.index.indexOf(path), b);
+      }
+
+      ar?.close();
     }
 
-    ar?.close();
+    if(b && options.encoding == 'utf-8') b = toString(b, 0, r ?? b.byteLength);
     return b;
   }
 
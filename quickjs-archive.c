@@ -4,7 +4,17 @@
 #include "quickjs-archive.h"
 #include "utils.h"
 #include "buffer-utils.h"
+#include "js-utils.h"
+#include "thread-pool.h"
+#include "stream-utils.h"
+#include "read-cache.h"
 #include "debug.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 /**
  * \addtogroup quickjs-archive
@@ -18,6 +28,7 @@ typedef enum { READ = 0, WRITE = 1 } archive_mode;
 
 static JSValue js_archive_wrap(JSContext* ctx, JSValueConst proto, struct archive* ar);
 static JSValue js_archiveentry_wrap(JSContext* ctx, JSValueConst proto, struct archive_entry* ent);
+static JSValue js_archive_create(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]);
 
 typedef struct {
   JSValue archive;
@@ -919,6 +930,7 @@ static const JSCFunctionListEntry js_archive_iterator_funcs[] = {
 static const JSCFunctionListEntry js_archive_static_funcs[] = {
     JS_CFUNC_MAGIC_DEF("read", 1, js_archive_functions, METHOD_READ),
     JS_CFUNC_MAGIC_DEF("write", 1, js_archive_functions, METHOD_WRITE),
+    JS_CFUNC_DEF("create", 2, js_archive_create),
     JS_PROP_INT32_DEF("READ", 0, JS_PROP_CONFIGURABLE | JS_PROP_ENUMERABLE),
     JS_PROP_INT32_DEF("WRITE", 1, JS_PROP_CONFIGURABLE | JS_PROP_ENUMERABLE),
     JS_PROP_INT32_DEF("SEEK_SET", SEEK_SET, JS_PROP_ENUMERABLE),
@@ -1976,6 +1988,2046 @@ static const JSCFunctionListEntry js_archivematch_funcs[] = {
     JS_PROP_STRING_DEF("[Symbol.toStringTag]", "ArchiveMatch", JS_PROP_CONFIGURABLE),
 };
 
+/**
+ * ArchiveIndex: the entry list of an archive file, read once. In zip files
+ * (from the central directory) and in uncompressed tar and cpio archives
+ * every entry knows the offset of its header, so a single entry is read by
+ * starting a reader right there instead of scanning the archive up to it.
+ * Other archives are scanned from the start, skipping over the entries.
+ */
+#define INDEX_BLOCK_SIZE 65536
+
+typedef struct {
+  char* pathname;
+  struct archive_entry* entry;
+  int64_t offset, size;
+} IndexEntry;
+
+typedef struct {
+  int ref_count;
+  int fd, format;
+  int64_t file_size;
+  char *file, *format_name;
+  uint32_t count, seekable;
+  IndexEntry* entries;
+  IndexEntry** sorted;
+} ArchiveIndex;
+
+/* client data of a reader starting at an entry's header */
+typedef struct {
+  int fd;
+  BOOL own;
+  int64_t pos, end;
+  uint8_t buf[INDEX_BLOCK_SIZE];
+} IndexView;
+
+typedef struct {
+  struct archive* ar;
+  uint32_t next;
+  BOOL view, own;
+} IndexReader;
+
+static JSClassID js_archiveindex_class_id = 0;
+static JSValue index_proto, index_ctor;
+
+static la_ssize_t
+index_view_read(struct archive* ar, void* client_data, const void** buffer) {
+  IndexView* v = client_data;
+  ssize_t r;
+
+  while((r = pread(v->fd, v->buf, sizeof(v->buf), v->pos)) == -1 && errno == EINTR) {}
+
+  if(r == -1) {
+    archive_set_error(ar, errno, "pread() failed: %s", strerror(errno));
+    return -1;
+  }
+
+  v->pos += r;
+  *buffer = v->buf;
+  return r;
+}
+
+static la_int64_t
+index_view_skip(struct archive* ar, void* client_data, la_int64_t request) {
+  IndexView* v = client_data;
+
+  if(request > v->end - v->pos)
+    request = v->end - v->pos;
+
+  v->pos += request;
+  return request;
+}
+
+static int
+index_view_close(struct archive* ar, void* client_data) {
+  IndexView* v = client_data;
+
+  if(v->own)
+    close(v->fd);
+
+  free(v);
+  return ARCHIVE_OK;
+}
+
+/* a reader for the whole file, *par is NULL when out of memory */
+static int
+index_open_file(ArchiveIndex* ix, struct archive** par) {
+  if(!(*par = archive_read_new()))
+    return ARCHIVE_FATAL;
+
+  archive_read_support_filter_all(*par);
+  archive_read_support_format_all(*par);
+
+  return archive_read_open_filename(*par, ix->file, INDEX_BLOCK_SIZE);
+}
+
+/* a reader whose input starts at the header of entry 'i' */
+static int
+index_open_at(ArchiveIndex* ix, uint32_t i, BOOL own, struct archive** par) {
+  IndexView* v;
+
+  if(!(*par = archive_read_new()))
+    return ARCHIVE_FATAL;
+
+  switch(ix->format & ARCHIVE_FORMAT_BASE_MASK) {
+    case ARCHIVE_FORMAT_TAR: archive_read_support_format_tar(*par); break;
+    case ARCHIVE_FORMAT_CPIO: archive_read_support_format_cpio(*par); break;
+    /* the seekable zip reader would look for the central directory */
+    case ARCHIVE_FORMAT_ZIP: archive_read_support_format_zip_streamable(*par); break;
+  }
+
+  if(!(v = malloc(sizeof(IndexView)))) {
+    archive_set_error(*par, ENOMEM, "out of memory");
+    return ARCHIVE_FATAL;
+  }
+
+  v->own = own;
+  v->pos = ix->entries[i].offset;
+  v->end = ix->file_size;
+
+  if((v->fd = own ? dup(ix->fd) : ix->fd) == -1) {
+    archive_set_error(*par, errno, "dup() failed: %s", strerror(errno));
+    free(v);
+    return ARCHIVE_FATAL;
+  }
+
+  return archive_read_open2(*par, v, 0, index_view_read, index_view_skip, index_view_close);
+}
+
+static void
+index_reader_close(IndexReader* rd) {
+  if(rd->ar) {
+    archive_read_free(rd->ar);
+    rd->ar = 0;
+  }
+}
+
+static const char*
+index_reader_error(IndexReader* rd) {
+  const char* err = rd->ar ? archive_error_string(rd->ar) : 0;
+
+  return err ? err : strerror(rd->ar ? archive_errno(rd->ar) : ENOMEM);
+}
+
+/* reads the header of entry 'i' into 'ent', keeps using the reader when it
+ * is already there */
+static int
+index_reader_seek(ArchiveIndex* ix, IndexReader* rd, uint32_t i, struct archive_entry* ent) {
+  BOOL view = ix->entries[i].offset >= 0;
+  int r;
+
+  if(rd->ar && rd->next != i && (view || rd->view || rd->next > i))
+    index_reader_close(rd);
+
+again:
+  if(!rd->ar) {
+    r = view ? index_open_at(ix, i, rd->own, &rd->ar) : index_open_file(ix, &rd->ar);
+    rd->next = view ? i : 0;
+    rd->view = view;
+
+    if(r < ARCHIVE_WARN)
+      goto fail;
+  }
+
+  /* the data of skipped entries is skipped by the next header */
+  for(r = ARCHIVE_OK; rd->next <= i; rd->next++)
+    if((r = archive_read_next_header2(rd->ar, ent)) < ARCHIVE_WARN || r == ARCHIVE_EOF)
+      goto fail;
+
+  if(strcmp(archive_entry_pathname(ent) ? archive_entry_pathname(ent) : "", ix->entries[i].pathname)) {
+    archive_set_error(rd->ar, EINVAL, "entry #%" PRIu32 " is not '%s'", i, ix->entries[i].pathname);
+    r = ARCHIVE_FATAL;
+    goto fail;
+  }
+
+  return r;
+
+fail:
+  if(r == ARCHIVE_EOF) {
+    archive_set_error(rd->ar, EINVAL, "entry #%" PRIu32 " not found", i);
+    r = ARCHIVE_FATAL;
+  }
+
+  /* retry a failed reader at an offset with a scan */
+  if(view) {
+    index_reader_close(rd);
+    view = FALSE;
+    goto again;
+  }
+
+  return r;
+}
+
+static int
+index_compare(const void* a, const void* b) {
+  IndexEntry *x = *(IndexEntry* const*)a, *y = *(IndexEntry* const*)b;
+  int r = strcmp(x->pathname, y->pathname);
+
+  return r ? r : x < y ? -1 : x > y;
+}
+
+/* the last entry with this pathname, like on extraction */
+static IndexEntry*
+index_find(ArchiveIndex* ix, const char* path) {
+  uint32_t lo = 0, hi = ix->count;
+
+  while(lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+
+    if(strcmp(ix->sorted[mid]->pathname, path) <= 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo > 0 && !strcmp(ix->sorted[lo - 1]->pathname, path) ? ix->sorted[lo - 1] : 0;
+}
+
+static uint64_t
+index_get64(const uint8_t* p) {
+  return ((uint64_t)uint32_get_le(p + 4) << 32) | uint32_get_le(p);
+}
+
+static ssize_t
+index_pread(int fd, void* buf, size_t len, int64_t pos) {
+  ssize_t r;
+
+  while((r = pread(fd, buf, len, pos)) == -1 && errno == EINTR) {}
+
+  return r;
+}
+
+/* takes the local header offsets from the central directory of a zip file,
+ * entries are matched by name */
+static void
+index_zip_offsets(ArchiveIndex* ix) {
+  uint8_t *tail, *cd = 0, *p, *end, rec[56];
+  int64_t size, len, eocd, base;
+  uint64_t count, cd_size, cd_offset;
+
+  if((size = ix->file_size) < 22)
+    return;
+
+  len = MIN_NUM(size, 22 + 65535);
+
+  if(!(tail = malloc(len)))
+    return;
+
+  if(index_pread(ix->fd, tail, len, size - len) != len)
+    goto end;
+
+  for(p = tail + len - 22; p >= tail; p--)
+    if(uint32_get_le(p) == 0x06054b50)
+      break;
+
+  if(p < tail)
+    goto end;
+
+  eocd = size - len + (p - tail);
+  count = uint16_get_le(p + 10);
+  cd_size = uint32_get_le(p + 12);
+  cd_offset = uint32_get_le(p + 16);
+
+  /* zip64 end of central directory locator */
+  if(eocd >= 20 && (count == 0xffff || cd_size == 0xffffffff || cd_offset == 0xffffffff)) {
+    if(index_pread(ix->fd, rec, 20, eocd - 20) != 20 || uint32_get_le(rec) != 0x07064b50)
+      goto end;
+
+    eocd = index_get64(rec + 8);
+
+    if(index_pread(ix->fd, rec, 56, eocd) != 56 || uint32_get_le(rec) != 0x06064b50)
+      goto end;
+
+    count = index_get64(rec + 32);
+    cd_size = index_get64(rec + 40);
+    cd_offset = index_get64(rec + 48);
+  }
+
+  /* the values come from the file, compared so that nothing overflows */
+  if(count == 0 || eocd < 0 || eocd > size || cd_offset > (uint64_t)eocd || cd_size > (uint64_t)eocd - cd_offset || cd_size > (uint64_t)size)
+    goto end;
+
+  /* data prepended to the zip file moves all offsets */
+  base = eocd - (int64_t)(cd_offset + cd_size);
+
+  if(!(cd = malloc(cd_size)) || index_pread(ix->fd, cd, cd_size, base + cd_offset) != (ssize_t)cd_size)
+    goto end;
+
+  for(p = cd, end = cd + cd_size; p + 46 <= end && uint32_get_le(p) == 0x02014b50;) {
+    uint16_t name_len = uint16_get_le(p + 28), extra_len = uint16_get_le(p + 30), comment_len = uint16_get_le(p + 32);
+    uint64_t offset = uint32_get_le(p + 42);
+    uint8_t *name = p + 46, *extra = name + name_len, *next = extra + extra_len + comment_len;
+    IndexEntry* e;
+    char* str;
+
+    if(next > end)
+      break;
+
+    /* zip64 extended information, only fields that didn't fit are there */
+    if(offset == 0xffffffff) {
+      for(uint8_t *x = extra, *limit; x + 4 <= extra + extra_len; x = limit) {
+        uint8_t* field = x + 4;
+
+        if((limit = field + uint16_get_le(x + 2)) > extra + extra_len)
+          break;
+
+        if(uint16_get_le(x) == 0x0001) {
+          field += uint32_get_le(p + 24) == 0xffffffff ? 8 : 0;
+          field += uint32_get_le(p + 20) == 0xffffffff ? 8 : 0;
+
+          if(field + 8 <= limit)
+            offset = index_get64(field);
+
+          break;
+        }
+      }
+    }
+
+    if(offset != 0xffffffff && (str = strndup((const char*)name, name_len))) {
+      if((e = index_find(ix, str)) && e->offset == -1) {
+        e->offset = base + offset;
+        ix->seekable++;
+      }
+
+      free(str);
+    }
+
+    p = next;
+  }
+
+end:
+  free(cd);
+  free(tail);
+}
+
+/* reads all headers, returns the libarchive result */
+static int
+index_scan(ArchiveIndex* ix, struct archive* ar) {
+  struct archive_entry* ent;
+  uint32_t capacity = 0;
+  BOOL offsets = FALSE;
+  int r;
+
+  for(;;) {
+    IndexEntry* e;
+
+    if(!(ent = archive_entry_new2(ar))) {
+      archive_set_error(ar, ENOMEM, "out of memory");
+      return ARCHIVE_FATAL;
+    }
+
+    if((r = archive_read_next_header2(ar, ent)) == ARCHIVE_EOF || r < ARCHIVE_WARN) {
+      archive_entry_free(ent);
+      break;
+    }
+
+    if(ix->count == capacity) {
+      IndexEntry* entries;
+
+      capacity = capacity ? capacity * 2 : 64;
+
+      if(!(entries = realloc(ix->entries, sizeof(IndexEntry) * capacity))) {
+        archive_entry_free(ent);
+        archive_set_error(ar, ENOMEM, "out of memory");
+        return ARCHIVE_FATAL;
+      }
+
+      ix->entries = entries;
+    }
+
+    /* the format is known once the first header is read */
+    if(ix->count == 0) {
+      ix->format = archive_format(ar);
+      ix->format_name = strdup(archive_format_name(ar) ? archive_format_name(ar) : "");
+
+      if(archive_filter_code(ar, 0) == ARCHIVE_FILTER_NONE)
+        switch(ix->format & ARCHIVE_FORMAT_BASE_MASK) {
+          case ARCHIVE_FORMAT_TAR:
+          case ARCHIVE_FORMAT_CPIO: offsets = TRUE; break;
+        }
+    }
+
+    e = &ix->entries[ix->count++];
+    e->entry = ent;
+    e->pathname = strdup(archive_entry_pathname(ent) ? archive_entry_pathname(ent) : "");
+    e->size = archive_entry_size_is_set(ent) ? archive_entry_size(ent) : 0;
+    e->offset = offsets ? archive_read_header_position(ar) : -1;
+
+    if(!e->pathname) {
+      archive_set_error(ar, ENOMEM, "out of memory");
+      return ARCHIVE_FATAL;
+    }
+
+    if(e->offset >= 0)
+      ix->seekable++;
+  }
+
+  if(r != ARCHIVE_EOF)
+    return r;
+
+  if(!(ix->sorted = malloc(sizeof(IndexEntry*) * (ix->count + 1)))) {
+    archive_set_error(ar, ENOMEM, "out of memory");
+    return ARCHIVE_FATAL;
+  }
+
+  for(uint32_t i = 0; i < ix->count; i++)
+    ix->sorted[i] = &ix->entries[i];
+
+  qsort(ix->sorted, ix->count, sizeof(IndexEntry*), index_compare);
+
+  if(ix->count && archive_filter_code(ar, 0) == ARCHIVE_FILTER_NONE && (ix->format & ARCHIVE_FORMAT_BASE_MASK) == ARCHIVE_FORMAT_ZIP)
+    index_zip_offsets(ix);
+
+  return ARCHIVE_OK;
+}
+
+static ArchiveIndex*
+index_dup(ArchiveIndex* ix) {
+  ++ix->ref_count;
+  return ix;
+}
+
+static void
+index_free(ArchiveIndex* ix) {
+  if(--ix->ref_count > 0)
+    return;
+
+  for(uint32_t i = 0; i < ix->count; i++) {
+    archive_entry_free(ix->entries[i].entry);
+    free(ix->entries[i].pathname);
+  }
+
+  if(ix->fd != -1)
+    close(ix->fd);
+
+  free(ix->entries);
+  free(ix->sorted);
+  free(ix->format_name);
+  free(ix->file);
+  free(ix);
+}
+
+static inline ArchiveIndex*
+js_archiveindex_data2(JSContext* ctx, JSValueConst value) {
+  return JS_GetOpaque2(ctx, value, js_archiveindex_class_id);
+}
+
+static JSValue
+js_archiveindex_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  JSValue proto, obj = JS_UNDEFINED;
+  ArchiveIndex* ix;
+  struct archive* ar = 0;
+  const char* file;
+  int r;
+
+  if(!(file = JS_ToCString(ctx, argv[0])))
+    return JS_EXCEPTION;
+
+  if(!(ix = calloc(1, sizeof(ArchiveIndex)))) {
+    JS_FreeCString(ctx, file);
+    return JS_ThrowOutOfMemory(ctx);
+  }
+
+  ix->ref_count = 1;
+  ix->fd = open(file, O_RDONLY | O_CLOEXEC);
+  ix->file = strdup(file);
+  JS_FreeCString(ctx, file);
+
+  if(ix->fd == -1) {
+    JS_ThrowInternalError(ctx, "ArchiveIndex: failed opening '%s': %s", ix->file, strerror(errno));
+    goto fail;
+  }
+
+  ix->file_size = lseek(ix->fd, 0, SEEK_END);
+
+  if((r = index_open_file(ix, &ar)) == ARCHIVE_OK)
+    r = index_scan(ix, ar);
+
+  if(r != ARCHIVE_OK) {
+    JS_ThrowInternalError(ctx, "libarchive error: %s", ar ? archive_error_string(ar) : strerror(ENOMEM));
+    goto fail;
+  }
+
+  archive_read_free(ar);
+  ar = 0;
+
+  /* using new_target to get the prototype is necessary when the class is extended. */
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+  if(JS_IsException(proto))
+    goto fail;
+
+  obj = JS_NewObjectProtoClass(ctx, proto, js_archiveindex_class_id);
+  JS_FreeValue(ctx, proto);
+  if(JS_IsException(obj))
+    goto fail;
+
+  JS_SetOpaque(obj, ix);
+  return obj;
+
+fail:
+  if(ar)
+    archive_read_free(ar);
+
+  index_free(ix);
+  return JS_EXCEPTION;
+}
+
+enum {
+  INDEX_HAS,
+  INDEX_GET,
+  INDEX_OPEN,
+  INDEX_INDEXOF,
+};
+
+static JSValue
+js_archiveindex_functions(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  JSValue ret = JS_UNDEFINED;
+  ArchiveIndex* ix;
+  IndexEntry* e;
+  const char* path;
+
+  if(!(ix = js_archiveindex_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(!(path = JS_ToCString(ctx, argv[0])))
+    return JS_EXCEPTION;
+
+  e = index_find(ix, path);
+  JS_FreeCString(ctx, path);
+
+  switch(magic) {
+    case INDEX_HAS: {
+      ret = JS_NewBool(ctx, !!e);
+      break;
+    }
+
+    case INDEX_INDEXOF: {
+      ret = JS_NewInt32(ctx, e ? (int32_t)(e - ix->entries) : -1);
+      break;
+    }
+
+    case INDEX_GET: {
+      if(e)
+        ret = js_archiveentry_wrap(ctx, entry_proto, archive_entry_clone(e->entry));
+
+      break;
+    }
+
+    case INDEX_OPEN: {
+      IndexReader rd = {.own = TRUE};
+      struct archive_entry* ent;
+
+      if(!e) {
+        ret = JS_NULL;
+        break;
+      }
+
+      if(!(ent = archive_entry_new()))
+        return JS_ThrowOutOfMemory(ctx);
+
+      if(index_reader_seek(ix, &rd, e - ix->entries, ent) < ARCHIVE_WARN) {
+        ret = JS_ThrowInternalError(ctx, "libarchive error: %s", index_reader_error(&rd));
+        index_reader_close(&rd);
+        archive_entry_free(ent);
+        break;
+      }
+
+      archive_entry_free(ent);
+
+      ret = js_archive_wrap(ctx, archive_proto, rd.ar);
+      JS_DefinePropertyValueStr(ctx, ret, "file", JS_NewString(ctx, ix->file), JS_PROP_CONFIGURABLE | JS_PROP_ENUMERABLE);
+      JS_DefinePropertyValueStr(ctx, ret, "entry", js_archiveentry_wrap(ctx, entry_proto, archive_entry_clone(e->entry)), JS_PROP_CONFIGURABLE);
+      js_archive_set_mode(ctx, ret, READ);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+/**
+ * Extraction runs on the thread pool, every job with its own reader and
+ * disk writer, data goes from archive_read_data_block() straight to
+ * archive_write_data_block(). Seekable archives are split into runs of
+ * entries of about the same size, one per job, other archives are read by a
+ * single job. Hard links go last, when their targets exist.
+ *
+ * The metadata comes from the index: a zip reader started at a local header
+ * doesn't see the central directory, which has the modes and symlinks.
+ */
+typedef struct archive_extract ArchiveExtract;
+
+typedef struct {
+  ThreadJob job;
+  ArchiveExtract* extract;
+  uint32_t *entries, count;
+  struct archive_entry** meta;
+  uint32_t extracted;
+  char* error;
+} ExtractJob;
+
+struct archive_extract {
+  ArchiveIndex* index;
+  char* dest;
+  int flags;
+  uint32_t* order;
+  struct archive_entry** meta;
+  ExtractJob* jobs;
+  int num_jobs, running;
+  ExtractJob* links;
+  uint32_t extracted;
+  char* error;
+  ResolveFunctions funcs;
+};
+
+static void
+extract_error(ExtractJob* job, const char* path, const char* msg) {
+  if(!job->error && (job->error = malloc(strlen(path) + strlen(msg) + 3)))
+    sprintf(job->error, "%s: %s", path, msg);
+}
+
+static int
+extract_entry(ExtractJob* job, IndexReader* rd, struct archive* aw, struct archive_entry* ent, const char* path, DynBuf* buf) {
+  ArchiveExtract* x = job->extract;
+  const char* link;
+  const void* data;
+  size_t size;
+  la_int64_t offset;
+  int r;
+
+  dbuf_zero(buf);
+  dbuf_printf(buf, "%s/%s", x->dest, path);
+  dbuf_0(buf);
+  archive_entry_set_pathname(ent, (const char*)buf->buf);
+
+  if((link = archive_entry_hardlink(ent))) {
+    dbuf_zero(buf);
+    dbuf_printf(buf, "%s/%s", x->dest, link);
+    dbuf_0(buf);
+    archive_entry_set_hardlink(ent, (const char*)buf->buf);
+  }
+
+  if(archive_write_header(aw, ent) < ARCHIVE_WARN)
+    goto write_fail;
+
+  /* zip has the target of a symlink as data */
+  r = ARCHIVE_EOF;
+
+  if(archive_entry_filetype(ent) == AE_IFREG)
+    while((r = archive_read_data_block(rd->ar, &data, &size, &offset)) == ARCHIVE_OK)
+      if(archive_write_data_block(aw, data, size, offset) < ARCHIVE_WARN)
+        goto write_fail;
+
+  if(r != ARCHIVE_EOF) {
+    extract_error(job, path, index_reader_error(rd));
+    return -1;
+  }
+
+  if(archive_write_finish_entry(aw) < ARCHIVE_WARN)
+    goto write_fail;
+
+  return 0;
+
+write_fail:
+  extract_error(job, path, archive_error_string(aw) ? archive_error_string(aw) : strerror(archive_errno(aw)));
+  return -1;
+}
+
+static void
+extract_job_work(ThreadJob* ptr) {
+  ExtractJob* job = (ExtractJob*)ptr;
+  ArchiveIndex* ix = job->extract->index;
+  IndexReader rd = {0};
+  struct archive* aw;
+  struct archive_entry* ent = archive_entry_new();
+  DynBuf buf;
+
+  dbuf_init(&buf);
+
+  if(!(aw = archive_write_disk_new()) || !ent) {
+    extract_error(job, ix->file, strerror(ENOMEM));
+    goto end;
+  }
+
+  archive_write_disk_set_options(aw, job->extract->flags);
+  archive_write_disk_set_standard_lookup(aw);
+
+  for(uint32_t k = 0; k < job->count; k++) {
+    uint32_t i = job->entries[k];
+    int r;
+
+    if(index_reader_seek(ix, &rd, i, ent) < ARCHIVE_WARN) {
+      extract_error(job, ix->entries[i].pathname, index_reader_error(&rd));
+      break;
+    }
+
+    r = extract_entry(job, &rd, aw, job->meta[k], ix->entries[i].pathname, &buf);
+
+    archive_entry_free(job->meta[k]);
+    job->meta[k] = 0;
+
+    if(r)
+      break;
+
+    job->extracted++;
+  }
+
+  /* sets the times and modes of directories */
+  if(archive_write_close(aw) < ARCHIVE_WARN)
+    extract_error(job, job->extract->dest, archive_error_string(aw));
+
+end:
+  if(aw)
+    archive_write_free(aw);
+  if(ent)
+    archive_entry_free(ent);
+
+  index_reader_close(&rd);
+  dbuf_free(&buf);
+}
+
+static void
+extract_free(JSRuntime* rt, ArchiveExtract* x) {
+  for(int i = 0; i < x->num_jobs; i++)
+    free(x->jobs[i].error);
+
+  if(x->meta) {
+    for(uint32_t k = 0; k < x->index->count; k++)
+      if(x->meta[k])
+        archive_entry_free(x->meta[k]);
+
+    js_free_rt(rt, x->meta);
+  }
+
+  free(x->error);
+  js_free_rt(rt, x->jobs);
+  js_free_rt(rt, x->order);
+  free(x->dest);
+  promise_free_funcs(rt, &x->funcs);
+  index_free(x->index);
+  js_free_rt(rt, x);
+}
+
+/* on the JS thread, after a job has finished */
+static void
+extract_job_done(JSContext* ctx, ThreadJob* ptr) {
+  ExtractJob* job = (ExtractJob*)ptr;
+  ArchiveExtract* x = job->extract;
+  JSValue value;
+
+  x->extracted += job->extracted;
+
+  if(job->error && !x->error) {
+    x->error = job->error;
+    job->error = 0;
+  }
+
+  if(--x->running > 0)
+    return;
+
+  if(x->links && !x->error) {
+    job = x->links;
+    x->links = 0;
+
+    if(!thread_pool_submit(ctx, &job->job, THREAD_LANE_ANY)) {
+      ++x->running;
+      return;
+    }
+
+    value = JS_GetException(ctx);
+  } else if(x->error) {
+    JS_ThrowInternalError(ctx, "extract: %s", x->error);
+    value = JS_GetException(ctx);
+  } else {
+    promise_resolve(ctx, &x->funcs, JS_NewUint32(ctx, x->extracted));
+    extract_free(JS_GetRuntime(ctx), x);
+    return;
+  }
+
+  promise_reject(ctx, &x->funcs, value);
+  JS_FreeValue(ctx, value);
+  extract_free(JS_GetRuntime(ctx), x);
+}
+
+/* the entries to extract, in archive order with hard links last */
+static int
+extract_select(JSContext* ctx, ArchiveExtract* x, JSValueConst paths, uint32_t* count, uint32_t* num_links) {
+  ArchiveIndex* ix = x->index;
+  uint8_t* selected;
+  uint32_t n = 0;
+  int64_t length;
+
+  if(!(selected = js_mallocz(ctx, ix->count + 1)))
+    return -1;
+
+  if(JS_IsArray(ctx, paths)) {
+    length = js_array_length(ctx, paths);
+
+    for(int64_t k = 0; k < length; k++) {
+      JSValue item = JS_GetPropertyUint32(ctx, paths, k);
+      const char* path = JS_ToCString(ctx, item);
+      IndexEntry* e;
+
+      JS_FreeValue(ctx, item);
+
+      if(!path)
+        goto fail;
+
+      if(!(e = index_find(ix, path))) {
+        JS_ThrowInternalError(ctx, "extract: no entry '%s' in '%s'", path, ix->file);
+        JS_FreeCString(ctx, path);
+        goto fail;
+      }
+
+      JS_FreeCString(ctx, path);
+      selected[e - ix->entries] = 1;
+    }
+  } else {
+    memset(selected, 1, ix->count);
+  }
+
+  if(!(x->order = js_malloc(ctx, sizeof(uint32_t) * (ix->count + 1))))
+    goto fail;
+
+  if(!(x->meta = js_mallocz(ctx, sizeof(struct archive_entry*) * (ix->count + 1))))
+    goto fail;
+
+  /* cloned here, the workers don't share entries */
+  for(int links = 0; links < 2; links++) {
+    for(uint32_t i = 0; i < ix->count; i++) {
+      if(selected[i] && !archive_entry_hardlink(ix->entries[i].entry) == !links) {
+        if(!(x->meta[n] = archive_entry_clone(ix->entries[i].entry))) {
+          JS_ThrowOutOfMemory(ctx);
+          goto fail;
+        }
+
+        x->order[n++] = i;
+      }
+    }
+
+    if(!links)
+      *count = n;
+  }
+
+  *num_links = n - *count;
+  js_free(ctx, selected);
+  return 0;
+
+fail:
+  js_free(ctx, selected);
+  return -1;
+}
+
+static JSValue
+js_archiveindex_extract(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  ArchiveIndex* ix;
+  ArchiveExtract* x;
+  JSValue ret, paths = JS_UNDEFINED;
+  int32_t concurrency;
+  uint32_t count, num_links;
+  uint64_t total = 0, sum = 0;
+  BOOL seekable = TRUE;
+  const char* dest;
+
+  if(!(ix = js_archiveindex_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if((concurrency = thread_pool_size()) == 0)
+    return JS_ThrowInternalError(ctx, "extract: failed starting worker threads");
+
+  if(!(x = js_mallocz(ctx, sizeof(ArchiveExtract))))
+    return JS_EXCEPTION;
+
+  x->index = index_dup(ix);
+  x->flags = ARCHIVE_EXTRACT_TIME | ARCHIVE_EXTRACT_SECURE_NODOTDOT | ARCHIVE_EXTRACT_SECURE_SYMLINKS;
+
+  if(!(dest = JS_ToCString(ctx, argv[0])))
+    goto fail;
+
+  /* entry paths are appended to an absolute path without '..' or symlinks */
+  if((mkdir(dest, 0777) == -1 && errno != EEXIST) || !(x->dest = realpath(dest, 0))) {
+    JS_ThrowInternalError(ctx, "extract: '%s': %s", dest, strerror(errno));
+    JS_FreeCString(ctx, dest);
+    goto fail;
+  }
+
+  JS_FreeCString(ctx, dest);
+
+  if(argc > 1 && JS_IsObject(argv[1])) {
+    JSValue value = JS_GetPropertyStr(ctx, argv[1], "flags");
+    if(JS_IsNumber(value))
+      JS_ToInt32(ctx, &x->flags, value);
+    JS_FreeValue(ctx, value);
+
+    value = JS_GetPropertyStr(ctx, argv[1], "concurrency");
+    if(JS_IsNumber(value))
+      JS_ToInt32(ctx, &concurrency, value);
+    JS_FreeValue(ctx, value);
+
+    paths = JS_GetPropertyStr(ctx, argv[1], "paths");
+  }
+
+  if(concurrency < 1)
+    concurrency = 1;
+
+  if(extract_select(ctx, x, paths, &count, &num_links))
+    goto fail;
+
+  for(uint32_t k = 0; k < count; k++) {
+    IndexEntry* e = &ix->entries[x->order[k]];
+
+    /* a small file costs about as much as a block of data */
+    total += e->size + INDEX_BLOCK_SIZE;
+    seekable &= e->offset >= 0;
+  }
+
+  if(!seekable || (uint32_t)concurrency > count)
+    concurrency = seekable ? count : 1;
+
+  if(!(x->jobs = js_mallocz(ctx, sizeof(ExtractJob) * (concurrency + 1))))
+    goto fail;
+
+  /* runs of entries with about the same amount of data */
+  for(uint32_t k = 0, start = 0; k < count; k++) {
+    IndexEntry* e = &ix->entries[x->order[k]];
+
+    sum += e->size + INDEX_BLOCK_SIZE;
+
+    if(k + 1 == count || (x->num_jobs < concurrency - 1 && sum >= total * (x->num_jobs + 1) / concurrency)) {
+      x->jobs[x->num_jobs].entries = x->order + start;
+      x->jobs[x->num_jobs].meta = x->meta + start;
+      x->jobs[x->num_jobs++].count = k + 1 - start;
+      start = k + 1;
+    }
+  }
+
+  if(num_links) {
+    x->links = &x->jobs[x->num_jobs++];
+    x->links->entries = x->order + count;
+    x->links->meta = x->meta + count;
+    x->links->count = num_links;
+  }
+
+  for(int i = 0; i < x->num_jobs; i++) {
+    x->jobs[i].job.work = extract_job_work;
+    x->jobs[i].job.done = extract_job_done;
+    x->jobs[i].extract = x;
+  }
+
+  ret = promise_create(ctx, &x->funcs);
+
+  if(x->num_jobs == 0) {
+    promise_resolve(ctx, &x->funcs, JS_NewUint32(ctx, 0));
+    extract_free(JS_GetRuntime(ctx), x);
+    JS_FreeValue(ctx, paths);
+    return ret;
+  }
+
+  /* when there are only hard links, they can go right away */
+  if(x->links == x->jobs)
+    x->links = 0;
+
+  for(int i = 0; i < x->num_jobs; i++) {
+    if(&x->jobs[i] == x->links)
+      continue;
+
+    if(thread_pool_submit(ctx, &x->jobs[i].job, THREAD_LANE_ANY)) {
+      /* settled by the jobs already running */
+      if(x->running) {
+        JS_FreeValue(ctx, JS_GetException(ctx));
+
+        if(!x->error)
+          x->error = strdup("failed submitting job");
+
+        x->links = 0;
+        break;
+      }
+
+      JS_FreeValue(ctx, ret);
+      goto fail;
+    }
+
+    ++x->running;
+  }
+
+  JS_FreeValue(ctx, paths);
+  return ret;
+
+fail:
+  JS_FreeValue(ctx, paths);
+  extract_free(JS_GetRuntime(ctx), x);
+  return JS_EXCEPTION;
+}
+
+enum {
+  INDEX_FILE,
+  INDEX_FORMAT,
+  INDEX_SIZE,
+  INDEX_SEEKABLE,
+  INDEX_PATHS,
+};
+
+static JSValue
+js_archiveindex_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  ArchiveIndex* ix;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(ix = js_archiveindex_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case INDEX_FILE: {
+      ret = JS_NewString(ctx, ix->file);
+      break;
+    }
+
+    case INDEX_FORMAT: {
+      ret = ix->format_name ? JS_NewString(ctx, ix->format_name) : JS_NULL;
+      break;
+    }
+
+    case INDEX_SIZE: {
+      ret = JS_NewUint32(ctx, ix->count);
+      break;
+    }
+
+    case INDEX_SEEKABLE: {
+      ret = JS_NewBool(ctx, ix->count > 0 && ix->seekable == ix->count);
+      break;
+    }
+
+    case INDEX_PATHS: {
+      ret = JS_NewArray(ctx);
+
+      for(uint32_t i = 0; i < ix->count; i++)
+        JS_SetPropertyUint32(ctx, ret, i, JS_NewString(ctx, ix->entries[i].pathname));
+
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static void
+js_archiveindex_finalizer(JSRuntime* rt, JSValue val) {
+  ArchiveIndex* ix;
+
+  if((ix = JS_GetOpaque(val, js_archiveindex_class_id)))
+    index_free(ix);
+}
+
+static JSClassDef js_archiveindex_class = {
+    .class_name = "ArchiveIndex",
+    .finalizer = js_archiveindex_finalizer,
+};
+
+static const JSCFunctionListEntry js_archiveindex_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("has", 1, js_archiveindex_functions, INDEX_HAS),
+    JS_CFUNC_MAGIC_DEF("get", 1, js_archiveindex_functions, INDEX_GET),
+    JS_CFUNC_MAGIC_DEF("open", 1, js_archiveindex_functions, INDEX_OPEN),
+    JS_CFUNC_MAGIC_DEF("indexOf", 1, js_archiveindex_functions, INDEX_INDEXOF),
+    JS_CFUNC_DEF("extract", 1, js_archiveindex_extract),
+    JS_CGETSET_MAGIC_DEF("file", js_archiveindex_get, 0, INDEX_FILE),
+    JS_CGETSET_MAGIC_DEF("format", js_archiveindex_get, 0, INDEX_FORMAT),
+    JS_CGETSET_MAGIC_DEF("size", js_archiveindex_get, 0, INDEX_SIZE),
+    JS_CGETSET_MAGIC_DEF("seekable", js_archiveindex_get, 0, INDEX_SEEKABLE),
+    JS_CGETSET_MAGIC_DEF("paths", js_archiveindex_get, 0, INDEX_PATHS),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "ArchiveIndex", JS_PROP_CONFIGURABLE),
+};
+
+/**
+ * Archive.create(): a job reads the files and writes the archive into
+ * blocks of uncompressed data. Every block is compressed by a job of its own
+ * into a complete gzip member (zstd frame, xz stream, ...), concatenated
+ * they decompress as one stream, like the output of pigz. The compressed
+ * blocks are written in order by jobs on a single lane, or on the JS thread
+ * when the output is a JS writer.
+ */
+#define CREATE_BLOCK_SIZE (1024 * 1024)
+
+typedef struct archive_create ArchiveCreate;
+
+typedef struct {
+  char *file, *pathname;
+} CreateEntry;
+
+typedef struct {
+  ThreadJob job;
+  ArchiveCreate* create;
+  struct list_head link;
+  DynBuf data;
+  BOOL compressed, writing;
+  char* error;
+} CreateBlock;
+
+struct archive_create {
+  ThreadJob job;
+  /* only used by the reading job */
+  struct archive *writer, *disk;
+  struct archive_entry_linkresolver* links;
+  uint32_t next_entry;
+  int file;
+  uint8_t* buf;
+  CreateBlock* block;
+  struct list_head sealed;
+  BOOL finished;
+  char* error;
+  /* not modified while jobs are running */
+  CreateEntry* entries;
+  uint32_t num_entries;
+  size_t block_size;
+  char* filter;
+  int32_t level;
+  /* only used on the JS thread */
+  int fd, lane, running, max_blocks, num_blocks;
+  BOOL own_fd, reading;
+  Writer output;
+  struct list_head blocks;
+  int64_t bytes;
+  char* failure;
+  ResolveFunctions funcs;
+};
+
+static void
+create_error(char** perror, const char* path, const char* msg) {
+  if(!*perror && (*perror = malloc(strlen(path) + strlen(msg) + 3)))
+    sprintf(*perror, "%s: %s", path, msg);
+}
+
+static CreateBlock*
+create_block_new(ArchiveCreate* x) {
+  CreateBlock* b;
+
+  if((b = calloc(1, sizeof(CreateBlock)))) {
+    b->create = x;
+    dbuf_init(&b->data);
+  }
+
+  return b;
+}
+
+static void
+create_block_free(CreateBlock* b) {
+  dbuf_free(&b->data);
+  free(b->error);
+  free(b);
+}
+
+/* the block being filled goes to the compression jobs */
+static void
+create_seal(ArchiveCreate* x) {
+  if(x->block && x->block->data.size) {
+    list_add_tail(&x->block->link, &x->sealed);
+    x->block = 0;
+  }
+}
+
+static la_ssize_t
+create_write(struct archive* ar, void* client_data, const void* buffer, size_t length) {
+  ArchiveCreate* x = client_data;
+
+  if(!x->block && !(x->block = create_block_new(x)))
+    goto fail;
+
+  if(dbuf_put(&x->block->data, buffer, length))
+    goto fail;
+
+  if(x->block->data.size >= x->block_size)
+    create_seal(x);
+
+  return length;
+
+fail:
+  archive_set_error(ar, ENOMEM, "out of memory");
+  return -1;
+}
+
+static la_ssize_t
+create_dbuf_write(struct archive* ar, void* client_data, const void* buffer, size_t length) {
+  if(dbuf_put(client_data, buffer, length)) {
+    archive_set_error(ar, ENOMEM, "out of memory");
+    return -1;
+  }
+
+  return length;
+}
+
+static const char*
+create_archive_error(struct archive* ar) {
+  return archive_error_string(ar) ? archive_error_string(ar) : strerror(archive_errno(ar));
+}
+
+/* writes the header of the next entry, opens a regular file for its data */
+static int
+create_header(ArchiveCreate* x, CreateEntry* e) {
+  struct archive_entry *ent, *spare = 0;
+  int r = -1;
+
+  if(!(ent = archive_entry_new())) {
+    create_error(&x->error, e->file, strerror(ENOMEM));
+    return -1;
+  }
+
+  archive_entry_copy_sourcepath(ent, e->file);
+
+  if(archive_read_disk_entry_from_file(x->disk, ent, -1, 0) < ARCHIVE_WARN) {
+    create_error(&x->error, e->file, create_archive_error(x->disk));
+    goto end;
+  }
+
+  archive_entry_copy_pathname(ent, e->pathname);
+  archive_entry_linkify(x->links, &ent, &spare);
+
+  if(ent && archive_entry_filetype(ent) == AE_IFREG && archive_entry_size(ent) > 0) {
+    if((x->file = open(e->file, O_RDONLY | O_CLOEXEC)) == -1) {
+      create_error(&x->error, e->file, strerror(errno));
+      goto end;
+    }
+  }
+
+  if(ent && archive_write_header(x->writer, ent) < ARCHIVE_WARN) {
+    create_error(&x->error, e->file, create_archive_error(x->writer));
+    goto end;
+  }
+
+  r = 0;
+
+end:
+  if(ent)
+    archive_entry_free(ent);
+  if(spare)
+    archive_entry_free(spare);
+
+  return r;
+}
+
+/* reads until a block is complete */
+static void
+create_read(ThreadJob* ptr) {
+  ArchiveCreate* x = (ArchiveCreate*)ptr;
+  ssize_t r;
+
+  while(!x->error && !x->finished && list_empty(&x->sealed)) {
+    if(x->file != -1) {
+      if((r = read(x->file, x->buf, INDEX_BLOCK_SIZE)) > 0) {
+        if(archive_write_data(x->writer, x->buf, r) < 0)
+          create_error(&x->error, x->entries[x->next_entry - 1].file, create_archive_error(x->writer));
+
+        continue;
+      }
+
+      if(r == -1 && errno == EINTR)
+        continue;
+
+      if(r == -1)
+        create_error(&x->error, x->entries[x->next_entry - 1].file, strerror(errno));
+
+      close(x->file);
+      x->file = -1;
+    } else if(x->next_entry < x->num_entries) {
+      create_header(x, &x->entries[x->next_entry++]);
+    } else {
+      /* the trailer ends the last block */
+      if(archive_write_close(x->writer) < ARCHIVE_WARN)
+        create_error(&x->error, "archive", create_archive_error(x->writer));
+
+      create_seal(x);
+      x->finished = TRUE;
+    }
+  }
+}
+
+static void
+create_compress(ThreadJob* ptr) {
+  CreateBlock* b = (CreateBlock*)ptr;
+  ArchiveCreate* x = b->create;
+  struct archive* ar;
+  struct archive_entry* ent = 0;
+  DynBuf out;
+  char level[16];
+
+  dbuf_init(&out);
+
+  if(!(ar = archive_write_new()) || !(ent = archive_entry_new())) {
+    create_error(&b->error, "compress", strerror(ENOMEM));
+    goto end;
+  }
+
+  archive_write_add_filter_by_name(ar, x->filter);
+
+  if(x->level >= 0) {
+    snprintf(level, sizeof(level), "%" PRId32, x->level);
+    archive_write_set_filter_option(ar, 0, "compression-level", level);
+  }
+
+  /* without padding, the members are concatenated */
+  archive_write_set_format_raw(ar);
+  archive_write_set_bytes_per_block(ar, 0);
+
+  archive_entry_set_filetype(ent, AE_IFREG);
+  archive_entry_set_pathname(ent, "block");
+
+  if(archive_write_open2(ar, &out, 0, create_dbuf_write, 0, 0) < ARCHIVE_WARN || archive_write_header(ar, ent) < ARCHIVE_WARN ||
+     archive_write_data(ar, b->data.buf, b->data.size) < 0 || archive_write_close(ar) < ARCHIVE_WARN) {
+    create_error(&b->error, "compress", create_archive_error(ar));
+    goto end;
+  }
+
+  dbuf_free(&b->data);
+  b->data = out;
+  dbuf_init(&out);
+
+end:
+  if(ent)
+    archive_entry_free(ent);
+  if(ar)
+    archive_write_free(ar);
+
+  dbuf_free(&out);
+}
+
+static void
+create_output(ThreadJob* ptr) {
+  CreateBlock* b = (CreateBlock*)ptr;
+  const uint8_t* p = b->data.buf;
+  size_t n = b->data.size;
+  ssize_t r;
+
+  while(n > 0) {
+    if((r = write(b->create->fd, p, n)) == -1) {
+      if(errno == EINTR)
+        continue;
+
+      create_error(&b->error, "write", strerror(errno));
+      break;
+    }
+
+    p += r;
+    n -= r;
+  }
+}
+
+static void
+create_free(JSRuntime* rt, ArchiveCreate* x) {
+  /* the writer may still flush into a block */
+  if(x->writer)
+    archive_write_free(x->writer);
+  if(x->disk)
+    archive_read_free(x->disk);
+  if(x->links)
+    archive_entry_linkresolver_free(x->links);
+
+  if(x->block)
+    create_block_free(x->block);
+
+  while(!list_empty(&x->sealed)) {
+    CreateBlock* b = list_entry(x->sealed.next, CreateBlock, link);
+
+    list_del(&b->link);
+    create_block_free(b);
+  }
+
+  while(!list_empty(&x->blocks)) {
+    CreateBlock* b = list_entry(x->blocks.next, CreateBlock, link);
+
+    list_del(&b->link);
+    create_block_free(b);
+  }
+
+  for(uint32_t i = 0; i < x->num_entries; i++) {
+    free(x->entries[i].file);
+    free(x->entries[i].pathname);
+  }
+
+  if(x->file != -1)
+    close(x->file);
+  if(x->own_fd && x->fd != -1)
+    close(x->fd);
+
+  writer_free(&x->output);
+  free(x->entries);
+  free(x->buf);
+  free(x->filter);
+  free(x->error);
+  free(x->failure);
+  promise_free_funcs(rt, &x->funcs);
+  js_free_rt(rt, x);
+}
+
+static void create_read_done(JSContext*, ThreadJob*);
+static void create_compress_done(JSContext*, ThreadJob*);
+static void create_output_done(JSContext*, ThreadJob*);
+
+static void
+create_fail(ArchiveCreate* x, char** perror) {
+  if(*perror && !x->failure) {
+    x->failure = *perror;
+    *perror = 0;
+  }
+}
+
+static int
+create_submit(JSContext* ctx, ArchiveCreate* x, ThreadJob* job, int lane) {
+  if(thread_pool_submit(ctx, job, lane)) {
+    JS_FreeValue(ctx, JS_GetException(ctx));
+
+    if(!x->failure)
+      x->failure = strdup("failed submitting job");
+
+    return -1;
+  }
+
+  ++x->running;
+  return 0;
+}
+
+/* writes the compressed blocks at the head of the list, in order */
+static void
+create_flush(JSContext* ctx, ArchiveCreate* x) {
+  struct list_head *el, *next;
+
+  list_for_each_safe(el, next, &x->blocks) {
+    CreateBlock* b = list_entry(el, CreateBlock, link);
+
+    if(b->writing)
+      continue;
+
+    if(!b->compressed || x->failure)
+      break;
+
+    if(x->fd == -1) {
+      ssize_t r = writer_write(&x->output, b->data.buf, b->data.size);
+
+      if(r < 0 || (size_t)r != b->data.size) {
+        x->failure = strdup("write failed");
+        break;
+      }
+
+      x->bytes += r;
+      list_del(&b->link);
+      --x->num_blocks;
+      create_block_free(b);
+      continue;
+    }
+
+    b->job.work = create_output;
+    b->job.done = create_output_done;
+
+    if(create_submit(ctx, x, &b->job, x->lane))
+      break;
+
+    b->writing = TRUE;
+  }
+}
+
+/* reads on, settles the promise once everything is written */
+static void
+create_continue(JSContext* ctx, ArchiveCreate* x) {
+  JSValue value;
+
+  if(!x->failure && !x->reading && !x->finished) {
+    if(x->num_blocks < x->max_blocks && !create_submit(ctx, x, &x->job, THREAD_LANE_ANY))
+      x->reading = TRUE;
+
+    return;
+  }
+
+  if(x->running > 0 || (!x->failure && x->num_blocks > 0))
+    return;
+
+  if(x->failure) {
+    JS_ThrowInternalError(ctx, "create: %s", x->failure);
+    value = JS_GetException(ctx);
+    promise_reject(ctx, &x->funcs, value);
+  } else {
+    value = JS_NewInt64(ctx, x->bytes);
+    promise_resolve(ctx, &x->funcs, value);
+  }
+
+  JS_FreeValue(ctx, value);
+  create_free(JS_GetRuntime(ctx), x);
+}
+
+static void
+create_read_done(JSContext* ctx, ThreadJob* ptr) {
+  ArchiveCreate* x = (ArchiveCreate*)ptr;
+
+  --x->running;
+  x->reading = FALSE;
+  create_fail(x, &x->error);
+
+  while(!list_empty(&x->sealed)) {
+    CreateBlock* b = list_entry(x->sealed.next, CreateBlock, link);
+
+    list_del(&b->link);
+    list_add_tail(&b->link, &x->blocks);
+    ++x->num_blocks;
+
+    if(!x->filter) {
+      b->compressed = TRUE;
+      continue;
+    }
+
+    b->job.work = create_compress;
+    b->job.done = create_compress_done;
+
+    if(!x->failure)
+      create_submit(ctx, x, &b->job, THREAD_LANE_ANY);
+  }
+
+  create_flush(ctx, x);
+  create_continue(ctx, x);
+}
+
+static void
+create_compress_done(JSContext* ctx, ThreadJob* ptr) {
+  CreateBlock* b = (CreateBlock*)ptr;
+  ArchiveCreate* x = b->create;
+
+  --x->running;
+  b->compressed = TRUE;
+  create_fail(x, &b->error);
+
+  create_flush(ctx, x);
+  create_continue(ctx, x);
+}
+
+static void
+create_output_done(JSContext* ctx, ThreadJob* ptr) {
+  CreateBlock* b = (CreateBlock*)ptr;
+  ArchiveCreate* x = b->create;
+
+  --x->running;
+  create_fail(x, &b->error);
+
+  x->bytes += b->data.size;
+  list_del(&b->link);
+  --x->num_blocks;
+  create_block_free(b);
+
+  create_continue(ctx, x);
+}
+
+/* the compression filter from the output file name */
+static const char*
+create_filter(const char* file) {
+  static const char* const filters[][2] = {
+      {".gz", "gzip"},
+      {".tgz", "gzip"},
+      {".zst", "zstd"},
+      {".tzst", "zstd"},
+      {".xz", "xz"},
+      {".txz", "xz"},
+      {".bz2", "bzip2"},
+      {".tbz2", "bzip2"},
+      {".lz4", "lz4"},
+      {".tar", 0},
+  };
+  size_t len = strlen(file);
+
+  for(size_t i = 0; i < countof(filters); i++) {
+    size_t n = strlen(filters[i][0]);
+
+    if(len >= n && !strcasecmp(file + len - n, filters[i][0]))
+      return filters[i][1];
+  }
+
+  return "gzip";
+}
+
+static int
+create_entries(JSContext* ctx, ArchiveCreate* x, JSValueConst list) {
+  int64_t length;
+
+  if(!JS_IsArray(ctx, list)) {
+    JS_ThrowTypeError(ctx, "create: entries must be an array");
+    return -1;
+  }
+
+  length = js_array_length(ctx, list);
+
+  if(!(x->entries = calloc(length + 1, sizeof(CreateEntry)))) {
+    JS_ThrowOutOfMemory(ctx);
+    return -1;
+  }
+
+  for(int64_t k = 0; k < length; k++) {
+    JSValue item = JS_GetPropertyUint32(ctx, list, k);
+    const char *file, *pathname;
+
+    if(JS_IsObject(item)) {
+      file = js_get_propertystr_cstring(ctx, item, "file");
+      pathname = js_get_propertystr_cstring(ctx, item, "pathname");
+    } else {
+      file = JS_ToCString(ctx, item);
+      pathname = 0;
+    }
+
+    JS_FreeValue(ctx, item);
+
+    if(!file) {
+      if(!JS_HasException(ctx))
+        JS_ThrowTypeError(ctx, "create: entry #%" PRId64 " has no file", k);
+
+      if(pathname)
+        JS_FreeCString(ctx, pathname);
+
+      return -1;
+    }
+
+    x->entries[x->num_entries].file = strdup(file);
+    x->entries[x->num_entries++].pathname = strdup(pathname ? pathname : file);
+
+    JS_FreeCString(ctx, file);
+    if(pathname)
+      JS_FreeCString(ctx, pathname);
+  }
+
+  return 0;
+}
+
+static JSValue
+js_archive_create(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  ArchiveCreate* x;
+  JSValue ret;
+  const char *format = 0, *filter = 0;
+  int32_t concurrency;
+  BOOL no_filter = FALSE;
+
+  if((concurrency = thread_pool_size()) == 0)
+    return JS_ThrowInternalError(ctx, "create: failed starting worker threads");
+
+  if(!(x = js_mallocz(ctx, sizeof(ArchiveCreate))))
+    return JS_EXCEPTION;
+
+  x->job.work = create_read;
+  x->job.done = create_read_done;
+  x->file = x->fd = -1;
+  x->level = -1;
+  x->block_size = CREATE_BLOCK_SIZE;
+  init_list_head(&x->sealed);
+  init_list_head(&x->blocks);
+
+  if(create_entries(ctx, x, argc > 1 ? argv[1] : JS_UNDEFINED))
+    goto fail;
+
+  if(argc > 2 && JS_IsObject(argv[2])) {
+    JSValue value;
+
+    format = js_get_propertystr_cstring(ctx, argv[2], "format");
+
+    value = JS_GetPropertyStr(ctx, argv[2], "compression");
+    if(JS_IsString(value))
+      filter = JS_ToCString(ctx, value);
+    else if(JS_IsNull(value) || JS_IsBool(value))
+      no_filter = !JS_ToBool(ctx, value);
+    JS_FreeValue(ctx, value);
+
+    value = JS_GetPropertyStr(ctx, argv[2], "level");
+    if(JS_IsNumber(value))
+      JS_ToInt32(ctx, &x->level, value);
+    JS_FreeValue(ctx, value);
+
+    value = JS_GetPropertyStr(ctx, argv[2], "blockSize");
+    if(JS_IsNumber(value))
+      x->block_size = js_touint64(ctx, value);
+    JS_FreeValue(ctx, value);
+
+    value = JS_GetPropertyStr(ctx, argv[2], "concurrency");
+    if(JS_IsNumber(value))
+      JS_ToInt32(ctx, &concurrency, value);
+    JS_FreeValue(ctx, value);
+  }
+
+  if(x->block_size < 65536)
+    x->block_size = 65536;
+
+  x->max_blocks = 2 * MAX_NUM(concurrency, 1);
+
+  if(no_filter)
+    x->filter = 0;
+  else if(filter)
+    x->filter = strcmp(filter, "none") ? strdup(filter) : 0;
+  else if(JS_IsString(argv[0])) {
+    const char* file = JS_ToCString(ctx, argv[0]);
+
+    if(file) {
+      const char* name = create_filter(file);
+
+      x->filter = name ? strdup(name) : 0;
+      JS_FreeCString(ctx, file);
+    }
+  } else {
+    x->filter = strdup("gzip");
+  }
+
+  if(filter)
+    JS_FreeCString(ctx, filter);
+
+  /* the tar writer gives the uncompressed stream to create_write() */
+  if(!(x->writer = archive_write_new()) || !(x->disk = archive_read_disk_new()) || !(x->links = archive_entry_linkresolver_new()) ||
+     !(x->buf = malloc(INDEX_BLOCK_SIZE))) {
+    JS_ThrowOutOfMemory(ctx);
+    goto fail;
+  }
+
+  if(archive_write_set_format_by_name(x->writer, format ? format : "paxr") != ARCHIVE_OK) {
+    JS_ThrowInternalError(ctx, "libarchive error: %s", archive_error_string(x->writer));
+    goto fail;
+  }
+
+  /* other formats may defer entries in the link resolver */
+  if((archive_format(x->writer) & ARCHIVE_FORMAT_BASE_MASK) != ARCHIVE_FORMAT_TAR) {
+    JS_ThrowTypeError(ctx, "create: format '%s' is not a tar format", archive_format_name(x->writer));
+    goto fail;
+  }
+
+  archive_read_disk_set_standard_lookup(x->disk);
+  archive_entry_linkresolver_set_strategy(x->links, archive_format(x->writer));
+
+  /* a filter which libarchive doesn't have fails here rather than in a job */
+  if(x->filter) {
+    struct archive* test = archive_write_new();
+    int r = archive_write_add_filter_by_name(test, x->filter);
+
+    if(r != ARCHIVE_OK)
+      JS_ThrowInternalError(ctx, "libarchive error: %s", archive_error_string(test));
+
+    archive_write_free(test);
+
+    if(r != ARCHIVE_OK)
+      goto fail;
+  }
+
+  if(archive_write_open2(x->writer, x, 0, create_write, 0, 0) != ARCHIVE_OK) {
+    JS_ThrowInternalError(ctx, "libarchive error: %s", archive_error_string(x->writer));
+    goto fail;
+  }
+
+  if(JS_IsString(argv[0])) {
+    const char* file;
+
+    if(!(file = JS_ToCString(ctx, argv[0])))
+      goto fail;
+
+    x->fd = open(file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    x->own_fd = TRUE;
+
+    if(x->fd == -1) {
+      JS_ThrowInternalError(ctx, "create: failed opening '%s': %s", file, strerror(errno));
+      JS_FreeCString(ctx, file);
+      goto fail;
+    }
+
+    JS_FreeCString(ctx, file);
+  } else if(JS_IsNumber(argv[0])) {
+    JS_ToInt32(ctx, &x->fd, argv[0]);
+  } else if(!writer_from_js(ctx, argv[0], &x->output)) {
+    JS_ThrowTypeError(ctx, "create: output must be a file name, a fd or a writer");
+    goto fail;
+  }
+
+  x->lane = thread_pool_lane();
+
+  if(format)
+    JS_FreeCString(ctx, format);
+
+  ret = promise_create(ctx, &x->funcs);
+
+  create_continue(ctx, x);
+  return ret;
+
+fail:
+  if(format)
+    JS_FreeCString(ctx, format);
+
+  create_free(JS_GetRuntime(ctx), x);
+  return JS_EXCEPTION;
+}
+
+/**
+ * ArchiveCache: contents of files read from the layers of a UnionFS or
+ * from an ArchiveFS, see read-cache.h
+ */
+#define CACHE_DEFAULT_BUDGET (64 * 1024 * 1024)
+
+static JSClassID js_archivecache_class_id = 0;
+static JSValue cache_proto, cache_ctor;
+
+static inline ReadCache*
+js_archivecache_data2(JSContext* ctx, JSValueConst value) {
+  return JS_GetOpaque2(ctx, value, js_archivecache_class_id);
+}
+
+static JSValue
+js_archivecache_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  JSValue proto, obj = JS_UNDEFINED;
+  ReadCache* rc;
+  int64_t budget = CACHE_DEFAULT_BUDGET;
+
+  if(argc > 0 && !JS_IsUndefined(argv[0]))
+    if(JS_ToInt64(ctx, &budget, argv[0]))
+      return JS_EXCEPTION;
+
+  if(budget < 0)
+    return JS_ThrowRangeError(ctx, "ArchiveCache: budget must not be negative");
+
+  if(!(rc = readcache_new(budget)))
+    return JS_ThrowOutOfMemory(ctx);
+
+  /* using new_target to get the prototype is necessary when the class is extended. */
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+  if(JS_IsException(proto))
+    goto fail;
+
+  obj = JS_NewObjectProtoClass(ctx, proto, js_archivecache_class_id);
+  JS_FreeValue(ctx, proto);
+  if(JS_IsException(obj))
+    goto fail;
+
+  JS_SetOpaque(obj, rc);
+  return obj;
+
+fail:
+  readcache_free(rc);
+  return JS_EXCEPTION;
+}
+
+enum {
+  CACHE_GET,
+  CACHE_SET,
+  CACHE_LOCATE,
+  CACHE_DELETE,
+  CACHE_INVALIDATE,
+  CACHE_CLEAR,
+};
+
+static JSValue
+js_archivecache_functions(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  JSValue ret = JS_UNDEFINED;
+  ReadCache* rc;
+  const char* path = 0;
+  size_t len = 0;
+
+  if(!(rc = js_archivecache_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(magic <= CACHE_DELETE)
+    if(!(path = JS_ToCStringLen(ctx, &len, argv[0])))
+      return JS_EXCEPTION;
+
+  switch(magic) {
+    case CACHE_GET: {
+      const void* data;
+      size_t size;
+
+      if((data = readcache_get(rc, path, len, &size)))
+        ret = JS_NewArrayBufferCopy(ctx, data, size);
+
+      break;
+    }
+
+    case CACHE_SET: {
+      int32_t layer = 0;
+      int64_t offset = 0;
+
+      if(JS_ToInt32(ctx, &layer, argv[1]) || JS_ToInt64(ctx, &offset, argv[2])) {
+        ret = JS_EXCEPTION;
+        break;
+      }
+
+      if(readcache_locate(rc, path, len, layer, offset)) {
+        ret = JS_ThrowOutOfMemory(ctx);
+        break;
+      }
+
+      ret = JS_FALSE;
+
+      if(argc > 3 && !js_is_nullish(ctx, argv[3])) {
+        InputBuffer input = js_input_chars(ctx, argv[3]);
+        int r = readcache_put(rc, path, len, inputbuffer_data(&input), inputbuffer_length(&input));
+
+        inputbuffer_free(&input, ctx);
+
+        if(r == -1)
+          ret = JS_ThrowOutOfMemory(ctx);
+        else
+          ret = JS_NewBool(ctx, r == 0);
+      }
+
+      break;
+    }
+
+    case CACHE_LOCATE: {
+      int32_t layer;
+      int64_t offset;
+
+      if(readcache_location(rc, path, len, &layer, &offset)) {
+        ret = JS_NewArray(ctx);
+        JS_SetPropertyUint32(ctx, ret, 0, JS_NewInt32(ctx, layer));
+        JS_SetPropertyUint32(ctx, ret, 1, JS_NewInt64(ctx, offset));
+      }
+
+      break;
+    }
+
+    case CACHE_DELETE: {
+      ret = JS_NewBool(ctx, readcache_remove(rc, path, len));
+      break;
+    }
+
+    case CACHE_INVALIDATE: {
+      int32_t layer = 0;
+
+      if(JS_ToInt32(ctx, &layer, argv[0]))
+        return JS_EXCEPTION;
+
+      ret = JS_NewUint32(ctx, readcache_invalidate(rc, layer));
+      break;
+    }
+
+    case CACHE_CLEAR: {
+      readcache_clear(rc);
+      break;
+    }
+  }
+
+  if(path)
+    JS_FreeCString(ctx, path);
+
+  return ret;
+}
+
+enum {
+  CACHE_HITS,
+  CACHE_MISSES,
+  CACHE_EVICTIONS,
+  CACHE_SIZE,
+  CACHE_COUNT,
+  CACHE_PATHS,
+  CACHE_BUDGET,
+};
+
+static JSValue
+js_archivecache_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  ReadCache* rc;
+  ReadCacheStats st;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(rc = js_archivecache_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  readcache_stats(rc, &st);
+
+  switch(magic) {
+    case CACHE_HITS: {
+      ret = JS_NewInt64(ctx, st.hits);
+      break;
+    }
+
+    case CACHE_MISSES: {
+      ret = JS_NewInt64(ctx, st.misses);
+      break;
+    }
+
+    case CACHE_EVICTIONS: {
+      ret = JS_NewInt64(ctx, st.evictions);
+      break;
+    }
+
+    case CACHE_SIZE: {
+      ret = JS_NewInt64(ctx, st.bytes);
+      break;
+    }
+
+    case CACHE_COUNT: {
+      ret = JS_NewUint32(ctx, st.bodies);
+      break;
+    }
+
+    case CACHE_PATHS: {
+      ret = JS_NewUint32(ctx, st.paths);
+      break;
+    }
+
+    case CACHE_BUDGET: {
+      ret = JS_NewInt64(ctx, st.budget);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static JSValue
+js_archivecache_set(JSContext* ctx, JSValueConst this_val, JSValueConst value, int magic) {
+  ReadCache* rc;
+  int64_t budget;
+
+  if(!(rc = js_archivecache_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(JS_ToInt64(ctx, &budget, value))
+    return JS_EXCEPTION;
+
+  if(budget < 0)
+    return JS_ThrowRangeError(ctx, "ArchiveCache: budget must not be negative");
+
+  readcache_budget(rc, budget);
+  return JS_UNDEFINED;
+}
+
+static void
+js_archivecache_finalizer(JSRuntime* rt, JSValue val) {
+  ReadCache* rc;
+
+  if((rc = JS_GetOpaque(val, js_archivecache_class_id)))
+    readcache_free(rc);
+}
+
+static JSClassDef js_archivecache_class = {
+    .class_name = "ArchiveCache",
+    .finalizer = js_archivecache_finalizer,
+};
+
+static const JSCFunctionListEntry js_archivecache_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("get", 1, js_archivecache_functions, CACHE_GET),
+    JS_CFUNC_MAGIC_DEF("set", 3, js_archivecache_functions, CACHE_SET),
+    JS_CFUNC_MAGIC_DEF("locate", 1, js_archivecache_functions, CACHE_LOCATE),
+    JS_CFUNC_MAGIC_DEF("delete", 1, js_archivecache_functions, CACHE_DELETE),
+    JS_CFUNC_MAGIC_DEF("invalidate", 1, js_archivecache_functions, CACHE_INVALIDATE),
+    JS_CFUNC_MAGIC_DEF("clear", 0, js_archivecache_functions, CACHE_CLEAR),
+    JS_CGETSET_MAGIC_DEF("hits", js_archivecache_get, 0, CACHE_HITS),
+    JS_CGETSET_MAGIC_DEF("misses", js_archivecache_get, 0, CACHE_MISSES),
+    JS_CGETSET_MAGIC_DEF("evictions", js_archivecache_get, 0, CACHE_EVICTIONS),
+    JS_CGETSET_MAGIC_DEF("size", js_archivecache_get, 0, CACHE_SIZE),
+    JS_CGETSET_MAGIC_DEF("count", js_archivecache_get, 0, CACHE_COUNT),
+    JS_CGETSET_MAGIC_DEF("paths", js_archivecache_get, 0, CACHE_PATHS),
+    JS_CGETSET_MAGIC_DEF("budget", js_archivecache_get, js_archivecache_set, CACHE_BUDGET),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "ArchiveCache", JS_PROP_CONFIGURABLE),
+};
+
 int
 js_archive_init(JSContext* ctx, JSModuleDef* m) {
   JS_NewClassID(&js_archive_class_id);
@@ -2017,10 +4069,32 @@ js_archive_init(JSContext* ctx, JSModuleDef* m) {
   JS_SetClassProto(ctx, js_archivematch_class_id, match_proto);
   JS_SetConstructor(ctx, match_ctor, match_proto);
 
+  JS_NewClassID(&js_archiveindex_class_id);
+  JS_NewClass(JS_GetRuntime(ctx), js_archiveindex_class_id, &js_archiveindex_class);
+
+  index_ctor = JS_NewCFunction2(ctx, js_archiveindex_constructor, "ArchiveIndex", 1, JS_CFUNC_constructor, 0);
+  index_proto = JS_NewObject(ctx);
+
+  JS_SetPropertyFunctionList(ctx, index_proto, js_archiveindex_funcs, countof(js_archiveindex_funcs));
+  JS_SetClassProto(ctx, js_archiveindex_class_id, index_proto);
+  JS_SetConstructor(ctx, index_ctor, index_proto);
+
+  JS_NewClassID(&js_archivecache_class_id);
+  JS_NewClass(JS_GetRuntime(ctx), js_archivecache_class_id, &js_archivecache_class);
+
+  cache_ctor = JS_NewCFunction2(ctx, js_archivecache_constructor, "ArchiveCache", 1, JS_CFUNC_constructor, 0);
+  cache_proto = JS_NewObject(ctx);
+
+  JS_SetPropertyFunctionList(ctx, cache_proto, js_archivecache_funcs, countof(js_archivecache_funcs));
+  JS_SetClassProto(ctx, js_archivecache_class_id, cache_proto);
+  JS_SetConstructor(ctx, cache_ctor, cache_proto);
+
   if(m) {
     JS_SetModuleExport(ctx, m, "Archive", archive_ctor);
     JS_SetModuleExport(ctx, m, "ArchiveEntry", entry_ctor);
     JS_SetModuleExport(ctx, m, "ArchiveMatch", match_ctor);
+    JS_SetModuleExport(ctx, m, "ArchiveIndex", index_ctor);
+    JS_SetModuleExport(ctx, m, "ArchiveCache", cache_ctor);
   }
 
   return 0;
@@ -2040,6 +4114,8 @@ JS_INIT_MODULE(JSContext* ctx, const char* module_name) {
     JS_AddModuleExport(ctx, m, "Archive");
     JS_AddModuleExport(ctx, m, "ArchiveEntry");
     JS_AddModuleExport(ctx, m, "ArchiveMatch");
+    JS_AddModuleExport(ctx, m, "ArchiveIndex");
+    JS_AddModuleExport(ctx, m, "ArchiveCache");
   }
 
   return m;
@@ -5,15 +5,89 @@
 #include "buffer-utils.h"
 #include "iteration.h"
 #include "debug.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#ifndef MADV_WILLNEED
+#define MADV_SEQUENTIAL 0
+#define MADV_WILLNEED 0
+#endif
 
 /**
  * \addtogroup quickjs-blob
  * @{
  */
 
+#define BLOB_STREAM_CHUNK 65536
+
 JSClassID js_blob_class_id = 0;
 static JSValue blob_proto, blob_ctor;
 
+static BlobMapping*
+blob_mapping_dup(BlobMapping* mapping) {
+  ++mapping->ref_count;
+  return mapping;
+}
+
+static void
+blob_mapping_free(JSRuntime* rt, BlobMapping* mapping) {
+  if(--mapping->ref_count == 0) {
+    block_munmap(&mapping->block);
+
+    if(mapping->fd != -1)
+      close(mapping->fd);
+
+    js_free_rt(rt, mapping);
+  }
+}
+
+#ifdef HAVE_SYS_MMAN_H
+/* 'opaque' is the length of the mapping, which starts at the page of 'ptr' */
+static void
+blob_mapping_buffer_free(JSRuntime* rt, void* opaque, void* ptr) {
+  uint8_t* page = (uint8_t*)((uintptr_t)ptr & ~(uintptr_t)(getpagesize() - 1));
+
+  munmap(page, (size_t)(uintptr_t)opaque);
+}
+#endif
+
+/* an ArrayBuffer with the 'size' bytes at 'data' in 'mapping'. It gets a
+ * private copy-on-write mapping of its own, so writing to it changes
+ * neither the file nor the Blob */
+static JSValue
+blob_mapping_buffer(JSContext* ctx, BlobMapping* mapping, uint8_t* data, size_t size) {
+#ifdef HAVE_SYS_MMAN_H
+  size_t offset = data - (uint8_t*)mapping->block.base;
+  size_t skip = offset & (getpagesize() - 1);
+  uint8_t* ptr;
+
+  if(size > 0 && (ptr = mmap(0, size + skip, PROT_READ | PROT_WRITE, MAP_PRIVATE, mapping->fd, offset - skip)) != MAP_FAILED) {
+    JSValue ret = JS_NewArrayBuffer(ctx, ptr + skip, size, blob_mapping_buffer_free, (void*)(uintptr_t)(size + skip), FALSE);
+
+    if(JS_IsException(ret))
+      munmap(ptr, size + skip);
+
+    return ret;
+  }
+#endif
+
+  return JS_NewArrayBufferCopy(ctx, data, size);
+}
+
+static void
+blob_mapping_advise(uint8_t* data, size_t size, int advice) {
+#if defined(HAVE_SYS_MMAN_H) && defined(MADV_WILLNEED)
+  uint8_t* page = (uint8_t*)((uintptr_t)data & ~(uintptr_t)(getpagesize() - 1));
+
+  madvise(page, size + (data - page), advice);
+#endif
+}
+
 static Blob*
 blob_new(JSContext* ctx, const char* type) {
   Blob* blob;
@@ -28,13 +102,53 @@ blob_new(JSContext* ctx, const char* type) {
   return blob;
 }
 
+/* a Blob viewing 'size' bytes at 'data' in 'mapping' */
+static Blob*
+blob_new_view(JSContext* ctx, BlobMapping* mapping, uint8_t* data, size_t size, const char* type) {
+  Blob* blob;
+
+  if(!(blob = blob_new(ctx, type)))
+    return 0;
+
+  blob->mapping = blob_mapping_dup(mapping);
+  blob->data = data;
+  blob->size = size;
+  return blob;
+}
+
 static void
 blob_free(JSRuntime* rt, Blob* blob) {
-  vector_free(&blob->vec);
+  if(blob->mapping)
+    blob_mapping_free(rt, blob->mapping);
+  else
+    vector_free(&blob->vec);
+
+  if(blob->type)
+    js_free_rt(rt, blob->type);
 
   js_free_rt(rt, blob);
 }
 
+/* replaces a view by a copy of its data, so more can be appended */
+static int
+blob_unshare(JSContext* ctx, Blob* blob) {
+  BlobMapping* mapping;
+  uint8_t* data = blob->data;
+  size_t size = blob->size;
+  int ret;
+
+  if(!(mapping = blob->mapping))
+    return 0;
+
+  blob->mapping = 0;
+  vector_init(&blob->vec, ctx);
+
+  ret = dbuf_put(&blob->vec, data, size) ? -1 : 0;
+
+  blob_mapping_free(JS_GetRuntime(ctx), mapping);
+  return ret;
+}
+
 static inline ssize_t
 blob_write(JSContext* ctx, Blob* blob, const void* x, size_t len) {
   if(dbuf_put(&blob->vec, x, len))
@@ -58,6 +172,76 @@ blob_stream_finalizer(JSRuntime* rt, void* opaque) {
   }
 }
 
+typedef struct {
+  BlobMapping* mapping;
+  uint8_t *pos, *end;
+} BlobStream;
+
+static void
+blob_view_stream_finalizer(JSRuntime* rt, void* opaque) {
+  BlobStream* bs = opaque;
+
+  blob_mapping_free(rt, bs->mapping);
+  js_free_rt(rt, bs);
+}
+
+/* pull(controller): enqueues the next chunk as a view of the mapping and
+ * asks the kernel to read ahead the one after it */
+static JSValue
+blob_view_stream_pull(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* opaque) {
+  BlobStream* bs = opaque;
+  JSValueConst controller = argc > 0 ? argv[0] : JS_UNDEFINED;
+  size_t n = MIN_NUM((size_t)(bs->end - bs->pos), BLOB_STREAM_CHUNK);
+  JSValue fn, ret, buffer, chunk;
+
+  if(n == 0) {
+    fn = JS_GetPropertyStr(ctx, controller, "close");
+    ret = JS_Call(ctx, fn, controller, 0, 0);
+    JS_FreeValue(ctx, fn);
+    return ret;
+  }
+
+  buffer = blob_mapping_buffer(ctx, bs->mapping, bs->pos, n);
+
+  if(JS_IsException(buffer))
+    return buffer;
+
+  bs->pos += n;
+
+  if(bs->pos < bs->end)
+    blob_mapping_advise(bs->pos, MIN_NUM((size_t)(bs->end - bs->pos), BLOB_STREAM_CHUNK), MADV_WILLNEED);
+
+  chunk = js_typedarray_new(ctx, 8, FALSE, FALSE, buffer);
+  JS_FreeValue(ctx, buffer);
+
+  fn = JS_GetPropertyStr(ctx, controller, "enqueue");
+  ret = JS_Call(ctx, fn, controller, 1, &chunk);
+  JS_FreeValue(ctx, fn);
+  JS_FreeValue(ctx, chunk);
+  return ret;
+}
+
+static JSValue
+blob_view_stream(JSContext* ctx, Blob* blob) {
+  BlobStream* bs;
+  JSValue source;
+
+  if(!(bs = js_malloc(ctx, sizeof(BlobStream))))
+    return JS_EXCEPTION;
+
+  bs->mapping = blob_mapping_dup(blob->mapping);
+  bs->pos = blob->data;
+  bs->end = blob->data + blob->size;
+
+  blob_mapping_advise(blob->data, blob->size, MADV_SEQUENTIAL);
+  blob_mapping_advise(blob->data, MIN_NUM(blob->size, BLOB_STREAM_CHUNK), MADV_WILLNEED);
+
+  source = JS_NewObject(ctx);
+  JS_SetPropertyStr(ctx, source, "pull", js_function_cclosure(ctx, blob_view_stream_pull, 1, 0, bs, blob_view_stream_finalizer));
+
+  return js_readable_stream_from_source(ctx, source);
+}
+
 JSValue
 js_blob_wrap(JSContext* ctx, Blob* blob) {
   JSValue obj = JS_NewObjectProtoClass(ctx, blob_proto, js_blob_class_id);
@@ -99,7 +283,7 @@ js_blob_get(JSContext* ctx, JSValueConst this_val, int magic) {
 
   switch(magic) {
     case BLOB_SIZE: {
-      ret = JS_NewUint32(ctx, blob->size);
+      ret = JS_NewInt64(ctx, blob->size);
       break;
     }
 
@@ -149,11 +333,27 @@ js_blob_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueCo
     while(!iteration_next(&iter, ctx)) {
       Blob* other;
       JSValue value = iteration_value(&iter, ctx);
-      InputBuffer input = (other = js_blob_data(ctx, value)) ? blob_input(ctx, other) : js_input_chars(ctx, value);
-      JS_FreeValue(ctx, value);
 
       ++i;
 
+      /* a Blob made from just one file-backed Blob views the same mapping */
+      if((other = js_blob_data(ctx, value)) && other->mapping && !blob->data) {
+        blob->mapping = blob_mapping_dup(other->mapping);
+        blob->data = other->data;
+        blob->size = other->size;
+        JS_FreeValue(ctx, value);
+        continue;
+      }
+
+      InputBuffer input = other ? blob_input(ctx, other) : js_input_chars(ctx, value);
+      JS_FreeValue(ctx, value);
+
+      if(blob_unshare(ctx, blob)) {
+        inputbuffer_free(&input, ctx);
+        JS_ThrowOutOfMemory(ctx);
+        goto fail;
+      }
+
       if(input.data == 0) {
         JS_ThrowTypeError(ctx, "item #%d supplied is not <Blob | ArrayBuffer | TypedArray | String>", i);
         goto fail;
@@ -225,12 +425,20 @@ js_blob_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst arg
 
   switch(magic) {
     case BLOB_ARRAYBUFFER: {
-      ret = js_promise_resolve(ctx, js_arraybuffer_fromvalue(ctx, blob->data, blob->size, this_val));
+      JSValue buf = blob->mapping ? blob_mapping_buffer(ctx, blob->mapping, blob->data, blob->size) : JS_NewArrayBufferCopy(ctx, blob->data, blob->size);
+
+      if(JS_IsException(buf))
+        return buf;
+
+      ret = js_promise_resolve(ctx, buf);
       break;
     }
 
     case BLOB_BYTES: {
-      JSValue buf = js_arraybuffer_fromvalue(ctx, blob->data, blob->size, this_val);
+      JSValue buf = blob->mapping ? blob_mapping_buffer(ctx, blob->mapping, blob->data, blob->size) : JS_NewArrayBufferCopy(ctx, blob->data, blob->size);
+
+      if(JS_IsException(buf))
+        return buf;
 
       ret = js_promise_resolve(ctx, js_typedarray_new(ctx, 8, FALSE, FALSE, buf));
 
@@ -251,7 +459,16 @@ js_blob_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst arg
       if(argc > index)
         type = js_tostring(ctx, argv[index]);
 
-      ret = js_blob_new(ctx, indexrange_begin(rng, blob->data, blob->size), indexrange_size(rng, blob->size), type ? type : blob->type);
+      if(blob->mapping) {
+        Blob* view;
+
+        if((view = blob_new_view(ctx, blob->mapping, indexrange_begin(rng, blob->data, blob->size), indexrange_size(rng, blob->size), type ? type : blob->type)))
+          ret = js_blob_wrap(ctx, view);
+        else
+          ret = JS_EXCEPTION;
+      } else {
+        ret = js_blob_new(ctx, indexrange_begin(rng, blob->data, blob->size), indexrange_size(rng, blob->size), type ? type : blob->type);
+      }
 
       if(type)
         js_free(ctx, type);
@@ -260,6 +477,11 @@ js_blob_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst arg
     }
 
     case BLOB_STREAM: {
+      if(blob->mapping) {
+        ret = blob_view_stream(ctx, blob);
+        break;
+      }
+
       /* Create a ReadableStream over the blob's data.
        * We need to copy the blob data because the blob object may be
        * garbage collected before the stream finishes reading. We also
@@ -295,6 +517,50 @@ js_blob_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst arg
   return ret;
 }
 
+static JSValue
+js_blob_fromfile(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  const char* filename;
+  char* type = 0;
+  BlobMapping* mapping;
+  Blob* blob = 0;
+  int err = 0;
+
+  if(!(filename = JS_ToCString(ctx, argv[0])))
+    return JS_EXCEPTION;
+
+  if(argc > 1 && JS_IsObject(argv[1]))
+    type = js_get_propertystr_string(ctx, argv[1], "type");
+
+  if((mapping = js_mallocz(ctx, sizeof(BlobMapping)))) {
+    mapping->ref_count = 1;
+
+    /* the descriptor stays open for the mappings blob_mapping_buffer() makes */
+    if((mapping->fd = open(filename, O_RDONLY)) == -1 || block_mmap_fd(&mapping->block, mapping->fd, FALSE))
+      err = errno;
+
+#ifdef HAVE_SYS_MMAN_H
+    /* the shared view must stay as it is */
+    if(!err && mapping->block.base)
+      mprotect(mapping->block.base, mapping->block.size, PROT_READ);
+#endif
+
+    if(err)
+      JS_ThrowInternalError(ctx, "Blob.fromFile('%s'): %s", filename, strerror(err));
+    else if(!(blob = mapping->block.base ? blob_new_view(ctx, mapping, mapping->block.base, mapping->block.size, type) : blob_new(ctx, type)))
+      JS_ThrowOutOfMemory(ctx);
+
+    /* the view holds its own reference */
+    blob_mapping_free(JS_GetRuntime(ctx), mapping);
+  }
+
+  if(type)
+    js_free(ctx, type);
+
+  JS_FreeCString(ctx, filename);
+
+  return blob ? js_blob_wrap(ctx, blob) : JS_EXCEPTION;
+}
+
 static void
 js_blob_finalizer(JSRuntime* rt, JSValue val) {
   Blob* blob;
@@ -319,6 +585,10 @@ static const JSCFunctionListEntry js_blob_funcs[] = {
     JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Blob", JS_PROP_CONFIGURABLE),
 };
 
+static const JSCFunctionListEntry js_blob_static[] = {
+    JS_CFUNC_DEF("fromFile", 1, js_blob_fromfile),
+};
+
 int
 js_blob_init(JSContext* ctx, JSModuleDef* m) {
   JS_NewClassID(&js_blob_class_id);
@@ -328,6 +598,7 @@ js_blob_init(JSContext* ctx, JSModuleDef* m) {
   blob_proto = JS_NewObject(ctx);
 
   JS_SetPropertyFunctionList(ctx, blob_proto, js_blob_funcs, countof(js_blob_funcs));
+  JS_SetPropertyFunctionList(ctx, blob_ctor, js_blob_static, countof(js_blob_static));
 
   JS_SetClassProto(ctx, js_blob_class_id, blob_proto);
   JS_SetConstructor(ctx, blob_ctor, blob_proto);
@@ -9,6 +9,16 @@
  * \defgroup quickjs-blob quickjs-blob: Blob
  * @{
  */
+/* A file mapped read-only with block_mmap_fd(), shared by the Blobs sliced
+ * from it. ArrayBuffers and stream chunks get private mappings of 'fd' */
+typedef struct blob_mapping {
+  int ref_count;
+  int fd;
+  MemoryBlock block;
+} BlobMapping;
+
+/* With a 'mapping', 'data' and 'size' describe a view into it and the
+ * vector isn't used */
 typedef union blob {
   struct {
     uint8_t* data;
@@ -17,6 +27,7 @@ typedef union blob {
     DynBufReallocFunc* realloc_func;
     void* opaque;
     char* type;
+    BlobMapping* mapping;
   };
   MemoryBlock block;
   Vector vec;
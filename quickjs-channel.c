@@ -0,0 +1,554 @@
+#include "defines.h"
+#include "channel.h"
+#include "utils.h"
+#include "buffer-utils.h"
+#include "js-utils.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * \defgroup quickjs-channel quickjs-channel: Message channels between runtimes
+ * @{
+ */
+VISIBLE JSClassID js_channel_class_id = 0;
+static JSValue channel_proto, channel_ctor;
+
+JSValue chunk_arraybuffer(Chunk* ch, JSContext* ctx);
+
+typedef struct channel_waiter {
+  struct list_head link;
+  ResolveFunctions funcs;
+  Chunk* chunk;
+  int type;
+  BOOL iterator;
+} ChannelWaiter;
+
+/* Per-runtime handle on a shared Channel. The eventfds are duplicated so
+ * that every handle can have its own os.setReadHandler() registration. */
+typedef struct channel_handle {
+  Channel* chan;
+  int fd_recv, fd_send;
+  BOOL recv_armed, send_armed;
+  struct list_head receivers, senders;
+} ChannelHandle;
+
+enum {
+  CHANNEL_RECV = 0,
+  CHANNEL_SEND,
+};
+
+static inline ChannelHandle*
+js_channel_data(JSValueConst value) {
+  return JS_GetOpaque(value, js_channel_class_id);
+}
+
+static inline ChannelHandle*
+js_channel_data2(JSContext* ctx, JSValueConst value) {
+  return JS_GetOpaque2(ctx, value, js_channel_class_id);
+}
+
+/* serializes a value into a Chunk: buffers are copied verbatim, everything
+ * else goes through JS_WriteObject() */
+static Chunk*
+js_channel_encode(JSContext* ctx, JSValueConst value, int* type) {
+  Chunk* ch = 0;
+
+  if(js_is_arraybuffer(ctx, value) || js_is_typedarray(ctx, value)) {
+    InputBuffer input = js_input_buffer(ctx, value);
+    size_t len = inputbuffer_length(&input);
+
+    if((ch = chunk_alloc(len))) {
+      memcpy(ch->data, inputbuffer_data(&input), len);
+      ch->size = len;
+    }
+
+    inputbuffer_free(&input, ctx);
+    *type = CHANNEL_BINARY;
+  } else {
+    uint8_t* buf;
+    size_t len;
+
+    if(!(buf = JS_WriteObject(ctx, &len, value, 0)))
+      return 0;
+
+    if((ch = chunk_alloc(len))) {
+      memcpy(ch->data, buf, len);
+      ch->size = len;
+    }
+
+    js_free(ctx, buf);
+    *type = CHANNEL_VALUE;
+  }
+
+  if(!ch)
+    JS_ThrowOutOfMemory(ctx);
+
+  return ch;
+}
+
+/* takes over the reference on 'ch'. binary messages are handed out without
+ * another copy, the ArrayBuffer keeps the Chunk alive */
+static JSValue
+js_channel_decode(JSContext* ctx, Chunk* ch, int type) {
+  JSValue ret;
+
+  if(type == CHANNEL_BINARY)
+    ret = chunk_arraybuffer(ch, ctx);
+  else
+    ret = JS_ReadObject(ctx, ch->data, ch->size, 0);
+
+  chunk_free(ch);
+  return ret;
+}
+
+static JSValue
+js_channel_closed_error(JSContext* ctx) {
+  JS_ThrowTypeError(ctx, "channel is closed");
+  return JS_GetException(ctx);
+}
+
+static void
+js_channel_waiter_free(JSRuntime* rt, ChannelWaiter* w) {
+  list_del(&w->link);
+
+  if(w->chunk)
+    chunk_free(w->chunk);
+
+  promise_free_funcs(rt, &w->funcs);
+  js_free_rt(rt, w);
+}
+
+static ChannelWaiter*
+js_channel_waiter(JSContext* ctx, struct list_head* list, JSValue* promise) {
+  ChannelWaiter* w;
+
+  if(!(w = js_mallocz(ctx, sizeof(ChannelWaiter))))
+    return 0;
+
+  *promise = promise_create(ctx, &w->funcs);
+
+  if(JS_IsException(*promise)) {
+    js_free(ctx, w);
+    return 0;
+  }
+
+  list_add_tail(&w->link, list);
+  return w;
+}
+
+static void
+js_channel_settle(JSContext* ctx, ChannelWaiter* w, JSValue value, BOOL reject) {
+  if(reject)
+    promise_reject(ctx, &w->funcs, value);
+  else
+    promise_resolve(ctx, &w->funcs, value);
+
+  JS_FreeValue(ctx, value);
+  js_channel_waiter_free(JS_GetRuntime(ctx), w);
+}
+
+static JSValue js_channel_ready(JSContext*, JSValueConst, int, JSValueConst[], int, JSValue[]);
+
+static void
+js_channel_arm(JSContext* ctx, JSValueConst this_val, ChannelHandle* h, int which, BOOL enable) {
+  Channel* chan = h->chan;
+  BOOL* armed = which == CHANNEL_RECV ? &h->recv_armed : &h->send_armed;
+  atomic_int* waiting = which == CHANNEL_RECV ? &chan->waiting_recv : &chan->waiting_send;
+  int fd = which == CHANNEL_RECV ? h->fd_recv : h->fd_send;
+  JSValue set_handler;
+
+  if(*armed == enable)
+    return;
+
+  set_handler = js_iohandler_fn(ctx, FALSE, "os");
+
+  if(enable) {
+    JSValueConst data[] = {this_val};
+
+    atomic_fetch_add(waiting, 1);
+    js_iohandler_set(ctx, set_handler, fd, JS_NewCFunctionData(ctx, js_channel_ready, 0, which, countof(data), data));
+  } else {
+    atomic_fetch_sub(waiting, 1);
+    js_iohandler_set(ctx, set_handler, fd, JS_NULL);
+  }
+
+  JS_FreeValue(ctx, set_handler);
+  *armed = enable;
+}
+
+/* satisfies as many pending receivers and senders as possible, then
+ * (un)registers the read handlers. after announcing itself waiting the
+ * handle has to look once more, a message could have been sent in between */
+static void
+js_channel_pump(JSContext* ctx, JSValueConst this_val, ChannelHandle* h) {
+  Channel* chan = h->chan;
+  BOOL again;
+
+  do {
+    again = FALSE;
+
+    while(!list_empty(&h->receivers)) {
+      ChannelWaiter* w = list_entry(h->receivers.next, ChannelWaiter, link);
+      Chunk* ch;
+      int type;
+
+      if((ch = channel_recv(chan, &type))) {
+        JSValue value = js_channel_decode(ctx, ch, type);
+
+        if(JS_IsException(value)) {
+          js_channel_settle(ctx, w, JS_GetException(ctx), TRUE);
+        } else if(w->iterator) {
+          js_channel_settle(ctx, w, js_iterator_result(ctx, value, FALSE), FALSE);
+          JS_FreeValue(ctx, value);
+        } else {
+          js_channel_settle(ctx, w, value, FALSE);
+        }
+
+      } else if(errno == EPIPE) {
+        if(w->iterator)
+          js_channel_settle(ctx, w, js_iterator_result(ctx, JS_UNDEFINED, TRUE), FALSE);
+        else
+          js_channel_settle(ctx, w, js_channel_closed_error(ctx), TRUE);
+      } else {
+        break;
+      }
+    }
+
+    while(!list_empty(&h->senders)) {
+      ChannelWaiter* w = list_entry(h->senders.next, ChannelWaiter, link);
+
+      if(!channel_send(chan, w->chunk, w->type)) {
+        w->chunk = 0;
+        js_channel_settle(ctx, w, JS_UNDEFINED, FALSE);
+      } else if(errno == EPIPE) {
+        js_channel_settle(ctx, w, js_channel_closed_error(ctx), TRUE);
+      } else {
+        break;
+      }
+    }
+
+    if(!list_empty(&h->receivers) && !h->recv_armed) {
+      js_channel_arm(ctx, this_val, h, CHANNEL_RECV, TRUE);
+      again = TRUE;
+    }
+
+    if(!list_empty(&h->senders) && !h->send_armed) {
+      js_channel_arm(ctx, this_val, h, CHANNEL_SEND, TRUE);
+      again = TRUE;
+    }
+
+    atomic_thread_fence(memory_order_seq_cst);
+  } while(again);
+
+  if(list_empty(&h->receivers))
+    js_channel_arm(ctx, this_val, h, CHANNEL_RECV, FALSE);
+
+  if(list_empty(&h->senders))
+    js_channel_arm(ctx, this_val, h, CHANNEL_SEND, FALSE);
+}
+
+static JSValue
+js_channel_ready(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, JSValue data[]) {
+  ChannelHandle* h;
+
+  if(!(h = js_channel_data2(ctx, data[0])))
+    return JS_EXCEPTION;
+
+  /* a closed channel stays signalled, so every other handle wakes up too */
+  if(!channel_closed(h->chan))
+    channel_drain(magic == CHANNEL_RECV ? h->fd_recv : h->fd_send);
+
+  js_channel_pump(ctx, data[0], h);
+  return JS_UNDEFINED;
+}
+
+static JSValue
+js_channel_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  JSValue proto, obj = JS_UNDEFINED;
+  ChannelHandle* h;
+  const char* name;
+  uint32_t capacity = 1024;
+  BOOL spsc = FALSE;
+
+  if(!(h = js_mallocz(ctx, sizeof(ChannelHandle))))
+    return JS_EXCEPTION;
+
+  h->fd_recv = h->fd_send = -1;
+  init_list_head(&h->receivers);
+  init_list_head(&h->senders);
+
+  if(argc < 1 || !(name = JS_ToCString(ctx, argv[0]))) {
+    if(argc < 1)
+      JS_ThrowTypeError(ctx, "argument 1 must be a channel name");
+    goto fail;
+  }
+
+  if(argc > 1 && !js_is_null_or_undefined(argv[1]))
+    JS_ToUint32(ctx, &capacity, argv[1]);
+
+  if(argc > 2 && JS_IsObject(argv[2]))
+    spsc = js_get_propertystr_bool(ctx, argv[2], "spsc");
+
+  h->chan = channel_open(name, capacity ? capacity : 1, spsc);
+  JS_FreeCString(ctx, name);
+
+  if(!h->chan) {
+    JS_ThrowInternalError(ctx, "could not create channel: %s", strerror(errno));
+    goto fail;
+  }
+
+  if((h->fd_recv = dup(h->chan->fd_recv)) == -1 || (h->fd_send = dup(h->chan->fd_send)) == -1) {
+    JS_ThrowInternalError(ctx, "could not duplicate channel descriptor: %s", strerror(errno));
+    goto fail;
+  }
+
+  /* using new_target to get the prototype is necessary when the class is extended. */
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+  if(JS_IsException(proto))
+    goto fail;
+
+  obj = JS_NewObjectProtoClass(ctx, proto, js_channel_class_id);
+  JS_FreeValue(ctx, proto);
+  if(JS_IsException(obj))
+    goto fail;
+
+  JS_SetOpaque(obj, h);
+  return obj;
+
+fail:
+  if(h->fd_recv != -1)
+    close(h->fd_recv);
+  if(h->fd_send != -1)
+    close(h->fd_send);
+  if(h->chan)
+    channel_free(h->chan);
+  js_free(ctx, h);
+  JS_FreeValue(ctx, obj);
+  return JS_EXCEPTION;
+}
+
+enum {
+  CHANNEL_METHOD_SEND = 0,
+  CHANNEL_METHOD_TRYSEND,
+  CHANNEL_METHOD_RECV,
+  CHANNEL_METHOD_TRYRECV,
+  CHANNEL_METHOD_NEXT,
+  CHANNEL_METHOD_CLOSE,
+};
+
+static JSValue
+js_channel_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  JSValue ret = JS_UNDEFINED;
+  ChannelHandle* h;
+
+  if(!(h = js_channel_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case CHANNEL_METHOD_SEND:
+    case CHANNEL_METHOD_TRYSEND: {
+      ChannelWaiter* w;
+      Chunk* ch;
+      int type;
+
+      if(!(ch = js_channel_encode(ctx, argc > 0 ? argv[0] : JS_UNDEFINED, &type)))
+        return JS_EXCEPTION;
+
+      /* senders queued before this one keep their order */
+      if(list_empty(&h->senders) && !channel_send(h->chan, ch, type)) {
+        if(magic == CHANNEL_METHOD_TRYSEND)
+          return JS_TRUE;
+
+        ret = js_promise_resolve(ctx, JS_UNDEFINED);
+        break;
+      }
+
+      if(magic == CHANNEL_METHOD_TRYSEND || channel_closed(h->chan)) {
+        JSValue error;
+
+        chunk_free(ch);
+
+        if(magic == CHANNEL_METHOD_TRYSEND)
+          return JS_FALSE;
+
+        error = js_channel_closed_error(ctx);
+        ret = js_promise_reject(ctx, error);
+        JS_FreeValue(ctx, error);
+        break;
+      }
+
+      if(!(w = js_channel_waiter(ctx, &h->senders, &ret))) {
+        chunk_free(ch);
+        return JS_EXCEPTION;
+      }
+
+      w->chunk = ch;
+      w->type = type;
+      js_channel_pump(ctx, this_val, h);
+      break;
+    }
+
+    case CHANNEL_METHOD_RECV:
+    case CHANNEL_METHOD_NEXT: {
+      ChannelWaiter* w;
+
+      if(!(w = js_channel_waiter(ctx, &h->receivers, &ret)))
+        return JS_EXCEPTION;
+
+      w->iterator = magic == CHANNEL_METHOD_NEXT;
+      js_channel_pump(ctx, this_val, h);
+      break;
+    }
+
+    case CHANNEL_METHOD_TRYRECV: {
+      Chunk* ch;
+      int type;
+
+      if(!list_empty(&h->receivers) || !(ch = channel_recv(h->chan, &type)))
+        return JS_UNDEFINED;
+
+      ret = js_channel_decode(ctx, ch, type);
+      break;
+    }
+
+    case CHANNEL_METHOD_CLOSE: {
+      channel_close(h->chan);
+      js_channel_pump(ctx, this_val, h);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+enum {
+  CHANNEL_NAME = 0,
+  CHANNEL_CAPACITY,
+  CHANNEL_SIZE,
+  CHANNEL_CLOSED,
+  CHANNEL_SPSC,
+};
+
+static JSValue
+js_channel_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  JSValue ret = JS_UNDEFINED;
+  ChannelHandle* h;
+
+  if(!(h = js_channel_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case CHANNEL_NAME: {
+      ret = JS_NewString(ctx, h->chan->name);
+      break;
+    }
+
+    case CHANNEL_CAPACITY: {
+      ret = JS_NewInt64(ctx, h->chan->capacity);
+      break;
+    }
+
+    case CHANNEL_SIZE: {
+      ret = JS_NewInt64(ctx, channel_size(h->chan));
+      break;
+    }
+
+    case CHANNEL_CLOSED: {
+      ret = JS_NewBool(ctx, channel_closed(h->chan));
+      break;
+    }
+
+    case CHANNEL_SPSC: {
+      ret = JS_NewBool(ctx, h->chan->spsc);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static JSValue
+js_channel_iterator(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  return JS_DupValue(ctx, this_val);
+}
+
+static void
+js_channel_finalizer(JSRuntime* rt, JSValue val) {
+  ChannelHandle* h;
+
+  if((h = js_channel_data(val))) {
+    /* armed read handlers keep the object alive, so both lists are empty
+     * unless the runtime is being torn down */
+    while(!list_empty(&h->receivers))
+      js_channel_waiter_free(rt, list_entry(h->receivers.next, ChannelWaiter, link));
+
+    while(!list_empty(&h->senders))
+      js_channel_waiter_free(rt, list_entry(h->senders.next, ChannelWaiter, link));
+
+    close(h->fd_recv);
+    close(h->fd_send);
+    channel_free(h->chan);
+    js_free_rt(rt, h);
+  }
+}
+
+static JSClassDef js_channel_class = {
+    .class_name = "Channel",
+    .finalizer = js_channel_finalizer,
+};
+
+static const JSCFunctionListEntry js_channel_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("send", 1, js_channel_method, CHANNEL_METHOD_SEND),
+    JS_CFUNC_MAGIC_DEF("trySend", 1, js_channel_method, CHANNEL_METHOD_TRYSEND),
+    JS_CFUNC_MAGIC_DEF("recv", 0, js_channel_method, CHANNEL_METHOD_RECV),
+    JS_CFUNC_MAGIC_DEF("tryRecv", 0, js_channel_method, CHANNEL_METHOD_TRYRECV),
+    JS_CFUNC_MAGIC_DEF("next", 0, js_channel_method, CHANNEL_METHOD_NEXT),
+    JS_CFUNC_MAGIC_DEF("close", 0, js_channel_method, CHANNEL_METHOD_CLOSE),
+    JS_CGETSET_MAGIC_DEF("name", js_channel_get, 0, CHANNEL_NAME),
+    JS_CGETSET_MAGIC_DEF("capacity", js_channel_get, 0, CHANNEL_CAPACITY),
+    JS_CGETSET_MAGIC_DEF("size", js_channel_get, 0, CHANNEL_SIZE),
+    JS_CGETSET_MAGIC_DEF("closed", js_channel_get, 0, CHANNEL_CLOSED),
+    JS_CGETSET_MAGIC_DEF("spsc", js_channel_get, 0, CHANNEL_SPSC),
+    JS_CFUNC_DEF("[Symbol.asyncIterator]", 0, js_channel_iterator),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Channel", JS_PROP_CONFIGURABLE),
+};
+
+int
+js_channel_init(JSContext* ctx, JSModuleDef* m) {
+  JS_NewClassID(&js_channel_class_id);
+  JS_NewClass(JS_GetRuntime(ctx), js_channel_class_id, &js_channel_class);
+
+  channel_ctor = JS_NewCFunction2(ctx, js_channel_constructor, "Channel", 1, JS_CFUNC_constructor, 0);
+  channel_proto = JS_NewObject(ctx);
+
+  JS_SetPropertyFunctionList(ctx, channel_proto, js_channel_funcs, countof(js_channel_funcs));
+
+  JS_SetClassProto(ctx, js_channel_class_id, channel_proto);
+  JS_SetConstructor(ctx, channel_ctor, channel_proto);
+
+  if(m)
+    JS_SetModuleExport(ctx, m, "Channel", channel_ctor);
+
+  return 0;
+}
+
+#ifdef JS_SHARED_LIBRARY
+#define JS_INIT_MODULE js_init_module
+#else
+#define JS_INIT_MODULE js_init_module_channel
+#endif
+
+VISIBLE JSModuleDef*
+JS_INIT_MODULE(JSContext* ctx, const char* module_name) {
+  JSModuleDef* m;
+
+  if((m = JS_NewCModule(ctx, module_name, js_channel_init)))
+    JS_AddModuleExport(ctx, m, "Channel");
+
+  return m;
+}
+
+/**
+ * @}
+ */
@@ -3,6 +3,7 @@
 #include "char-utils.h"
 #include "buffer-utils.h"
 #include "child-process.h"
+#include "js-utils.h"
 #include "debug.h"
 
 /**
@@ -19,6 +20,11 @@
 #include <signal.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <errno.h>
+
+#if defined(HAVE_SPLICE) && defined(HAVE_TEE)
+#define PIPELINE_SPLICE 1
+#endif
 
 enum {
   CHILD_PROCESS_SPAWNFILE = 0,
@@ -32,10 +38,25 @@ enum {
   CHILD_PROCESS_SIGNALCODE,
   CHILD_PROCESS_KILLED,
   CHILD_PROCESS_ONEXIT,
+  CHILD_PROCESS_DONE,
 };
 
-VISIBLE JSClassID js_child_process_class_id = 0;
-static JSValue child_process_proto, child_process_ctor;
+VISIBLE JSClassID js_child_process_class_id = 0, js_pipeline_class_id = 0;
+static JSValue child_process_proto, child_process_ctor, pipeline_proto;
+
+/* A chain of processes where each stage writes straight into the stdin of
+ * the next one. Only the input of the first and the output of the last
+ * stage are visible to the parent. In tee mode the output goes to 'dest_fd'
+ * and is tee(2)'d from 'src_fd' into the pipe behind 'out_fd' on read().
+ * 'unmoved' bytes were tee'd already but are still in 'src_fd'. */
+typedef struct {
+  int num_procs;
+  JSValue* procs;
+  int in_fd, out_fd;
+  int src_fd, dest_fd, tee_fd;
+  size_t unmoved;
+  JSValue promise;
+} Pipeline;
 
 ChildProcess*
 js_child_process_data(JSValueConst value) {
@@ -247,6 +268,73 @@ child_process_result(JSContext* ctx, ChildProcess* cp) {
   return obj;
 }
 
+/* removes the read handler and closes the pidfd, which stays readable */
+static void
+js_child_process_unwatch(JSContext* ctx, ChildProcess* cp) {
+  if(cp->watched) {
+    JSValue set_handler = js_iohandler_fn(ctx, FALSE, "os");
+
+    js_iohandler_set(ctx, set_handler, cp->pidfd, JS_NULL);
+    JS_FreeValue(ctx, set_handler);
+    cp->watched = FALSE;
+  }
+
+  if(cp->pidfd != -1 && (cp->exited || cp->signaled)) {
+    close(cp->pidfd);
+    cp->pidfd = -1;
+  }
+}
+
+static JSValue
+js_child_process_exited(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, JSValue data[]) {
+  ChildProcess* cp;
+
+  if(!(cp = js_child_process_data2(ctx, data[0])))
+    return JS_EXCEPTION;
+
+  /* the pidfd is readable once the child is gone. If nothing can be
+   * collected, it was reaped elsewhere and the handler would spin */
+  if(!child_process_reap(cp, ctx))
+    child_process_lost(cp, ctx);
+
+  js_child_process_unwatch(ctx, cp);
+  return JS_UNDEFINED;
+}
+
+static JSValue
+js_child_process_reapjob(JSContext* ctx, int argc, JSValueConst argv[]) {
+  ChildProcess* cp;
+
+  if((cp = js_child_process_data(argv[0])))
+    child_process_reap(cp, ctx);
+
+  return JS_UNDEFINED;
+}
+
+/* Reaps the child as soon as it terminates. The pidfd becomes readable on
+ * exit of this very child, so the handler only waits for it and never for
+ * someone else's children. The handler references the object, keeping it
+ * alive until then. Without pidfds we fall back to SIGCHLD. */
+static void
+js_child_process_watch(JSContext* ctx, JSValueConst obj, ChildProcess* cp) {
+  JSValue set_handler;
+
+  if(cp->watched || cp->pid <= 0 || cp->exited || cp->signaled)
+    return;
+
+  if(child_process_pidfd(cp) == -1 || JS_IsException((set_handler = js_iohandler_fn(ctx, FALSE, "os")))) {
+    child_process_sigchld_handler(ctx);
+
+    /* a SIGCHLD before the handler was installed is lost */
+    JS_EnqueueJob(ctx, js_child_process_reapjob, 1, &obj);
+    return;
+  }
+
+  js_iohandler_set(ctx, set_handler, cp->pidfd, JS_NewCFunctionData(ctx, js_child_process_exited, 0, 0, 1, &obj));
+  JS_FreeValue(ctx, set_handler);
+  cp->watched = TRUE;
+}
+
 static JSValue
 js_child_process_spawn(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
   JSValue ret;
@@ -292,6 +380,8 @@ js_child_process_spawn(JSContext* ctx, JSValueConst this_val, int argc, JSValueC
     JSValue result = child_process_result(ctx, cp);
     JS_FreeValue(ctx, ret);
     ret = result;
+  } else {
+    js_child_process_watch(ctx, ret, cp);
   }
 
   return ret;
@@ -329,6 +419,8 @@ js_child_process_exec(JSContext* ctx, JSValueConst this_val, int argc, JSValueCo
     JSValue result = child_process_result(ctx, cp);
     JS_FreeValue(ctx, ret);
     ret = result;
+  } else {
+    js_child_process_watch(ctx, ret, cp);
   }
 
   return ret;
@@ -342,6 +434,497 @@ child_process_fd(JSContext* ctx, ChildProcess* cp, int idx) {
   return JS_NULL;
 }
 
+/* pipes between stages must not leak into the other stages */
+static int
+pipeline_pipe(int fds[2]) {
+#ifdef HAVE_PIPE2
+  return pipe2(fds, O_CLOEXEC);
+#else
+  if(pipe(fds) == -1)
+    return -1;
+
+#ifdef FD_CLOEXEC
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+  fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+#endif
+  return 0;
+#endif
+}
+
+static inline Pipeline*
+js_pipeline_data2(JSContext* ctx, JSValueConst value) {
+  return JS_GetOpaque2(ctx, value, js_pipeline_class_id);
+}
+
+static void
+pipeline_close(int* fd) {
+  if(*fd >= 0) {
+    close(*fd);
+    *fd = -1;
+  }
+}
+
+/* parses the 'stdin'/'stderr' pipeline options: a fd number, 'inherit',
+ * 'ignore', or (stdin only) 'pipe' */
+static int
+pipeline_stdio(JSContext* ctx, JSValueConst options, const char* prop, int fd, BOOL* owned, int* parent_fd) {
+  JSValue value = JS_GetPropertyStr(ctx, options, prop);
+
+  *owned = FALSE;
+
+  if(JS_IsNumber(value)) {
+    int32_t n;
+
+    JS_ToInt32(ctx, &n, value);
+    fd = n;
+  } else if(JS_IsString(value)) {
+    const char* str = JS_ToCString(ctx, value);
+
+    if(!strcmp(str, "ignore")) {
+      fd = open("/dev/null", O_RDWR);
+      *owned = TRUE;
+    } else if(parent_fd && !strcmp(str, "pipe")) {
+      int fds[2];
+
+      if(pipeline_pipe(fds) == -1) {
+        fd = -1;
+      } else {
+        fd = fds[0];
+        *parent_fd = fds[1];
+        *owned = TRUE;
+      }
+    }
+
+    JS_FreeCString(ctx, str);
+  }
+
+  JS_FreeValue(ctx, value);
+  return fd;
+}
+
+static JSValue
+js_child_process_pipeline(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  JSValueConst options = argc > 1 && JS_IsObject(argv[1]) ? argv[1] : JS_UNDEFINED;
+  Pipeline* pl;
+  JSValue obj;
+  int64_t num_procs;
+  int in_fd = 0, err_fd = 2, dest_fd = -1;
+  BOOL in_owned = FALSE, err_owned = FALSE, tee = FALSE;
+  char** env = 0;
+  char* cwd = 0;
+
+  if(argc < 1 || !JS_IsArray(ctx, argv[0]) || (num_procs = js_array_length(ctx, argv[0])) < 1)
+    return JS_ThrowTypeError(ctx, "argument 1 must be a non-empty array of argument arrays");
+
+  if(!(pl = js_mallocz(ctx, sizeof(Pipeline))))
+    return JS_EXCEPTION;
+
+  pl->in_fd = pl->out_fd = pl->src_fd = pl->dest_fd = pl->tee_fd = -1;
+  pl->promise = JS_UNDEFINED;
+
+  obj = JS_NewObjectProtoClass(ctx, pipeline_proto, js_pipeline_class_id);
+  JS_SetOpaque(obj, pl);
+
+  if(!(pl->procs = js_mallocz(ctx, sizeof(JSValue) * num_procs)))
+    goto fail;
+
+  if(JS_IsObject(options)) {
+    JSValue value;
+
+    in_fd = pipeline_stdio(ctx, options, "stdin", in_fd, &in_owned, &pl->in_fd);
+    err_fd = pipeline_stdio(ctx, options, "stderr", err_fd, &err_owned, 0);
+
+    value = JS_GetPropertyStr(ctx, options, "output");
+    if(JS_IsNumber(value)) {
+      int32_t n;
+
+      JS_ToInt32(ctx, &n, value);
+      dest_fd = n;
+    }
+    JS_FreeValue(ctx, value);
+
+    tee = dest_fd >= 0 && js_get_propertystr_bool(ctx, options, "tee");
+
+    value = JS_GetPropertyStr(ctx, options, "env");
+    if(JS_IsObject(value))
+      env = child_process_environment(ctx, value);
+    JS_FreeValue(ctx, value);
+
+    value = JS_GetPropertyStr(ctx, options, "cwd");
+    if(JS_IsString(value))
+      cwd = js_tostring(ctx, value);
+    JS_FreeValue(ctx, value);
+  }
+
+#ifndef PIPELINE_SPLICE
+  if(tee) {
+    JS_ThrowInternalError(ctx, "pipeline: tee mode needs splice()/tee()");
+    goto fail;
+  }
+#endif
+
+  if(in_fd < 0 || err_fd < 0) {
+    JS_ThrowInternalError(ctx, "pipeline: could not set up stdio: %s", strerror(errno));
+    goto fail;
+  }
+
+  for(int64_t i = 0; i < num_procs; i++) {
+    BOOL last = i == num_procs - 1;
+    JSValue stage = JS_GetPropertyUint32(ctx, argv[0], i);
+    ChildProcess* cp;
+    int fds[2] = {-1, -1}, out_fd;
+
+    if(!last || dest_fd < 0 || tee) {
+      if(pipeline_pipe(fds) == -1) {
+        JS_FreeValue(ctx, stage);
+        JS_ThrowInternalError(ctx, "pipeline: pipe() failed: %s", strerror(errno));
+        goto fail;
+      }
+
+      out_fd = fds[1];
+    } else {
+      out_fd = dest_fd;
+    }
+
+    if(!(cp = child_process_new(ctx))) {
+      JS_FreeValue(ctx, stage);
+      pipeline_close(&fds[0]);
+      pipeline_close(&fds[1]);
+      goto fail;
+    }
+
+    pl->procs[pl->num_procs++] = js_child_process_wrap(ctx, cp);
+
+    cp->args = JS_IsArray(ctx, stage) ? js_array_to_argv(ctx, NULL, stage) : 0;
+    JS_FreeValue(ctx, stage);
+
+    if(!cp->args || !cp->args[0]) {
+      pipeline_close(&fds[0]);
+      pipeline_close(&fds[1]);
+      JS_ThrowTypeError(ctx, "pipeline: stage %d must be a non-empty argument array", (int)i);
+      goto fail;
+    }
+
+    cp->file = js_strdup(ctx, cp->args[0]);
+    cp->env = env ? js_strv_dup(ctx, env) : js_strv_dup(ctx, environ);
+    cp->cwd = cwd ? js_strdup(ctx, cwd) : 0;
+
+    cp->num_fds = 3;
+    cp->child_fds = js_mallocz(ctx, sizeof(int) * 4);
+    cp->pipe_fds = js_mallocz(ctx, sizeof(int) * 4);
+
+    /* child_process_spawn() closes the child's ends flagged in pipe_fds */
+    cp->child_fds[0] = in_fd;
+    cp->child_fds[1] = out_fd;
+    cp->child_fds[2] = err_fd;
+    cp->pipe_fds[0] = in_owned;
+    cp->pipe_fds[1] = fds[1] != -1;
+
+    if(child_process_spawn(cp) == -1) {
+      /* the stage's ends are closed along with the ChildProcess */
+      in_owned = FALSE;
+      pipeline_close(&fds[0]);
+      JS_ThrowInternalError(ctx, "pipeline: could not spawn '%s': %s", cp->file, strerror(errno));
+      goto fail;
+    }
+
+    js_child_process_watch(ctx, pl->procs[pl->num_procs - 1], cp);
+
+    in_fd = fds[0];
+    in_owned = TRUE;
+  }
+
+  if(tee) {
+    int fds[2];
+
+    pl->src_fd = in_fd;
+    pl->dest_fd = dest_fd;
+
+    if(pipeline_pipe(fds) == -1) {
+      JS_ThrowInternalError(ctx, "pipeline: pipe() failed: %s", strerror(errno));
+      goto fail;
+    }
+
+    pl->out_fd = fds[0];
+    pl->tee_fd = fds[1];
+  } else if(in_fd != -1) {
+    pl->out_fd = in_fd;
+  }
+
+  if(err_owned)
+    close(err_fd);
+
+  if(env)
+    js_strv_free(ctx, env);
+  if(cwd)
+    js_free(ctx, cwd);
+
+  return obj;
+
+fail:
+  if(in_owned && in_fd >= 0)
+    close(in_fd);
+  if(err_owned && err_fd >= 0)
+    close(err_fd);
+
+  if(env)
+    js_strv_free(ctx, env);
+  if(cwd)
+    js_free(ctx, cwd);
+
+  JS_FreeValue(ctx, obj);
+  return JS_EXCEPTION;
+}
+
+/* resolves with the exit statuses once every stage has terminated */
+static JSValue
+js_pipeline_wait(JSContext* ctx, Pipeline* pl) {
+  JSValue promises, ctor;
+
+  if(!JS_IsUndefined(pl->promise))
+    return JS_DupValue(ctx, pl->promise);
+
+  promises = JS_NewArray(ctx);
+
+  for(int i = 0; i < pl->num_procs; i++)
+    JS_SetPropertyUint32(ctx, promises, i, child_process_done(ctx, js_child_process_data(pl->procs[i])));
+
+  ctor = js_global_get_str(ctx, "Promise");
+  pl->promise = js_invoke(ctx, ctor, "all", 1, &promises);
+  JS_FreeValue(ctx, ctor);
+  JS_FreeValue(ctx, promises);
+
+  return JS_DupValue(ctx, pl->promise);
+}
+
+#ifdef PIPELINE_SPLICE
+/* moves the tee'd bytes still in 'src_fd' on to the destination, so they
+ * are neither lost nor tee'd twice. returns -1 with errno set (e.g. EAGAIN
+ * when the destination is full) while some are left */
+static int
+pipeline_move(Pipeline* pl) {
+  while(pl->unmoved > 0) {
+    ssize_t r = splice(pl->src_fd, NULL, pl->dest_fd, NULL, pl->unmoved, SPLICE_F_MOVE);
+
+    if(r == -1 && errno == EINTR)
+      continue;
+
+    if(r <= 0) {
+      if(r == 0)
+        errno = EPIPE;
+
+      return -1;
+    }
+
+    pl->unmoved -= r;
+  }
+
+  return 0;
+}
+#endif
+
+/* read(buffer, length?) -> bytes read, 0 on EOF, -errno on error.
+ * same shape as ReadableStream.fromReader() sources expect */
+static ssize_t
+pipeline_read(Pipeline* pl, uint8_t* buf, size_t len) {
+#ifdef PIPELINE_SPLICE
+  if(pl->src_fd >= 0) {
+    ssize_t n;
+
+    if(pipeline_move(pl) == -1)
+      return -1;
+
+    if((n = tee(pl->src_fd, pl->tee_fd, len, 0)) <= 0) {
+      if(n == 0)
+        pipeline_close(&pl->tee_fd);
+
+      return n == 0 ? read(pl->out_fd, buf, len) : -1;
+    }
+
+    /* the copy is in our pipe now and is returned in any case. what isn't
+     * moved on to the destination yet is moved before the next tee() */
+    pl->unmoved = n;
+    pipeline_move(pl);
+
+    return read(pl->out_fd, buf, n);
+  }
+#endif
+
+  return read(pl->out_fd, buf, len);
+}
+
+enum {
+  PIPELINE_READ = 0,
+  PIPELINE_SPLICE_TO,
+  PIPELINE_WAIT,
+  PIPELINE_KILL,
+  PIPELINE_CLOSE,
+};
+
+static JSValue
+js_pipeline_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  Pipeline* pl;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(pl = js_pipeline_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case PIPELINE_READ: {
+      OutputBuffer out;
+      size_t len;
+      int64_t max = -1;
+      ssize_t n;
+
+      if(pl->out_fd < 0)
+        return JS_ThrowInternalError(ctx, "pipeline has no readable output");
+
+      out = js_output_args(ctx, 1, argv);
+      len = outputbuffer_length(&out);
+
+      if(argc > 1 && !JS_ToInt64(ctx, &max, argv[1]) && max >= 0 && (size_t)max < len)
+        len = max;
+
+      n = pipeline_read(pl, (uint8_t*)outputbuffer_data(&out), len);
+      inputbuffer_free(&out, ctx);
+
+      ret = JS_NewInt64(ctx, n < 0 ? -errno : n);
+      break;
+    }
+
+    case PIPELINE_SPLICE_TO: {
+#ifdef PIPELINE_SPLICE
+      int32_t fd = -1;
+      int64_t len = 65536;
+      ssize_t n;
+
+      JS_ToInt32(ctx, &fd, argv[0]);
+
+      if(argc > 1)
+        JS_ToInt64(ctx, &len, argv[1]);
+
+      if(pl->out_fd < 0)
+        return JS_ThrowInternalError(ctx, "pipeline has no readable output");
+
+      if(pl->src_fd >= 0 && pipeline_move(pl) == -1)
+        return JS_NewInt64(ctx, -errno);
+
+      while((n = splice(pl->src_fd >= 0 ? pl->src_fd : pl->out_fd, NULL, fd, NULL, len, SPLICE_F_MOVE)) == -1 && errno == EINTR)
+        ;
+
+      ret = JS_NewInt64(ctx, n < 0 ? -errno : n);
+#else
+      ret = JS_NewInt32(ctx, -ENOSYS);
+#endif
+      break;
+    }
+
+    case PIPELINE_WAIT: {
+      ret = js_pipeline_wait(ctx, pl);
+      break;
+    }
+
+    case PIPELINE_KILL: {
+      int32_t signum = SIGTERM;
+
+      if(argc > 0)
+        JS_ToInt32(ctx, &signum, argv[0]);
+
+      for(int i = 0; i < pl->num_procs; i++) {
+        ChildProcess* cp = js_child_process_data(pl->procs[i]);
+
+        if(!cp->exited && !cp->signaled && child_process_kill(cp, signum) == 0)
+          cp->killed = TRUE;
+      }
+
+      break;
+    }
+
+    case PIPELINE_CLOSE: {
+      pipeline_close(&pl->in_fd);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+enum {
+  PIPELINE_PROCESSES = 0,
+  PIPELINE_STDIN,
+  PIPELINE_STDOUT,
+};
+
+static JSValue
+js_pipeline_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  Pipeline* pl;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(pl = js_pipeline_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case PIPELINE_PROCESSES: {
+      ret = JS_NewArray(ctx);
+
+      for(int i = 0; i < pl->num_procs; i++)
+        JS_SetPropertyUint32(ctx, ret, i, JS_DupValue(ctx, pl->procs[i]));
+
+      break;
+    }
+
+    case PIPELINE_STDIN: {
+      ret = pl->in_fd >= 0 ? JS_NewInt32(ctx, pl->in_fd) : JS_NULL;
+      break;
+    }
+
+    case PIPELINE_STDOUT: {
+      ret = pl->out_fd >= 0 ? JS_NewInt32(ctx, pl->out_fd) : JS_NULL;
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static void
+js_pipeline_finalizer(JSRuntime* rt, JSValue val) {
+  Pipeline* pl;
+
+  if((pl = JS_GetOpaque(val, js_pipeline_class_id))) {
+    for(int i = 0; i < pl->num_procs; i++)
+      JS_FreeValueRT(rt, pl->procs[i]);
+
+    if(pl->procs)
+      js_free_rt(rt, pl->procs);
+
+    pipeline_close(&pl->in_fd);
+    pipeline_close(&pl->out_fd);
+    pipeline_close(&pl->src_fd);
+    pipeline_close(&pl->tee_fd);
+
+    JS_FreeValueRT(rt, pl->promise);
+    js_free_rt(rt, pl);
+  }
+}
+
+static JSClassDef js_pipeline_class = {
+    .class_name = "Pipeline",
+    .finalizer = js_pipeline_finalizer,
+};
+
+static const JSCFunctionListEntry js_pipeline_proto_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("read", 2, js_pipeline_method, PIPELINE_READ),
+    JS_CFUNC_MAGIC_DEF("splice", 1, js_pipeline_method, PIPELINE_SPLICE_TO),
+    JS_CFUNC_MAGIC_DEF("wait", 0, js_pipeline_method, PIPELINE_WAIT),
+    JS_CFUNC_MAGIC_DEF("kill", 0, js_pipeline_method, PIPELINE_KILL),
+    JS_CFUNC_MAGIC_DEF("close", 0, js_pipeline_method, PIPELINE_CLOSE),
+    JS_CGETSET_ENUMERABLE_DEF("processes", js_pipeline_get, 0, PIPELINE_PROCESSES),
+    JS_CGETSET_ENUMERABLE_DEF("stdin", js_pipeline_get, 0, PIPELINE_STDIN),
+    JS_CGETSET_ENUMERABLE_DEF("stdout", js_pipeline_get, 0, PIPELINE_STDOUT),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Pipeline", 0),
+};
+
 static JSValue
 js_child_process_get(JSContext* ctx, JSValueConst this_val, int magic) {
   ChildProcess* cp;
@@ -405,6 +988,11 @@ js_child_process_get(JSContext* ctx, JSValueConst this_val, int magic) {
       ret = js_is_null_or_undefined(cp->onexit) ? JS_NULL : JS_DupValue(ctx, cp->onexit);
       break;
     }
+
+    case CHILD_PROCESS_DONE: {
+      ret = child_process_done(ctx, cp);
+      break;
+    }
   }
 
   return ret;
@@ -428,7 +1016,7 @@ js_child_process_set(JSContext* ctx, JSValueConst this_val, JSValueConst value,
   return JS_UNDEFINED;
 }
 
-/* Blocking wait for the child to change state; callers wanting async notification should use `onExit` instead. */
+/* Blocking wait for the child to change state; callers wanting async notification should use `onExit` or `done` instead. */
 static JSValue
 js_child_process_wait(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
   ChildProcess* cp;
@@ -443,19 +1031,20 @@ js_child_process_wait(JSContext* ctx, JSValueConst this_val, int argc, JSValueCo
   if(!cp->exited && !cp->signaled) {
     int pid;
 
-    if((pid = child_process_wait(cp, flags)) != -1 && pid == cp->pid) {
+    if((pid = child_process_wait(cp, flags)) != -1 && pid == cp->pid && (cp->exited || cp->signaled)) {
+      js_child_process_unwatch(ctx, cp);
       child_process_remove(cp, ctx);
       child_process_notify(ctx, cp);
+    } else if(pid == -1 && errno == ECHILD) {
+      child_process_lost(cp, ctx);
+      js_child_process_unwatch(ctx, cp);
     }
   }
 
   if(!cp->exited && !cp->signaled)
     return JS_NULL;
 
-  JSValue ret = JS_NewObjectProto(ctx, JS_NULL);
-  JS_SetPropertyStr(ctx, ret, "exitCode", child_process_exitcode(ctx, cp));
-  JS_SetPropertyStr(ctx, ret, "signalCode", child_process_signalcode(ctx, cp));
-  return ret;
+  return child_process_exitstatus(ctx, cp);
 }
 
 static JSValue
@@ -541,6 +1130,7 @@ static const JSCFunctionListEntry js_child_process_proto_funcs[] = {
     JS_CGETSET_ENUMERABLE_DEF("signalCode", js_child_process_get, 0, CHILD_PROCESS_SIGNALCODE),
     JS_CGETSET_ENUMERABLE_DEF("killed", js_child_process_get, 0, CHILD_PROCESS_KILLED),
     JS_CGETSET_ENUMERABLE_DEF("onExit", js_child_process_get, js_child_process_set, CHILD_PROCESS_ONEXIT),
+    JS_CGETSET_MAGIC_DEF("done", js_child_process_get, 0, CHILD_PROCESS_DONE),
     JS_CFUNC_DEF("wait", 0, js_child_process_wait),
     JS_CFUNC_MAGIC_DEF("kill", 0, js_child_process_kill, 0),
     JS_CFUNC_MAGIC_DEF("[Symbol.toPrimitive]", 0, js_child_process_method, CHILD_PROCESS_TOPRIMITIVE),
@@ -551,6 +1141,7 @@ static const JSCFunctionListEntry js_child_process_funcs[] = {
     JS_CFUNC_MAGIC_DEF("exec", 1, js_child_process_exec, 0),       JS_CFUNC_MAGIC_DEF("execSync", 1, js_child_process_exec, 1),
     JS_CFUNC_MAGIC_DEF("spawn", 1, js_child_process_spawn, 0),     JS_CFUNC_MAGIC_DEF("spawnSync", 1, js_child_process_spawn, 1),
     JS_CFUNC_MAGIC_DEF("kill", 1, js_child_process_kill, 1),
+    JS_CFUNC_DEF("pipeline", 1, js_child_process_pipeline),
 
     JS_PROP_INT32_DEF("WNOHANG", WNOHANG, JS_PROP_ENUMERABLE),
 #ifdef WNOWAIT
@@ -589,6 +1180,13 @@ js_child_process_init(JSContext* ctx, JSModuleDef* m) {
   child_process_ctor = JS_NewCFunction2(ctx, js_child_process_constructor, "ChildProcess", 1, JS_CFUNC_constructor, 0);
 
   JS_SetConstructor(ctx, child_process_ctor, child_process_proto);
+
+  JS_NewClassID(&js_pipeline_class_id);
+  JS_NewClass(JS_GetRuntime(ctx), js_pipeline_class_id, &js_pipeline_class);
+
+  pipeline_proto = JS_NewObject(ctx);
+  JS_SetPropertyFunctionList(ctx, pipeline_proto, js_pipeline_proto_funcs, countof(js_pipeline_proto_funcs));
+  JS_SetClassProto(ctx, js_pipeline_class_id, pipeline_proto);
   JS_SetPropertyFunctionList(ctx, child_process_ctor, js_child_process_funcs, countof(js_child_process_funcs));
 
   if(m) {
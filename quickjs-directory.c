@@ -5,6 +5,20 @@
 #include <errno.h>
 #include <string.h>
 
+#if !(defined(_WIN32) || defined(__MSYS__) || defined(__CYGWIN__))
+#define DIRECTORY_AT 1
+#include "glob-set.h"
+#include "js-utils.h"
+#include "path.h"
+#include "thread-pool.h"
+#include "watcher.h"
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 /**
  * \defgroup quickjs-directory quickjs-directory: Directory reader
  * @{
@@ -207,8 +221,301 @@ enum {
   DIRECTORY_NEXT,
   DIRECTORY_RETURN,
   DIRECTORY_THROW,
+  DIRECTORY_READ_BATCH,
+};
+
+#ifdef DIRECTORY_AT
+#define DIRECTORY_BATCH_SIZE 4096
+
+enum {
+  STAT_SIZE = 1 << 0,
+  STAT_BLOCKS = 1 << 1,
+  STAT_MTIME = 1 << 2,
+  STAT_MODE = 1 << 3,
+  STAT_INO = 1 << 4,
+  STAT_ALL = STAT_SIZE | STAT_BLOCKS | STAT_MTIME | STAT_MODE | STAT_INO,
 };
 
+/* Metadata of a batch of entries, one column per STAT_* field instead of
+ * an object per entry: 'size', 'blocks' (512 byte units) and 'mtime' (ms)
+ * as float64, 'mode' as uint32, 'ino' as uint64. Entries which can't be
+ * stat'ed get NaN and 0. */
+typedef struct {
+  int mask;
+  DynBuf size, blocks, mtime, mode, ino;
+} StatColumns;
+
+/* entry i is bytes[offsets[i]] up to bytes[offsets[i + 1]], with its
+ * TYPE_* in types[i]. Filled by the walk workers too, so the memory comes
+ * from malloc() and is handed to the ArrayBuffers as it is. */
+typedef struct directory_batch {
+  struct list_head link;
+  DynBuf bytes, offsets, types;
+  StatColumns stat;
+  uint32_t count;
+} DirectoryBatch;
+
+static int
+directory_stat_type(int dirfd, const char* name) {
+  struct stat st;
+
+  if(fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) == -1)
+    return 0;
+
+  switch(st.st_mode & S_IFMT) {
+    case S_IFREG: return TYPE_REG;
+    case S_IFDIR: return TYPE_DIR;
+    case S_IFLNK: return TYPE_LNK;
+    case S_IFBLK: return TYPE_BLK;
+    case S_IFCHR: return TYPE_CHR;
+    case S_IFIFO: return TYPE_FIFO;
+    case S_IFSOCK: return TYPE_SOCK;
+  }
+
+  return 0;
+}
+
+static DynBuf*
+stat_column(StatColumns* sc, int field) {
+  switch(field) {
+    case STAT_SIZE: return &sc->size;
+    case STAT_BLOCKS: return &sc->blocks;
+    case STAT_MTIME: return &sc->mtime;
+    case STAT_MODE: return &sc->mode;
+    case STAT_INO: return &sc->ino;
+  }
+
+  return 0;
+}
+
+static void
+stat_columns_init(StatColumns* sc, int mask) {
+  sc->mask = mask & STAT_ALL;
+
+  for(int field = STAT_SIZE; field <= STAT_INO; field <<= 1)
+    dbuf_init(stat_column(sc, field));
+}
+
+static void
+stat_columns_free(StatColumns* sc) {
+  for(int field = STAT_SIZE; field <= STAT_INO; field <<= 1)
+    dbuf_free(stat_column(sc, field));
+}
+
+static int
+stat_columns_reserve(StatColumns* sc) {
+  for(int field = STAT_SIZE; field <= STAT_INO; field <<= 1)
+    if(sc->mask & field) {
+      DynBuf* db = stat_column(sc, field);
+
+      if(dbuf_realloc(db, db->size + sizeof(uint64_t)))
+        return -1;
+    }
+
+  return 0;
+}
+
+/* space must have been reserved */
+static void
+stat_columns_put(StatColumns* sc, int dirfd, const char* name) {
+  double size = NAN, blocks = NAN, mtime = NAN;
+  uint32_t mode = 0;
+  uint64_t ino = 0;
+
+#ifdef HAVE_STATX
+  struct statx stx;
+  unsigned int want = ((sc->mask & STAT_SIZE) ? STATX_SIZE : 0) | ((sc->mask & STAT_BLOCKS) ? STATX_BLOCKS : 0) | ((sc->mask & STAT_MTIME) ? STATX_MTIME : 0) |
+                      ((sc->mask & STAT_MODE) ? STATX_MODE | STATX_TYPE : 0) | ((sc->mask & STAT_INO) ? STATX_INO : 0);
+
+  /* only what was asked for, which saves work on network file systems */
+  if(statx(dirfd, name, AT_SYMLINK_NOFOLLOW, want, &stx) == 0) {
+    size = stx.stx_size;
+    blocks = stx.stx_blocks;
+    mtime = stx.stx_mtime.tv_sec * 1000.0 + stx.stx_mtime.tv_nsec / 1000000.0;
+    mode = stx.stx_mode;
+    ino = stx.stx_ino;
+  }
+#else
+  struct stat st;
+
+  if(fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+    size = st.st_size;
+    blocks = st.st_blocks;
+    mtime = st.st_mtime * 1000.0;
+    mode = st.st_mode;
+    ino = st.st_ino;
+  }
+#endif
+
+  if(sc->mask & STAT_SIZE)
+    dbuf_put(&sc->size, (const uint8_t*)&size, sizeof(size));
+
+  if(sc->mask & STAT_BLOCKS)
+    dbuf_put(&sc->blocks, (const uint8_t*)&blocks, sizeof(blocks));
+
+  if(sc->mask & STAT_MTIME)
+    dbuf_put(&sc->mtime, (const uint8_t*)&mtime, sizeof(mtime));
+
+  if(sc->mask & STAT_MODE)
+    dbuf_put(&sc->mode, (const uint8_t*)&mode, sizeof(mode));
+
+  if(sc->mask & STAT_INO)
+    dbuf_put(&sc->ino, (const uint8_t*)&ino, sizeof(ino));
+}
+
+static DirectoryBatch*
+directory_batch_new(int stat) {
+  DirectoryBatch* b;
+
+  if((b = malloc(sizeof(DirectoryBatch)))) {
+    dbuf_init(&b->bytes);
+    dbuf_init(&b->offsets);
+    dbuf_init(&b->types);
+    stat_columns_init(&b->stat, stat);
+    b->count = 0;
+  }
+
+  return b;
+}
+
+static void
+directory_batch_free(DirectoryBatch* b) {
+  dbuf_free(&b->bytes);
+  dbuf_free(&b->offsets);
+  dbuf_free(&b->types);
+  stat_columns_free(&b->stat);
+  free(b);
+}
+
+static void
+directory_batch_reset(DirectoryBatch* b) {
+  b->bytes.size = b->offsets.size = b->types.size = 0;
+
+  for(int field = STAT_SIZE; field <= STAT_INO; field <<= 1)
+    stat_column(&b->stat, field)->size = 0;
+
+  b->count = 0;
+}
+
+/* appends 'path', stat'ing 'name' relative to 'dirfd' when the batch has
+ * stat columns. Everything is reserved first, so a failure leaves the
+ * columns in step */
+static int
+directory_batch_put(DirectoryBatch* b, int dirfd, const char* name, const void* path, size_t len, int type) {
+  uint32_t offset = 0;
+
+  if(dbuf_realloc(&b->bytes, b->bytes.size + len) || dbuf_realloc(&b->offsets, b->offsets.size + 2 * sizeof(offset)) || dbuf_realloc(&b->types, b->types.size + 1) ||
+     stat_columns_reserve(&b->stat))
+    return -1;
+
+  if(b->count == 0)
+    dbuf_put(&b->offsets, (const uint8_t*)&offset, sizeof(offset));
+
+  dbuf_put(&b->bytes, path, len);
+  offset = b->bytes.size;
+  dbuf_put(&b->offsets, (const uint8_t*)&offset, sizeof(offset));
+  dbuf_putc(&b->types, type);
+
+  if(b->stat.mask)
+    stat_columns_put(&b->stat, dirfd, name);
+
+  b->count++;
+  return 0;
+}
+
+static void
+directory_buffer_free(JSRuntime* rt, void* opaque, void* ptr) {
+  free(ptr);
+}
+
+static JSValue
+directory_typedarray(JSContext* ctx, DynBuf* db, int bits, BOOL floating) {
+  JSValue ret, buf = JS_NewArrayBuffer(ctx, db->buf, db->size, directory_buffer_free, 0, FALSE);
+
+  if(JS_IsException(buf))
+    return buf;
+
+  /* the memory now belongs to the ArrayBuffer */
+  dbuf_init(db);
+
+  ret = js_typedarray_new(ctx, bits, floating, FALSE, buf);
+  JS_FreeValue(ctx, buf);
+  return ret;
+}
+
+static JSValue
+directory_batch_value(JSContext* ctx, DirectoryBatch* b) {
+  JSValue ret = JS_NewObjectProto(ctx, JS_NULL);
+  StatColumns* sc = &b->stat;
+
+  JS_SetPropertyStr(ctx, ret, "length", JS_NewUint32(ctx, b->count));
+  JS_SetPropertyStr(ctx, ret, "offsets", directory_typedarray(ctx, &b->offsets, 32, FALSE));
+  JS_SetPropertyStr(ctx, ret, "bytes", directory_typedarray(ctx, &b->bytes, 8, FALSE));
+  JS_SetPropertyStr(ctx, ret, "types", directory_typedarray(ctx, &b->types, 8, FALSE));
+
+  if(sc->mask & STAT_SIZE)
+    JS_SetPropertyStr(ctx, ret, "size", directory_typedarray(ctx, &sc->size, 64, TRUE));
+
+  if(sc->mask & STAT_BLOCKS)
+    JS_SetPropertyStr(ctx, ret, "blocks", directory_typedarray(ctx, &sc->blocks, 64, TRUE));
+
+  if(sc->mask & STAT_MTIME)
+    JS_SetPropertyStr(ctx, ret, "mtime", directory_typedarray(ctx, &sc->mtime, 64, TRUE));
+
+  if(sc->mask & STAT_MODE)
+    JS_SetPropertyStr(ctx, ret, "mode", directory_typedarray(ctx, &sc->mode, 32, FALSE));
+
+  if(sc->mask & STAT_INO)
+    JS_SetPropertyStr(ctx, ret, "ino", directory_typedarray(ctx, &sc->ino, 64, FALSE));
+
+  return ret;
+}
+
+/* the next entries of 'directory' as one batch, null at the end */
+static JSValue
+directory_read_batch(JSContext* ctx, Directory* directory, uint32_t count, int mask, int stat) {
+  DirectoryBatch* b;
+  DirEntry* entry;
+  JSValue ret;
+  int fd = getdents_handle(directory);
+
+  if(fd == -1)
+    return JS_NULL;
+
+  if(!(b = directory_batch_new(stat)))
+    return JS_ThrowOutOfMemory(ctx);
+
+  while(b->count < count && (entry = getdents_read(directory))) {
+    const char* name = getdents_cname(entry);
+    int type;
+
+    if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+      continue;
+
+    if(!(type = getdents_type(entry)))
+      type = directory_stat_type(fd, name);
+
+    if((type & mask) == 0)
+      continue;
+
+    if(directory_batch_put(b, fd, name, name, strlen(name), type)) {
+      directory_batch_free(b);
+      return JS_ThrowOutOfMemory(ctx);
+    }
+  }
+
+  if(b->count == 0) {
+    getdents_close(directory);
+    ret = JS_NULL;
+  } else {
+    ret = directory_batch_value(ctx, b);
+  }
+
+  directory_batch_free(b);
+  return ret;
+}
+#endif /* DIRECTORY_AT */
+
 static JSValue
 directory_namebuf(JSContext* ctx, DirEntry* entry) {
   size_t len = 0;
@@ -431,6 +738,23 @@ js_directory_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueCons
       ret = JS_Throw(ctx, argv[0]);
       break;
     }
+
+#ifdef DIRECTORY_AT
+    case DIRECTORY_READ_BATCH: {
+      int32_t* opts = ((int32_t*)((char*)directory + getdents_size()));
+      uint32_t count = DIRECTORY_BATCH_SIZE;
+      int32_t stat = 0;
+
+      if(argc > 0 && JS_IsNumber(argv[0]))
+        JS_ToUint32(ctx, &count, argv[0]);
+
+      if(argc > 1)
+        JS_ToInt32(ctx, &stat, argv[1]);
+
+      ret = directory_read_batch(ctx, directory, count ? count : 1, opts[1], stat);
+      break;
+    }
+#endif
   }
 
   return ret;
@@ -459,6 +783,9 @@ static const JSCFunctionListEntry js_directory_funcs[] = {
     JS_CFUNC_MAGIC_DEF("next", 0, js_directory_method, DIRECTORY_NEXT),
     JS_CFUNC_MAGIC_DEF("return", 0, js_directory_method, DIRECTORY_RETURN),
     JS_CFUNC_MAGIC_DEF("throw", 1, js_directory_method, DIRECTORY_THROW),
+#ifdef DIRECTORY_AT
+    JS_CFUNC_MAGIC_DEF("readBatch", 0, js_directory_method, DIRECTORY_READ_BATCH),
+#endif
     JS_CFUNC_MAGIC_DEF("[Symbol.iterator]", 0, js_directory_method, DIRECTORY_ITERATOR),
     JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Directory", JS_PROP_CONFIGURABLE),
 };
@@ -475,49 +802,1102 @@ static const JSCFunctionListEntry js_directory_static[] = {
     JS_PROP_INT32_DEF("TYPE_REG", TYPE_REG, JS_PROP_ENUMERABLE),
     JS_PROP_INT32_DEF("TYPE_SOCK", TYPE_SOCK, JS_PROP_ENUMERABLE),
     JS_PROP_INT32_DEF("TYPE_MASK", TYPE_MASK, JS_PROP_ENUMERABLE),
+#ifdef DIRECTORY_AT
+    JS_PROP_INT32_DEF("STAT_SIZE", STAT_SIZE, JS_PROP_ENUMERABLE),
+    JS_PROP_INT32_DEF("STAT_BLOCKS", STAT_BLOCKS, JS_PROP_ENUMERABLE),
+    JS_PROP_INT32_DEF("STAT_MTIME", STAT_MTIME, JS_PROP_ENUMERABLE),
+    JS_PROP_INT32_DEF("STAT_MODE", STAT_MODE, JS_PROP_ENUMERABLE),
+    JS_PROP_INT32_DEF("STAT_INO", STAT_INO, JS_PROP_ENUMERABLE),
+    JS_PROP_INT32_DEF("STAT_ALL", STAT_ALL, JS_PROP_ENUMERABLE),
+#endif
 };
 
-int
-js_directory_init(JSContext* ctx, JSModuleDef* m) {
-  JS_NewClassID(&js_directory_class_id);
-  JS_NewClass(JS_GetRuntime(ctx), js_directory_class_id, &js_directory_class);
+#ifdef DIRECTORY_AT
+/*
+ * walk(root, options) reads the tree below 'root' on the thread pool. Every
+ * job pops directories off a shared stack, opens them with openat() relative
+ * to the root and reads them with getdents_read(), packing the entries which
+ * pass the filters into a batch. It returns to the event loop once the batch
+ * is full or the stack is empty, a partly read directory stays open for its
+ * next round. The type comes from d_type, fstatat() is only needed where the
+ * file system reports DT_UNKNOWN.
+ */
+#define WALK_HIGH_WATER 4
 
-  directory_ctor = JS_NewCFunction2(ctx, js_directory_constructor, "Directory", 1, JS_CFUNC_constructor, 0);
-  JSValue generator_proto = js_generator_prototype(ctx);
-  // directory_proto = JS_NewObjectProto(ctx, generator_proto);
-  directory_proto = JS_NewObject(ctx);
-  JS_FreeValue(ctx, generator_proto);
+typedef struct {
+  char* path;
+  uint32_t depth;
+} WalkDir;
 
-  JS_SetPropertyFunctionList(ctx, directory_proto, js_directory_funcs, countof(js_directory_funcs));
-  JS_SetPropertyFunctionList(ctx, directory_proto, js_directory_static, countof(js_directory_static));
-  JS_SetPropertyFunctionList(ctx, directory_ctor, js_directory_static, countof(js_directory_static));
+typedef struct directory_walk DirectoryWalk;
 
-  JS_SetClassProto(ctx, js_directory_class_id, directory_proto);
-  JS_SetConstructor(ctx, directory_ctor, directory_proto);
+typedef struct {
+  ThreadJob job;
+  DirectoryWalk* walk;
+  Directory* dir;
+  WalkDir cur;
+  DirectoryBatch* batch;
+  DynBuf path;
+  BOOL running;
+} WalkJob;
+
+typedef struct {
+  struct list_head link;
+  ResolveFunctions funcs;
+  JSValue this_obj;
+} WalkRequest;
+
+struct directory_walk {
+  pthread_mutex_t lock;
+  WalkDir* stack;
+  size_t stack_size, stack_capacity;
+  uint32_t errors;
+  /* not modified while jobs are running */
+  int root, mask, stat;
+  uint32_t max_depth, batch_size;
+  GlobSet *include, *exclude;
+  /* only used on the JS thread */
+  WalkJob* jobs;
+  int num_jobs, running;
+  struct list_head batches, requests;
+  uint32_t queued;
+  BOOL closed, finalized;
+};
 
-  if(m) {
-    JS_SetModuleExport(ctx, m, "Directory", directory_ctor);
-    JS_SetModuleExport(ctx, m, "default", directory_ctor);
-    JS_SetModuleExportList(ctx, m, js_directory_static, countof(js_directory_static));
+static JSClassID js_walk_class_id = 0;
+static JSValue walk_proto;
+
+static void
+walk_error(DirectoryWalk* w) {
+  pthread_mutex_lock(&w->lock);
+  w->errors++;
+  pthread_mutex_unlock(&w->lock);
+}
+
+static int
+walk_push(DirectoryWalk* w, char* path, uint32_t depth) {
+  int ret = 0;
+
+  pthread_mutex_lock(&w->lock);
+
+  if(w->stack_size == w->stack_capacity) {
+    size_t n = w->stack_capacity ? w->stack_capacity * 2 : 64;
+    WalkDir* stack;
+
+    if((stack = realloc(w->stack, n * sizeof(WalkDir)))) {
+      w->stack = stack;
+      w->stack_capacity = n;
+    } else {
+      ret = -1;
+    }
+  }
+
+  if(ret == 0)
+    w->stack[w->stack_size++] = (WalkDir){path, depth};
+
+  pthread_mutex_unlock(&w->lock);
+  return ret;
+}
+
+static BOOL
+walk_pop(DirectoryWalk* w, WalkDir* d) {
+  BOOL ret;
+
+  pthread_mutex_lock(&w->lock);
+
+  if((ret = w->stack_size > 0))
+    *d = w->stack[--w->stack_size];
+
+  pthread_mutex_unlock(&w->lock);
+  return ret;
+}
+
+static size_t
+walk_stacked(DirectoryWalk* w) {
+  size_t ret;
+
+  pthread_mutex_lock(&w->lock);
+  ret = w->stack_size;
+  pthread_mutex_unlock(&w->lock);
+
+  return ret;
+}
+
+/* on a worker thread: opens the next directory from the stack */
+static BOOL
+walk_open(WalkJob* job) {
+  DirectoryWalk* w = job->walk;
+  int fd;
+
+  while(walk_pop(w, &job->cur)) {
+    if((fd = openat(w->root, job->cur.path[0] ? job->cur.path : ".", O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)) != -1) {
+      if(!getdents_adopt(job->dir, fd))
+        return TRUE;
+
+      close(fd);
+    }
+
+    walk_error(w);
+    free(job->cur.path);
+    job->cur.path = 0;
+  }
+
+  return FALSE;
+}
+
+static void
+walk_entry(WalkJob* job, DirEntry* e) {
+  DirectoryWalk* w = job->walk;
+  const char *name = getdents_cname(e), *path;
+  size_t len, namelen = strlen(name);
+  int type;
+
+  if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+    return;
+
+  if(!(type = getdents_type(e)))
+    type = directory_stat_type(getdents_handle(job->dir), name);
+
+  job->path.size = 0;
+
+  if(job->cur.path[0]) {
+    dbuf_putstr(&job->path, job->cur.path);
+    dbuf_putc(&job->path, '/');
+  }
+
+  dbuf_put(&job->path, (const uint8_t*)name, namelen);
+
+  if(job->path.error) {
+    job->path.error = FALSE;
+    walk_error(w);
+    return;
+  }
+
+  path = (const char*)job->path.buf;
+  len = job->path.size;
+
+  /* excluded directories aren't descended into */
+  if(w->exclude && globset_test(w->exclude, path, len) > 0)
+    return;
+
+  if(type == TYPE_DIR && job->cur.depth + 1 < w->max_depth) {
+    char* dir;
+
+    if(!(dir = strndup(path, len)) || walk_push(w, dir, job->cur.depth + 1)) {
+      free(dir);
+      walk_error(w);
+    }
+  }
+
+  if((type & w->mask) && (!w->include || globset_test(w->include, path, len) > 0))
+    if(directory_batch_put(job->batch, getdents_handle(job->dir), name, path, len, type))
+      walk_error(w);
+}
+
+static void
+walk_job_work(ThreadJob* ptr) {
+  WalkJob* job = (WalkJob*)ptr;
+  DirectoryWalk* w = job->walk;
+  DirectoryBatch* b = job->batch;
+  DirEntry* e;
+
+  while(b->count < w->batch_size) {
+    if(!job->cur.path && !walk_open(job))
+      break;
+
+    while(b->count < w->batch_size && (e = getdents_read(job->dir)))
+      walk_entry(job, e);
+
+    /* a full batch may leave the directory for the next round */
+    if(b->count < w->batch_size) {
+      getdents_close(job->dir);
+      free(job->cur.path);
+      job->cur.path = 0;
+    }
+  }
+}
+
+static void walk_job_done(JSContext*, ThreadJob*);
+
+/* (re)submits the jobs which have work, unless enough batches are waiting */
+static int
+walk_schedule(JSContext* ctx, DirectoryWalk* w) {
+  size_t stacked;
+
+  if(w->closed)
+    return 0;
+
+  stacked = walk_stacked(w);
+
+  for(int i = 0; i < w->num_jobs && w->queued < WALK_HIGH_WATER; i++) {
+    WalkJob* job = &w->jobs[i];
+
+    if(job->running)
+      continue;
+
+    if(!job->cur.path) {
+      if(stacked == 0)
+        continue;
+
+      --stacked;
+    }
+
+    if(!job->batch && !(job->batch = directory_batch_new(w->stat))) {
+      JS_ThrowOutOfMemory(ctx);
+      return -1;
+    }
+
+    if(thread_pool_submit(ctx, &job->job, THREAD_LANE_ANY))
+      return -1;
+
+    job->running = TRUE;
+    ++w->running;
   }
 
   return 0;
 }
 
-#ifdef JS_SHARED_LIBRARY
-#define JS_INIT_MODULE js_init_module
-#else
-#define JS_INIT_MODULE js_init_module_directory
-#endif
+static BOOL
+walk_finished(DirectoryWalk* w) {
+  if(w->running > 0)
+    return FALSE;
 
-VISIBLE JSModuleDef*
-JS_INIT_MODULE(JSContext* ctx, const char* module_name) {
-  JSModuleDef* m;
+  for(int i = 0; i < w->num_jobs; i++)
+    if(w->jobs[i].cur.path)
+      return FALSE;
 
-  if((m = JS_NewCModule(ctx, module_name, js_directory_init))) {
-    JS_AddModuleExport(ctx, m, "Directory");
-    JS_AddModuleExport(ctx, m, "default");
-    JS_AddModuleExportList(ctx, m, js_directory_static, countof(js_directory_static));
+  return walk_stacked(w) == 0;
+}
+
+/* settles the pending next() calls with the batches read so far */
+static void
+walk_deliver(JSContext* ctx, DirectoryWalk* w) {
+  BOOL taken = FALSE;
+
+  while(!list_empty(&w->requests)) {
+    WalkRequest* req = list_entry(w->requests.next, WalkRequest, link);
+    JSValue value = JS_UNDEFINED, result;
+    BOOL done = FALSE;
+
+    if(!list_empty(&w->batches)) {
+      DirectoryBatch* b = list_entry(w->batches.next, DirectoryBatch, link);
+
+      list_del(&b->link);
+      --w->queued;
+      taken = TRUE;
+
+      value = directory_batch_value(ctx, b);
+      directory_batch_free(b);
+    } else if(w->closed || walk_finished(w)) {
+      done = TRUE;
+    } else {
+      break;
+    }
+
+    list_del(&req->link);
+
+    result = js_iterator_result(ctx, value, done);
+    promise_resolve(ctx, &req->funcs, result);
+    JS_FreeValue(ctx, result);
+    JS_FreeValue(ctx, value);
+
+    JS_FreeValue(ctx, req->this_obj);
+    js_free(ctx, req);
+  }
+
+  if(taken && walk_schedule(ctx, w))
+    JS_FreeValue(ctx, JS_GetException(ctx));
+}
+
+/* stops reading, jobs still running are left to finish their round */
+static void
+walk_close(JSRuntime* rt, DirectoryWalk* w) {
+  w->closed = TRUE;
+
+  while(!list_empty(&w->batches)) {
+    DirectoryBatch* b = list_entry(w->batches.next, DirectoryBatch, link);
+
+    list_del(&b->link);
+    directory_batch_free(b);
+  }
+
+  w->queued = 0;
+
+  pthread_mutex_lock(&w->lock);
+
+  while(w->stack_size)
+    free(w->stack[--w->stack_size].path);
+
+  pthread_mutex_unlock(&w->lock);
+
+  for(int i = 0; i < w->num_jobs; i++) {
+    WalkJob* job = &w->jobs[i];
+
+    if(!job->running && job->cur.path) {
+      getdents_close(job->dir);
+      free(job->cur.path);
+      job->cur.path = 0;
+    }
+  }
+}
+
+static void
+walk_free(JSRuntime* rt, DirectoryWalk* w) {
+  walk_close(rt, w);
+
+  for(int i = 0; i < w->num_jobs; i++) {
+    WalkJob* job = &w->jobs[i];
+
+    if(job->batch)
+      directory_batch_free(job->batch);
+
+    dbuf_free(&job->path);
+    free(job->dir);
+  }
+
+  js_free_rt(rt, w->jobs);
+  free(w->stack);
+
+  if(w->include)
+    globset_free(w->include);
+  if(w->exclude)
+    globset_free(w->exclude);
+
+  if(w->root != -1)
+    close(w->root);
+
+  pthread_mutex_destroy(&w->lock);
+  js_free_rt(rt, w);
+}
+
+/* on the JS thread, after a job's round */
+static void
+walk_job_done(JSContext* ctx, ThreadJob* ptr) {
+  WalkJob* job = (WalkJob*)ptr;
+  DirectoryWalk* w = job->walk;
+
+  job->running = FALSE;
+  --w->running;
+
+  if(w->finalized) {
+    if(w->running == 0)
+      walk_free(JS_GetRuntime(ctx), w);
+
+    return;
+  }
+
+  if(job->batch->count && !w->closed) {
+    list_add_tail(&job->batch->link, &w->batches);
+    ++w->queued;
+    job->batch = 0;
+  } else {
+    directory_batch_reset(job->batch);
+  }
+
+  if(w->closed)
+    walk_close(JS_GetRuntime(ctx), w);
+  else if(walk_schedule(ctx, w))
+    JS_FreeValue(ctx, JS_GetException(ctx));
+
+  walk_deliver(ctx, w);
+}
+
+/* compiles a pattern, an array of them or a GlobSet (anything with a
+ * 'patterns' array) */
+static int
+walk_patterns(JSContext* ctx, JSValueConst value, GlobSet** set) {
+  JSValue patterns;
+  int64_t i, len;
+  int ret = 0;
+
+  if(js_is_null_or_undefined(value))
+    return 0;
+
+  if(JS_IsArray(ctx, value) || !JS_IsObject(value))
+    patterns = JS_DupValue(ctx, value);
+  else
+    patterns = JS_GetPropertyStr(ctx, value, "patterns");
+
+  if(!(*set = globset_new())) {
+    JS_FreeValue(ctx, patterns);
+    JS_ThrowOutOfMemory(ctx);
+    return -1;
+  }
+
+  len = JS_IsArray(ctx, patterns) ? js_array_length(ctx, patterns) : -1;
+
+  for(i = len < 0 ? -1 : 0; i < len && ret == 0; i++) {
+    JSValue pattern = i < 0 ? JS_DupValue(ctx, patterns) : JS_GetPropertyUint32(ctx, patterns, i);
+    const char* str;
+    size_t n;
+
+    if(!(str = JS_ToCStringLen(ctx, &n, pattern))) {
+      ret = -1;
+    } else if(globset_add(*set, str, n) == -1) {
+      JS_ThrowInternalError(ctx, "walk: failed adding pattern '%s': %s", str, strerror(errno));
+      ret = -1;
+    }
+
+    JS_FreeCString(ctx, str);
+    JS_FreeValue(ctx, pattern);
+  }
+
+  JS_FreeValue(ctx, patterns);
+  return ret;
+}
+
+static int
+walk_options(JSContext* ctx, DirectoryWalk* w, JSValueConst options, int32_t* concurrency) {
+  JSValue value;
+  int ret;
+
+  value = JS_GetPropertyStr(ctx, options, "include");
+  ret = walk_patterns(ctx, value, &w->include);
+  JS_FreeValue(ctx, value);
+
+  if(ret)
+    return ret;
+
+  value = JS_GetPropertyStr(ctx, options, "exclude");
+  ret = walk_patterns(ctx, value, &w->exclude);
+  JS_FreeValue(ctx, value);
+
+  if(ret)
+    return ret;
+
+  value = JS_GetPropertyStr(ctx, options, "maxDepth");
+  if(JS_IsNumber(value))
+    JS_ToUint32(ctx, &w->max_depth, value);
+  JS_FreeValue(ctx, value);
+
+  value = JS_GetPropertyStr(ctx, options, "types");
+  if(JS_IsNumber(value))
+    JS_ToInt32(ctx, &w->mask, value);
+  JS_FreeValue(ctx, value);
+
+  value = JS_GetPropertyStr(ctx, options, "stat");
+  if(JS_IsNumber(value))
+    JS_ToInt32(ctx, &w->stat, value);
+  JS_FreeValue(ctx, value);
+
+  value = JS_GetPropertyStr(ctx, options, "batchSize");
+  if(JS_IsNumber(value))
+    JS_ToUint32(ctx, &w->batch_size, value);
+  JS_FreeValue(ctx, value);
+
+  value = JS_GetPropertyStr(ctx, options, "concurrency");
+  if(JS_IsNumber(value))
+    JS_ToInt32(ctx, concurrency, value);
+  JS_FreeValue(ctx, value);
+
+  if(w->batch_size == 0)
+    w->batch_size = 1;
+
+  if(*concurrency < 1)
+    *concurrency = 1;
+
+  return 0;
+}
+
+static JSValue
+js_directory_walk(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  DirectoryWalk* w;
+  const char* root;
+  int32_t concurrency;
+  char* top;
+  JSValue obj;
+
+  if((concurrency = thread_pool_size()) == 0)
+    return JS_ThrowInternalError(ctx, "walk: failed starting worker threads");
+
+  if(!(w = js_mallocz(ctx, sizeof(DirectoryWalk))))
+    return JS_EXCEPTION;
+
+  pthread_mutex_init(&w->lock, 0);
+  init_list_head(&w->batches);
+  init_list_head(&w->requests);
+  w->root = -1;
+  w->mask = TYPE_MASK;
+  w->max_depth = UINT32_MAX;
+  w->batch_size = DIRECTORY_BATCH_SIZE;
+
+  obj = JS_NewObjectProtoClass(ctx, walk_proto, js_walk_class_id);
+
+  if(JS_IsException(obj)) {
+    js_free(ctx, w);
+    return obj;
+  }
+
+  /* from here on the finalizer cleans up */
+  JS_SetOpaque(obj, w);
+
+  if(!(root = JS_ToCString(ctx, argv[0])))
+    goto fail;
+
+  w->root = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+  if(w->root == -1) {
+    JS_ThrowInternalError(ctx, "walk(%s) failed: %s", root, strerror(errno));
+    JS_FreeCString(ctx, root);
+    goto fail;
+  }
+
+  JS_FreeCString(ctx, root);
+
+  if(argc > 1 && JS_IsObject(argv[1]) && walk_options(ctx, w, argv[1], &concurrency))
+    goto fail;
+
+  if(!(w->jobs = js_mallocz(ctx, sizeof(WalkJob) * concurrency)))
+    goto fail;
+
+  for(w->num_jobs = 0; w->num_jobs < concurrency; w->num_jobs++) {
+    WalkJob* job = &w->jobs[w->num_jobs];
+
+    job->job.work = walk_job_work;
+    job->job.done = walk_job_done;
+    job->walk = w;
+    dbuf_init(&job->path);
+
+    if(!(job->dir = getdents_new())) {
+      JS_ThrowOutOfMemory(ctx);
+      goto fail;
+    }
+  }
+
+  if(!(top = strdup("")) || walk_push(w, top, 0)) {
+    free(top);
+    JS_ThrowOutOfMemory(ctx);
+    goto fail;
+  }
+
+  if(walk_schedule(ctx, w))
+    goto fail;
+
+  return obj;
+
+fail:
+  JS_FreeValue(ctx, obj);
+  return JS_EXCEPTION;
+}
+
+enum {
+  WALK_NEXT = 0,
+  WALK_RETURN,
+  WALK_ITERATOR,
+};
+
+static JSValue
+js_walk_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  DirectoryWalk* w;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(w = JS_GetOpaque2(ctx, this_val, js_walk_class_id)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case WALK_NEXT: {
+      WalkRequest* req;
+
+      if(!(req = js_malloc(ctx, sizeof(WalkRequest))))
+        return JS_EXCEPTION;
+
+      ret = promise_create(ctx, &req->funcs);
+      req->this_obj = JS_DupValue(ctx, this_val);
+      list_add_tail(&req->link, &w->requests);
+
+      walk_deliver(ctx, w);
+      break;
+    }
+
+    case WALK_RETURN: {
+      JSValue result = js_iterator_result(ctx, argc > 0 ? argv[0] : JS_UNDEFINED, TRUE);
+
+      walk_close(JS_GetRuntime(ctx), w);
+      walk_deliver(ctx, w);
+
+      ret = js_promise_resolve(ctx, result);
+      JS_FreeValue(ctx, result);
+      break;
+    }
+
+    case WALK_ITERATOR: {
+      ret = JS_DupValue(ctx, this_val);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static JSValue
+js_walk_errors(JSContext* ctx, JSValueConst this_val) {
+  DirectoryWalk* w;
+  uint32_t errors;
+
+  if(!(w = JS_GetOpaque2(ctx, this_val, js_walk_class_id)))
+    return JS_EXCEPTION;
+
+  pthread_mutex_lock(&w->lock);
+  errors = w->errors;
+  pthread_mutex_unlock(&w->lock);
+
+  return JS_NewUint32(ctx, errors);
+}
+
+static void
+js_walk_finalizer(JSRuntime* rt, JSValue val) {
+  DirectoryWalk* w;
+
+  if((w = JS_GetOpaque(val, js_walk_class_id))) {
+    w->finalized = TRUE;
+
+    if(w->running == 0)
+      walk_free(rt, w);
+    else
+      walk_close(rt, w);
+  }
+}
+
+static JSClassDef js_walk_class = {
+    .class_name = "DirectoryWalk",
+    .finalizer = js_walk_finalizer,
+};
+
+static const JSCFunctionListEntry js_walk_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("next", 0, js_walk_method, WALK_NEXT),
+    JS_CFUNC_MAGIC_DEF("return", 0, js_walk_method, WALK_RETURN),
+    JS_CFUNC_MAGIC_DEF("[Symbol.asyncIterator]", 0, js_walk_method, WALK_ITERATOR),
+    JS_CGETSET_DEF("errors", js_walk_errors, 0),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "DirectoryWalk", JS_PROP_CONFIGURABLE),
+};
+
+static const JSCFunctionListEntry js_directory_walk_funcs[] = {
+    JS_CFUNC_DEF("walk", 1, js_directory_walk),
+};
+#endif /* DIRECTORY_AT */
+
+#if HAVE_INOTIFY_INIT1
+/*
+ * Watcher(paths, callback, options) watches directory trees with the core in
+ * watcher.c: the inotify fd and the timer fd of the Watcher get read handlers
+ * on the event loop, events are merged in C and 'callback' gets an array of
+ * them once they are due. The handlers keep the object alive until close().
+ */
+typedef struct {
+  Watcher* watcher;
+  JSValue callback;
+  BOOL watched;
+} JSWatcher;
+
+enum {
+  WATCHER_READ = 0,
+  WATCHER_TIMER,
+};
+
+static JSClassID js_watcher_class_id = 0;
+static JSValue watcher_proto, watcher_ctor;
+
+static const char* const watcher_types[] = {
+    0,
+    "create",
+    "change",
+    "delete",
+    "rename",
+    "rescan",
+};
+
+static inline JSWatcher*
+js_watcher_data2(JSContext* ctx, JSValueConst value) {
+  return JS_GetOpaque2(ctx, value, js_watcher_class_id);
+}
+
+static JSValue
+js_watcher_events(JSContext* ctx, WatchEvent* events, size_t n) {
+  JSValue ret = JS_NewArray(ctx);
+
+  for(size_t i = 0; i < n; i++) {
+    JSValue ev = JS_NewObject(ctx);
+
+    JS_SetPropertyStr(ctx, ev, "type", JS_NewString(ctx, watcher_types[events[i].type]));
+    JS_SetPropertyStr(ctx, ev, "path", JS_NewString(ctx, events[i].path));
+
+    if(events[i].from)
+      JS_SetPropertyStr(ctx, ev, "from", JS_NewString(ctx, events[i].from));
+
+    JS_SetPropertyStr(ctx, ev, "directory", JS_NewBool(ctx, events[i].directory));
+    JS_SetPropertyUint32(ctx, ret, i, ev);
+  }
+
+  return ret;
+}
+
+static JSValue
+js_watcher_handler(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, JSValue data[]) {
+  JSWatcher* jw;
+  WatchEvent* events;
+  JSValue callback, arg, ret;
+  size_t n;
+
+  if(!(jw = js_watcher_data2(ctx, data[0])))
+    return JS_EXCEPTION;
+
+  if(!jw->watcher)
+    return JS_UNDEFINED;
+
+  if(magic == WATCHER_READ) {
+    watcher_read(jw->watcher);
+    return JS_UNDEFINED;
+  }
+
+  if((n = watcher_take(jw->watcher, &events)) == 0)
+    return JS_UNDEFINED;
+
+  arg = js_watcher_events(ctx, events, n);
+  watcher_events_free(events, n);
+
+  /* the callback may close the watcher */
+  callback = JS_DupValue(ctx, jw->callback);
+  ret = JS_Call(ctx, callback, data[0], 1, &arg);
+  JS_FreeValue(ctx, callback);
+  JS_FreeValue(ctx, arg);
+
+  if(JS_IsException(ret))
+    return JS_EXCEPTION;
+
+  JS_FreeValue(ctx, ret);
+  return JS_UNDEFINED;
+}
+
+static BOOL
+js_watcher_watch(JSContext* ctx, JSWatcher* jw, JSValueConst obj) {
+  JSValue set_handler;
+
+  if(jw->watched)
+    return TRUE;
+
+  if(JS_IsException((set_handler = js_iohandler_fn(ctx, FALSE, "os"))))
+    return FALSE;
+
+  js_iohandler_set(ctx, set_handler, watcher_fd(jw->watcher), JS_NewCFunctionData(ctx, js_watcher_handler, 0, WATCHER_READ, 1, &obj));
+  js_iohandler_set(ctx, set_handler, watcher_timer(jw->watcher), JS_NewCFunctionData(ctx, js_watcher_handler, 0, WATCHER_TIMER, 1, &obj));
+  JS_FreeValue(ctx, set_handler);
+  jw->watched = TRUE;
+  return TRUE;
+}
+
+static void
+js_watcher_unwatch(JSContext* ctx, JSWatcher* jw) {
+  if(jw->watched) {
+    JSValue set_handler = js_iohandler_fn(ctx, FALSE, "os");
+
+    js_iohandler_set(ctx, set_handler, watcher_fd(jw->watcher), JS_NULL);
+    js_iohandler_set(ctx, set_handler, watcher_timer(jw->watcher), JS_NULL);
+    JS_FreeValue(ctx, set_handler);
+    jw->watched = FALSE;
+  }
+}
+
+static int
+js_watcher_add(JSContext* ctx, JSWatcher* jw, JSValueConst path) {
+  const char* str;
+  int ret;
+
+  if(!(str = JS_ToCString(ctx, path)))
+    return -1;
+
+  if((ret = watcher_add(jw->watcher, str)) == -1)
+    JS_ThrowInternalError(ctx, "Watcher: failed watching '%s': %s", str, strerror(errno));
+
+  JS_FreeCString(ctx, str);
+  return ret;
+}
+
+static JSValue
+js_watcher_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  JSValue proto, value, obj = JS_UNDEFINED;
+  JSWatcher* jw;
+  uint32_t delay = 50, max_delay = 1000;
+
+  if(argc < 2 || !JS_IsFunction(ctx, argv[1]))
+    return JS_ThrowTypeError(ctx, "argument 2 must be a function");
+
+  if(argc > 2 && JS_IsObject(argv[2])) {
+    value = JS_GetPropertyStr(ctx, argv[2], "delay");
+    if(JS_IsNumber(value))
+      JS_ToUint32(ctx, &delay, value);
+    JS_FreeValue(ctx, value);
+
+    value = JS_GetPropertyStr(ctx, argv[2], "maxDelay");
+    if(JS_IsNumber(value))
+      JS_ToUint32(ctx, &max_delay, value);
+    JS_FreeValue(ctx, value);
+  }
+
+  if(!(jw = js_mallocz(ctx, sizeof(JSWatcher))))
+    return JS_EXCEPTION;
+
+  jw->callback = JS_UNDEFINED;
+
+  if(!(jw->watcher = watcher_new(delay, max_delay))) {
+    JS_ThrowInternalError(ctx, "Watcher: inotify_init1() failed: %s", strerror(errno));
+    goto fail;
+  }
+
+  /* using new_target to get the prototype is necessary when the class is extended. */
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+  if(JS_IsException(proto))
+    goto fail;
+
+  obj = JS_NewObjectProtoClass(ctx, proto, js_watcher_class_id);
+  JS_FreeValue(ctx, proto);
+
+  if(JS_IsException(obj))
+    goto fail;
+
+  jw->callback = JS_DupValue(ctx, argv[1]);
+  JS_SetOpaque(obj, jw);
+
+  if(JS_IsArray(ctx, argv[0])) {
+    int64_t len = js_array_length(ctx, argv[0]);
+
+    for(int64_t i = 0; i < len; i++) {
+      int ret;
+
+      value = JS_GetPropertyInt64(ctx, argv[0], i);
+      ret = js_watcher_add(ctx, jw, value);
+      JS_FreeValue(ctx, value);
+
+      if(ret == -1)
+        goto fail_obj;
+    }
+  } else if(!js_is_null_or_undefined(argv[0])) {
+    if(js_watcher_add(ctx, jw, argv[0]) == -1)
+      goto fail_obj;
+  }
+
+  if(!js_watcher_watch(ctx, jw, obj))
+    goto fail_obj;
+
+  return obj;
+
+fail:
+  if(jw->watcher)
+    watcher_free(jw->watcher);
+
+  JS_FreeValue(ctx, jw->callback);
+  js_free(ctx, jw);
+  return JS_EXCEPTION;
+
+fail_obj:
+  JS_FreeValue(ctx, obj);
+  return JS_EXCEPTION;
+}
+
+enum {
+  WATCHER_ADD = 0,
+  WATCHER_REMOVE,
+  WATCHER_CLOSE,
+};
+
+static JSValue
+js_watcher_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  JSWatcher* jw;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(jw = js_watcher_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(!jw->watcher && magic != WATCHER_CLOSE)
+    return JS_ThrowInternalError(ctx, "Watcher is closed");
+
+  switch(magic) {
+    case WATCHER_ADD: {
+      int n;
+
+      if((n = js_watcher_add(ctx, jw, argv[0])) == -1)
+        return JS_EXCEPTION;
+
+      ret = JS_NewInt32(ctx, n);
+      break;
+    }
+
+    case WATCHER_REMOVE: {
+      const char* path;
+
+      if(!(path = JS_ToCString(ctx, argv[0])))
+        return JS_EXCEPTION;
+
+      ret = JS_NewBool(ctx, watcher_remove(jw->watcher, path));
+      JS_FreeCString(ctx, path);
+      break;
+    }
+
+    case WATCHER_CLOSE: {
+      if(jw->watcher) {
+        js_watcher_unwatch(ctx, jw);
+        watcher_free(jw->watcher);
+        jw->watcher = 0;
+      }
+
+      break;
+    }
+  }
+
+  return ret;
+}
+
+enum {
+  WATCHER_PATHS = 0,
+  WATCHER_SIZE,
+  WATCHER_PENDING,
+};
+
+static JSValue
+js_watcher_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  JSWatcher* jw;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(jw = js_watcher_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case WATCHER_PATHS: {
+      const char** roots;
+      uint32_t n = jw->watcher ? watcher_roots(jw->watcher, &roots) : 0;
+
+      ret = JS_NewArray(ctx);
+
+      for(uint32_t i = 0; i < n; i++)
+        JS_SetPropertyUint32(ctx, ret, i, JS_NewString(ctx, roots[i]));
+
+      break;
+    }
+
+    case WATCHER_SIZE: {
+      ret = JS_NewUint32(ctx, jw->watcher ? watcher_count(jw->watcher) : 0);
+      break;
+    }
+
+    case WATCHER_PENDING: {
+      ret = JS_NewUint32(ctx, jw->watcher ? watcher_pending(jw->watcher) : 0);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static void
+js_watcher_finalizer(JSRuntime* rt, JSValue val) {
+  JSWatcher* jw;
+
+  if((jw = JS_GetOpaque(val, js_watcher_class_id))) {
+    if(jw->watcher)
+      watcher_free(jw->watcher);
+
+    JS_FreeValueRT(rt, jw->callback);
+    js_free_rt(rt, jw);
+  }
+}
+
+static void
+js_watcher_gc_mark(JSRuntime* rt, JSValueConst val, JS_MarkFunc* mark_func) {
+  JSWatcher* jw;
+
+  if((jw = JS_GetOpaque(val, js_watcher_class_id)))
+    JS_MarkValue(rt, jw->callback, mark_func);
+}
+
+static JSClassDef js_watcher_class = {
+    .class_name = "Watcher",
+    .finalizer = js_watcher_finalizer,
+    .gc_mark = js_watcher_gc_mark,
+};
+
+static const JSCFunctionListEntry js_watcher_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("add", 1, js_watcher_method, WATCHER_ADD),
+    JS_CFUNC_MAGIC_DEF("remove", 1, js_watcher_method, WATCHER_REMOVE),
+    JS_CFUNC_MAGIC_DEF("close", 0, js_watcher_method, WATCHER_CLOSE),
+    JS_CGETSET_MAGIC_DEF("paths", js_watcher_get, 0, WATCHER_PATHS),
+    JS_CGETSET_MAGIC_DEF("size", js_watcher_get, 0, WATCHER_SIZE),
+    JS_CGETSET_MAGIC_DEF("pending", js_watcher_get, 0, WATCHER_PENDING),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Watcher", JS_PROP_CONFIGURABLE),
+};
+#endif /* HAVE_INOTIFY_INIT1 */
+
+int
+js_directory_init(JSContext* ctx, JSModuleDef* m) {
+  JS_NewClassID(&js_directory_class_id);
+  JS_NewClass(JS_GetRuntime(ctx), js_directory_class_id, &js_directory_class);
+
+  directory_ctor = JS_NewCFunction2(ctx, js_directory_constructor, "Directory", 1, JS_CFUNC_constructor, 0);
+  JSValue generator_proto = js_generator_prototype(ctx);
+  // directory_proto = JS_NewObjectProto(ctx, generator_proto);
+  directory_proto = JS_NewObject(ctx);
+  JS_FreeValue(ctx, generator_proto);
+
+  JS_SetPropertyFunctionList(ctx, directory_proto, js_directory_funcs, countof(js_directory_funcs));
+  JS_SetPropertyFunctionList(ctx, directory_proto, js_directory_static, countof(js_directory_static));
+  JS_SetPropertyFunctionList(ctx, directory_ctor, js_directory_static, countof(js_directory_static));
+
+  JS_SetClassProto(ctx, js_directory_class_id, directory_proto);
+  JS_SetConstructor(ctx, directory_ctor, directory_proto);
+
+#ifdef DIRECTORY_AT
+  JS_NewClassID(&js_walk_class_id);
+  JS_NewClass(JS_GetRuntime(ctx), js_walk_class_id, &js_walk_class);
+
+  walk_proto = JS_NewObject(ctx);
+  JS_SetPropertyFunctionList(ctx, walk_proto, js_walk_funcs, countof(js_walk_funcs));
+  JS_SetClassProto(ctx, js_walk_class_id, walk_proto);
+#endif
+
+#if HAVE_INOTIFY_INIT1
+  JS_NewClassID(&js_watcher_class_id);
+  JS_NewClass(JS_GetRuntime(ctx), js_watcher_class_id, &js_watcher_class);
+
+  watcher_ctor = JS_NewCFunction2(ctx, js_watcher_constructor, "Watcher", 2, JS_CFUNC_constructor, 0);
+  watcher_proto = JS_NewObject(ctx);
+  JS_SetPropertyFunctionList(ctx, watcher_proto, js_watcher_funcs, countof(js_watcher_funcs));
+  JS_SetClassProto(ctx, js_watcher_class_id, watcher_proto);
+  JS_SetConstructor(ctx, watcher_ctor, watcher_proto);
+#endif
+
+  if(m) {
+    JS_SetModuleExport(ctx, m, "Directory", directory_ctor);
+    JS_SetModuleExport(ctx, m, "default", directory_ctor);
+    JS_SetModuleExportList(ctx, m, js_directory_static, countof(js_directory_static));
+#ifdef DIRECTORY_AT
+    JS_SetModuleExportList(ctx, m, js_directory_walk_funcs, countof(js_directory_walk_funcs));
+#endif
+#if HAVE_INOTIFY_INIT1
+    JS_SetModuleExport(ctx, m, "Watcher", watcher_ctor);
+#endif
+  }
+
+  return 0;
+}
+
+#ifdef JS_SHARED_LIBRARY
+#define JS_INIT_MODULE js_init_module
+#else
+#define JS_INIT_MODULE js_init_module_directory
+#endif
+
+VISIBLE JSModuleDef*
+JS_INIT_MODULE(JSContext* ctx, const char* module_name) {
+  JSModuleDef* m;
+
+  if((m = JS_NewCModule(ctx, module_name, js_directory_init))) {
+    JS_AddModuleExport(ctx, m, "Directory");
+    JS_AddModuleExport(ctx, m, "default");
+    JS_AddModuleExportList(ctx, m, js_directory_static, countof(js_directory_static));
+#ifdef DIRECTORY_AT
+    JS_AddModuleExportList(ctx, m, js_directory_walk_funcs, countof(js_directory_walk_funcs));
+#endif
+#if HAVE_INOTIFY_INIT1
+    JS_AddModuleExport(ctx, m, "Watcher");
+#endif
   }
 
   return m;
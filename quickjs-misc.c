@@ -17,6 +17,10 @@
 #include "path.h"
 #include "vector.h"
 #include "base64.h"
+#include "js-utils.h"
+#ifndef _WIN32
+#include "thread-pool.h"
+#endif
 #include <time.h>
 #include <stddef.h>
 #include <sys/types.h>
@@ -3341,6 +3345,47 @@ timespec_to_ms(const struct timespec* tv) {
 }
 #endif
 
+/* the object fstat() returns, also used by asyncStat() */
+static JSValue
+js_misc_statobj(JSContext* ctx, const struct stat* st, BOOL use_bigint) {
+  JSValue obj = JS_NewObject(ctx);
+  struct {
+    JSValue (*i)(JSContext*, int64_t);
+    JSValue (*u)(JSContext*, uint64_t);
+  } new64;
+
+  new64.i = use_bigint ? JS_NewBigInt64 : JS_NewInt64;
+  new64.u = use_bigint ? JS_NewBigUint64 : (JSValue (*)(JSContext*, uint64_t))&JS_NewInt64;
+
+  JS_SetPropertyStr(ctx, obj, "dev", new64.u(ctx, st->st_dev));
+  JS_SetPropertyStr(ctx, obj, "ino", new64.u(ctx, st->st_ino));
+  JS_SetPropertyStr(ctx, obj, "mode", new64.u(ctx, st->st_mode));
+  JS_SetPropertyStr(ctx, obj, "nlink", new64.u(ctx, st->st_nlink));
+  JS_SetPropertyStr(ctx, obj, "uid", new64.u(ctx, st->st_uid));
+  JS_SetPropertyStr(ctx, obj, "gid", new64.u(ctx, st->st_gid));
+  JS_SetPropertyStr(ctx, obj, "rdev", new64.u(ctx, st->st_rdev));
+  JS_SetPropertyStr(ctx, obj, "size", new64.u(ctx, st->st_size));
+#if !defined(_WIN32)
+  JS_SetPropertyStr(ctx, obj, "blocks", new64.u(ctx, st->st_blocks));
+#endif
+
+#if defined(_WIN32) || defined(__dietlibc__) || defined(__ANDROID__)
+  JS_SetPropertyStr(ctx, obj, "atime", new64.u(ctx, (int64_t)st->st_atime * 1000));
+  JS_SetPropertyStr(ctx, obj, "mtime", new64.u(ctx, (int64_t)st->st_mtime * 1000));
+  JS_SetPropertyStr(ctx, obj, "ctime", new64.u(ctx, (int64_t)st->st_ctime * 1000));
+#elif defined(__APPLE__)
+  JS_SetPropertyStr(ctx, obj, "atime", new64.u(ctx, timespec_to_ms(&st->st_atimespec)));
+  JS_SetPropertyStr(ctx, obj, "mtime", new64.u(ctx, timespec_to_ms(&st->st_mtimespec)));
+  JS_SetPropertyStr(ctx, obj, "ctime", new64.u(ctx, timespec_to_ms(&st->st_ctimespec)));
+#else
+  JS_SetPropertyStr(ctx, obj, "atime", new64.u(ctx, timespec_to_ms(&st->st_atim)));
+  JS_SetPropertyStr(ctx, obj, "mtime", new64.u(ctx, timespec_to_ms(&st->st_mtim)));
+  JS_SetPropertyStr(ctx, obj, "ctime", new64.u(ctx, timespec_to_ms(&st->st_ctim)));
+#endif
+
+  return obj;
+}
+
 static JSValue
 js_misc_fstat(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
   int32_t fd = -1;
@@ -3348,10 +3393,6 @@ js_misc_fstat(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv
   JSValue ret = JS_NewArray(ctx), obj = JS_NULL;
   struct stat st;
   BOOL use_bigint = FALSE;
-  struct {
-    JSValue (*i)(JSContext*, int64_t);
-    JSValue (*u)(JSContext*, uint64_t);
-  } new64;
 
   JS_ToInt32(ctx, &fd, argv[0]);
 
@@ -3361,9 +3402,6 @@ js_misc_fstat(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv
     JS_FreeValue(ctx, bi);
   }
 
-  new64.i = use_bigint ? JS_NewBigInt64 : JS_NewInt64;
-  new64.u = use_bigint ? JS_NewBigUint64 : (JSValue (*)(JSContext*, uint64_t))&JS_NewInt64;
-
 #if HAVE_FSTAT
   if((res = fstat(fd, &st)) == -1)
     return js_syscallerror_throw_free(ctx, "fstat", ret);
@@ -3379,38 +3417,10 @@ js_misc_fstat(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv
   }
 #endif
 
-  if(res < 0) {
+  if(res < 0)
     err = errno;
-
-  } else {
-    obj = JS_NewObject(ctx);
-
-    JS_SetPropertyStr(ctx, obj, "dev", new64.u(ctx, st.st_dev));
-    JS_SetPropertyStr(ctx, obj, "ino", new64.u(ctx, st.st_ino));
-    JS_SetPropertyStr(ctx, obj, "mode", new64.u(ctx, st.st_mode));
-    JS_SetPropertyStr(ctx, obj, "nlink", new64.u(ctx, st.st_nlink));
-    JS_SetPropertyStr(ctx, obj, "uid", new64.u(ctx, st.st_uid));
-    JS_SetPropertyStr(ctx, obj, "gid", new64.u(ctx, st.st_gid));
-    JS_SetPropertyStr(ctx, obj, "rdev", new64.u(ctx, st.st_rdev));
-    JS_SetPropertyStr(ctx, obj, "size", new64.u(ctx, st.st_size));
-#if !defined(_WIN32)
-    JS_SetPropertyStr(ctx, obj, "blocks", new64.u(ctx, st.st_blocks));
-#endif
-
-#if defined(_WIN32) || defined(__dietlibc__) || defined(__ANDROID__)
-    JS_SetPropertyStr(ctx, obj, "atime", new64.u(ctx, (int64_t)st.st_atime * 1000));
-    JS_SetPropertyStr(ctx, obj, "mtime", new64.u(ctx, (int64_t)st.st_mtime * 1000));
-    JS_SetPropertyStr(ctx, obj, "ctime", new64.u(ctx, (int64_t)st.st_ctime * 1000));
-#elif defined(__APPLE__)
-    JS_SetPropertyStr(ctx, obj, "atime", new64.u(ctx, timespec_to_ms(&st.st_atimespec)));
-    JS_SetPropertyStr(ctx, obj, "mtime", new64.u(ctx, timespec_to_ms(&st.st_mtimespec)));
-    JS_SetPropertyStr(ctx, obj, "ctime", new64.u(ctx, timespec_to_ms(&st.st_ctimespec)));
-#else
-    JS_SetPropertyStr(ctx, obj, "atime", new64.u(ctx, timespec_to_ms(&st.st_atim)));
-    JS_SetPropertyStr(ctx, obj, "mtime", new64.u(ctx, timespec_to_ms(&st.st_mtim)));
-    JS_SetPropertyStr(ctx, obj, "ctime", new64.u(ctx, timespec_to_ms(&st.st_ctim)));
-#endif
-  }
+  else
+    obj = js_misc_statobj(ctx, &st, use_bigint);
 
   JS_SetPropertyUint32(ctx, ret, 0, obj);
   JS_SetPropertyUint32(ctx, ret, 1, JS_NewInt32(ctx, err));
@@ -3590,6 +3600,451 @@ js_misc_get_bytecode(JSContext* ctx, JSValueConst this_val, int argc, JSValueCon
 }
 #endif
 
+#ifndef _WIN32
+/*
+ * async*() run open(), read(), write(), fsync(), stat() and whole-file reads
+ * and writes on the thread pool and return a Promise, which is settled from
+ * the event loop when the call is done. Buffers are read into and written
+ * from directly, a reference keeps them alive meanwhile. Failures reject
+ * with a SyscallError.
+ */
+enum {
+  ASYNC_OPEN = 0,
+  ASYNC_CLOSE,
+  ASYNC_READ,
+  ASYNC_WRITE,
+  ASYNC_FSYNC,
+  ASYNC_FDATASYNC,
+  ASYNC_STAT,
+  ASYNC_LSTAT,
+  ASYNC_FSTAT,
+  ASYNC_READFILE,
+  ASYNC_WRITEFILE,
+};
+
+#define ASYNC_READ_SIZE 65536
+
+typedef struct {
+  ThreadJob job;
+  int op;
+  ResolveFunctions funcs;
+  char* path;
+  int fd, flags, mode;
+  InputBuffer buf;
+  size_t length;
+  int64_t position;
+  BOOL bigint;
+  int64_t result;
+  const char* syscall;
+  int error;
+  struct stat st;
+  uint8_t* data;
+} AsyncFileJob;
+
+static void
+async_free_buffer(JSRuntime* rt, void* opaque, void* ptr) {
+  free(ptr);
+}
+
+static void
+async_failed(AsyncFileJob* job, const char* syscall) {
+  job->syscall = syscall;
+  job->error = errno;
+  job->result = -1;
+}
+
+/* reads 'fd' to the end into a malloc()'d buffer */
+static void
+async_readfile(AsyncFileJob* job) {
+  size_t size = 0, alloc = ASYNC_READ_SIZE;
+  uint8_t* ptr;
+  ssize_t r;
+
+  /* the size is a hint, files in /proc report 0 */
+  if(fstat(job->fd, &job->st) == 0 && S_ISREG(job->st.st_mode) && job->st.st_size > 0)
+    alloc = job->st.st_size + 1;
+
+  for(;;) {
+    if(size == alloc || !job->data) {
+      if(job->data)
+        alloc *= 2;
+
+      if(!(ptr = realloc(job->data, alloc))) {
+        async_failed(job, "realloc");
+        break;
+      }
+
+      job->data = ptr;
+    }
+
+    if((r = read(job->fd, job->data + size, alloc - size)) == -1) {
+      if(errno == EINTR)
+        continue;
+
+      async_failed(job, "read");
+      break;
+    }
+
+    if(r == 0) {
+      job->result = size;
+      break;
+    }
+
+    size += r;
+  }
+}
+
+static void
+async_writefile(AsyncFileJob* job) {
+  const uint8_t* ptr = inputbuffer_data(&job->buf);
+  size_t size = inputbuffer_length(&job->buf), pos = 0;
+  ssize_t r;
+
+  while(pos < size) {
+    if((r = write(job->fd, ptr + pos, size - pos)) == -1) {
+      if(errno == EINTR)
+        continue;
+
+      async_failed(job, "write");
+      return;
+    }
+
+    pos += r;
+  }
+
+  job->result = pos;
+}
+
+/* runs on a worker thread */
+static void
+async_work(ThreadJob* ptr) {
+  AsyncFileJob* job = (AsyncFileJob*)ptr;
+  uint8_t* data = (uint8_t*)inputbuffer_data(&job->buf);
+  ssize_t r = 0;
+
+  switch(job->op) {
+    case ASYNC_OPEN: {
+      if((r = open(job->path, job->flags, job->mode)) == -1)
+        async_failed(job, "open");
+
+      break;
+    }
+
+    case ASYNC_CLOSE: {
+      if((r = close(job->fd)) == -1)
+        async_failed(job, "close");
+
+      break;
+    }
+
+    case ASYNC_READ: {
+      do
+        r = job->position >= 0 ? pread(job->fd, data, job->length, job->position) : read(job->fd, data, job->length);
+      while(r == -1 && errno == EINTR);
+
+      if(r == -1)
+        async_failed(job, "read");
+
+      break;
+    }
+
+    case ASYNC_WRITE: {
+      do
+        r = job->position >= 0 ? pwrite(job->fd, data, job->length, job->position) : write(job->fd, data, job->length);
+      while(r == -1 && errno == EINTR);
+
+      if(r == -1)
+        async_failed(job, "write");
+
+      break;
+    }
+
+    case ASYNC_FSYNC: {
+      if((r = fsync(job->fd)) == -1)
+        async_failed(job, "fsync");
+
+      break;
+    }
+
+    case ASYNC_FDATASYNC: {
+#if HAVE_FDATASYNC
+      if((r = fdatasync(job->fd)) == -1)
+        async_failed(job, "fdatasync");
+#else
+      if((r = fsync(job->fd)) == -1)
+        async_failed(job, "fsync");
+#endif
+      break;
+    }
+
+    case ASYNC_STAT: {
+      if((r = stat(job->path, &job->st)) == -1)
+        async_failed(job, "stat");
+
+      break;
+    }
+
+    case ASYNC_LSTAT: {
+      if((r = lstat(job->path, &job->st)) == -1)
+        async_failed(job, "lstat");
+
+      break;
+    }
+
+    case ASYNC_FSTAT: {
+      if((r = fstat(job->fd, &job->st)) == -1)
+        async_failed(job, "fstat");
+
+      break;
+    }
+
+    case ASYNC_READFILE:
+    case ASYNC_WRITEFILE: {
+      if((job->fd = open(job->path, job->flags, job->mode)) == -1) {
+        async_failed(job, "open");
+        return;
+      }
+
+      if(job->op == ASYNC_READFILE)
+        async_readfile(job);
+      else
+        async_writefile(job);
+
+      close(job->fd);
+      return;
+    }
+  }
+
+  if(r != -1)
+    job->result = r;
+}
+
+static void
+async_free(JSContext* ctx, AsyncFileJob* job) {
+  if(job->path)
+    js_free(ctx, job->path);
+
+  /* an empty buffer has no data and isn't released by inputbuffer_free() */
+  inputbuffer_free(&job->buf, ctx);
+  JS_FreeValue(ctx, job->buf.value);
+
+  promise_free_funcs(JS_GetRuntime(ctx), &job->funcs);
+  free(job->data);
+  js_free(ctx, job);
+}
+
+/* runs on the JS thread */
+static void
+async_done(JSContext* ctx, ThreadJob* ptr) {
+  AsyncFileJob* job = (AsyncFileJob*)ptr;
+  JSValue ret;
+
+  if(job->result == -1) {
+    ret = js_syscallerror_new(ctx, job->syscall, job->error);
+    promise_reject(ctx, &job->funcs, ret);
+  } else {
+    switch(job->op) {
+      case ASYNC_STAT:
+      case ASYNC_LSTAT:
+      case ASYNC_FSTAT: {
+        ret = js_misc_statobj(ctx, &job->st, job->bigint);
+        break;
+      }
+
+      case ASYNC_CLOSE:
+      case ASYNC_FSYNC:
+      case ASYNC_FDATASYNC: {
+        ret = JS_UNDEFINED;
+        break;
+      }
+
+      case ASYNC_READFILE: {
+        ret = JS_NewArrayBuffer(ctx, job->data, job->result, async_free_buffer, 0, FALSE);
+
+        if(!JS_IsException(ret))
+          job->data = 0;
+
+        break;
+      }
+
+      default: {
+        ret = JS_NewInt64(ctx, job->result);
+        break;
+      }
+    }
+
+    if(JS_IsException(ret)) {
+      ret = JS_GetException(ctx);
+      promise_reject(ctx, &job->funcs, ret);
+    } else {
+      promise_resolve(ctx, &job->funcs, ret);
+    }
+  }
+
+  JS_FreeValue(ctx, ret);
+  async_free(ctx, job);
+}
+
+/* offset and length of the range in 'job->buf' */
+static BOOL
+async_range(JSContext* ctx, AsyncFileJob* job, int argc, JSValueConst argv[]) {
+  size_t size = inputbuffer_length(&job->buf);
+  int64_t offset = 0, length = -1;
+
+  if(argc > 2 && !js_is_null_or_undefined(argv[2]))
+    JS_ToInt64Ext(ctx, &offset, argv[2]);
+
+  if(argc > 3 && !js_is_null_or_undefined(argv[3]))
+    JS_ToInt64Ext(ctx, &length, argv[3]);
+
+  if(offset < 0 || (size_t)offset > size) {
+    JS_ThrowRangeError(ctx, "offset %" PRId64 " out of range (size %zu)", offset, size);
+    return FALSE;
+  }
+
+  if(length < 0 || (size_t)length > size - offset)
+    length = size - offset;
+
+  job->buf.range.offset += offset;
+  job->buf.range.length = length;
+  job->length = length;
+  return TRUE;
+}
+
+static JSValue
+js_misc_async(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  AsyncFileJob* job;
+  JSValue ret;
+  int32_t value;
+
+  if(!(job = js_mallocz(ctx, sizeof(AsyncFileJob))))
+    return JS_EXCEPTION;
+
+  job->job.work = async_work;
+  job->job.done = async_done;
+  job->op = magic;
+  job->fd = -1;
+  job->position = -1;
+  job->funcs.resolve = job->funcs.reject = JS_UNDEFINED;
+  job->buf = INPUTBUFFER();
+
+  switch(magic) {
+    case ASYNC_OPEN:
+    case ASYNC_READFILE:
+    case ASYNC_WRITEFILE:
+    case ASYNC_STAT:
+    case ASYNC_LSTAT: {
+      const char* path;
+
+      if(magic == ASYNC_STAT && JS_IsNumber(argv[0])) {
+        JS_ToInt32(ctx, &job->fd, argv[0]);
+        job->op = ASYNC_FSTAT;
+        break;
+      }
+
+      if(!(path = JS_ToCString(ctx, argv[0]))) {
+        JS_ThrowTypeError(ctx, "argument 1 must be a string");
+        goto fail;
+      }
+
+      job->path = js_strdup(ctx, path);
+      JS_FreeCString(ctx, path);
+      break;
+    }
+
+    default: {
+      JS_ToInt32(ctx, &job->fd, argv[0]);
+      break;
+    }
+  }
+
+  switch(magic) {
+    case ASYNC_OPEN: {
+      job->flags = O_RDONLY;
+      job->mode = 0666;
+
+      if(argc > 1 && JS_IsNumber(argv[1]))
+        JS_ToInt32(ctx, &job->flags, argv[1]);
+
+      if(argc > 2 && JS_IsNumber(argv[2]))
+        JS_ToInt32(ctx, &job->mode, argv[2]);
+
+      break;
+    }
+
+    case ASYNC_READ:
+    case ASYNC_WRITE: {
+      job->buf = magic == ASYNC_READ ? js_input_buffer(ctx, argv[1]) : js_input_chars(ctx, argv[1]);
+
+      if(JS_IsException(job->buf.value)) {
+        job->buf.value = JS_UNDEFINED;
+        goto fail;
+      }
+
+      if(!async_range(ctx, job, argc, argv))
+        goto fail;
+
+      if(argc > 4 && JS_IsNumber(argv[4]))
+        JS_ToInt64Ext(ctx, &job->position, argv[4]);
+
+      break;
+    }
+
+    case ASYNC_FSYNC: {
+      if(argc > 1 && JS_ToBool(ctx, argv[1]))
+        job->op = ASYNC_FDATASYNC;
+
+      break;
+    }
+
+    case ASYNC_STAT:
+    case ASYNC_LSTAT: {
+      if(argc > 1 && JS_IsObject(argv[1]))
+        job->bigint = js_get_propertystr_bool(ctx, argv[1], "bigint");
+
+      break;
+    }
+
+    case ASYNC_READFILE: {
+      job->flags = O_RDONLY | O_CLOEXEC;
+      break;
+    }
+
+    case ASYNC_WRITEFILE: {
+      job->flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+      job->mode = 0666;
+      job->buf = js_input_chars(ctx, argv[1]);
+
+      if(JS_IsException(job->buf.value)) {
+        job->buf.value = JS_UNDEFINED;
+        goto fail;
+      }
+
+      if(argc > 2 && JS_IsNumber(argv[2]) && !JS_ToInt32(ctx, &value, argv[2]))
+        job->flags = value | O_CLOEXEC;
+
+      if(argc > 3 && JS_IsNumber(argv[3]))
+        JS_ToInt32(ctx, &job->mode, argv[3]);
+
+      break;
+    }
+  }
+
+  ret = promise_create(ctx, &job->funcs);
+
+  if(JS_IsException(ret) || thread_pool_submit(ctx, &job->job, THREAD_LANE_ANY)) {
+    JS_FreeValue(ctx, ret);
+    goto fail;
+  }
+
+  return ret;
+
+fail:
+  async_free(ctx, job);
+  return JS_EXCEPTION;
+}
+#endif
+
 static const JSCFunctionListEntry js_misc_funcs[] = {
     JS_CFUNC_DEF("getRelease", 0, js_misc_getrelease),
 #ifndef __wasi__
@@ -3713,6 +4168,17 @@ static const JSCFunctionListEntry js_misc_funcs[] = {
     JS_CONSTANT(O_WRONLY),
 #endif
     JS_CFUNC_DEF("fstat", 1, js_misc_fstat),
+#ifndef _WIN32
+    JS_CFUNC_MAGIC_DEF("asyncOpen", 3, js_misc_async, ASYNC_OPEN),
+    JS_CFUNC_MAGIC_DEF("asyncClose", 1, js_misc_async, ASYNC_CLOSE),
+    JS_CFUNC_MAGIC_DEF("asyncRead", 5, js_misc_async, ASYNC_READ),
+    JS_CFUNC_MAGIC_DEF("asyncWrite", 5, js_misc_async, ASYNC_WRITE),
+    JS_CFUNC_MAGIC_DEF("asyncFsync", 2, js_misc_async, ASYNC_FSYNC),
+    JS_CFUNC_MAGIC_DEF("asyncStat", 2, js_misc_async, ASYNC_STAT),
+    JS_CFUNC_MAGIC_DEF("asyncLstat", 2, js_misc_async, ASYNC_LSTAT),
+    JS_CFUNC_MAGIC_DEF("asyncReadFile", 1, js_misc_async, ASYNC_READFILE),
+    JS_CFUNC_MAGIC_DEF("asyncWriteFile", 4, js_misc_async, ASYNC_WRITEFILE),
+#endif
     JS_CFUNC_MAGIC_DEF("_get_osfhandle", 1, js_misc_osfhandle, FUNC_GET_OSFHANDLE),
     JS_CFUNC_MAGIC_DEF("_open_osfhandle", 1, js_misc_osfhandle, FUNC_OPEN_OSFHANDLE),
     JS_CFUNC_MAGIC_DEF("charCode", 1, js_misc_char, 0),
@@ -5,6 +5,7 @@
 #include "char-utils.h"
 #include "js-utils.h"
 #include "async-closure.h"
+#include "column-builder.h"
 #include <cutils.h>
 
 #ifdef _WIN32
@@ -22,10 +23,12 @@ typedef BOOL my_bool;
  * @{
  */
 
-VISIBLE JSClassID js_connectparams_class_id = 0, js_mysqlerror_class_id = 0, js_mysql_class_id = 0, js_mysqlresult_class_id = 0;
-static JSValue mysqlerror_proto, mysqlerror_ctor, mysql_proto, mysql_ctor, mysqlresult_proto, mysqlresult_ctor;
+VISIBLE JSClassID js_connectparams_class_id = 0, js_mysqlerror_class_id = 0, js_mysql_class_id = 0, js_mysqlresult_class_id = 0, js_mysqlstmt_class_id = 0;
+static JSValue mysqlerror_proto, mysqlerror_ctor, mysql_proto, mysql_ctor, mysqlresult_proto, mysqlresult_ctor, mysqlstmt_proto;
 
 static JSValue js_mysqlresult_wrap(JSContext* ctx, MYSQL_RES* res);
+static JSValue js_mysqlresult_new(JSContext*, JSValueConst, MYSQL_RES*);
+static JSValue js_mysql_prepare(JSContext*, JSValueConst, int, JSValueConst[]);
 
 typedef enum {
   RESULT_OBJECT = 1 << 0,
@@ -272,6 +275,12 @@ js_connectparams_data2(JSContext* ctx, JSValueConst value) {
   return JS_GetOpaque2(ctx, value, js_connectparams_class_id);
 }
 
+/* null and undefined leave the parameter to the client library */
+static char*
+connectparams_string(JSContext* ctx, int argc, JSValueConst argv[], int i) {
+  return i < argc && !JS_IsNull(argv[i]) && !JS_IsUndefined(argv[i]) ? js_tostring(ctx, argv[i]) : 0;
+}
+
 static void
 connectparams_init(JSContext* ctx, MYSQLConnectParameters* cp, int argc, JSValueConst argv[]) {
   cp->ref_count = 1;
@@ -292,19 +301,19 @@ connectparams_init(JSContext* ctx, MYSQLConnectParameters* cp, int argc, JSValue
     for(size_t i = 0; i < countof(args); i++)
       JS_FreeValue(ctx, args[i]);
   } else {
-    cp->host = argc > 0 ? js_tostring(ctx, argv[0]) : 0;
-    cp->user = argc > 1 ? js_tostring(ctx, argv[1]) : 0;
-    cp->password = argc > 2 ? js_tostring(ctx, argv[2]) : 0;
-    cp->db = argc > 3 ? js_tostring(ctx, argv[3]) : 0;
+    cp->host = connectparams_string(ctx, argc, argv, 0);
+    cp->user = connectparams_string(ctx, argc, argv, 1);
+    cp->password = connectparams_string(ctx, argc, argv, 2);
+    cp->db = connectparams_string(ctx, argc, argv, 3);
 
     if(argc > 4 && JS_IsNumber(argv[4]))
       JS_ToUint32(ctx, &cp->port, argv[4]);
     else
       cp->port = 3306;
 
-    cp->socket = argc > 5 ? js_tostring(ctx, argv[5]) : 0;
+    cp->socket = connectparams_string(ctx, argc, argv, 5);
 
-    if(argc > 6)
+    if(argc > 6 && !JS_IsUndefined(argv[6]))
       JS_ToInt64(ctx, &cp->flags, argv[6]);
     else
       cp->flags = 0;
@@ -1176,6 +1185,90 @@ js_mysql_query(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst arg
 #endif
 }
 
+#ifndef MYSQL_NO_ASYNC
+static void
+next_result_settle(JSContext* ctx, AsyncClosure* ac, int err) {
+  MYSQL_RES* res;
+
+  if(err > 0) {
+    JSValue error = js_mysqlerror_new(ctx, mysql_error(ac->opaque));
+
+    asyncclosure_error(ac, error);
+    JS_FreeValue(ctx, error);
+    return;
+  }
+
+  if(err == 0 && (res = mysql_use_result(ac->opaque))) {
+    JS_SetOpaque(ac->result, res);
+  } else {
+    JS_FreeValue(ctx, ac->result);
+    ac->result = err ? JS_FALSE : JS_NULL;
+  }
+
+  asyncclosure_resolve(ac);
+}
+
+static JSValue
+js_mysql_next_result_continue(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  AsyncClosure* ac = ptr;
+  int err = 0, state;
+
+  state = mysql_next_result_cont(&err, ac->opaque, to_mysql_wait(ac->state));
+
+  if(state)
+    asyncclosure_change_event(ac, to_asyncevent(state));
+  else
+    next_result_settle(ctx, ac, err);
+
+  return JS_UNDEFINED;
+}
+#endif
+
+/* after a multi-statement query(): resolves to the MySQLResult of the next
+ * statement, null when it has no result set, false when there are no more.
+ * The previous result must have been read completely */
+static JSValue
+js_mysql_next_result(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  MYSQL* my;
+  int err = 0;
+
+  if(!(my = js_mysql_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+#ifndef MYSQL_NO_ASYNC
+  AsyncClosure* ac;
+  JSValue ret, res_obj;
+  int state;
+
+  state = mysql_next_result_start(&err, my);
+  res_obj = JS_NewObjectProtoClass(ctx, mysqlresult_proto, js_mysqlresult_class_id);
+
+  if(!(ac = asyncclosure_new(ctx, js_mysql_fd(ctx, this_val), to_asyncevent(state), res_obj, &js_mysql_next_result_continue))) {
+    JS_FreeValue(ctx, res_obj);
+    return JS_EXCEPTION;
+  }
+
+  JS_FreeValue(ctx, res_obj);
+  asyncclosure_opaque(ac, my, NULL);
+  ret = asyncclosure_promise(ac);
+
+  if(state == 0)
+    next_result_settle(ctx, ac, err);
+
+  return ret;
+#else
+  MYSQL_RES* res;
+
+  if((err = mysql_next_result(my)) > 0)
+    return JS_Throw(ctx, js_mysqlerror_new(ctx, mysql_error(my)));
+
+  if(err < 0)
+    return JS_FALSE;
+
+  return (res = mysql_use_result(my)) ? js_mysqlresult_new(ctx, mysqlresult_proto, res) : JS_NULL;
+#endif
+}
+
 static JSValue
 js_mysql_close(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
   JSValue ret = JS_UNDEFINED;
@@ -1249,6 +1342,8 @@ static const JSCFunctionListEntry js_mysql_funcs[] = {
     JS_CGETSET_MAGIC_DEF("pending", js_mysql_get, 0, PROP_PENDING),
     JS_CFUNC_DEF("connect", 1, js_mysql_connect),
     JS_CFUNC_DEF("query", 1, js_mysql_query),
+    JS_CFUNC_DEF("prepare", 1, js_mysql_prepare),
+    JS_CFUNC_DEF("nextResult", 0, js_mysql_next_result),
     JS_CFUNC_DEF("close", 0, js_mysql_close),
     JS_ALIAS_DEF("execute", "query"),
     JS_CFUNC_MAGIC_DEF("escapeString", 1, js_mysql_methods, METHOD_ESCAPE_STRING),
@@ -1273,6 +1368,8 @@ static const JSCFunctionListEntry js_mysql_defines[] = {
     JS_PROP_INT32_DEF("RESULT_STRING", RESULT_STRING, JS_PROP_CONFIGURABLE),
     JS_PROP_INT32_DEF("RESULT_TBLNAM", RESULT_TBLNAM, JS_PROP_CONFIGURABLE),
     JS_PROP_INT64_DEF("COUNT_ERROR", MYSQL_COUNT_ERROR, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT64_DEF("CLIENT_MULTI_STATEMENTS", CLIENT_MULTI_STATEMENTS, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT64_DEF("CLIENT_MULTI_RESULTS", CLIENT_MULTI_RESULTS, JS_PROP_CONFIGURABLE),
 #ifndef MYSQL_NOT_MARIADB
     JS_PROP_INT32_DEF("DATABASE_DRIVER", MYSQL_DATABASE_DRIVER, JS_PROP_CONFIGURABLE),
 #endif
@@ -1684,6 +1781,376 @@ js_mysqlresult_next(JSContext* ctx, JSValueConst this_val, int argc, JSValueCons
   return JS_ThrowRangeError(ctx, "MySQLResult is EOF");
 }
 
+typedef struct {
+  MYSQL* conn;
+  MYSQL_RES* res;
+  uint32_t num_fields, batch_size, rows;
+  ColumnBuilder* cols;
+} ColumnBatch;
+
+static void
+column_batch_free(JSRuntime* rt, void* ptr) {
+  ColumnBatch* cb = ptr;
+
+  for(uint32_t i = 0; i < cb->num_fields; i++)
+    column_free(&cb->cols[i]);
+
+  js_free_rt(rt, cb->cols);
+  js_free_rt(rt, cb);
+}
+
+static ColumnBatch*
+column_batch_new(JSContext* ctx, MYSQL* my, MYSQL_RES* res, uint32_t batch_size) {
+  ColumnBatch* cb;
+
+  if(!(cb = js_mallocz(ctx, sizeof(ColumnBatch))))
+    return 0;
+
+  cb->conn = my;
+  cb->res = res;
+  cb->num_fields = mysql_num_fields(res);
+  cb->batch_size = batch_size;
+
+  if(!(cb->cols = js_malloc(ctx, sizeof(ColumnBuilder) * (cb->num_fields ? cb->num_fields : 1)))) {
+    js_free(ctx, cb);
+    return 0;
+  }
+
+  for(uint32_t i = 0; i < cb->num_fields; i++)
+    column_init(&cb->cols[i], ctx);
+
+  return cb;
+}
+
+/* numbers are parsed from the text protocol, DECIMAL and dates stay text */
+static int
+column_batch_put(ColumnBatch* cb, MYSQL_ROW row) {
+  MYSQL_FIELD* fields = mysql_fetch_fields(cb->res);
+  unsigned long* lengths = mysql_fetch_lengths(cb->res);
+
+  for(uint32_t i = 0; i < cb->num_fields; i++) {
+    ColumnBuilder* col = &cb->cols[i];
+    int r;
+
+    if(row[i] == 0)
+      r = column_put_null(col);
+    else if(field_is_number(&fields[i]) || field_is_boolean(&fields[i]))
+      r = column_put_number(col, row[i], lengths[i]);
+    else
+      r = column_put_text(col, row[i], lengths[i], field_is_blob(&fields[i]));
+
+    if(r)
+      return -1;
+  }
+
+  cb->rows++;
+  return 0;
+}
+
+static JSValue
+column_batch_value(JSContext* ctx, ColumnBatch* cb) {
+  MYSQL_FIELD* fields = mysql_fetch_fields(cb->res);
+  JSValue ret;
+
+  if(cb->rows == 0)
+    return JS_NULL;
+
+  ret = JS_NewObjectProto(ctx, JS_NULL);
+
+  for(uint32_t i = 0; i < cb->num_fields; i++) {
+    JSAtom prop = JS_NewAtomLen(ctx, fields[i].name, fields[i].name_length);
+
+    JS_SetProperty(ctx, ret, prop, column_value(&cb->cols[i], ctx));
+    JS_FreeAtom(ctx, prop);
+  }
+
+  cb->rows = 0;
+  return ret;
+}
+
+#ifndef MYSQL_NO_ASYNC
+/* collects rows for as long as they arrive without blocking. returns the
+ * state to wait for, 0 when the batch is complete */
+static int
+column_batch_fetch(ColumnBatch* cb, MYSQL_ROW row, int state, BOOL* error) {
+  for(;;) {
+    if(state)
+      return state;
+
+    if(row == 0) {
+      *error = mysql_errno(cb->conn) != 0;
+      return 0;
+    }
+
+    if(column_batch_put(cb, row)) {
+      *error = TRUE;
+      return 0;
+    }
+
+    if(cb->rows >= cb->batch_size)
+      return 0;
+
+    state = mysql_fetch_row_start(&row, cb->res);
+  }
+}
+
+static void
+column_batch_settle(JSContext* ctx, AsyncClosure* ac, ColumnBatch* cb, BOOL error) {
+  if(error) {
+    JSValue err = js_mysqlerror_new(ctx, mysql_errno(cb->conn) ? mysql_error(cb->conn) : "out of memory");
+
+    asyncclosure_error(ac, err);
+    JS_FreeValue(ctx, err);
+    return;
+  }
+
+  JS_FreeValue(ctx, ac->result);
+  ac->result = column_batch_value(ctx, cb);
+  asyncclosure_resolve(ac);
+}
+
+static JSValue
+js_mysqlresult_columns_continue(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  AsyncClosure* ac = ptr;
+  ColumnBatch* cb = ac->opaque;
+  MYSQL_ROW row = 0;
+  BOOL error = FALSE;
+  int state;
+
+  state = mysql_fetch_row_cont(&row, cb->res, to_mysql_wait(ac->state));
+  state = column_batch_fetch(cb, row, state, &error);
+
+  if(state)
+    asyncclosure_change_event(ac, to_asyncevent(state));
+  else
+    column_batch_settle(ctx, ac, cb, error);
+
+  return JS_UNDEFINED;
+}
+#endif
+
+/* fetches up to 'batch_size' rows column-wise, see column_value() */
+static JSValue
+js_mysqlresult_columns(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  MYSQL_RES* res;
+  MYSQL* my;
+  ColumnBatch* cb;
+  uint32_t batch_size = UINT32_MAX;
+
+  if(!(res = js_mysqlresult_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(argc > 0 && !JS_IsUndefined(argv[0]))
+    if(JS_ToUint32(ctx, &batch_size, argv[0]) || batch_size == 0)
+      return JS_ThrowRangeError(ctx, "argument 1 must be a positive batch size");
+
+  my = js_mysqlresult_handle(ctx, this_val);
+
+  if(!(cb = column_batch_new(ctx, my, res, batch_size)))
+    return JS_EXCEPTION;
+
+#ifndef MYSQL_NO_ASYNC
+  MYSQL_ROW row = 0;
+  BOOL error = FALSE;
+  int state = 0;
+  AsyncClosure* ac;
+  JSValue ret;
+
+  if(!mysql_eof(res))
+    state = column_batch_fetch(cb, row, mysql_fetch_row_start(&row, res), &error);
+
+  if(!(ac = asyncclosure_new(ctx, js_mysqlresult_fd(ctx, this_val), to_asyncevent(state), this_val, &js_mysqlresult_columns_continue))) {
+    column_batch_free(JS_GetRuntime(ctx), cb);
+    return JS_EXCEPTION;
+  }
+
+  asyncclosure_opaque(ac, cb, &column_batch_free);
+  ret = asyncclosure_promise(ac);
+
+  if(state == 0)
+    column_batch_settle(ctx, ac, cb, error);
+
+  return ret;
+#else
+  JSValue ret = JS_NULL;
+  MYSQL_ROW row;
+
+  while(cb->rows < batch_size && (row = mysql_fetch_row(res)))
+    if(column_batch_put(cb, row)) {
+      column_batch_free(JS_GetRuntime(ctx), cb);
+      return JS_ThrowOutOfMemory(ctx);
+    }
+
+  if(mysql_errno(my))
+    ret = JS_Throw(ctx, js_mysqlerror_new(ctx, mysql_error(my)));
+  else
+    ret = column_batch_value(ctx, cb);
+
+  column_batch_free(JS_GetRuntime(ctx), cb);
+  return ret;
+#endif
+}
+
+typedef struct {
+  MYSQL* conn;
+  MYSQL_RES* res;
+  uint32_t batch_size, rows;
+  JSValue array;
+} RowBatch;
+
+static void
+row_batch_free(JSRuntime* rt, void* ptr) {
+  RowBatch* rb = ptr;
+
+  JS_FreeValueRT(rt, rb->array);
+  js_free_rt(rt, rb);
+}
+
+static RowBatch*
+row_batch_new(JSContext* ctx, MYSQL* my, MYSQL_RES* res, uint32_t batch_size) {
+  RowBatch* rb;
+
+  if(!(rb = js_mallocz(ctx, sizeof(RowBatch))))
+    return 0;
+
+  rb->conn = my;
+  rb->res = res;
+  rb->batch_size = batch_size;
+  rb->array = JS_NewArray(ctx);
+
+  return rb;
+}
+
+static JSValue
+row_batch_value(JSContext* ctx, RowBatch* rb) {
+  JSValue ret;
+
+  if(rb->rows == 0)
+    return JS_NULL;
+
+  ret = rb->array;
+  rb->array = JS_NewArray(ctx);
+  rb->rows = 0;
+  return ret;
+}
+
+#ifndef MYSQL_NO_ASYNC
+/* like column_batch_fetch(), rows are converted as they come in. With
+ * mysql_use_result() only the current row is held by the client library */
+static int
+row_batch_fetch(JSContext* ctx, RowBatch* rb, MYSQL_ROW row, int state, BOOL* error) {
+  for(;;) {
+    if(state)
+      return state;
+
+    if(row == 0) {
+      *error = mysql_errno(rb->conn) != 0;
+      return 0;
+    }
+
+    JS_SetPropertyUint32(ctx, rb->array, rb->rows++, result_array(ctx, rb->res, row, 0));
+
+    if(rb->rows >= rb->batch_size)
+      return 0;
+
+    state = mysql_fetch_row_start(&row, rb->res);
+  }
+}
+
+static void
+row_batch_settle(JSContext* ctx, AsyncClosure* ac, RowBatch* rb, BOOL error) {
+  if(error) {
+    JSValue err = js_mysqlerror_new(ctx, mysql_error(rb->conn));
+
+    asyncclosure_error(ac, err);
+    JS_FreeValue(ctx, err);
+    return;
+  }
+
+  JS_FreeValue(ctx, ac->result);
+  ac->result = row_batch_value(ctx, rb);
+  asyncclosure_resolve(ac);
+}
+
+static JSValue
+js_mysqlresult_rows_continue(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  AsyncClosure* ac = ptr;
+  RowBatch* rb = ac->opaque;
+  MYSQL_ROW row = 0;
+  BOOL error = FALSE;
+  int state;
+
+  state = mysql_fetch_row_cont(&row, rb->res, to_mysql_wait(ac->state));
+  state = row_batch_fetch(ctx, rb, row, state, &error);
+
+  if(state)
+    asyncclosure_change_event(ac, to_asyncevent(state));
+  else
+    row_batch_settle(ctx, ac, rb, error);
+
+  return JS_UNDEFINED;
+}
+#endif
+
+/* fetches up to 'batch_size' rows as an array of row arrays, null at the end */
+static JSValue
+js_mysqlresult_rows(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  MYSQL_RES* res;
+  MYSQL* my;
+  RowBatch* rb;
+  uint32_t batch_size = 1000;
+
+  if(!(res = js_mysqlresult_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(argc > 0 && !JS_IsUndefined(argv[0]))
+    if(JS_ToUint32(ctx, &batch_size, argv[0]) || batch_size == 0)
+      return JS_ThrowRangeError(ctx, "argument 1 must be a positive batch size");
+
+  my = js_mysqlresult_handle(ctx, this_val);
+
+  if(!(rb = row_batch_new(ctx, my, res, batch_size)))
+    return JS_EXCEPTION;
+
+#ifndef MYSQL_NO_ASYNC
+  MYSQL_ROW row = 0;
+  BOOL error = FALSE;
+  int state = 0;
+  AsyncClosure* ac;
+  JSValue ret;
+
+  if(!mysql_eof(res))
+    state = row_batch_fetch(ctx, rb, row, mysql_fetch_row_start(&row, res), &error);
+
+  if(!(ac = asyncclosure_new(ctx, js_mysqlresult_fd(ctx, this_val), to_asyncevent(state), this_val, &js_mysqlresult_rows_continue))) {
+    row_batch_free(JS_GetRuntime(ctx), rb);
+    return JS_EXCEPTION;
+  }
+
+  asyncclosure_opaque(ac, rb, &row_batch_free);
+  ret = asyncclosure_promise(ac);
+
+  if(state == 0)
+    row_batch_settle(ctx, ac, rb, error);
+
+  return ret;
+#else
+  JSValue ret;
+  MYSQL_ROW row;
+
+  while(rb->rows < batch_size && (row = mysql_fetch_row(res)))
+    JS_SetPropertyUint32(ctx, rb->array, rb->rows++, result_array(ctx, res, row, 0));
+
+  if(mysql_errno(my))
+    ret = JS_Throw(ctx, js_mysqlerror_new(ctx, mysql_error(my)));
+  else
+    ret = row_batch_value(ctx, rb);
+
+  row_batch_free(JS_GetRuntime(ctx), rb);
+  return ret;
+#endif
+}
+
 enum {
   METHOD_FETCH_FIELD,
   METHOD_FETCH_FIELDS,
@@ -1873,46 +2340,895 @@ static const JSCFunctionListEntry js_mysqlresult_funcs[] = {
     JS_CFUNC_MAGIC_DEF("fetchFields", 0, js_mysqlresult_functions, METHOD_FETCH_FIELDS),
     JS_CFUNC_MAGIC_DEF("fetchRow", 0, js_mysqlresult_next, 0),
     JS_CFUNC_MAGIC_DEF("fetchAssoc", 0, js_mysqlresult_next, RESULT_OBJECT),
+    JS_CFUNC_DEF("fetchColumns", 1, js_mysqlresult_columns),
+    JS_CFUNC_DEF("fetchRows", 1, js_mysqlresult_rows),
     JS_CFUNC_MAGIC_DEF("[Symbol.iterator]", 0, js_mysqlresult_iterator, METHOD_ITERATOR),
     JS_CFUNC_MAGIC_DEF("[Symbol.asyncIterator]", 0, js_mysqlresult_iterator, METHOD_ASYNC_ITERATOR),
     JS_PROP_STRING_DEF("[Symbol.toStringTag]", "MySQLResult", JS_PROP_CONFIGURABLE),
 };
 
-static char*
-field_id(JSContext* ctx, MYSQL_FIELD const* field) {
-  DynBuf buf;
+#define STMT_BUFFER_SIZE 256
+
+typedef union {
+  int64_t i;
+  double d;
+  MYSQL_TIME t;
+} StmtNumber;
+
+typedef struct {
+  StmtNumber num;
+  char* buf;
+  unsigned long size, length;
+  my_bool is_null, error;
+} StmtColumn;
+
+/* A server-side prepared statement. Results are bound once per statement,
+ * variable length columns grow their buffer when a value got truncated */
+typedef struct {
+  MYSQL_STMT* stmt;
+  MYSQL_RES* meta;
+  MYSQL_FIELD* fields;
+  MYSQL_BIND* bind;
+  StmtColumn* cols;
+  uint32_t num_fields;
+  JSValue conn;
+  BOOL rebind, eof, busy;
+} MySQLStatement;
+
+typedef struct {
+  uint32_t count;
+  MYSQL_BIND* bind;
+  StmtNumber* nums;
+} StmtParams;
+
+typedef struct {
+  MySQLStatement* st;
+  uint32_t batch_size, rows;
+  JSValue array;
+} StmtBatch;
 
-  dbuf_init2(&buf, 0, 0);
-  dbuf_put(&buf, (const uint8_t*)field->table, field->table_length);
-  dbuf_putstr(&buf, ".");
-  dbuf_put(&buf, (const uint8_t*)field->name, field->name_length);
-  dbuf_0(&buf);
+static void
+stmt_columns_free(JSRuntime* rt, MySQLStatement* st) {
+  if(st->cols)
+    for(uint32_t i = 0; i < st->num_fields; i++)
+      js_free_rt(rt, st->cols[i].buf);
 
-  return (char*)buf.buf;
-}
+  js_free_rt(rt, st->cols);
+  js_free_rt(rt, st->bind);
 
-static char*
-field_name(JSContext* ctx, MYSQL_FIELD const* field) {
-  return js_strndup(ctx, field->name, field->name_length);
+  if(st->meta)
+    mysql_free_result(st->meta);
+
+  st->cols = 0;
+  st->bind = 0;
+  st->meta = 0;
+  st->fields = 0;
+  st->num_fields = 0;
 }
 
-static FieldNameFunc*
-field_namefunc(MYSQL_FIELD* fields, uint32_t num_fields) {
-  BOOL eq = FALSE;
+static void
+stmt_free(JSRuntime* rt, MySQLStatement* st) {
+  stmt_columns_free(rt, st);
 
-  for(uint32_t i = 0; !eq && i < num_fields; i++)
-    for(uint32_t j = 0; !eq && j < num_fields; j++)
-      if(i != j && fields[i].name_length == fields[j].name_length && byte_equal(fields[i].name, fields[i].name_length, fields[j].name))
-        return field_id;
+  if(st->stmt)
+    mysql_stmt_close(st->stmt);
 
-  return field_name;
+  JS_FreeValueRT(rt, st->conn);
+  js_free_rt(rt, st);
 }
 
 static JSValue
-field_array(JSContext* ctx, MYSQL_FIELD* field) {
-  JSValue ret = JS_NewArray(ctx);
-  const char* type = 0;
-  DynBuf buf;
+stmt_error(JSContext* ctx, MySQLStatement* st) {
+  return js_mysqlerror_new(ctx, mysql_stmt_errno(st->stmt) ? mysql_stmt_error(st->stmt) : "out of memory");
+}
+
+/* integers and floats are fetched into native buffers, dates with
+ * TIMESTAMP_FLAG into a MYSQL_TIME, everything else as bytes */
+static int
+stmt_bind_result(JSContext* ctx, MySQLStatement* st) {
+  uint32_t i, num_fields;
+
+  if(st->meta || (num_fields = mysql_stmt_field_count(st->stmt)) == 0)
+    return 0;
+
+  if(!(st->meta = mysql_stmt_result_metadata(st->stmt)))
+    return -1;
+
+  st->fields = mysql_fetch_fields(st->meta);
+  st->num_fields = num_fields;
+
+  if(!(st->bind = js_mallocz(ctx, sizeof(MYSQL_BIND) * num_fields)) || !(st->cols = js_mallocz(ctx, sizeof(StmtColumn) * num_fields)))
+    return -1;
+
+  for(i = 0; i < num_fields; i++) {
+    MYSQL_FIELD* field = &st->fields[i];
+    MYSQL_BIND* b = &st->bind[i];
+    StmtColumn* col = &st->cols[i];
+
+    b->is_null = &col->is_null;
+    b->error = &col->error;
+    b->length = &col->length;
+
+    switch(field->type) {
+      case MYSQL_TYPE_TINY:
+      case MYSQL_TYPE_SHORT:
+      case MYSQL_TYPE_INT24:
+      case MYSQL_TYPE_LONG:
+      case MYSQL_TYPE_LONGLONG:
+      case MYSQL_TYPE_YEAR: {
+        b->buffer_type = MYSQL_TYPE_LONGLONG;
+        b->buffer = &col->num.i;
+        b->is_unsigned = !!(field->flags & UNSIGNED_FLAG);
+        continue;
+      }
+
+      case MYSQL_TYPE_FLOAT:
+      case MYSQL_TYPE_DOUBLE: {
+        b->buffer_type = MYSQL_TYPE_DOUBLE;
+        b->buffer = &col->num.d;
+        continue;
+      }
+
+      case MYSQL_TYPE_TIMESTAMP:
+      case MYSQL_TYPE_DATE:
+      case MYSQL_TYPE_DATETIME:
+      case MYSQL_TYPE_NEWDATE: {
+        if(!field_is_date(field))
+          break;
+
+        b->buffer_type = MYSQL_TYPE_DATETIME;
+        b->buffer = &col->num.t;
+        continue;
+      }
+
+      default: break;
+    }
+
+    if(!(col->buf = js_malloc(ctx, STMT_BUFFER_SIZE)))
+      return -1;
+
+    col->size = STMT_BUFFER_SIZE;
+    b->buffer_type = MYSQL_TYPE_STRING;
+    b->buffer = col->buf;
+    b->buffer_length = col->size - 1;
+  }
+
+  return mysql_stmt_bind_result(st->stmt, st->bind) ? -1 : 0;
+}
+
+/* re-reads the columns which didn't fit into their buffer */
+static int
+stmt_fetch_truncated(JSContext* ctx, MySQLStatement* st) {
+  for(uint32_t i = 0; i < st->num_fields; i++) {
+    StmtColumn* col = &st->cols[i];
+    MYSQL_BIND* b = &st->bind[i];
+    char* buf;
+
+    if(!col->buf || col->is_null || col->length <= b->buffer_length)
+      continue;
+
+    if(!(buf = js_realloc(ctx, col->buf, col->length + 1)))
+      return -1;
+
+    col->buf = buf;
+    col->size = col->length + 1;
+    b->buffer = buf;
+    b->buffer_length = col->length;
+    st->rebind = TRUE;
+
+    if(mysql_stmt_fetch_column(st->stmt, b, i, 0))
+      return -1;
+  }
+
+  return 0;
+}
+
+static void
+stmt_rebind(MySQLStatement* st) {
+  if(st->rebind) {
+    mysql_stmt_bind_result(st->stmt, st->bind);
+    st->rebind = FALSE;
+  }
+}
+
+static JSValue
+stmt_date(JSContext* ctx, MYSQL_TIME const* t) {
+  char buf[64];
+
+  if(t->time_type == MYSQL_TIMESTAMP_DATE)
+    snprintf(buf, sizeof(buf), "%04u-%02u-%02u", t->year, t->month, t->day);
+  else
+    snprintf(buf, sizeof(buf), "%04u-%02u-%02uT%02u:%02u:%02u.%03lu", t->year, t->month, t->day, t->hour, t->minute, t->second, (unsigned long)t->second_part / 1000);
+
+  return string_to_date(ctx, buf);
+}
+
+/* numbers come straight from the binary row, BigInt beyond 2^53 */
+static JSValue
+stmt_value(JSContext* ctx, MySQLStatement* st, uint32_t i) {
+  MYSQL_FIELD* field = &st->fields[i];
+  StmtColumn* col = &st->cols[i];
+
+  if(col->is_null)
+    return JS_NULL;
+
+  switch(st->bind[i].buffer_type) {
+    case MYSQL_TYPE_LONGLONG: {
+      if(field_is_boolean(field))
+        return JS_NewBool(ctx, col->num.i != 0);
+
+      if(field->flags & UNSIGNED_FLAG) {
+        uint64_t u = col->num.i;
+
+        return u > MAX_SAFE_INTEGER ? JS_NewBigUint64(ctx, u) : JS_NewInt64(ctx, u);
+      }
+
+      if(col->num.i > MAX_SAFE_INTEGER || col->num.i < -MAX_SAFE_INTEGER)
+        return JS_NewBigInt64(ctx, col->num.i);
+
+      return JS_NewInt64(ctx, col->num.i);
+    }
+
+    case MYSQL_TYPE_DOUBLE: return JS_NewFloat64(ctx, col->num.d);
+    case MYSQL_TYPE_DATETIME: return stmt_date(ctx, &col->num.t);
+    default: break;
+  }
+
+  col->buf[col->length] = '\0';
+  return result_value(ctx, field, col->buf, col->length, 0);
+}
+
+static JSValue
+stmt_row(JSContext* ctx, MySQLStatement* st) {
+  JSValue ret = JS_NewArray(ctx);
+
+  for(uint32_t i = 0; i < st->num_fields; i++)
+    JS_SetPropertyUint32(ctx, ret, i, stmt_value(ctx, st, i));
+
+  return ret;
+}
+
+static void
+stmt_params_free(JSRuntime* rt, void* ptr) {
+  StmtParams* sp = ptr;
+
+  for(uint32_t i = 0; i < sp->count; i++)
+    if(sp->bind[i].buffer_type == MYSQL_TYPE_STRING || sp->bind[i].buffer_type == MYSQL_TYPE_BLOB)
+      js_free_rt(rt, sp->bind[i].buffer);
+
+  js_free_rt(rt, sp->bind);
+  js_free_rt(rt, sp->nums);
+  js_free_rt(rt, sp);
+}
+
+static int
+stmt_param_set(JSContext* ctx, MYSQL_BIND* b, StmtNumber* num, JSValueConst value) {
+  if(JS_IsNull(value) || JS_IsUndefined(value)) {
+    b->buffer_type = MYSQL_TYPE_NULL;
+    return 0;
+  }
+
+  if(JS_IsBool(value) || JS_IsNumber(value)) {
+    JS_ToFloat64(ctx, &num->d, value);
+
+    if(num->d == trunc(num->d) && fabs(num->d) <= MAX_SAFE_INTEGER) {
+      num->i = num->d;
+      b->buffer_type = MYSQL_TYPE_LONGLONG;
+      b->buffer = &num->i;
+    } else {
+      b->buffer_type = MYSQL_TYPE_DOUBLE;
+      b->buffer = &num->d;
+    }
+
+    return 0;
+  }
+
+  if(JS_IsBigInt(ctx, value)) {
+    if(JS_ToBigInt64(ctx, &num->i, value))
+      return -1;
+
+    b->buffer_type = MYSQL_TYPE_LONGLONG;
+    b->buffer = &num->i;
+    return 0;
+  }
+
+  if(js_is_arraybuffer(ctx, value) || js_is_typedarray(ctx, value)) {
+    InputBuffer input = js_input_buffer(ctx, value);
+
+    if((b->buffer = js_malloc(ctx, input.size + 1)))
+      memcpy(b->buffer, input.data, input.size);
+
+    b->buffer_type = MYSQL_TYPE_BLOB;
+    b->buffer_length = input.size;
+    inputbuffer_free(&input, ctx);
+
+    return b->buffer ? 0 : -1;
+  }
+
+  /* dates are sent as 'YYYY-MM-DD HH:MM:SS.sss' like js_mysql_print_value() does */
+  BOOL date = js_is_date(ctx, value);
+  JSValue str = date ? js_invoke(ctx, value, "toISOString", 0, 0) : JS_DupValue(ctx, value);
+  const char* s;
+  size_t len;
+
+  s = JS_ToCStringLen(ctx, &len, str);
+  JS_FreeValue(ctx, str);
+
+  if(!s)
+    return -1;
+
+  if(date && len >= 24 && s[23] == 'Z')
+    len = 23;
+
+  if((b->buffer = js_strndup(ctx, s, len)))
+    if(date && len >= 19 && ((char*)b->buffer)[10] == 'T')
+      ((char*)b->buffer)[10] = ' ';
+
+  b->buffer_type = MYSQL_TYPE_STRING;
+  b->buffer_length = len;
+  JS_FreeCString(ctx, s);
+
+  return b->buffer ? 0 : -1;
+}
+
+/* takes the parameters either as an array or as the argument list */
+static StmtParams*
+stmt_params_new(JSContext* ctx, MySQLStatement* st, int argc, JSValueConst argv[]) {
+  BOOL array = argc == 1 && JS_IsArray(ctx, argv[0]);
+  uint32_t i, count = array ? js_array_length(ctx, argv[0]) : argc;
+  StmtParams* sp;
+
+  if(count != mysql_stmt_param_count(st->stmt)) {
+    JS_ThrowRangeError(ctx, "statement expects %lu parameters, got %" PRIu32, mysql_stmt_param_count(st->stmt), count);
+    return 0;
+  }
+
+  if(!(sp = js_mallocz(ctx, sizeof(StmtParams))))
+    return 0;
+
+  sp->bind = js_mallocz(ctx, sizeof(MYSQL_BIND) * (count ? count : 1));
+  sp->nums = js_mallocz(ctx, sizeof(StmtNumber) * (count ? count : 1));
+
+  if(!sp->bind || !sp->nums) {
+    stmt_params_free(JS_GetRuntime(ctx), sp);
+    return 0;
+  }
+
+  for(i = 0; i < count; i++) {
+    JSValue value = array ? JS_GetPropertyUint32(ctx, argv[0], i) : JS_DupValue(ctx, argv[i]);
+    int r = stmt_param_set(ctx, &sp->bind[i], &sp->nums[i], value);
+
+    JS_FreeValue(ctx, value);
+    sp->count = i + 1;
+
+    if(r) {
+      stmt_params_free(JS_GetRuntime(ctx), sp);
+      return 0;
+    }
+  }
+
+  if(count && mysql_stmt_bind_param(st->stmt, sp->bind)) {
+    JS_Throw(ctx, stmt_error(ctx, st));
+    stmt_params_free(JS_GetRuntime(ctx), sp);
+    return 0;
+  }
+
+  return sp;
+}
+
+static void
+stmt_batch_free(JSRuntime* rt, void* ptr) {
+  StmtBatch* sb = ptr;
+
+  JS_FreeValueRT(rt, sb->array);
+  js_free_rt(rt, sb);
+}
+
+static MySQLStatement*
+js_mysqlstmt_data2(JSContext* ctx, JSValueConst value) {
+  MySQLStatement* st;
+
+  if(!(st = JS_GetOpaque2(ctx, value, js_mysqlstmt_class_id)))
+    return 0;
+
+  if(!st->stmt) {
+    JS_ThrowTypeError(ctx, "MySQLStatement is closed");
+    return 0;
+  }
+
+  if(st->busy) {
+    JS_ThrowTypeError(ctx, "MySQLStatement is busy");
+    return 0;
+  }
+
+  return st;
+}
+
+static JSValue
+js_mysqlstmt_new(JSContext* ctx, JSValueConst conn, MYSQL* my) {
+  MySQLStatement* st;
+  JSValue obj;
+
+  if(!(st = js_mallocz(ctx, sizeof(MySQLStatement))))
+    return JS_EXCEPTION;
+
+  if(!(st->stmt = mysql_stmt_init(my))) {
+    js_free(ctx, st);
+    return JS_Throw(ctx, js_mysqlerror_new(ctx, mysql_error(my)));
+  }
+
+  st->conn = JS_DupValue(ctx, conn);
+  st->eof = TRUE;
+
+  obj = JS_NewObjectProtoClass(ctx, mysqlstmt_proto, js_mysqlstmt_class_id);
+
+  if(JS_IsException(obj)) {
+    stmt_free(JS_GetRuntime(ctx), st);
+    return JS_EXCEPTION;
+  }
+
+  JS_SetOpaque(obj, st);
+  return obj;
+}
+
+#ifndef MYSQL_NO_ASYNC
+static void
+stmt_settle(JSContext* ctx, AsyncClosure* ac, MySQLStatement* st, BOOL error) {
+  st->busy = FALSE;
+
+  if(error) {
+    JSValue err = stmt_error(ctx, st);
+
+    st->eof = TRUE;
+    asyncclosure_error(ac, err);
+    JS_FreeValue(ctx, err);
+    return;
+  }
+
+  asyncclosure_resolve(ac);
+}
+
+static JSValue
+js_mysqlstmt_prepare_continue(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  AsyncClosure* ac = ptr;
+  MySQLStatement* st = JS_GetOpaque(ac->result, js_mysqlstmt_class_id);
+  int err = 0, state;
+
+  state = mysql_stmt_prepare_cont(&err, st->stmt, to_mysql_wait(ac->state));
+
+  if(state)
+    asyncclosure_change_event(ac, to_asyncevent(state));
+  else
+    stmt_settle(ctx, ac, st, err != 0);
+
+  return JS_UNDEFINED;
+}
+
+static void
+stmt_execute_settle(JSContext* ctx, AsyncClosure* ac, MySQLStatement* st, int err) {
+  BOOL error = err || stmt_bind_result(ctx, st);
+
+  st->eof = error || st->num_fields == 0;
+  stmt_settle(ctx, ac, st, error);
+}
+
+static JSValue
+js_mysqlstmt_execute_continue(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  AsyncClosure* ac = ptr;
+  MySQLStatement* st = JS_GetOpaque(ac->result, js_mysqlstmt_class_id);
+  int err = 0, state;
+
+  state = mysql_stmt_execute_cont(&err, st->stmt, to_mysql_wait(ac->state));
+
+  if(state)
+    asyncclosure_change_event(ac, to_asyncevent(state));
+  else
+    stmt_execute_settle(ctx, ac, st, err);
+
+  return JS_UNDEFINED;
+}
+
+/* like row_batch_fetch(), for the binary protocol */
+static int
+stmt_batch_fetch(JSContext* ctx, StmtBatch* sb, int ret, int state, BOOL* error) {
+  MySQLStatement* st = sb->st;
+
+  for(;;) {
+    if(state)
+      return state;
+
+    if(ret == MYSQL_NO_DATA) {
+      st->eof = TRUE;
+      return 0;
+    }
+
+    if((ret && ret != MYSQL_DATA_TRUNCATED) || stmt_fetch_truncated(ctx, st)) {
+      *error = TRUE;
+      return 0;
+    }
+
+    JS_SetPropertyUint32(ctx, sb->array, sb->rows++, stmt_row(ctx, st));
+
+    if(sb->rows >= sb->batch_size)
+      return 0;
+
+    stmt_rebind(st);
+    state = mysql_stmt_fetch_start(&ret, st->stmt);
+  }
+}
+
+static void
+stmt_batch_settle(JSContext* ctx, AsyncClosure* ac, StmtBatch* sb, BOOL error) {
+  if(!error) {
+    JS_FreeValue(ctx, ac->result);
+    ac->result = sb->rows ? JS_DupValue(ctx, sb->array) : JS_NULL;
+  }
+
+  stmt_settle(ctx, ac, sb->st, error);
+}
+
+static JSValue
+js_mysqlstmt_rows_continue(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  AsyncClosure* ac = ptr;
+  StmtBatch* sb = ac->opaque;
+  BOOL error = FALSE;
+  int ret = 0, state;
+
+  state = mysql_stmt_fetch_cont(&ret, sb->st->stmt, to_mysql_wait(ac->state));
+  state = stmt_batch_fetch(ctx, sb, ret, state, &error);
+
+  if(state)
+    asyncclosure_change_event(ac, to_asyncevent(state));
+  else
+    stmt_batch_settle(ctx, ac, sb, error);
+
+  return JS_UNDEFINED;
+}
+#endif
+
+/* prepares 'sql' on the server, resolves to a MySQLStatement */
+static JSValue
+js_mysql_prepare(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  MYSQL* my;
+  MySQLStatement* st;
+  const char* sql;
+  size_t len;
+  JSValue obj;
+
+  if(!(my = js_mysql_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(!(sql = JS_ToCStringLen(ctx, &len, argv[0])))
+    return JS_EXCEPTION;
+
+  obj = js_mysqlstmt_new(ctx, this_val, my);
+
+  if(JS_IsException(obj)) {
+    JS_FreeCString(ctx, sql);
+    return obj;
+  }
+
+  st = JS_GetOpaque(obj, js_mysqlstmt_class_id);
+
+#ifndef MYSQL_NO_ASYNC
+  AsyncClosure* ac;
+  JSValue ret;
+  char* query;
+  int err = 0, state;
+
+  query = js_strndup(ctx, sql, len);
+  JS_FreeCString(ctx, sql);
+
+  if(!query) {
+    JS_FreeValue(ctx, obj);
+    return JS_EXCEPTION;
+  }
+
+  state = mysql_stmt_prepare_start(&err, st->stmt, query, len);
+
+  if(!(ac = asyncclosure_new(ctx, js_mysql_fd(ctx, this_val), to_asyncevent(state), obj, &js_mysqlstmt_prepare_continue))) {
+    js_free(ctx, query);
+    JS_FreeValue(ctx, obj);
+    return JS_EXCEPTION;
+  }
+
+  asyncclosure_opaque(ac, query, &js_free_rt);
+  ret = asyncclosure_promise(ac);
+  st->busy = TRUE;
+  JS_FreeValue(ctx, obj);
+
+  if(state == 0)
+    stmt_settle(ctx, ac, st, err != 0);
+
+  return ret;
+#else
+  int err = mysql_stmt_prepare(st->stmt, sql, len);
+
+  JS_FreeCString(ctx, sql);
+
+  if(err) {
+    JSValue error = stmt_error(ctx, st);
+
+    JS_FreeValue(ctx, obj);
+    return JS_Throw(ctx, error);
+  }
+
+  return obj;
+#endif
+}
+
+/* binds the parameters and executes, resolves to the statement itself */
+static JSValue
+js_mysqlstmt_execute(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  MySQLStatement* st;
+  StmtParams* sp;
+
+  if(!(st = js_mysqlstmt_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(!(sp = stmt_params_new(ctx, st, argc, argv)))
+    return JS_EXCEPTION;
+
+#ifndef MYSQL_NO_ASYNC
+  AsyncClosure* ac;
+  JSValue ret;
+  int err = 0, state;
+
+  state = mysql_stmt_execute_start(&err, st->stmt);
+
+  if(!(ac = asyncclosure_new(ctx, js_mysql_fd(ctx, st->conn), to_asyncevent(state), this_val, &js_mysqlstmt_execute_continue))) {
+    stmt_params_free(JS_GetRuntime(ctx), sp);
+    return JS_EXCEPTION;
+  }
+
+  asyncclosure_opaque(ac, sp, &stmt_params_free);
+  ret = asyncclosure_promise(ac);
+  st->busy = TRUE;
+
+  if(state == 0)
+    stmt_execute_settle(ctx, ac, st, err);
+
+  return ret;
+#else
+  int err = mysql_stmt_execute(st->stmt);
+
+  stmt_params_free(JS_GetRuntime(ctx), sp);
+
+  if(err || stmt_bind_result(ctx, st)) {
+    st->eof = TRUE;
+    return JS_Throw(ctx, stmt_error(ctx, st));
+  }
+
+  st->eof = st->num_fields == 0;
+  return JS_DupValue(ctx, this_val);
+#endif
+}
+
+/* fetches up to 'batch_size' rows of the last execute(), null at the end */
+static JSValue
+js_mysqlstmt_rows(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  MySQLStatement* st;
+  StmtBatch* sb;
+  uint32_t batch_size = 1000;
+
+  if(!(st = js_mysqlstmt_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(argc > 0 && !JS_IsUndefined(argv[0]))
+    if(JS_ToUint32(ctx, &batch_size, argv[0]) || batch_size == 0)
+      return JS_ThrowRangeError(ctx, "argument 1 must be a positive batch size");
+
+  if(!(sb = js_mallocz(ctx, sizeof(StmtBatch))))
+    return JS_EXCEPTION;
+
+  sb->st = st;
+  sb->batch_size = batch_size;
+  sb->array = JS_NewArray(ctx);
+
+#ifndef MYSQL_NO_ASYNC
+  BOOL error = FALSE;
+  int ret = 0, state = 0;
+  AsyncClosure* ac;
+  JSValue promise;
+
+  if(!st->eof) {
+    stmt_rebind(st);
+    state = mysql_stmt_fetch_start(&ret, st->stmt);
+    state = stmt_batch_fetch(ctx, sb, ret, state, &error);
+  }
+
+  if(!(ac = asyncclosure_new(ctx, js_mysql_fd(ctx, st->conn), to_asyncevent(state), this_val, &js_mysqlstmt_rows_continue))) {
+    stmt_batch_free(JS_GetRuntime(ctx), sb);
+    return JS_EXCEPTION;
+  }
+
+  asyncclosure_opaque(ac, sb, &stmt_batch_free);
+  promise = asyncclosure_promise(ac);
+  st->busy = TRUE;
+
+  if(state == 0)
+    stmt_batch_settle(ctx, ac, sb, error);
+
+  return promise;
+#else
+  JSValue ret = JS_NULL;
+  int r;
+
+  while(!st->eof && sb->rows < batch_size) {
+    stmt_rebind(st);
+
+    if((r = mysql_stmt_fetch(st->stmt)) == MYSQL_NO_DATA) {
+      st->eof = TRUE;
+      break;
+    }
+
+    if((r && r != MYSQL_DATA_TRUNCATED) || stmt_fetch_truncated(ctx, st)) {
+      st->eof = TRUE;
+      stmt_batch_free(JS_GetRuntime(ctx), sb);
+      return JS_Throw(ctx, stmt_error(ctx, st));
+    }
+
+    JS_SetPropertyUint32(ctx, sb->array, sb->rows++, stmt_row(ctx, st));
+  }
+
+  if(sb->rows)
+    ret = JS_DupValue(ctx, sb->array);
+
+  stmt_batch_free(JS_GetRuntime(ctx), sb);
+  return ret;
+#endif
+}
+
+enum {
+  STMT_PARAM_COUNT,
+  STMT_FIELD_COUNT,
+  STMT_AFFECTED_ROWS,
+  STMT_INSERT_ID,
+  STMT_EOF,
+};
+
+static JSValue
+js_mysqlstmt_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  MySQLStatement* st;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(st = JS_GetOpaque2(ctx, this_val, js_mysqlstmt_class_id)))
+    return JS_EXCEPTION;
+
+  if(!st->stmt)
+    return magic == STMT_EOF ? JS_TRUE : JS_UNDEFINED;
+
+  switch(magic) {
+    case STMT_PARAM_COUNT: {
+      ret = JS_NewUint32(ctx, mysql_stmt_param_count(st->stmt));
+      break;
+    }
+
+    case STMT_FIELD_COUNT: {
+      ret = JS_NewUint32(ctx, mysql_stmt_field_count(st->stmt));
+      break;
+    }
+
+    case STMT_AFFECTED_ROWS: {
+      ret = JS_NewInt64(ctx, (int64_t)mysql_stmt_affected_rows(st->stmt));
+      break;
+    }
+
+    case STMT_INSERT_ID: {
+      ret = JS_NewInt64(ctx, mysql_stmt_insert_id(st->stmt));
+      break;
+    }
+
+    case STMT_EOF: {
+      ret = JS_NewBool(ctx, st->eof);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static JSValue
+js_mysqlstmt_fields(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  MySQLStatement* st;
+  MYSQL_RES* meta;
+  JSValue ret = JS_NewArray(ctx);
+
+  if(!(st = js_mysqlstmt_data2(ctx, this_val))) {
+    JS_FreeValue(ctx, ret);
+    return JS_EXCEPTION;
+  }
+
+  if((meta = st->meta ? st->meta : mysql_stmt_result_metadata(st->stmt))) {
+    MYSQL_FIELD* fields = mysql_fetch_fields(meta);
+    uint32_t i, num_fields = mysql_num_fields(meta);
+
+    for(i = 0; i < num_fields; i++)
+      JS_SetPropertyUint32(ctx, ret, i, field_array(ctx, &fields[i]));
+
+    if(meta != st->meta)
+      mysql_free_result(meta);
+  }
+
+  return ret;
+}
+
+static JSValue
+js_mysqlstmt_close(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  MySQLStatement* st;
+
+  if(!(st = js_mysqlstmt_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  stmt_columns_free(JS_GetRuntime(ctx), st);
+  mysql_stmt_close(st->stmt);
+  st->stmt = 0;
+  st->eof = TRUE;
+
+  return JS_UNDEFINED;
+}
+
+static void
+js_mysqlstmt_finalizer(JSRuntime* rt, JSValue val) {
+  MySQLStatement* st;
+
+  if((st = JS_GetOpaque(val, js_mysqlstmt_class_id)))
+    stmt_free(rt, st);
+}
+
+static JSClassDef js_mysqlstmt_class = {
+    .class_name = "MySQLStatement",
+    .finalizer = js_mysqlstmt_finalizer,
+};
+
+static const JSCFunctionListEntry js_mysqlstmt_funcs[] = {
+    JS_CFUNC_DEF("execute", 0, js_mysqlstmt_execute),
+    JS_CFUNC_DEF("fetchRows", 1, js_mysqlstmt_rows),
+    JS_CFUNC_DEF("fetchFields", 0, js_mysqlstmt_fields),
+    JS_CFUNC_DEF("close", 0, js_mysqlstmt_close),
+    JS_CGETSET_MAGIC_DEF("paramCount", js_mysqlstmt_get, 0, STMT_PARAM_COUNT),
+    JS_CGETSET_MAGIC_DEF("fieldCount", js_mysqlstmt_get, 0, STMT_FIELD_COUNT),
+    JS_CGETSET_MAGIC_DEF("affectedRows", js_mysqlstmt_get, 0, STMT_AFFECTED_ROWS),
+    JS_CGETSET_MAGIC_DEF("insertId", js_mysqlstmt_get, 0, STMT_INSERT_ID),
+    JS_CGETSET_MAGIC_DEF("eof", js_mysqlstmt_get, 0, STMT_EOF),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "MySQLStatement", JS_PROP_CONFIGURABLE),
+};
+
+static char*
+field_id(JSContext* ctx, MYSQL_FIELD const* field) {
+  DynBuf buf;
+
+  dbuf_init2(&buf, 0, 0);
+  dbuf_put(&buf, (const uint8_t*)field->table, field->table_length);
+  dbuf_putstr(&buf, ".");
+  dbuf_put(&buf, (const uint8_t*)field->name, field->name_length);
+  dbuf_0(&buf);
+
+  return (char*)buf.buf;
+}
+
+static char*
+field_name(JSContext* ctx, MYSQL_FIELD const* field) {
+  return js_strndup(ctx, field->name, field->name_length);
+}
+
+static FieldNameFunc*
+field_namefunc(MYSQL_FIELD* fields, uint32_t num_fields) {
+  BOOL eq = FALSE;
+
+  for(uint32_t i = 0; !eq && i < num_fields; i++)
+    for(uint32_t j = 0; !eq && j < num_fields; j++)
+      if(i != j && fields[i].name_length == fields[j].name_length && byte_equal(fields[i].name, fields[i].name_length, fields[j].name))
+        return field_id;
+
+  return field_name;
+}
+
+static JSValue
+field_array(JSContext* ctx, MYSQL_FIELD* field) {
+  JSValue ret = JS_NewArray(ctx);
+  const char* type = 0;
+  DynBuf buf;
 
   dbuf_init2(&buf, 0, 0);
 
@@ -2158,6 +3474,13 @@ js_mysql_init(JSContext* ctx, JSModuleDef* m) {
   JS_SetPropertyFunctionList(ctx, mysqlresult_proto, js_mysqlresult_funcs, countof(js_mysqlresult_funcs));
   JS_SetClassProto(ctx, js_mysqlresult_class_id, mysqlresult_proto);
 
+  JS_NewClassID(&js_mysqlstmt_class_id);
+  JS_NewClass(JS_GetRuntime(ctx), js_mysqlstmt_class_id, &js_mysqlstmt_class);
+
+  mysqlstmt_proto = JS_NewObject(ctx);
+  JS_SetPropertyFunctionList(ctx, mysqlstmt_proto, js_mysqlstmt_funcs, countof(js_mysqlstmt_funcs));
+  JS_SetClassProto(ctx, js_mysqlstmt_class_id, mysqlstmt_proto);
+
   if(m) {
     JS_SetModuleExport(ctx, m, "MySQL", mysql_ctor);
     JS_SetModuleExport(ctx, m, "MySQLError", mysqlerror_ctor);
@@ -7,9 +7,11 @@
 
 #include <stddef.h>
 #include <sys/types.h>
+#include <errno.h>
 #include <limits.h>
 #include <string.h>
 
+#include "glob-set.h"
 #include "path.h"
 #include "utils.h"
 #ifdef _WIN32
@@ -336,6 +338,27 @@ js_path_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst arg
       break;
     }
 
+    case PATH_NORMALIZE: {
+      char* out;
+
+      if(!JS_IsString(argv[0])) {
+        ret = JS_ThrowTypeError(ctx, "argument 1 must be a string");
+        break;
+      }
+
+      if(!(out = alen < sizeof(buf) ? buf : js_malloc(ctx, alen + 1))) {
+        ret = JS_EXCEPTION;
+        break;
+      }
+
+      ret = JS_NewStringLen(ctx, out, path_normalize4(a, alen, out, alen + 1));
+
+      if(out != buf)
+        js_free(ctx, out);
+
+      break;
+    }
+
     case PATH_TOARRAY: {
       ret = JS_NewArray(ctx);
       uint32_t idx = 0;
@@ -384,11 +407,6 @@ js_path_method_dbuf(JSContext* ctx, JSValueConst this_val, int argc, JSValueCons
       break;
     }
 
-    case PATH_NORMALIZE: {
-      path_normalize3(a, alen, &db);
-      break;
-    }
-
     case PATH_REALPATH: {
       if(!path_realpath3(a, alen, &db))
         ret = JS_NULL;
@@ -606,75 +624,403 @@ js_path_format(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst arg
   return ret;
 }
 
+/* equal paths share one string: the atom's, which lives as long as it is used */
+static JSValue
+js_path_intern(JSContext* ctx, const char* path, size_t len) {
+  JSAtom atom;
+  JSValue ret;
+
+  if((atom = JS_NewAtomLen(ctx, path, len)) == JS_ATOM_NULL)
+    return JS_EXCEPTION;
+
+  ret = JS_AtomToString(ctx, atom);
+  JS_FreeAtom(ctx, atom);
+  return ret;
+}
+
 static JSValue
 js_path_resolve(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
-  DynBuf db = DBUF_INIT_0(), cwd = DBUF_INIT_0();
-  int i;
-  const char* str;
-  size_t len = 0;
-  JSValue ret = JS_UNDEFINED;
+  const char* parts_buf[8];
+  size_t lens_buf[8];
+  const char** parts = parts_buf;
+  size_t* lens = lens_buf;
+  char cwd[PATH_MAX + 1], buf[PATH_MAX + 1], *out = buf;
+  JSValue ret = JS_EXCEPTION;
   BOOL absolute = FALSE;
+  int i, n = 0;
+  size_t len;
 
-  dbuf_init_ctx(ctx, &db);
-  dbuf_0(&db);
+  /* parts[0] is the working directory, when none is absolute */
+  if(argc + 1 > (int)countof(parts_buf)) {
+    if(!(parts = js_mallocz(ctx, (argc + 1) * sizeof(char*))) || !(lens = js_malloc(ctx, (argc + 1) * sizeof(size_t))))
+      goto fail;
+  }
 
-  for(i = argc - 1; i >= 0; i--) {
+  for(i = 0; i < argc; i++) {
     if(!JS_IsString(argv[i])) {
-      ret = JS_ThrowTypeError(ctx, "argument #%d is not a string", i);
+      JS_ThrowTypeError(ctx, "argument #%d is not a string", i);
       goto fail;
     }
 
-    str = JS_ToCStringLen(ctx, &len, argv[i]);
+    if(!(parts[i + 1] = JS_ToCStringLen(ctx, &lens[i + 1], argv[i])))
+      goto fail;
 
-    while(len > 0 && str[len - 1] == PATHSEP_C)
-      len--;
+    n = i + 1;
+
+    if(path_isabsolute2(parts[i + 1], lens[i + 1]))
+      absolute = TRUE;
+  }
 
-    if(dbuf_reserve_start(&db, len + 1))
+  parts[0] = cwd;
+  lens[0] = 0;
+
+  if(!absolute && getcwd(cwd, sizeof(cwd)))
+    lens[0] = strlen(cwd);
+
+  if((len = path_resolve5(parts, lens, n + 1, buf, sizeof(buf))) >= sizeof(buf)) {
+    if(!(out = js_malloc(ctx, len + 1)))
       goto fail;
 
-    if(len > 0) {
-      memcpy(db.buf, str, len);
-      db.buf[len] = PATHSEP_C;
+    len = path_resolve5(parts, lens, n + 1, out, len + 1);
+  }
+
+  ret = JS_NewStringLen(ctx, out, len);
+
+  if(out != buf)
+    js_free(ctx, out);
+
+fail:
+  for(i = 1; i <= n; i++)
+    JS_FreeCString(ctx, parts[i]);
+
+  if(parts != parts_buf) {
+    if(parts)
+      js_free(ctx, parts);
+    if(lens != lens_buf)
+      js_free(ctx, lens);
+  }
+
+  return ret;
+}
+
+enum {
+  PATH_NORMALIZE_MANY = 0,
+  PATH_INTERN,
+};
+
+/* normalizeMany(paths) and intern(path): the results are interned, the
+ * paths are normalized in one buffer */
+static JSValue
+js_path_interned(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  char buf[PATH_MAX + 1], *out = buf;
+  size_t size = sizeof(buf);
+  JSValue ret = JS_UNDEFINED;
+  int64_t i, n = 1;
+
+  if(magic == PATH_NORMALIZE_MANY) {
+    if(!JS_IsObject(argv[0]) || (n = js_array_length(ctx, argv[0])) < 0)
+      return JS_ThrowTypeError(ctx, "argument 1 must be an array");
+
+    ret = JS_NewArray(ctx);
+  }
+
+  for(i = 0; i < n; i++) {
+    JSValue value = magic == PATH_NORMALIZE_MANY ? JS_GetPropertyInt64(ctx, argv[0], i) : JS_DupValue(ctx, argv[0]);
+    const char* str = 0;
+    size_t len;
+    JSValue result = JS_EXCEPTION;
+
+    if(!JS_IsString(value))
+      JS_ThrowTypeError(ctx, "path #%" PRId64 " is not a string", i);
+    else if((str = JS_ToCStringLen(ctx, &len, value))) {
+      if(len >= size) {
+        char* ptr;
+
+        if((ptr = js_realloc(ctx, out == buf ? 0 : out, len + 1))) {
+          out = ptr;
+          size = len + 1;
+        }
+      }
+
+      if(len < size)
+        result = js_path_intern(ctx, out, path_normalize4(str, len, out, size));
+
+      JS_FreeCString(ctx, str);
     }
 
-    JS_FreeCString(ctx, str);
+    JS_FreeValue(ctx, value);
 
-    if((absolute = path_isabsolute2((const char*)db.buf, db.size)))
+    if(JS_IsException(result)) {
+      JS_FreeValue(ctx, ret);
+      ret = JS_EXCEPTION;
       break;
+    }
+
+    if(magic == PATH_NORMALIZE_MANY)
+      JS_SetPropertyInt64(ctx, ret, i, result);
+    else
+      ret = result;
   }
 
-  if(!absolute) {
-    dbuf_init_ctx(ctx, &cwd);
-    str = path_getcwd1(&cwd);
-    len = cwd.size;
+  if(out != buf)
+    js_free(ctx, out);
 
-    if(dbuf_reserve_start(&db, len + 1))
-      goto fail;
+  return ret;
+}
 
-    if(len > 0) {
-      memcpy(db.buf, str, len);
-      db.buf[len] = PATHSEP_C;
-    }
+typedef struct {
+  GlobSet* set;
+  JSValue patterns;
+} JSGlobSet;
+
+enum {
+  GLOBSET_ADD,
+  GLOBSET_MATCH,
+  GLOBSET_TEST,
+  GLOBSET_FILTER,
+};
+
+enum {
+  GLOBSET_SIZE,
+  GLOBSET_PATTERNS,
+};
+
+static JSClassID js_globset_class_id = 0;
+static JSValue globset_proto, globset_ctor;
+
+static int
+js_globset_add(JSContext* ctx, JSGlobSet* gs, JSValueConst pattern) {
+  const char* str;
+  size_t len;
+  int ret;
+
+  if(!(str = JS_ToCStringLen(ctx, &len, pattern)))
+    return -1;
+
+  if((ret = globset_add(gs->set, str, len)) == -1)
+    JS_ThrowInternalError(ctx, "GlobSet: failed adding pattern '%s': %s", str, strerror(errno));
+  else
+    JS_SetPropertyUint32(ctx, gs->patterns, ret, JS_NewStringLen(ctx, str, len));
+
+  JS_FreeCString(ctx, str);
+  return ret;
+}
+
+static JSValue
+js_globset_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  JSValue proto, obj = JS_UNDEFINED;
+  JSGlobSet* gs;
+
+  if(!(gs = js_mallocz(ctx, sizeof(JSGlobSet))))
+    return JS_EXCEPTION;
+
+  gs->patterns = JS_NewArray(ctx);
 
-    dbuf_free(&cwd);
+  if(!(gs->set = globset_new())) {
+    JS_ThrowOutOfMemory(ctx);
+    goto fail;
   }
 
-  dbuf_0(&db);
+  /* using new_target to get the prototype is necessary when the class is extended. */
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+  if(JS_IsException(proto))
+    goto fail;
 
-  if(db.size) {
-    db.size = path_normalize2((char*)db.buf, db.size);
+  obj = JS_NewObjectProtoClass(ctx, proto, js_globset_class_id);
+  JS_FreeValue(ctx, proto);
 
-    while(db.size > 0 && db.buf[db.size - 1] == PATHSEP_C)
-      db.size--;
+  if(JS_IsException(obj))
+    goto fail;
 
-    ret = JS_NewStringLen(ctx, (const char*)db.buf, db.size);
+  JS_SetOpaque(obj, gs);
+
+  if(argc > 0 && !js_is_null_or_undefined(argv[0])) {
+    if(JS_IsArray(ctx, argv[0])) {
+      int64_t i, len = js_array_length(ctx, argv[0]);
+
+      for(i = 0; i < len; i++) {
+        JSValue pattern = JS_GetPropertyUint32(ctx, argv[0], i);
+        int ret = js_globset_add(ctx, gs, pattern);
+
+        JS_FreeValue(ctx, pattern);
+
+        if(ret == -1)
+          goto fail_obj;
+      }
+    } else if(js_globset_add(ctx, gs, argv[0]) == -1) {
+      goto fail_obj;
+    }
   }
 
+  return obj;
+
 fail:
-  dbuf_free(&db);
+  if(gs->set)
+    globset_free(gs->set);
+
+  JS_FreeValue(ctx, gs->patterns);
+  js_free(ctx, gs);
+
+fail_obj:
+  JS_FreeValue(ctx, obj);
+  return JS_EXCEPTION;
+}
+
+static JSValue
+js_globset_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  JSGlobSet* gs;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(gs = JS_GetOpaque2(ctx, this_val, js_globset_class_id)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case GLOBSET_ADD: {
+      int index;
+
+      if((index = js_globset_add(ctx, gs, argv[0])) == -1)
+        return JS_EXCEPTION;
+
+      ret = JS_NewInt32(ctx, index);
+      break;
+    }
+
+    case GLOBSET_MATCH: {
+      uint32_t i, n = 0, count = globset_count(gs->set);
+      uint8_t* hits;
+      const char* str;
+      size_t len;
+
+      if(!(str = JS_ToCStringLen(ctx, &len, argv[0])))
+        return JS_EXCEPTION;
+
+      if(!(hits = js_malloc(ctx, count + 1))) {
+        JS_FreeCString(ctx, str);
+        return JS_EXCEPTION;
+      }
+
+      if(globset_match(gs->set, str, len, hits) == -1) {
+        ret = JS_ThrowOutOfMemory(ctx);
+      } else {
+        ret = JS_NewArray(ctx);
+
+        for(i = 0; i < count; i++)
+          if(hits[i])
+            JS_SetPropertyUint32(ctx, ret, n++, JS_NewUint32(ctx, i));
+      }
+
+      js_free(ctx, hits);
+      JS_FreeCString(ctx, str);
+      break;
+    }
+
+    case GLOBSET_TEST: {
+      const char* str;
+      size_t len;
+      int result;
+
+      if(!(str = JS_ToCStringLen(ctx, &len, argv[0])))
+        return JS_EXCEPTION;
+
+      result = globset_test(gs->set, str, len);
+      JS_FreeCString(ctx, str);
+
+      ret = result == -1 ? JS_ThrowOutOfMemory(ctx) : JS_NewBool(ctx, result);
+      break;
+    }
+
+    case GLOBSET_FILTER: {
+      int64_t i, len = js_array_length(ctx, argv[0]);
+      uint32_t n = 0;
+
+      if(len < 0)
+        return JS_ThrowTypeError(ctx, "argument 1 must be an array");
+
+      ret = JS_NewArray(ctx);
+
+      for(i = 0; i < len; i++) {
+        JSValue path = JS_GetPropertyUint32(ctx, argv[0], i);
+        const char* str;
+        size_t slen;
+        int result;
+
+        if(!(str = JS_ToCStringLen(ctx, &slen, path))) {
+          JS_FreeValue(ctx, path);
+          JS_FreeValue(ctx, ret);
+          return JS_EXCEPTION;
+        }
+
+        result = globset_test(gs->set, str, slen);
+        JS_FreeCString(ctx, str);
+
+        if(result == 1)
+          JS_SetPropertyUint32(ctx, ret, n++, path);
+        else
+          JS_FreeValue(ctx, path);
+      }
+
+      break;
+    }
+  }
+
   return ret;
 }
 
+static JSValue
+js_globset_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  JSGlobSet* gs;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(gs = JS_GetOpaque2(ctx, this_val, js_globset_class_id)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case GLOBSET_SIZE: {
+      ret = JS_NewUint32(ctx, globset_count(gs->set));
+      break;
+    }
+
+    case GLOBSET_PATTERNS: {
+      uint32_t i, count = globset_count(gs->set);
+
+      ret = JS_NewArray(ctx);
+
+      for(i = 0; i < count; i++)
+        JS_SetPropertyUint32(ctx, ret, i, JS_GetPropertyUint32(ctx, gs->patterns, i));
+
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static void
+js_globset_finalizer(JSRuntime* rt, JSValue val) {
+  JSGlobSet* gs;
+
+  if((gs = JS_GetOpaque(val, js_globset_class_id))) {
+    globset_free(gs->set);
+    JS_FreeValueRT(rt, gs->patterns);
+    js_free_rt(rt, gs);
+  }
+}
+
+static JSClassDef js_globset_class = {
+    .class_name = "GlobSet",
+    .finalizer = js_globset_finalizer,
+};
+
+static const JSCFunctionListEntry js_globset_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("add", 1, js_globset_method, GLOBSET_ADD),
+    JS_CFUNC_MAGIC_DEF("match", 1, js_globset_method, GLOBSET_MATCH),
+    JS_CFUNC_MAGIC_DEF("test", 1, js_globset_method, GLOBSET_TEST),
+    JS_CFUNC_MAGIC_DEF("filter", 1, js_globset_method, GLOBSET_FILTER),
+    JS_CGETSET_MAGIC_DEF("size", js_globset_get, 0, GLOBSET_SIZE),
+    JS_CGETSET_MAGIC_DEF("patterns", js_globset_get, 0, GLOBSET_PATTERNS),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "GlobSet", JS_PROP_CONFIGURABLE),
+};
+
 static const JSCFunctionListEntry js_path_funcs[] = {
     JS_CFUNC_MAGIC_DEF("basename", 1, js_path_method, PATH_BASENAME),
     JS_CFUNC_MAGIC_DEF("basepos", 1, js_path_method, PATH_BASEPOS),
@@ -709,7 +1055,7 @@ static const JSCFunctionListEntry js_path_funcs[] = {
     JS_CFUNC_MAGIC_DEF("isSeparator", 1, js_path_method, PATH_IS_SEPARATOR),
     JS_CFUNC_MAGIC_DEF("absolute", 1, js_path_method_dbuf, PATH_ABSOLUTE),
     JS_CFUNC_MAGIC_DEF("canonical", 1, js_path_method_dbuf, PATH_CANONICAL),
-    JS_CFUNC_MAGIC_DEF("normalize", 1, js_path_method_dbuf, PATH_NORMALIZE),
+    JS_CFUNC_MAGIC_DEF("normalize", 1, js_path_method, PATH_NORMALIZE),
     JS_CFUNC_MAGIC_DEF("realpath", 1, js_path_method_dbuf, PATH_REALPATH),
     JS_CFUNC_MAGIC_DEF("at", 2, js_path_method, PATH_AT),
     JS_CFUNC_MAGIC_DEF("search", 2, js_path_method_dbuf, PATH_SEARCH),
@@ -722,6 +1068,8 @@ static const JSCFunctionListEntry js_path_funcs[] = {
     JS_CFUNC_DEF("parse", 1, js_path_parse),
     JS_CFUNC_DEF("format", 1, js_path_format),
     JS_CFUNC_DEF("resolve", 1, js_path_resolve),
+    JS_CFUNC_MAGIC_DEF("normalizeMany", 1, js_path_interned, PATH_NORMALIZE_MANY),
+    JS_CFUNC_MAGIC_DEF("intern", 1, js_path_interned, PATH_INTERN),
     JS_PROP_STRING_DEF("delimiter", PATHDELIM_S, JS_PROP_CONFIGURABLE),
     JS_PROP_STRING_DEF("sep", PATHSEP_S, JS_PROP_CONFIGURABLE),
     JS_PROP_INT32_DEF("FNM_NOMATCH", PATH_FNM_NOMATCH, JS_PROP_CONFIGURABLE),
@@ -732,8 +1080,20 @@ static const JSCFunctionListEntry js_path_funcs[] = {
 
 static int
 js_path_init(JSContext* ctx, JSModuleDef* m) {
-  if(m)
+  JS_NewClassID(&js_globset_class_id);
+  JS_NewClass(JS_GetRuntime(ctx), js_globset_class_id, &js_globset_class);
+
+  globset_ctor = JS_NewCFunction2(ctx, js_globset_constructor, "GlobSet", 1, JS_CFUNC_constructor, 0);
+  globset_proto = JS_NewObject(ctx);
+
+  JS_SetPropertyFunctionList(ctx, globset_proto, js_globset_funcs, countof(js_globset_funcs));
+  JS_SetClassProto(ctx, js_globset_class_id, globset_proto);
+  JS_SetConstructor(ctx, globset_ctor, globset_proto);
+
+  if(m) {
     JS_SetModuleExportList(ctx, m, js_path_funcs, countof(js_path_funcs));
+    JS_SetModuleExport(ctx, m, "GlobSet", globset_ctor);
+  }
 
   return 0;
 }
@@ -748,8 +1108,10 @@ VISIBLE JSModuleDef*
 JS_INIT_MODULE(JSContext* ctx, const char* module_name) {
   JSModuleDef* m;
 
-  if((m = JS_NewCModule(ctx, module_name, js_path_init)))
+  if((m = JS_NewCModule(ctx, module_name, js_path_init))) {
     JS_AddModuleExportList(ctx, m, js_path_funcs, countof(js_path_funcs));
+    JS_AddModuleExport(ctx, m, "GlobSet");
+  }
 
   return m;
 }
@@ -6,14 +6,16 @@
 #include "js-utils.h"
 #include "iteration.h"
 #include "property-enumeration.h"
+#include "column-builder.h"
+#include "stream-utils.h"
 
 /**
  * \addtogroup quickjs-pgsql
  * @{
  */
 
-VISIBLE JSClassID js_pgsqlerror_class_id = 0, js_pgconn_class_id = 0, js_pgresult_class_id = 0;
-static JSValue pgsqlerror_proto, pgsqlerror_ctor, pgsql_proto, pgsql_ctor, pgresult_proto, pgresult_ctor;
+VISIBLE JSClassID js_pgsqlerror_class_id = 0, js_pgconn_class_id = 0, js_pgresult_class_id = 0, js_pgstream_class_id = 0;
+static JSValue pgsqlerror_proto, pgsqlerror_ctor, pgsql_proto, pgsql_ctor, pgresult_proto, pgresult_ctor, pgstream_proto;
 
 static JSValue js_pgresult_wrap(JSContext* ctx, PGresult* res);
 static JSValue string_to_value(JSContext* ctx, const char* func_name, const char* s);
@@ -44,6 +46,73 @@ struct PGConnection {
   PGconn* conn;
   BOOL nonblocking;
   struct PGResult* result;
+  struct list_head requests, prepared;
+  uint32_t syncs;
+  BOOL reading, writing;
+};
+
+enum {
+  REQUEST_QUERY,
+  REQUEST_PREPARE,
+  REQUEST_DESCRIBE,
+  REQUEST_EXEC_PREPARED,
+  REQUEST_COPY,
+  REQUEST_STREAM,
+};
+
+/* A command of a nonblocking connection. Requests are sent in order, all
+ * at once in pipeline mode and one after the other otherwise, and settled
+ * when their results have been read. 'sync' ends a pipeline segment after
+ * the command, so an error doesn't abort the requests which follow */
+struct PGRequest {
+  struct list_head link;
+  int op;
+  BOOL sent, sync, reject;
+  char *name, *sql;
+  JSValue params;
+  Oid* types;
+  int num_types;
+  PGresult* result;
+  struct PGCopy* copy;
+  struct PGStream* stream;
+  ResolveFunctions funcs;
+};
+
+/* Parameter types of a statement from prepare(), for binary parameters */
+struct PGPrepared {
+  struct list_head link;
+  char* name;
+  int num_params;
+  Oid* types;
+  BOOL described;
+};
+
+/* Source or destination of copyFrom()/copyTo(): a Reader/Writer from
+ * stream-utils.c, or in 'stream' the reader of a ReadableStream, an async
+ * iterator or the writer of a WritableStream, whose promises are waited
+ * for before more data is read or requested from the server */
+struct PGCopy {
+  Reader reader;
+  Writer writer;
+  JSValue stream;
+  const char* method;
+  DynBuf* collect;
+  uint8_t* buf;
+  size_t len;
+  char* error;
+  BOOL in, owned, started, active, waiting, ended, blocked;
+};
+
+/* Rows of stream() in single-row (or chunked) mode, shared between the
+ * PGstream object and its request. Rows are converted as they arrive and
+ * handed out in batches; while a complete batch waits for next(), the
+ * connection isn't read any further */
+struct PGStream {
+  int ref_count;
+  JSValue conn, batch, ready, error;
+  uint32_t batch_size, rows;
+  ResolveFunctions next;
+  BOOL blocking, done, closed;
 };
 
 struct PGConnectParameters {
@@ -55,10 +124,15 @@ typedef struct PGConnection PGSQLConnection;
 typedef struct PGResult PGSQLResult;
 typedef struct PGResultIterator PGSQLResultIterator;
 typedef struct PGConnectParameters PGSQLConnectParameters;
+typedef struct PGRequest PGSQLRequest;
+typedef struct PGPrepared PGSQLPrepared;
+typedef struct PGCopy PGSQLCopy;
+typedef struct PGStream PGSQLStream;
 
 typedef char* FieldNameFunc(JSContext*, PGSQLResult*, int field);
 typedef JSValue RowValueFunc(JSContext*, PGSQLResult*, int, int);
 
+static JSValue result_array(JSContext*, PGSQLResult*, int, int);
 static char* field_id(JSContext* ctx, PGSQLResult*, int field);
 static char* field_name(JSContext* ctx, PGSQLResult*, int field);
 static FieldNameFunc* field_namefunc(PGresult* res);
@@ -87,6 +161,8 @@ static void pgresult_set_conn(PGSQLResult*, PGSQLConnection*, JSContext*);
 
 static JSValue js_pgresult_new(JSContext*, JSValueConst, PGresult*);
 static JSValue js_pgsqlerror_new(JSContext*, const char*);
+static void pgrequest_free(JSRuntime*, PGSQLRequest*);
+static void pgconn_prepared_free(JSRuntime*, PGSQLPrepared*);
 
 static void
 connectparams_parse(JSContext* ctx, PGSQLConnectParameters* c, const char* params) {
@@ -405,6 +481,8 @@ pgconn_new(JSContext* ctx) {
     return 0;
 
   *pq = (PGSQLConnection){1, NULL, FALSE, NULL};
+  init_list_head(&pq->requests);
+  init_list_head(&pq->prepared);
 
   return pq;
 }
@@ -419,6 +497,20 @@ pgconn_dup(PGSQLConnection* pq) {
 static void
 pgconn_free(PGSQLConnection* pq, JSRuntime* rt) {
   if(--pq->ref_count == 0) {
+    struct list_head *el, *next;
+
+    list_for_each_safe(el, next, &pq->requests) {
+      PGSQLRequest* req = list_entry(el, PGSQLRequest, link);
+
+      pgrequest_free(rt, req);
+    }
+
+    list_for_each_safe(el, next, &pq->prepared) {
+      PGSQLPrepared* ps = list_entry(el, PGSQLPrepared, link);
+
+      pgconn_prepared_free(rt, ps);
+    }
+
     if(pq->result) {
       pgresult_free(rt, pq->result, 0);
       pq->result = 0;
@@ -438,6 +530,15 @@ pgconn_nonblock(PGSQLConnection* pq) {
   return pq->conn ? PQisnonblocking(pq->conn) : pq->nonblocking;
 }
 
+static BOOL
+pgconn_pipeline(PGSQLConnection* pq) {
+#ifdef LIBPQ_HAS_PIPELINING
+  return pq->conn && PQpipelineStatus(pq->conn) != PQ_PIPELINE_OFF;
+#else
+  return FALSE;
+#endif
+}
+
 static const char*
 pgconn_error(PGSQLConnection* pq) {
   return PQerrorMessage(pq->conn);
@@ -596,6 +697,8 @@ js_pgconn_methods(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
 enum {
   PROP_CMD_TUPLES,
   PROP_NONBLOCKING,
+  PROP_PIPELINE,
+  PROP_PENDING,
   PROP_FD,
   PROP_OPTIONS,
   PROP_ERRNO,
@@ -639,6 +742,23 @@ js_pgconn_get(JSContext* ctx, JSValueConst this_val, int magic) {
       break;
     }
 
+    case PROP_PIPELINE: {
+      ret = JS_NewBool(ctx, pgconn_pipeline(pq));
+      break;
+    }
+
+    case PROP_PENDING: {
+      struct list_head* el;
+      uint32_t n = 0;
+
+      list_for_each(el, &pq->requests) {
+        ++n;
+      }
+
+      ret = JS_NewUint32(ctx, n);
+      break;
+    }
+
     case PROP_FD: {
       ret = JS_NewInt32(ctx, PQsocket(pq->conn));
       break;
@@ -762,6 +882,25 @@ js_pgconn_set(JSContext* ctx, JSValueConst this_val, JSValueConst value, int mag
       break;
     }
 
+    case PROP_PIPELINE: {
+#ifdef LIBPQ_HAS_PIPELINING
+      BOOL enable = JS_ToBool(ctx, value);
+
+      if(!pq->conn || !pgconn_nonblock(pq))
+        return JS_ThrowTypeError(ctx, "pipeline mode needs a nonblocking connection");
+
+      if(enable == pgconn_pipeline(pq))
+        break;
+
+      /* both fail unless the connection is idle */
+      if(!(enable ? PQenterPipelineMode(pq->conn) : PQexitPipelineMode(pq->conn)))
+        return JS_Throw(ctx, js_pgsqlerror_new(ctx, pgconn_error(pq)));
+#else
+      return JS_ThrowInternalError(ctx, "libpq has no pipeline mode");
+#endif
+      break;
+    }
+
     case PROP_CLIENT_ENCODING: {
       const char* charset;
 
@@ -1146,243 +1285,1975 @@ js_pgconn_connect(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
   return ret;
 }
 
-static JSValue
-js_pgconn_query_cont(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, JSValue data[]) {
-  int32_t fd;
-  int ret = 0;
-  PGSQLConnection* pq = 0;
+/* type oids used when encoding parameters, see catalog/pg_type.dat */
+enum {
+  PG_TYPE_BOOL = 16,
+  PG_TYPE_BYTEA = 17,
+  PG_TYPE_INT8 = 20,
+  PG_TYPE_INT2 = 21,
+  PG_TYPE_INT4 = 23,
+  PG_TYPE_FLOAT4 = 700,
+  PG_TYPE_FLOAT8 = 701,
+  PG_TYPE_TIMESTAMPTZ = 1184,
+};
 
-  if(!(pq = js_pgconn_data2(ctx, data[0])))
-    return JS_EXCEPTION;
+/* Parameters of one command. Integers, floats, booleans and buffers go
+ * out in binary format, everything else as text. 'data' holds the encoded
+ * values, which 'values' points into once pgparams_init() returns */
+typedef struct PGParams {
+  int count;
+  Oid* types;
+  const char** values;
+  int *lengths, *formats;
+  DynBuf data;
+} PGSQLParams;
 
-  fd = PQsocket(pq->conn);
-  ret = PQconsumeInput(pq->conn);
+static void
+pgparams_free(JSContext* ctx, PGSQLParams* p) {
+  js_free(ctx, p->types);
+  js_free(ctx, p->values);
+  js_free(ctx, p->lengths);
+  js_free(ctx, p->formats);
+  dbuf_free(&p->data);
+}
 
-  if(ret == 0) {
-    JSValue err = js_pgsqlerror_new(ctx, pgconn_error(pq));
-    JS_Call(ctx, data[3], JS_UNDEFINED, 1, &err);
-    JS_FreeValue(ctx, err);
-  } else {
+static void
+pgparams_put_be(DynBuf* db, uint64_t v, int size) {
+  uint8_t buf[8];
+
+  for(int i = size - 1; i >= 0; i--, v >>= 8)
+    buf[i] = v & 0xff;
+
+  dbuf_put(db, buf, size);
+}
+
+/* appends 'value' in text format, including the terminating \0 */
+static int
+pgparams_put_text(JSContext* ctx, DynBuf* db, JSValueConst value) {
+  JSValue str;
+  const char* s;
+  size_t len;
 
-    if(!PQisBusy(pq->conn)) {
-      PGresult* res = PQgetResult(pq->conn);
-      JSValue res_val = pgconn_result(pq, res, ctx);
+  if(JS_IsBool(value)) {
+    dbuf_putstr(db, JS_ToBool(ctx, value) ? "t" : "f");
+  } else if(js_is_arraybuffer(ctx, value) || js_is_typedarray(ctx, value)) {
+    static const char hex[] = "0123456789abcdef";
+    InputBuffer input = js_input_buffer(ctx, value);
+    const uint8_t* x = inputbuffer_data(&input);
 
-      js_iohandler_set(ctx, data[1], fd, JS_NULL);
+    dbuf_putstr(db, "\\x");
 
-      JS_Call(ctx, data[2], JS_UNDEFINED, 1, &res_val);
-      JS_FreeValue(ctx, res_val);
+    for(size_t i = 0; i < inputbuffer_length(&input); i++) {
+      dbuf_putc(db, hex[x[i] >> 4]);
+      dbuf_putc(db, hex[x[i] & 0xf]);
     }
+
+    inputbuffer_free(&input, ctx);
+  } else {
+    if(js_is_date(ctx, value))
+      str = js_invoke(ctx, value, "toISOString", 0, 0);
+    else if(JS_IsObject(value))
+      str = JS_JSONStringify(ctx, value, JS_NULL, JS_NULL);
+    else
+      str = JS_DupValue(ctx, value);
+
+    s = JS_ToCStringLen(ctx, &len, str);
+    JS_FreeValue(ctx, str);
+
+    if(!s)
+      return -1;
+
+    dbuf_put(db, (const uint8_t*)s, len);
+    JS_FreeCString(ctx, s);
   }
 
-#ifdef DEBUG_OUTPUT
-  printf("%s fd=%i pq=%p ret=%d error='%s'\n", __func__, fd, pq, ret, pgconn_error(pq));
-#endif
+  return dbuf_putc(db, '\0');
+}
 
-  return JS_UNDEFINED;
+/* the type announced for a parameter when the statement didn't declare one */
+static Oid
+pgparams_type(JSContext* ctx, JSValueConst value) {
+  if(JS_IsBool(value))
+    return PG_TYPE_BOOL;
+
+  if(JS_VALUE_GET_TAG(value) == JS_TAG_INT)
+    return PG_TYPE_INT4;
+
+  if(JS_IsNumber(value)) {
+    double d;
+
+    JS_ToFloat64(ctx, &d, value);
+    return d == trunc(d) && fabs(d) <= MAX_SAFE_INTEGER ? PG_TYPE_INT8 : PG_TYPE_FLOAT8;
+  }
+
+  if(JS_IsBigInt(ctx, value))
+    return PG_TYPE_INT8;
+
+  if(js_is_arraybuffer(ctx, value) || js_is_typedarray(ctx, value))
+    return PG_TYPE_BYTEA;
+
+  if(js_is_date(ctx, value))
+    return PG_TYPE_TIMESTAMPTZ;
+
+  return 0;
 }
 
-static JSValue
-js_pgconn_query_start(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
-  JSValue promise = JS_UNDEFINED, data[4], handler;
-  const char* query = 0;
-  PGSQLConnection* pq;
-  int ret = 0, fd;
+/* encodes 'value' for a parameter of 'type', returns the format */
+static int
+pgparams_put(JSContext* ctx, DynBuf* db, JSValueConst value, Oid type) {
+  BOOL numeric = JS_IsNumber(value) || JS_IsBigInt(ctx, value) || JS_IsBool(value);
+  int64_t i64;
+  double d;
+
+  switch(type) {
+    case PG_TYPE_BOOL: {
+      if(!numeric)
+        break;
 
-  if(!(pq = js_pgconn_data2(ctx, this_val)))
-    return JS_EXCEPTION;
+      dbuf_putc(db, JS_ToBool(ctx, value));
+      return 1;
+    }
 
-  query = JS_ToCString(ctx, argv[0]);
-  ret = PQsendQuery(pq->conn, query);
-  fd = PQsocket(pq->conn);
+    case PG_TYPE_INT2:
+    case PG_TYPE_INT4:
+    case PG_TYPE_INT8: {
+      int size = type == PG_TYPE_INT8 ? 8 : type == PG_TYPE_INT4 ? 4 : 2;
 
-#ifdef DEBUG_OUTPUT
-  printf("%s ret=%d query='%s'\n", __func__, ret, query);
-#endif
+      if(!numeric)
+        break;
 
-  promise = JS_NewPromiseCapability(ctx, &data[2]);
+      if(JS_IsNumber(value)) {
+        JS_ToFloat64(ctx, &d, value);
 
-  if(ret == 0) {
-    JSValue err = js_pgsqlerror_new(ctx, pgconn_error(pq));
-    JS_Call(ctx, data[3], JS_UNDEFINED, 1, &err);
-    JS_FreeValue(ctx, err);
-  } else {
+        if(d != trunc(d))
+          break;
+      }
+
+      JS_ToInt64Ext(ctx, &i64, value);
+
+      /* out of range values are left for the server to complain about */
+      if((size == 2 && (i64 < INT16_MIN || i64 > INT16_MAX)) || (size == 4 && (i64 < INT32_MIN || i64 > INT32_MAX)))
+        break;
 
-    data[0] = JS_DupValue(ctx, this_val);
-    data[1] = js_iohandler_fn(ctx, 0, 0);
+      pgparams_put_be(db, i64, size);
+      return 1;
+    }
 
-    if(PQisBusy(pq->conn)) {
-      handler = JS_NewCFunctionData(ctx, js_pgconn_query_cont, 0, 0, countof(data), data);
+    case PG_TYPE_FLOAT4:
+    case PG_TYPE_FLOAT8: {
+      if(!JS_IsNumber(value))
+        break;
 
-      if(!js_iohandler_set(ctx, data[1], fd, handler))
-        JS_Call(ctx, data[3], JS_UNDEFINED, 0, 0);
+      JS_ToFloat64(ctx, &d, value);
 
-      JS_FreeValue(ctx, handler);
-    } else {
-      js_pgconn_query_cont(ctx, this_val, argc, argv, 0, data);
+      if(type == PG_TYPE_FLOAT4) {
+        union {
+          float f;
+          uint32_t u;
+        } u = {.f = d};
+
+        pgparams_put_be(db, u.u, 4);
+      } else {
+        union {
+          double d;
+          uint64_t u;
+        } u = {.d = d};
+
+        pgparams_put_be(db, u.u, 8);
+      }
+
+      return 1;
     }
 
-    JS_FreeValue(ctx, data[0]);
-    JS_FreeValue(ctx, data[1]);
+    case PG_TYPE_BYTEA: {
+      InputBuffer input;
+
+      if(!js_is_arraybuffer(ctx, value) && !js_is_typedarray(ctx, value))
+        break;
+
+      input = js_input_buffer(ctx, value);
+      dbuf_put(db, inputbuffer_data(&input), inputbuffer_length(&input));
+      inputbuffer_free(&input, ctx);
+      return 1;
+    }
   }
 
-  JS_FreeValue(ctx, data[2]);
-  JS_FreeValue(ctx, data[3]);
-  return promise;
+  return pgparams_put_text(ctx, db, value) ? -1 : 0;
 }
 
-static JSValue
-js_pgconn_query(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
-  PGSQLConnection* pq;
+/* 'types' are the declared parameter types, without them each type is
+ * derived from the value when 'derive' is set and left to the server
+ * (text format) otherwise */
+static int
+pgparams_init(JSContext* ctx, PGSQLParams* p, JSValueConst array, const Oid* types, int num_types, BOOL derive) {
+  size_t* offsets;
+  int64_t len;
+  int i;
 
-  if(!(pq = js_pgconn_data2(ctx, this_val)))
-    return JS_EXCEPTION;
+  memset(p, 0, sizeof(PGSQLParams));
+  dbuf_init_ctx(ctx, &p->data);
 
-  if(!pgconn_nonblock(pq)) {
-    const char* query = JS_ToCString(ctx, argv[0]);
-    PGresult* res = PQexec(pq->conn, query);
-    JSValue ret = res ? pgconn_result(pq, res, ctx) : JS_NULL;
+  if(JS_IsUndefined(array))
+    return 0;
 
-    if(res)
-      JS_DefinePropertyValueStr(ctx, ret, "handle", JS_DupValue(ctx, this_val), JS_PROP_CONFIGURABLE);
+  if(!JS_IsArray(ctx, array) || (len = js_array_length(ctx, array)) < 0) {
+    JS_ThrowTypeError(ctx, "parameters must be an array");
+    return -1;
+  }
 
-    return ret;
+  if(len > 65535) {
+    JS_ThrowRangeError(ctx, "too many parameters (%" PRId64 ")", len);
+    return -1;
   }
 
-  return js_pgconn_query_start(ctx, this_val, argc, argv);
-}
+  p->count = len;
 
-static JSValue
-js_pgconn_close(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
-  JSValue ret = JS_UNDEFINED;
-  PGSQLConnection* pq;
+  if(!(p->types = js_mallocz(ctx, sizeof(Oid) * (len + 1))) || !(p->values = js_mallocz(ctx, sizeof(char*) * (len + 1))) ||
+     !(p->lengths = js_mallocz(ctx, sizeof(int) * (len + 1))) || !(p->formats = js_mallocz(ctx, sizeof(int) * (len + 1))))
+    return -1;
 
-  if(!(pq = js_pgconn_data2(ctx, this_val)))
-    return JS_EXCEPTION;
+  /* 'data' moves while growing, so record offsets first */
+  offsets = (size_t*)p->values;
 
-  PQfinish(pq->conn);
-  pq->conn = 0;
+  for(i = 0; i < p->count; i++) {
+    JSValue value = JS_GetPropertyUint32(ctx, array, i);
+    Oid type = i < num_types ? types[i] : 0;
+    size_t start = p->data.size;
 
-  return ret;
-}
+    if(type == 0 && derive)
+      type = pgparams_type(ctx, value);
 
-static void
-js_pgconn_finalizer(JSRuntime* rt, JSValue val) {
-  PGSQLConnection* pq;
+    p->types[i] = type;
 
-  if((pq = JS_GetOpaque(val, js_pgconn_class_id)))
-    pgconn_free(pq, rt);
+    if(js_is_null_or_undefined(value)) {
+      p->lengths[i] = -1;
+    } else if((p->formats[i] = pgparams_put(ctx, &p->data, value, type)) == -1) {
+      JS_FreeValue(ctx, value);
+      return -1;
+    } else {
+      offsets[i] = start;
+      p->lengths[i] = p->data.size - start;
+    }
+
+    JS_FreeValue(ctx, value);
+  }
+
+  for(i = 0; i < p->count; i++)
+    if(p->lengths[i] == -1) {
+      p->lengths[i] = 0;
+      p->values[i] = 0;
+    } else {
+      p->values[i] = (const char*)p->data.buf + offsets[i];
+    }
+
+  return 0;
 }
 
-static JSClassDef js_pgconn_class = {
-    .class_name = "PGconn",
-    .finalizer = js_pgconn_finalizer,
-};
+static PGSQLPrepared*
+pgconn_prepared(PGSQLConnection* pq, const char* name) {
+  struct list_head* el;
 
-static const JSCFunctionListEntry js_pgconn_funcs[] = {
-    JS_CGETSET_MAGIC_DEF("cmdTuples", js_pgconn_get, 0, PROP_CMD_TUPLES),
-    JS_CGETSET_MAGIC_DEF("affectedRows", js_pgconn_get, 0, PROP_CMD_TUPLES),
+  list_for_each(el, &pq->prepared) {
+    PGSQLPrepared* ps = list_entry(el, PGSQLPrepared, link);
 
-    JS_CGETSET_MAGIC_DEF("nonblocking", js_pgconn_get, js_pgconn_set, PROP_NONBLOCKING),
-    JS_CGETSET_MAGIC_DEF("fd", js_pgconn_get, 0, PROP_FD),
-    JS_CGETSET_MAGIC_DEF("errorMessage", js_pgconn_get, 0, PROP_ERROR_MESSAGE),
-    JS_CGETSET_MAGIC_DEF("options", js_pgconn_get, 0, PROP_OPTIONS),
-    JS_CGETSET_MAGIC_DEF("insertId", js_pgconn_get, 0, PROP_INSERT_ID),
-    JS_CGETSET_MAGIC_DEF("charset", js_pgconn_get, js_pgconn_set, PROP_CLIENT_ENCODING),
-    JS_CGETSET_MAGIC_DEF("protocolVersion", js_pgconn_get, 0, PROP_PROTOCOL_VERSION),
-    JS_CGETSET_MAGIC_DEF("serverVersion", js_pgconn_get, 0, PROP_SERVER_VERSION),
-    JS_CGETSET_MAGIC_DEF("user", js_pgconn_get, 0, PROP_USER),
-    JS_CGETSET_MAGIC_DEF("password", js_pgconn_get, 0, PROP_PASSWORD),
-    JS_CGETSET_MAGIC_DEF("host", js_pgconn_get, 0, PROP_HOST),
-    JS_CGETSET_MAGIC_DEF("port", js_pgconn_get, 0, PROP_PORT),
-    JS_CGETSET_MAGIC_DEF("db", js_pgconn_get, 0, PROP_DB),
-    JS_CGETSET_MAGIC_DEF("conninfo", js_pgconn_get, 0, PROP_CONNINFO),
-    JS_CFUNC_DEF("connect", 1, js_pgconn_connect),
-    JS_CFUNC_DEF("query", 1, js_pgconn_query),
-    JS_CFUNC_DEF("close", 0, js_pgconn_close),
-    JS_ALIAS_DEF("execute", "query"),
-    JS_CFUNC_DEF("escapeString", 1, js_pgconn_escape_string),
-    JS_CFUNC_MAGIC_DEF("escapeLiteral", 1, js_pgconn_escape_alloc, 0),
-    JS_CFUNC_MAGIC_DEF("escapeIdentifier", 1, js_pgconn_escape_alloc, 1),
-    JS_CFUNC_DEF("escapeBytea", 1, js_pgconn_escape_bytea),
-    JS_CFUNC_DEF("unescapeBytea", 1, js_pgconn_unescape_bytea),
-    JS_CFUNC_DEF("valueString", 0, js_pgconn_value_string),
-    JS_CFUNC_DEF("valuesString", 1, js_pgconn_values_string),
-    JS_CFUNC_DEF("insertQuery", 2, js_pgconn_insert_query),
-    // JS_CFUNC_MAGIC_DEF("escapeString", 1, js_pgconn_methods, METHOD_ESCAPE_STRING),
-    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "PGconn", JS_PROP_CONFIGURABLE),
-};
+    if(!strcmp(ps->name, name))
+      return ps;
+  }
 
-static const JSCFunctionListEntry js_pgconn_static[] = {
-    JS_CFUNC_DEF("escapeString", 1, js_pgconn_escape_string),
-    JS_CFUNC_DEF("escapeBytea", 1, js_pgconn_escape_bytea),
-    JS_CFUNC_DEF("unescapeBytea", 1, js_pgconn_unescape_bytea),
-};
+  return 0;
+}
 
-static const JSCFunctionListEntry js_pgconn_defines[] = {
-    JS_PROP_INT32_DEF("RESULT_OBJECT", RESULT_OBJECT, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("RESULT_STRING", RESULT_STRING, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("RESULT_TBLNAM", RESULT_TBLNAM, JS_PROP_CONFIGURABLE),
-};
+static void
+pgconn_prepared_free(JSRuntime* rt, PGSQLPrepared* ps) {
+  list_del(&ps->link);
+  js_free_rt(rt, ps->name);
+  js_free_rt(rt, ps->types);
+  js_free_rt(rt, ps);
+}
 
-static JSValue
-js_pgsqlerror_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
-  JSValue proto, obj = JS_UNDEFINED;
-  JSAtom prop;
+/* records the parameter types from a describe result, or forgets about
+ * the statement when preparing it failed ('res' == NULL) */
+static void
+pgconn_describe(JSContext* ctx, PGSQLConnection* pq, const char* name, PGresult* res) {
+  PGSQLPrepared* ps;
 
-  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
-  if(JS_IsException(proto))
-    goto fail;
+  if(!(ps = pgconn_prepared(pq, name))) {
+    if(!res || !(ps = js_mallocz(ctx, sizeof(PGSQLPrepared))))
+      return;
 
-  obj = JS_NewObjectProtoClass(ctx, proto, js_pgsqlerror_class_id);
-  JS_FreeValue(ctx, proto);
-  if(JS_IsException(obj))
-    goto fail;
+    if(!(ps->name = js_strdup(ctx, name))) {
+      js_free(ctx, ps);
+      return;
+    }
 
-  if(argc > 0) {
-    prop = JS_NewAtom(ctx, "message");
-    JS_DefinePropertyValue(ctx, obj, prop, JS_DupValue(ctx, argv[0]), JS_PROP_C_W_E);
-    JS_FreeAtom(ctx, prop);
+    list_add_tail(&ps->link, &pq->prepared);
   }
 
-  if(argc > 1) {
-    prop = JS_NewAtom(ctx, "type");
-    JS_DefinePropertyValue(ctx, obj, prop, JS_DupValue(ctx, argv[1]), JS_PROP_WRITABLE | JS_PROP_CONFIGURABLE);
-    JS_FreeAtom(ctx, prop);
+  if(!res) {
+    if(!ps->described)
+      pgconn_prepared_free(JS_GetRuntime(ctx), ps);
+    return;
   }
 
-  JSValue stack = js_error_stack(ctx);
-  prop = JS_NewAtom(ctx, "stack");
-  JS_DefinePropertyValue(ctx, obj, prop, stack, JS_PROP_CONFIGURABLE);
-  JS_FreeAtom(ctx, prop);
+  js_free(ctx, ps->types);
+  ps->num_params = PQnparams(res);
 
-  return obj;
+  if((ps->types = js_malloc(ctx, sizeof(Oid) * (ps->num_params + 1))))
+    for(int i = 0; i < ps->num_params; i++)
+      ps->types[i] = PQparamtype(res, i);
+  else
+    ps->num_params = 0;
 
-fail:
-  JS_FreeValue(ctx, obj);
-  return JS_EXCEPTION;
+  ps->described = TRUE;
 }
 
-static JSValue
-js_pgsqlerror_new(JSContext* ctx, const char* msg) {
-  JSValue obj;
-  JSValue argv[2];
+static BOOL
+pgresult_failed(PGresult* res) {
+  switch(PQresultStatus(res)) {
+    case PGRES_BAD_RESPONSE:
+    case PGRES_FATAL_ERROR:
+#ifdef LIBPQ_HAS_PIPELINING
+    case PGRES_PIPELINE_ABORTED:
+#endif
+      return TRUE;
+    default: return FALSE;
+  }
+}
 
-  obj = JS_NewObjectProtoClass(ctx, pgsqlerror_proto, js_pgsqlerror_class_id);
-  if(JS_IsException(obj))
-    return JS_EXCEPTION;
+#define COPY_BUFFER_SIZE 65536
 
-  argv[0] = JS_NewString(ctx, msg);
-  obj = js_pgsqlerror_constructor(ctx, pgsqlerror_ctor, 1, argv);
+static PGSQLCopy*
+pgcopy_new(JSContext* ctx, BOOL in) {
+  PGSQLCopy* copy;
 
-  JS_FreeValue(ctx, argv[0]);
-  JS_FreeValue(ctx, argv[1]);
+  if(!(copy = js_mallocz(ctx, sizeof(PGSQLCopy))))
+    return 0;
 
-  return obj;
+  copy->stream = JS_UNDEFINED;
+  copy->in = in;
+  return copy;
 }
 
-static JSClassDef js_pgsqlerror_class = {
-    .class_name = "PGerror",
+static void
+pgcopy_free(JSRuntime* rt, PGSQLCopy* copy) {
+  if(copy->reader.read)
+    reader_free(&copy->reader);
+
+  if(copy->writer.write)
+    writer_free(&copy->writer);
+
+  if(copy->collect) {
+    dbuf_free(copy->collect);
+    js_free_rt(rt, copy->collect);
+  }
+
+  JS_FreeValueRT(rt, copy->stream);
+  js_free_rt(rt, copy->buf);
+  js_free_rt(rt, copy->error);
+  js_free_rt(rt, copy);
+}
+
+/* keeps the first error, which the request is rejected with */
+static void
+pgcopy_error(JSContext* ctx, PGSQLCopy* copy, const char* msg) {
+  if(!copy->error)
+    copy->error = js_strdup(ctx, msg && *msg ? msg : "copy failed");
+}
+
+static void
+pgcopy_error_value(JSContext* ctx, PGSQLCopy* copy, JSValueConst reason) {
+  const char* msg;
+
+  if((msg = JS_ToCString(ctx, reason))) {
+    pgcopy_error(ctx, copy, msg);
+    JS_FreeCString(ctx, msg);
+  } else {
+    JS_FreeValue(ctx, JS_GetException(ctx));
+    pgcopy_error(ctx, copy, 0);
+  }
+}
+
+/* ReadableStreams (and their readers) and async iterables are read by
+ * awaiting their promises, everything else goes through reader_from_js().
+ * Likewise WritableStreams (and their writers) and writer_from_js().
+ * copyTo() without a destination collects the data */
+static int
+pgcopy_init(JSContext* ctx, PGSQLCopy* copy, JSValueConst value) {
+  const char* open = copy->in ? "getReader" : "getWriter";
+
+  if(JS_IsObject(value) && js_has_propertystr(ctx, value, open)) {
+    copy->stream = js_invoke(ctx, value, open, 0, 0);
+    copy->owned = TRUE;
+  } else if(JS_IsObject(value) && js_has_propertystr(ctx, value, copy->in ? "read" : "write") && js_has_propertystr(ctx, value, "releaseLock")) {
+    copy->stream = JS_DupValue(ctx, value);
+  } else if(copy->in && JS_IsObject(value)) {
+    JSAtom atom = js_symbol_static_atom(ctx, "asyncIterator");
+    JSValue fn = JS_GetProperty(ctx, value, atom);
+
+    JS_FreeAtom(ctx, atom);
+
+    if(JS_IsFunction(ctx, fn)) {
+      copy->stream = JS_Call(ctx, fn, value, 0, 0);
+      copy->method = "next";
+    }
+
+    JS_FreeValue(ctx, fn);
+  }
+
+  if(JS_IsException(copy->stream)) {
+    copy->stream = JS_UNDEFINED;
+    return -1;
+  }
+
+  if(!JS_IsUndefined(copy->stream)) {
+    if(!copy->method)
+      copy->method = copy->in ? "read" : "write";
+
+    return 0;
+  }
+
+  if(copy->in) {
+    if(!reader_from_js(ctx, value, &copy->reader)) {
+      JS_ThrowTypeError(ctx, "argument 2 must be a readable source");
+      return -1;
+    }
+  } else if(JS_IsUndefined(value)) {
+    if(!(copy->collect = js_malloc(ctx, sizeof(DynBuf))))
+      return -1;
+
+    dbuf_init_ctx(ctx, copy->collect);
+  } else if(!writer_from_js(ctx, value, &copy->writer)) {
+    JS_ThrowTypeError(ctx, "argument 2 must be a writable destination");
+    return -1;
+  }
+
+  return 0;
+}
+
+/* closes (or aborts) a WritableStream after the copy and releases the
+ * lock taken by getReader()/getWriter(). Readers and writers which were
+ * passed in are left open */
+static void
+pgcopy_release(JSContext* ctx, PGSQLCopy* copy, BOOL ok) {
+  const char* methods[2] = {0, 0};
+
+  if(JS_IsUndefined(copy->stream))
+    return;
+
+  if(copy->owned) {
+    methods[0] = copy->in ? 0 : ok ? "close" : "abort";
+    methods[1] = "releaseLock";
+  } else if(!ok && !strcmp(copy->method, "next")) {
+    methods[0] = "return";
+  }
+
+  for(int i = 0; i < 2; i++)
+    if(methods[i] && js_has_propertystr(ctx, copy->stream, methods[i])) {
+      JSValue ret = js_invoke(ctx, copy->stream, methods[i], 0, 0);
+
+      if(JS_IsException(ret))
+        ret = JS_GetException(ctx);
+
+      JS_FreeValue(ctx, ret);
+    }
+
+  JS_FreeValue(ctx, copy->stream);
+  copy->stream = JS_UNDEFINED;
+}
+
+/* the server entered COPY IN or COPY OUT state. When the direction is
+ * the wrong one, the data is ended right away or dropped */
+static void
+pgcopy_start(JSContext* ctx, PGSQLCopy* copy, ExecStatusType status) {
+  BOOL in = status == PGRES_COPY_IN;
+
+  if(in != copy->in) {
+    pgcopy_error(ctx, copy, in ? "COPY FROM STDIN needs copyFrom()" : "COPY TO STDOUT needs copyTo()");
+    copy->in = in;
+    copy->ended = TRUE;
+  }
+
+  copy->started = copy->active = TRUE;
+}
+
+static void
+pgcopy_buffer_free(JSRuntime* rt, void* opaque, void* ptr) {
+  js_free_rt(rt, ptr);
+}
+
+/* the number of rows copied, or the data when copyTo() had no destination.
+ * Throws when the command, the source or the destination failed */
+static JSValue
+pgcopy_value(JSContext* ctx, PGSQLCopy* copy, PGresult* res) {
+  const char* msg = !res ? "no result" : pgresult_failed(res) ? PQresultErrorMessage(res) : copy->error;
+  JSValue ret;
+
+  if(!msg && !copy->started)
+    msg = copy->in ? "not a COPY FROM STDIN statement" : "not a COPY TO STDOUT statement";
+
+  if(msg)
+    return JS_Throw(ctx, js_pgsqlerror_new(ctx, msg));
+
+  if(!copy->collect)
+    return JS_NewInt64(ctx, strtoll(PQcmdTuples(res), 0, 10));
+
+  if(copy->collect->size == 0)
+    return JS_NewArrayBufferCopy(ctx, 0, 0);
+
+  ret = JS_NewArrayBuffer(ctx, copy->collect->buf, copy->collect->size, pgcopy_buffer_free, 0, FALSE);
+
+  /* the ArrayBuffer owns it now */
+  dbuf_init_ctx(ctx, copy->collect);
+  return ret;
+}
+
+static PGSQLStream*
+pgstream_new(JSContext* ctx, JSValueConst conn, uint32_t batch_size) {
+  PGSQLStream* st;
+
+  if(!(st = js_mallocz(ctx, sizeof(PGSQLStream))))
+    return 0;
+
+  st->ref_count = 1;
+  st->conn = JS_DupValue(ctx, conn);
+  st->batch = st->ready = st->error = JS_UNDEFINED;
+  st->batch_size = batch_size;
+  st->next.resolve = st->next.reject = JS_NULL;
+
+  return st;
+}
+
+static PGSQLStream*
+pgstream_dup(PGSQLStream* st) {
+  ++st->ref_count;
+  return st;
+}
+
+static void
+pgstream_free(JSRuntime* rt, PGSQLStream* st) {
+  if(--st->ref_count)
+    return;
+
+  JS_FreeValueRT(rt, st->conn);
+  JS_FreeValueRT(rt, st->batch);
+  JS_FreeValueRT(rt, st->ready);
+  JS_FreeValueRT(rt, st->error);
+  promise_free_funcs(rt, &st->next);
+  js_free_rt(rt, st);
+}
+
+/* asks libpq for results of at most 'batch_size' rows, must follow the
+ * PQsend*() call */
+static int
+pgstream_mode(PGconn* conn, uint32_t batch_size) {
+#ifdef LIBPQ_HAS_CHUNK_MODE
+  if(batch_size > 1)
+    return PQsetChunkedRowsMode(conn, batch_size);
+#endif
+
+  return PQsetSingleRowMode(conn);
+}
+
+/* settles a pending next() from what has been received: complete batches
+ * first, then the error, the rest of the rows and the end */
+static void
+pgstream_deliver(JSContext* ctx, PGSQLStream* st) {
+  JSValue value = JS_UNDEFINED, ret;
+  BOOL done = FALSE;
+
+  if(!promise_pending(&st->next))
+    return;
+
+  if(!JS_IsUndefined(st->ready)) {
+    value = st->ready;
+    st->ready = JS_UNDEFINED;
+  } else if(!st->done) {
+    return;
+  } else if(!JS_IsUndefined(st->error)) {
+    promise_reject(ctx, &st->next, st->error);
+    JS_FreeValue(ctx, st->error);
+    st->error = JS_UNDEFINED;
+    return;
+  } else if(st->rows) {
+    value = st->batch;
+    st->batch = JS_UNDEFINED;
+    st->rows = 0;
+  } else {
+    done = TRUE;
+  }
+
+  ret = js_iterator_result(ctx, value, done);
+  promise_resolve(ctx, &st->next, ret);
+  JS_FreeValue(ctx, ret);
+  JS_FreeValue(ctx, value);
+}
+
+/* appends the rows of 'res', a full batch becomes ready */
+static void
+pgstream_rows(JSContext* ctx, PGSQLStream* st, PGresult* res) {
+  PGSQLResult tmp = {.result = res};
+  int num_rows = PQntuples(res);
+
+  if(st->closed || num_rows <= 0)
+    return;
+
+  if(JS_IsUndefined(st->batch))
+    st->batch = JS_NewArray(ctx);
+
+  for(int i = 0; i < num_rows; i++)
+    JS_SetPropertyUint32(ctx, st->batch, st->rows++, result_array(ctx, &tmp, i, 0));
+
+  if(st->rows >= st->batch_size && JS_IsUndefined(st->ready)) {
+    st->ready = st->batch;
+    st->batch = JS_UNDEFINED;
+    st->rows = 0;
+    pgstream_deliver(ctx, st);
+  }
+}
+
+static void
+pgstream_end(JSContext* ctx, PGSQLStream* st, JSValueConst error) {
+  if(JS_IsUndefined(st->error) && !JS_IsUndefined(error) && !st->closed)
+    st->error = JS_DupValue(ctx, error);
+
+  st->done = TRUE;
+  pgstream_deliver(ctx, st);
+}
+
+static PGSQLRequest*
+pgrequest_new(JSContext* ctx, int op) {
+  PGSQLRequest* req;
+
+  if(!(req = js_mallocz(ctx, sizeof(PGSQLRequest))))
+    return 0;
+
+  req->op = op;
+  req->params = JS_UNDEFINED;
+  req->funcs.resolve = req->funcs.reject = JS_NULL;
+
+  return req;
+}
+
+static void
+pgrequest_free(JSRuntime* rt, PGSQLRequest* req) {
+  if(req->link.next)
+    list_del(&req->link);
+
+  js_free_rt(rt, req->name);
+  js_free_rt(rt, req->sql);
+  js_free_rt(rt, req->types);
+  JS_FreeValueRT(rt, req->params);
+
+  if(req->result)
+    PQclear(req->result);
+
+  if(req->copy)
+    pgcopy_free(rt, req->copy);
+
+  if(req->stream)
+    pgstream_free(rt, req->stream);
+
+  promise_free_funcs(rt, &req->funcs);
+  js_free_rt(rt, req);
+}
+
+static void
+pgconn_reject(JSContext* ctx, PGSQLRequest* req, const char* msg) {
+  JSValue err = js_pgsqlerror_new(ctx, msg);
+
+  if(req->stream)
+    pgstream_end(ctx, req->stream, err);
+
+  promise_reject(ctx, &req->funcs, err);
+  JS_FreeValue(ctx, err);
+}
+
+/* resolves or rejects 'req' from its results and removes it */
+static void
+pgconn_settle(JSContext* ctx, PGSQLConnection* pq, PGSQLRequest* req) {
+  PGresult* res = req->result;
+  BOOL failed = res && pgresult_failed(res);
+
+  switch(req->op) {
+    case REQUEST_PREPARE: {
+      /* the describe request which follows reports the error */
+      if(failed && req->link.next != &pq->requests) {
+        PGSQLRequest* next = list_entry(req->link.next, PGSQLRequest, link);
+
+        if(next->result)
+          PQclear(next->result);
+
+        next->result = res;
+        req->result = res = 0;
+      }
+
+      if(failed)
+        pgconn_describe(ctx, pq, req->name, 0);
+
+      break;
+    }
+
+    case REQUEST_DESCRIBE: {
+      pgconn_describe(ctx, pq, req->name, failed ? 0 : res);
+      break;
+    }
+  }
+
+  if(req->op == REQUEST_COPY) {
+    JSValue value = pgcopy_value(ctx, req->copy, res);
+    BOOL ok = !JS_IsException(value);
+
+    pgcopy_release(ctx, req->copy, ok);
+
+    if(ok) {
+      promise_resolve(ctx, &req->funcs, value);
+    } else {
+      value = JS_GetException(ctx);
+      promise_reject(ctx, &req->funcs, value);
+    }
+
+    JS_FreeValue(ctx, value);
+  } else if(req->op == REQUEST_STREAM) {
+    JSValue err = failed ? js_pgsqlerror_new(ctx, PQresultErrorMessage(res)) : JS_UNDEFINED;
+
+    /* without single-row mode all rows come at the end */
+    if(res && !failed)
+      pgstream_rows(ctx, req->stream, res);
+
+    pgstream_end(ctx, req->stream, err);
+    JS_FreeValue(ctx, err);
+  } else if(promise_pending(&req->funcs)) {
+    if(failed && req->reject) {
+      pgconn_reject(ctx, req, PQresultErrorMessage(res));
+    } else {
+      JSValue value = res ? pgconn_result(pq, res, ctx) : JS_NULL;
+
+      /* the PGSQLResult owns it now */
+      if(res)
+        req->result = 0;
+
+      promise_resolve(ctx, &req->funcs, value);
+      JS_FreeValue(ctx, value);
+    }
+  }
+
+  pgrequest_free(JS_GetRuntime(ctx), req);
+}
+
+/* rejects every queued request, after the connection broke */
+static void
+pgconn_fail(JSContext* ctx, PGSQLConnection* pq, const char* msg) {
+  struct list_head *el, *next;
+  char* copy = js_strdup(ctx, msg && *msg ? msg : "connection failed");
+
+  list_for_each_safe(el, next, &pq->requests) {
+    PGSQLRequest* req = list_entry(el, PGSQLRequest, link);
+
+    if(req->copy)
+      pgcopy_release(ctx, req->copy, FALSE);
+
+    pgconn_reject(ctx, req, copy);
+    pgrequest_free(JS_GetRuntime(ctx), req);
+  }
+
+  js_free(ctx, copy);
+  pq->syncs = 0;
+}
+
+static int
+pgconn_send(JSContext* ctx, PGSQLConnection* pq, PGSQLRequest* req) {
+  PGSQLParams params = {0};
+  int ret = 0;
+
+  switch(req->op) {
+    case REQUEST_QUERY:
+    case REQUEST_STREAM: {
+      if(JS_IsUndefined(req->params)) {
+        ret = PQsendQuery(pq->conn, req->sql);
+        break;
+      }
+
+      if(pgparams_init(ctx, &params, req->params, 0, 0, TRUE))
+        goto fail;
+
+      ret = PQsendQueryParams(pq->conn, req->sql, params.count, params.types, params.values, params.lengths, params.formats, 0);
+      break;
+    }
+
+    case REQUEST_PREPARE: {
+      ret = PQsendPrepare(pq->conn, req->name, req->sql, req->num_types, req->types);
+      break;
+    }
+
+    case REQUEST_DESCRIBE: {
+      ret = PQsendDescribePrepared(pq->conn, req->name);
+      break;
+    }
+
+    case REQUEST_COPY: {
+      ret = PQsendQuery(pq->conn, req->sql);
+      break;
+    }
+
+    case REQUEST_EXEC_PREPARED: {
+      PGSQLPrepared* ps = pgconn_prepared(pq, req->name);
+
+      if(pgparams_init(ctx, &params, req->params, ps ? ps->types : 0, ps ? ps->num_params : 0, FALSE))
+        goto fail;
+
+      ret = PQsendQueryPrepared(pq->conn, req->name, params.count, params.values, params.lengths, params.formats, 0);
+      break;
+    }
+  }
+
+  pgparams_free(ctx, &params);
+
+  if(ret && req->stream)
+    pgstream_mode(pq->conn, req->stream->batch_size);
+
+  if(!ret) {
+    pgconn_reject(ctx, req, pgconn_error(pq));
+    return -1;
+  }
+
+#ifdef LIBPQ_HAS_PIPELINING
+  if(req->sync && pgconn_pipeline(pq)) {
+    if(!PQpipelineSync(pq->conn)) {
+      pgconn_reject(ctx, req, pgconn_error(pq));
+      return -1;
+    }
+
+    ++pq->syncs;
+  }
+#endif
+
+  req->sent = TRUE;
+  return 0;
+
+fail:
+  pgparams_free(ctx, &params);
+
+  {
+    JSValue err = JS_GetException(ctx);
+
+    if(req->stream)
+      pgstream_end(ctx, req->stream, err);
+
+    promise_reject(ctx, &req->funcs, err);
+    JS_FreeValue(ctx, err);
+  }
+
+  return -1;
+}
+
+static JSValue js_pgconn_io(JSContext*, JSValueConst, int, JSValueConst[], int, JSValue[]);
+
+static void
+pgconn_watch(JSContext* ctx, PGSQLConnection* pq, JSValueConst this_obj, BOOL write, BOOL enable) {
+  BOOL* state = write ? &pq->writing : &pq->reading;
+  JSValue set_handler;
+
+  if(*state == enable)
+    return;
+
+  set_handler = js_iohandler_fn(ctx, write, 0);
+  js_iohandler_set(ctx, set_handler, PQsocket(pq->conn), enable ? JS_NewCFunctionData(ctx, js_pgconn_io, 0, write, 1, &this_obj) : JS_NULL);
+  JS_FreeValue(ctx, set_handler);
+
+  *state = enable;
+}
+
+/* the head request can't take more data now: a COPY destination is busy,
+ * or a batch of stream() rows hasn't been picked up */
+static BOOL
+pgconn_paused(PGSQLConnection* pq) {
+  PGSQLRequest* req;
+
+  if(list_empty(&pq->requests))
+    return FALSE;
+
+  req = list_entry(pq->requests.next, PGSQLRequest, link);
+
+  if(req->copy)
+    return req->copy->waiting && !req->copy->in;
+
+  return req->stream && !JS_IsUndefined(req->stream->ready);
+}
+
+/* sends what may be sent: everything in pipeline mode, otherwise the next
+ * request once the previous one completed. Statements still waiting for
+ * their parameter types hold back the requests after them */
+static void
+pgconn_dispatch(JSContext* ctx, PGSQLConnection* pq, JSValueConst this_obj) {
+  struct list_head *el, *next;
+  BOOL pipeline = pgconn_pipeline(pq), busy = FALSE;
+  PGSQLCopy* copy = 0;
+
+  list_for_each_safe(el, next, &pq->requests) {
+    PGSQLRequest* req = list_entry(el, PGSQLRequest, link);
+
+    if(req->sent) {
+      busy = TRUE;
+      continue;
+    }
+
+    if(busy && !pipeline)
+      break;
+
+    if(req->op == REQUEST_EXEC_PREPARED && busy) {
+      PGSQLPrepared* ps = pgconn_prepared(pq, req->name);
+
+      if(ps && !ps->described)
+        break;
+    }
+
+    if(pgconn_send(ctx, pq, req)) {
+      pgrequest_free(JS_GetRuntime(ctx), req);
+      continue;
+    }
+
+    busy = TRUE;
+  }
+
+  /* a COPY may wait for room to send */
+  if(!list_empty(&pq->requests))
+    copy = list_entry(pq->requests.next, PGSQLRequest, link)->copy;
+
+  pgconn_watch(ctx, pq, this_obj, TRUE, (busy || pq->syncs) && (PQflush(pq->conn) == 1 || (copy && copy->blocked)));
+
+  pgconn_watch(ctx, pq, this_obj, FALSE, (busy || pq->syncs) && !pgconn_paused(pq));
+}
+
+static JSValue js_pgconn_copy_then(JSContext*, JSValueConst, int, JSValueConst[], int, JSValue[]);
+
+/* a promise from the stream settled: a chunk to send, the end of the
+ * source, or a completed write */
+static void
+pgcopy_settled(JSContext* ctx, PGSQLCopy* copy, BOOL rejected, JSValueConst value) {
+  JSValue chunk;
+  InputBuffer input;
+
+  copy->waiting = FALSE;
+
+  if(rejected) {
+    pgcopy_error_value(ctx, copy, value);
+    copy->ended = TRUE;
+    return;
+  }
+
+  if(!copy->in)
+    return;
+
+  if(!JS_IsObject(value) || js_get_propertystr_bool(ctx, value, "done")) {
+    copy->ended = TRUE;
+    return;
+  }
+
+  chunk = JS_GetPropertyStr(ctx, value, "value");
+  input = js_input_chars(ctx, chunk);
+  JS_FreeValue(ctx, chunk);
+
+  if(inputbuffer_length(&input) > 0) {
+    uint8_t* buf;
+
+    if((buf = js_realloc(ctx, copy->buf, inputbuffer_length(&input)))) {
+      memcpy(buf, inputbuffer_data(&input), inputbuffer_length(&input));
+      copy->buf = buf;
+      copy->len = inputbuffer_length(&input);
+    } else {
+      pgcopy_error(ctx, copy, "out of memory");
+      copy->ended = TRUE;
+    }
+  }
+
+  inputbuffer_free(&input, ctx);
+}
+
+/* waits for 'promise' (read(), next() or write() of the stream) before
+ * copying goes on. Other values are taken as they are */
+static void
+pgcopy_wait(JSContext* ctx, PGSQLCopy* copy, JSValueConst this_obj, JSValue promise) {
+  JSValue fns[2];
+
+  if(JS_IsException(promise)) {
+    JSValue err = JS_GetException(ctx);
+
+    pgcopy_settled(ctx, copy, TRUE, err);
+    JS_FreeValue(ctx, err);
+    return;
+  }
+
+  if(!js_is_promise(ctx, promise)) {
+    pgcopy_settled(ctx, copy, FALSE, promise);
+    JS_FreeValue(ctx, promise);
+    return;
+  }
+
+  for(int i = 0; i < 2; i++)
+    fns[i] = JS_NewCFunctionData(ctx, js_pgconn_copy_then, 1, i, 1, &this_obj);
+
+  JS_FreeValue(ctx, promise_then2(ctx, promise, fns[0], fns[1]));
+  JS_FreeValue(ctx, fns[0]);
+  JS_FreeValue(ctx, fns[1]);
+  JS_FreeValue(ctx, promise);
+
+  copy->waiting = TRUE;
+}
+
+/* passes a row of COPY TO STDOUT on. After the destination failed the
+ * rest is dropped */
+static void
+pgcopy_write(JSContext* ctx, PGSQLCopy* copy, JSValueConst this_obj, const char* data, size_t len) {
+  if(copy->error)
+    return;
+
+  if(!JS_IsUndefined(copy->stream)) {
+    JSValue buf = JS_NewArrayBufferCopy(ctx, (const uint8_t*)data, len);
+    JSValue chunk = js_typedarray_new(ctx, 8, FALSE, FALSE, buf);
+
+    JS_FreeValue(ctx, buf);
+    pgcopy_wait(ctx, copy, this_obj, js_invoke(ctx, copy->stream, copy->method, 1, &chunk));
+    JS_FreeValue(ctx, chunk);
+    return;
+  }
+
+  if(copy->collect) {
+    if(dbuf_put(copy->collect, (const uint8_t*)data, len))
+      pgcopy_error(ctx, copy, "out of memory");
+
+    return;
+  }
+
+  for(size_t pos = 0; copy->writer.write && pos < len;) {
+    ssize_t r = writer_write(&copy->writer, data + pos, len - pos);
+
+    if(r <= 0) {
+      pgcopy_error(ctx, copy, "writing the destination failed");
+      break;
+    }
+
+    pos += r;
+  }
+}
+
+/* feeds COPY FROM STDIN. Returns TRUE while waiting for the socket
+ * ('blocked') or the stream ('waiting'), FALSE when the end was sent.
+ * Only one chunk is buffered at a time */
+static BOOL
+pgcopy_put(JSContext* ctx, PGSQLConnection* pq, JSValueConst this_obj, PGSQLCopy* copy) {
+  copy->blocked = FALSE;
+
+  for(;;) {
+    ssize_t n;
+    int r;
+
+    if(copy->len) {
+      if((r = PQputCopyData(pq->conn, (const char*)copy->buf, copy->len)) == 0)
+        return copy->blocked = TRUE;
+
+      copy->len = 0;
+
+      if(r < 0 || (r = PQflush(pq->conn)) < 0)
+        break;
+
+      if(r == 1)
+        return copy->blocked = TRUE;
+    }
+
+    if(copy->ended) {
+      if(PQputCopyEnd(pq->conn, copy->error) == 0)
+        return copy->blocked = TRUE;
+
+      break;
+    }
+
+    if(!JS_IsUndefined(copy->stream)) {
+      if(!copy->waiting)
+        pgcopy_wait(ctx, copy, this_obj, js_invoke(ctx, copy->stream, copy->method, 0, 0));
+
+      if(copy->waiting)
+        return TRUE;
+
+      continue;
+    }
+
+    if(!copy->buf && !(copy->buf = js_malloc(ctx, COPY_BUFFER_SIZE))) {
+      JS_FreeValue(ctx, JS_GetException(ctx));
+      pgcopy_error(ctx, copy, "out of memory");
+      copy->ended = TRUE;
+      continue;
+    }
+
+    if((n = copy->reader.read ? reader_read(&copy->reader, copy->buf, COPY_BUFFER_SIZE) : 0) > 0) {
+      copy->len = n;
+    } else {
+      if(n != 0 && n != STREAM_EOF)
+        pgcopy_error(ctx, copy, "reading the source failed");
+
+      copy->ended = TRUE;
+    }
+  }
+
+  copy->active = FALSE;
+  return FALSE;
+}
+
+/* drains COPY TO STDOUT. Returns TRUE while more data is expected, FALSE
+ * once the server is done. Reading pauses while a write() is pending */
+static BOOL
+pgcopy_get(JSContext* ctx, PGSQLConnection* pq, JSValueConst this_obj, PGSQLCopy* copy) {
+  while(!copy->waiting) {
+    char* data;
+    int n;
+
+    if((n = PQgetCopyData(pq->conn, &data, pgconn_nonblock(pq))) == 0)
+      return TRUE;
+
+    if(n < 0) {
+      if(n == -2)
+        pgcopy_error(ctx, copy, pgconn_error(pq));
+
+      copy->active = FALSE;
+      return FALSE;
+    }
+
+    pgcopy_write(ctx, copy, this_obj, data, n);
+    PQfreemem(data);
+  }
+
+  return TRUE;
+}
+
+static BOOL
+pgcopy_pump(JSContext* ctx, PGSQLConnection* pq, JSValueConst this_obj, PGSQLCopy* copy) {
+  return copy->in ? pgcopy_put(ctx, pq, this_obj, copy) : pgcopy_get(ctx, pq, this_obj, copy);
+}
+
+/* reads all results available and settles the requests they complete */
+static void
+pgconn_receive(JSContext* ctx, PGSQLConnection* pq, JSValueConst this_obj) {
+  for(;;) {
+    PGSQLRequest* req = list_empty(&pq->requests) ? 0 : list_entry(pq->requests.next, PGSQLRequest, link);
+    PGresult* res;
+
+    /* no results until the data of a COPY went through */
+    if(req && req->copy && req->copy->active && pgcopy_pump(ctx, pq, this_obj, req->copy))
+      break;
+
+    if(pgconn_paused(pq) || PQisBusy(pq->conn))
+      break;
+
+    if((!req || !req->sent) && pq->syncs == 0)
+      break;
+
+    if(!(res = PQgetResult(pq->conn))) {
+      if(req && req->sent)
+        pgconn_settle(ctx, pq, req);
+
+      /* without pipeline mode the next request may be sent now */
+      if(!pgconn_pipeline(pq))
+        break;
+
+      continue;
+    }
+
+    switch(PQresultStatus(res)) {
+#ifdef LIBPQ_HAS_PIPELINING
+      case PGRES_PIPELINE_SYNC: {
+        PQclear(res);
+
+        if(pq->syncs)
+          --pq->syncs;
+
+        continue;
+      }
+#endif
+
+#ifdef LIBPQ_HAS_CHUNK_MODE
+      case PGRES_TUPLES_CHUNK:
+#endif
+      case PGRES_SINGLE_TUPLE: {
+        if(req && req->sent && req->stream) {
+          pgstream_rows(ctx, req->stream, res);
+          PQclear(res);
+          continue;
+        }
+
+        break;
+      }
+
+      case PGRES_COPY_IN:
+      case PGRES_COPY_OUT:
+      case PGRES_COPY_BOTH: {
+        ExecStatusType status = PQresultStatus(res);
+
+        PQclear(res);
+
+        if(!req || !req->sent)
+          continue;
+
+        /* a COPY issued by query() gets ended right away */
+        if(!req->copy && !(req->copy = pgcopy_new(ctx, status != PGRES_COPY_IN))) {
+          pgconn_fail(ctx, pq, "out of memory");
+          return;
+        }
+
+        pgcopy_start(ctx, req->copy, status);
+        continue;
+      }
+
+      default: break;
+    }
+
+    if(!req || !req->sent) {
+      PQclear(res);
+      continue;
+    }
+
+    /* keep the last result of a command, unless an earlier one failed */
+    if(req->result && pgresult_failed(req->result)) {
+      PQclear(res);
+    } else {
+      if(req->result)
+        PQclear(req->result);
+
+      req->result = res;
+    }
+  }
+}
+
+static JSValue
+js_pgconn_io(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, JSValue data[]) {
+  PGSQLConnection* pq;
+
+  if(!(pq = js_pgconn_data2(ctx, data[0])))
+    return JS_EXCEPTION;
+
+  if(!pq->conn)
+    return JS_UNDEFINED;
+
+  if(magic ? PQflush(pq->conn) == -1 : !PQconsumeInput(pq->conn))
+    pgconn_fail(ctx, pq, pgconn_error(pq));
+  else
+    pgconn_receive(ctx, pq, data[0]);
+
+#ifdef DEBUG_OUTPUT
+  printf("%s write=%d pq=%p error='%s'\n", __func__, magic, pq, pgconn_error(pq));
+#endif
+
+  pgconn_dispatch(ctx, pq, data[0]);
+  return JS_UNDEFINED;
+}
+
+/* queues 'req' on a nonblocking connection and returns its promise */
+static JSValue
+pgconn_submit(JSContext* ctx, PGSQLConnection* pq, JSValueConst this_obj, PGSQLRequest* req) {
+  JSValue promise;
+
+  if(JS_IsException((promise = promise_create(ctx, &req->funcs)))) {
+    pgrequest_free(JS_GetRuntime(ctx), req);
+    return JS_EXCEPTION;
+  }
+
+  list_add_tail(&req->link, &pq->requests);
+  pgconn_dispatch(ctx, pq, this_obj);
+
+  return promise;
+}
+
+/* result of a blocking call, which throws on errors when 'reject' is set */
+static JSValue
+pgconn_return(JSContext* ctx, PGSQLConnection* pq, JSValueConst this_val, PGresult* res, BOOL reject) {
+  JSValue ret;
+
+  if(!res)
+    return reject ? JS_Throw(ctx, js_pgsqlerror_new(ctx, pgconn_error(pq))) : JS_NULL;
+
+  if(reject && pgresult_failed(res)) {
+    ret = js_pgsqlerror_new(ctx, PQresultErrorMessage(res));
+    PQclear(res);
+    return JS_Throw(ctx, ret);
+  }
+
+  ret = pgconn_result(pq, res, ctx);
+  JS_DefinePropertyValueStr(ctx, ret, "handle", JS_DupValue(ctx, this_val), JS_PROP_CONFIGURABLE);
+  return ret;
+}
+
+/* query(sql, [params]) */
+static JSValue
+js_pgconn_query(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  JSValueConst params = argc > 1 ? argv[1] : JS_UNDEFINED;
+  PGSQLConnection* pq;
+  PGSQLRequest* req;
+
+  if(!(pq = js_pgconn_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(!pq->conn)
+    return JS_Throw(ctx, js_pgsqlerror_new(ctx, "not connected"));
+
+  if(!pgconn_nonblock(pq)) {
+    const char* query;
+    PGSQLParams p;
+    PGresult* res;
+
+    if(!(query = JS_ToCString(ctx, argv[0])))
+      return JS_ThrowTypeError(ctx, "argument 1 must be string");
+
+    if(JS_IsUndefined(params)) {
+      res = PQexec(pq->conn, query);
+    } else if(pgparams_init(ctx, &p, params, 0, 0, TRUE)) {
+      pgparams_free(ctx, &p);
+      JS_FreeCString(ctx, query);
+      return JS_EXCEPTION;
+    } else {
+      res = PQexecParams(pq->conn, query, p.count, p.types, p.values, p.lengths, p.formats, 0);
+      pgparams_free(ctx, &p);
+    }
+
+    JS_FreeCString(ctx, query);
+    return pgconn_return(ctx, pq, this_val, res, !JS_IsUndefined(params));
+  }
+
+  if(!(req = pgrequest_new(ctx, REQUEST_QUERY)))
+    return JS_EXCEPTION;
+
+  req->sync = TRUE;
+
+  if(!(req->sql = js_tostring(ctx, argv[0]))) {
+    pgrequest_free(JS_GetRuntime(ctx), req);
+    return JS_ThrowTypeError(ctx, "argument 1 must be string");
+  }
+
+  /* plain queries resolve to failed results, like they always did */
+  if(!JS_IsUndefined(params)) {
+    req->params = JS_DupValue(ctx, params);
+    req->reject = TRUE;
+  }
+
+  return pgconn_submit(ctx, pq, this_val, req);
+}
+
+/* prepare(name, sql, [types]) - 'types' are optional parameter type oids.
+ * The statement is described afterwards, so execPrepared() knows which
+ * parameters to send in binary format */
+static JSValue
+js_pgconn_prepare(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  PGSQLConnection* pq;
+  PGSQLRequest *prep, *desc;
+  Oid* types = 0;
+  int64_t num_types = 0;
+  char *name, *sql;
+
+  if(!(pq = js_pgconn_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(!pq->conn)
+    return JS_Throw(ctx, js_pgsqlerror_new(ctx, "not connected"));
+
+  if(argc > 2 && !JS_IsUndefined(argv[2])) {
+    if(!JS_IsArray(ctx, argv[2]) || (num_types = js_array_length(ctx, argv[2])) < 0)
+      return JS_ThrowTypeError(ctx, "argument 3 must be an array of type oids");
+
+    if(!(types = js_mallocz(ctx, sizeof(Oid) * (num_types + 1))))
+      return JS_EXCEPTION;
+
+    for(int64_t i = 0; i < num_types; i++) {
+      JSValue value = JS_GetPropertyUint32(ctx, argv[2], i);
+      uint32_t oid = 0;
+
+      JS_ToUint32(ctx, &oid, value);
+      JS_FreeValue(ctx, value);
+      types[i] = oid;
+    }
+  }
+
+  name = js_tostring(ctx, argv[0]);
+  sql = js_tostring(ctx, argv[1]);
+
+  if(!name || !sql) {
+    js_free(ctx, name);
+    js_free(ctx, sql);
+    js_free(ctx, types);
+    return JS_EXCEPTION;
+  }
+
+  if(!pgconn_nonblock(pq)) {
+    PGresult* res = PQprepare(pq->conn, name, sql, num_types, types);
+
+    js_free(ctx, sql);
+    js_free(ctx, types);
+
+    if(!res || pgresult_failed(res)) {
+      js_free(ctx, name);
+      return pgconn_return(ctx, pq, this_val, res, TRUE);
+    }
+
+    PQclear(res);
+
+    if((res = PQdescribePrepared(pq->conn, name)) && !pgresult_failed(res))
+      pgconn_describe(ctx, pq, name, res);
+
+    js_free(ctx, name);
+    return pgconn_return(ctx, pq, this_val, res, TRUE);
+  }
+
+  if(!(prep = pgrequest_new(ctx, REQUEST_PREPARE)) || !(desc = pgrequest_new(ctx, REQUEST_DESCRIBE))) {
+    if(prep)
+      pgrequest_free(JS_GetRuntime(ctx), prep);
+
+    js_free(ctx, name);
+    js_free(ctx, sql);
+    js_free(ctx, types);
+    return JS_EXCEPTION;
+  }
+
+  prep->name = name;
+  prep->sql = sql;
+  prep->types = types;
+  prep->num_types = num_types;
+
+  desc->name = js_strdup(ctx, name);
+  desc->sync = desc->reject = TRUE;
+
+  /* execPrepared() calls wait for the types */
+  if(!pgconn_prepared(pq, name)) {
+    PGSQLPrepared* ps;
+
+    if((ps = js_mallocz(ctx, sizeof(PGSQLPrepared)))) {
+      if((ps->name = js_strdup(ctx, name)))
+        list_add_tail(&ps->link, &pq->prepared);
+      else
+        js_free(ctx, ps);
+    }
+  }
+
+  list_add_tail(&prep->link, &pq->requests);
+  return pgconn_submit(ctx, pq, this_val, desc);
+}
+
+/* execPrepared(name, [params]) */
+static JSValue
+js_pgconn_exec_prepared(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  JSValueConst params = argc > 1 ? argv[1] : JS_UNDEFINED;
+  PGSQLConnection* pq;
+  PGSQLRequest* req;
+
+  if(!(pq = js_pgconn_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(!pq->conn)
+    return JS_Throw(ctx, js_pgsqlerror_new(ctx, "not connected"));
+
+  if(!pgconn_nonblock(pq)) {
+    PGSQLPrepared* ps;
+    PGSQLParams p;
+    PGresult* res;
+    char* name;
+
+    if(!(name = js_tostring(ctx, argv[0])))
+      return JS_EXCEPTION;
+
+    ps = pgconn_prepared(pq, name);
+
+    if(pgparams_init(ctx, &p, params, ps ? ps->types : 0, ps ? ps->num_params : 0, FALSE)) {
+      pgparams_free(ctx, &p);
+      js_free(ctx, name);
+      return JS_EXCEPTION;
+    }
+
+    res = PQexecPrepared(pq->conn, name, p.count, p.values, p.lengths, p.formats, 0);
+    pgparams_free(ctx, &p);
+    js_free(ctx, name);
+
+    return pgconn_return(ctx, pq, this_val, res, TRUE);
+  }
+
+  if(!(req = pgrequest_new(ctx, REQUEST_EXEC_PREPARED)))
+    return JS_EXCEPTION;
+
+  if(!(req->name = js_tostring(ctx, argv[0]))) {
+    pgrequest_free(JS_GetRuntime(ctx), req);
+    return JS_EXCEPTION;
+  }
+
+  req->params = JS_DupValue(ctx, params);
+  req->sync = req->reject = TRUE;
+
+  return pgconn_submit(ctx, pq, this_val, req);
+}
+
+/* then() handlers of the stream promises of a COPY, 'magic' tells whether
+ * it was rejected */
+static JSValue
+js_pgconn_copy_then(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, JSValue data[]) {
+  PGSQLConnection* pq;
+  PGSQLRequest* req;
+
+  if(!(pq = js_pgconn_data2(ctx, data[0])))
+    return JS_EXCEPTION;
+
+  /* the request is gone when the connection was closed meanwhile */
+  if(!pq->conn || list_empty(&pq->requests))
+    return JS_UNDEFINED;
+
+  req = list_entry(pq->requests.next, PGSQLRequest, link);
+
+  if(!req->copy || !req->copy->waiting)
+    return JS_UNDEFINED;
+
+  pgcopy_settled(ctx, req->copy, magic, argc > 0 ? argv[0] : JS_UNDEFINED);
+
+  pgconn_receive(ctx, pq, data[0]);
+  pgconn_dispatch(ctx, pq, data[0]);
+  return JS_UNDEFINED;
+}
+
+/* copyFrom(sql, source) / copyTo(sql, [destination]) run a COPY ... FROM
+ * STDIN or COPY ... TO STDOUT statement, and return the number of rows
+ * (copyTo() without destination returns the data as ArrayBuffer) */
+static JSValue
+js_pgconn_copy(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  PGSQLConnection* pq;
+  PGSQLCopy* copy;
+  PGSQLRequest* req;
+
+  if(!(pq = js_pgconn_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(!pq->conn)
+    return JS_Throw(ctx, js_pgsqlerror_new(ctx, "not connected"));
+
+  if(pgconn_pipeline(pq))
+    return JS_Throw(ctx, js_pgsqlerror_new(ctx, "COPY is not supported in pipeline mode"));
+
+  if(!(copy = pgcopy_new(ctx, magic == 0)))
+    return JS_EXCEPTION;
+
+  if(pgcopy_init(ctx, copy, argc > 1 ? argv[1] : JS_UNDEFINED)) {
+    pgcopy_free(JS_GetRuntime(ctx), copy);
+    return JS_EXCEPTION;
+  }
+
+  if(!pgconn_nonblock(pq)) {
+    const char* sql;
+    PGresult *res, *next;
+    JSValue ret;
+
+    if(!JS_IsUndefined(copy->stream)) {
+      pgcopy_free(JS_GetRuntime(ctx), copy);
+      return JS_ThrowTypeError(ctx, "streams need a nonblocking connection");
+    }
+
+    if(!(sql = JS_ToCString(ctx, argv[0]))) {
+      pgcopy_free(JS_GetRuntime(ctx), copy);
+      return JS_EXCEPTION;
+    }
+
+    res = PQexec(pq->conn, sql);
+    JS_FreeCString(ctx, sql);
+
+    if(res && (PQresultStatus(res) == PGRES_COPY_IN || PQresultStatus(res) == PGRES_COPY_OUT)) {
+      pgcopy_start(ctx, copy, PQresultStatus(res));
+      PQclear(res);
+
+      /* blocking calls never wait in between */
+      pgcopy_pump(ctx, pq, this_val, copy);
+
+      if((res = PQgetResult(pq->conn)))
+        while((next = PQgetResult(pq->conn)))
+          PQclear(next);
+    }
+
+    ret = pgcopy_value(ctx, copy, res);
+
+    if(res)
+      PQclear(res);
+
+    pgcopy_free(JS_GetRuntime(ctx), copy);
+    return ret;
+  }
+
+  if(!(req = pgrequest_new(ctx, REQUEST_COPY))) {
+    pgcopy_free(JS_GetRuntime(ctx), copy);
+    return JS_EXCEPTION;
+  }
+
+  req->copy = copy;
+
+  if(!(req->sql = js_tostring(ctx, argv[0]))) {
+    pgrequest_free(JS_GetRuntime(ctx), req);
+    return JS_ThrowTypeError(ctx, "argument 1 must be string");
+  }
+
+  return pgconn_submit(ctx, pq, this_val, req);
+}
+
+/* stream(sql, [params], [batchSize]) runs a query in single-row mode
+ * (chunked rows mode where libpq has it) and returns a PGstream, an async
+ * iterator of arrays of up to 'batchSize' rows (default 1000) */
+static JSValue
+js_pgconn_stream(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  JSValueConst params = argc > 1 && !JS_IsNull(argv[1]) ? argv[1] : JS_UNDEFINED;
+  PGSQLConnection* pq;
+  PGSQLStream* st;
+  uint32_t batch_size = 1000;
+  JSValue obj;
+
+  if(!(pq = js_pgconn_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(!pq->conn)
+    return JS_Throw(ctx, js_pgsqlerror_new(ctx, "not connected"));
+
+  if(pgconn_pipeline(pq))
+    return JS_Throw(ctx, js_pgsqlerror_new(ctx, "stream() is not supported in pipeline mode"));
+
+  if(argc > 2 && !JS_IsUndefined(argv[2]))
+    if(JS_ToUint32(ctx, &batch_size, argv[2]) || batch_size == 0)
+      return JS_ThrowRangeError(ctx, "argument 3 must be a positive batch size");
+
+  if(!(st = pgstream_new(ctx, this_val, batch_size)))
+    return JS_EXCEPTION;
+
+  obj = JS_NewObjectProtoClass(ctx, pgstream_proto, js_pgstream_class_id);
+
+  if(JS_IsException(obj)) {
+    pgstream_free(JS_GetRuntime(ctx), st);
+    return JS_EXCEPTION;
+  }
+
+  JS_SetOpaque(obj, st);
+
+  if(!pgconn_nonblock(pq)) {
+    const char* sql;
+    PGSQLParams p = {0};
+    int ret;
+
+    if(!(sql = JS_ToCString(ctx, argv[0]))) {
+      JS_FreeValue(ctx, obj);
+      return JS_EXCEPTION;
+    }
+
+    if(JS_IsUndefined(params)) {
+      ret = PQsendQuery(pq->conn, sql);
+    } else if(pgparams_init(ctx, &p, params, 0, 0, TRUE)) {
+      pgparams_free(ctx, &p);
+      JS_FreeCString(ctx, sql);
+      JS_FreeValue(ctx, obj);
+      return JS_EXCEPTION;
+    } else {
+      ret = PQsendQueryParams(pq->conn, sql, p.count, p.types, p.values, p.lengths, p.formats, 0);
+    }
+
+    pgparams_free(ctx, &p);
+    JS_FreeCString(ctx, sql);
+
+    if(!ret) {
+      JS_FreeValue(ctx, obj);
+      return JS_Throw(ctx, js_pgsqlerror_new(ctx, pgconn_error(pq)));
+    }
+
+    pgstream_mode(pq->conn, batch_size);
+    st->blocking = TRUE;
+    return obj;
+  }
+
+  {
+    PGSQLRequest* req;
+
+    if(!(req = pgrequest_new(ctx, REQUEST_STREAM))) {
+      JS_FreeValue(ctx, obj);
+      return JS_EXCEPTION;
+    }
+
+    req->stream = pgstream_dup(st);
+    req->params = JS_DupValue(ctx, params);
+    req->sync = TRUE;
+
+    if(!(req->sql = js_tostring(ctx, argv[0]))) {
+      pgrequest_free(JS_GetRuntime(ctx), req);
+      JS_FreeValue(ctx, obj);
+      return JS_ThrowTypeError(ctx, "argument 1 must be string");
+    }
+
+    /* the rows are handed out by the PGstream, not by a promise */
+    list_add_tail(&req->link, &pq->requests);
+    pgconn_dispatch(ctx, pq, this_val);
+  }
+
+  return obj;
+}
+
+/* blocking connections read up to the next batch on next() */
+static void
+pgstream_fetch(JSContext* ctx, PGSQLStream* st, PGconn* conn) {
+  PGresult* res;
+
+  while(!st->done && JS_IsUndefined(st->ready)) {
+    if(!(res = PQgetResult(conn))) {
+      pgstream_end(ctx, st, JS_UNDEFINED);
+      break;
+    }
+
+    if(pgresult_failed(res)) {
+      JSValue err = js_pgsqlerror_new(ctx, PQresultErrorMessage(res));
+
+      PQclear(res);
+
+      while((res = PQgetResult(conn)))
+        PQclear(res);
+
+      pgstream_end(ctx, st, err);
+      JS_FreeValue(ctx, err);
+      break;
+    }
+
+    pgstream_rows(ctx, st, res);
+    PQclear(res);
+  }
+}
+
+/* next() resolves with the next batch, return() discards the rows which
+ * are still to come */
+static JSValue
+js_pgstream_next(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  PGSQLStream* st;
+  PGSQLConnection* pq;
+  JSValue promise;
+
+  if(!(st = JS_GetOpaque2(ctx, this_val, js_pgstream_class_id)))
+    return JS_EXCEPTION;
+
+  if(promise_pending(&st->next))
+    return JS_ThrowTypeError(ctx, "PGstream: next() is still pending");
+
+  if(JS_IsException((promise = promise_create(ctx, &st->next))))
+    return JS_EXCEPTION;
+
+  pq = JS_GetOpaque(st->conn, js_pgconn_class_id);
+
+  if(magic || st->closed) {
+    st->closed = TRUE;
+    st->rows = 0;
+    JS_FreeValue(ctx, st->batch);
+    JS_FreeValue(ctx, st->ready);
+    JS_FreeValue(ctx, st->error);
+    st->batch = st->ready = st->error = JS_UNDEFINED;
+
+    if(st->blocking && !st->done && pq && pq->conn) {
+      PGresult* res;
+
+      while((res = PQgetResult(pq->conn)))
+        PQclear(res);
+    }
+
+    if(st->blocking)
+      st->done = TRUE;
+
+    {
+      JSValue ret = js_iterator_result(ctx, JS_UNDEFINED, TRUE);
+
+      promise_resolve(ctx, &st->next, ret);
+      JS_FreeValue(ctx, ret);
+    }
+  } else if(st->blocking) {
+    if(pq && pq->conn)
+      pgstream_fetch(ctx, st, pq->conn);
+    else
+      pgstream_end(ctx, st, JS_UNDEFINED);
+  }
+
+  pgstream_deliver(ctx, st);
+
+  /* reading may go on */
+  if(!st->blocking && pq && pq->conn) {
+    pgconn_receive(ctx, pq, st->conn);
+    pgconn_dispatch(ctx, pq, st->conn);
+  }
+
+  return promise;
+}
+
+static JSValue
+js_pgstream_iterator(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  return JS_DupValue(ctx, this_val);
+}
+
+static void
+js_pgstream_finalizer(JSRuntime* rt, JSValue val) {
+  PGSQLStream* st;
+
+  /* like return(), the request drops what's left */
+  if((st = JS_GetOpaque(val, js_pgstream_class_id))) {
+    st->closed = TRUE;
+    JS_FreeValueRT(rt, st->batch);
+    JS_FreeValueRT(rt, st->ready);
+    st->batch = st->ready = JS_UNDEFINED;
+    pgstream_free(rt, st);
+  }
+}
+
+static JSClassDef js_pgstream_class = {
+    .class_name = "PGstream",
+    .finalizer = js_pgstream_finalizer,
+};
+
+static const JSCFunctionListEntry js_pgstream_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("next", 0, js_pgstream_next, 0),
+    JS_CFUNC_MAGIC_DEF("return", 0, js_pgstream_next, 1),
+    JS_CFUNC_DEF("[Symbol.asyncIterator]", 0, js_pgstream_iterator),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "PGstream", JS_PROP_CONFIGURABLE),
+};
+
+static JSValue
+js_pgconn_close(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  JSValue ret = JS_UNDEFINED;
+  PGSQLConnection* pq;
+
+  if(!(pq = js_pgconn_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(pq->conn) {
+    pgconn_fail(ctx, pq, "connection closed");
+    pgconn_watch(ctx, pq, this_val, TRUE, FALSE);
+    pgconn_watch(ctx, pq, this_val, FALSE, FALSE);
+  }
+
+  PQfinish(pq->conn);
+  pq->conn = 0;
+
+  while(!list_empty(&pq->prepared))
+    pgconn_prepared_free(JS_GetRuntime(ctx), list_entry(pq->prepared.next, PGSQLPrepared, link));
+
+  return ret;
+}
+
+static void
+js_pgconn_finalizer(JSRuntime* rt, JSValue val) {
+  PGSQLConnection* pq;
+
+  if((pq = JS_GetOpaque(val, js_pgconn_class_id)))
+    pgconn_free(pq, rt);
+}
+
+static JSClassDef js_pgconn_class = {
+    .class_name = "PGconn",
+    .finalizer = js_pgconn_finalizer,
+};
+
+static const JSCFunctionListEntry js_pgconn_funcs[] = {
+    JS_CGETSET_MAGIC_DEF("cmdTuples", js_pgconn_get, 0, PROP_CMD_TUPLES),
+    JS_CGETSET_MAGIC_DEF("affectedRows", js_pgconn_get, 0, PROP_CMD_TUPLES),
+
+    JS_CGETSET_MAGIC_DEF("nonblocking", js_pgconn_get, js_pgconn_set, PROP_NONBLOCKING),
+    JS_CGETSET_MAGIC_DEF("pipeline", js_pgconn_get, js_pgconn_set, PROP_PIPELINE),
+    JS_CGETSET_MAGIC_DEF("pending", js_pgconn_get, 0, PROP_PENDING),
+    JS_CGETSET_MAGIC_DEF("fd", js_pgconn_get, 0, PROP_FD),
+    JS_CGETSET_MAGIC_DEF("errorMessage", js_pgconn_get, 0, PROP_ERROR_MESSAGE),
+    JS_CGETSET_MAGIC_DEF("options", js_pgconn_get, 0, PROP_OPTIONS),
+    JS_CGETSET_MAGIC_DEF("insertId", js_pgconn_get, 0, PROP_INSERT_ID),
+    JS_CGETSET_MAGIC_DEF("charset", js_pgconn_get, js_pgconn_set, PROP_CLIENT_ENCODING),
+    JS_CGETSET_MAGIC_DEF("protocolVersion", js_pgconn_get, 0, PROP_PROTOCOL_VERSION),
+    JS_CGETSET_MAGIC_DEF("serverVersion", js_pgconn_get, 0, PROP_SERVER_VERSION),
+    JS_CGETSET_MAGIC_DEF("user", js_pgconn_get, 0, PROP_USER),
+    JS_CGETSET_MAGIC_DEF("password", js_pgconn_get, 0, PROP_PASSWORD),
+    JS_CGETSET_MAGIC_DEF("host", js_pgconn_get, 0, PROP_HOST),
+    JS_CGETSET_MAGIC_DEF("port", js_pgconn_get, 0, PROP_PORT),
+    JS_CGETSET_MAGIC_DEF("db", js_pgconn_get, 0, PROP_DB),
+    JS_CGETSET_MAGIC_DEF("conninfo", js_pgconn_get, 0, PROP_CONNINFO),
+    JS_CFUNC_DEF("connect", 1, js_pgconn_connect),
+    JS_CFUNC_DEF("query", 1, js_pgconn_query),
+    JS_CFUNC_DEF("prepare", 2, js_pgconn_prepare),
+    JS_CFUNC_DEF("execPrepared", 1, js_pgconn_exec_prepared),
+    JS_CFUNC_MAGIC_DEF("copyFrom", 2, js_pgconn_copy, 0),
+    JS_CFUNC_MAGIC_DEF("copyTo", 1, js_pgconn_copy, 1),
+    JS_CFUNC_DEF("stream", 1, js_pgconn_stream),
+    JS_CFUNC_DEF("close", 0, js_pgconn_close),
+    JS_ALIAS_DEF("execute", "query"),
+    JS_CFUNC_DEF("escapeString", 1, js_pgconn_escape_string),
+    JS_CFUNC_MAGIC_DEF("escapeLiteral", 1, js_pgconn_escape_alloc, 0),
+    JS_CFUNC_MAGIC_DEF("escapeIdentifier", 1, js_pgconn_escape_alloc, 1),
+    JS_CFUNC_DEF("escapeBytea", 1, js_pgconn_escape_bytea),
+    JS_CFUNC_DEF("unescapeBytea", 1, js_pgconn_unescape_bytea),
+    JS_CFUNC_DEF("valueString", 0, js_pgconn_value_string),
+    JS_CFUNC_DEF("valuesString", 1, js_pgconn_values_string),
+    JS_CFUNC_DEF("insertQuery", 2, js_pgconn_insert_query),
+    // JS_CFUNC_MAGIC_DEF("escapeString", 1, js_pgconn_methods, METHOD_ESCAPE_STRING),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "PGconn", JS_PROP_CONFIGURABLE),
+};
+
+static const JSCFunctionListEntry js_pgconn_static[] = {
+    JS_CFUNC_DEF("escapeString", 1, js_pgconn_escape_string),
+    JS_CFUNC_DEF("escapeBytea", 1, js_pgconn_escape_bytea),
+    JS_CFUNC_DEF("unescapeBytea", 1, js_pgconn_unescape_bytea),
+};
+
+static const JSCFunctionListEntry js_pgconn_defines[] = {
+    JS_PROP_INT32_DEF("RESULT_OBJECT", RESULT_OBJECT, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("RESULT_STRING", RESULT_STRING, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("RESULT_TBLNAM", RESULT_TBLNAM, JS_PROP_CONFIGURABLE),
+};
+
+static JSValue
+js_pgsqlerror_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  JSValue proto, obj = JS_UNDEFINED;
+  JSAtom prop;
+
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+  if(JS_IsException(proto))
+    goto fail;
+
+  obj = JS_NewObjectProtoClass(ctx, proto, js_pgsqlerror_class_id);
+  JS_FreeValue(ctx, proto);
+  if(JS_IsException(obj))
+    goto fail;
+
+  if(argc > 0) {
+    prop = JS_NewAtom(ctx, "message");
+    JS_DefinePropertyValue(ctx, obj, prop, JS_DupValue(ctx, argv[0]), JS_PROP_C_W_E);
+    JS_FreeAtom(ctx, prop);
+  }
+
+  if(argc > 1) {
+    prop = JS_NewAtom(ctx, "type");
+    JS_DefinePropertyValue(ctx, obj, prop, JS_DupValue(ctx, argv[1]), JS_PROP_WRITABLE | JS_PROP_CONFIGURABLE);
+    JS_FreeAtom(ctx, prop);
+  }
+
+  JSValue stack = js_error_stack(ctx);
+  prop = JS_NewAtom(ctx, "stack");
+  JS_DefinePropertyValue(ctx, obj, prop, stack, JS_PROP_CONFIGURABLE);
+  JS_FreeAtom(ctx, prop);
+
+  return obj;
+
+fail:
+  JS_FreeValue(ctx, obj);
+  return JS_EXCEPTION;
+}
+
+static JSValue
+js_pgsqlerror_new(JSContext* ctx, const char* msg) {
+  JSValue obj;
+  JSValue argv[2];
+
+  obj = JS_NewObjectProtoClass(ctx, pgsqlerror_proto, js_pgsqlerror_class_id);
+  if(JS_IsException(obj))
+    return JS_EXCEPTION;
+
+  argv[0] = JS_NewString(ctx, msg);
+  obj = js_pgsqlerror_constructor(ctx, pgsqlerror_ctor, 1, argv);
+
+  JS_FreeValue(ctx, argv[0]);
+  JS_FreeValue(ctx, argv[1]);
+
+  return obj;
+}
+
+static JSClassDef js_pgsqlerror_class = {
+    .class_name = "PGerror",
 };
 
 static const JSCFunctionListEntry js_pgsqlerror_funcs[] = {
@@ -1516,6 +3387,103 @@ result_iterate(JSContext* ctx, PGSQLResult* opaque, int row, int rtype) {
   return ret;
 }
 
+enum {
+  COLUMN_PUT_TEXT = 0,
+  COLUMN_PUT_NUMBER,
+  COLUMN_PUT_BOOLEAN,
+  COLUMN_PUT_BYTEA,
+  COLUMN_PUT_BINARY,
+};
+
+static int
+result_column_put(ColumnBuilder* col, int mode, char* buf, int len) {
+  switch(mode) {
+    case COLUMN_PUT_NUMBER: return column_put_number(col, buf, len);
+    case COLUMN_PUT_BOOLEAN: return column_put_int64(col, buf[0] == 't');
+    case COLUMN_PUT_BINARY: return column_put_text(col, buf, len, TRUE);
+    case COLUMN_PUT_BYTEA: {
+      unsigned char* dst;
+      size_t dlen;
+      int r;
+
+      if(!(dst = PQunescapeBytea((const unsigned char*)buf, &dlen)))
+        return -1;
+
+      r = column_put_text(col, dst, dlen, TRUE);
+      PQfreemem(dst);
+      return r;
+    }
+  }
+
+  return column_put_text(col, buf, len, FALSE);
+}
+
+/* collects up to 'batch_size' rows starting at the current row index
+ * column-wise, returns null when all rows have been fetched */
+static JSValue
+result_columns(JSContext* ctx, PGSQLResult* opaque, uint32_t batch_size) {
+  PGresult* res = opaque->result;
+  uint32_t i, row, end, num_fields = PQnfields(res), ntuples = PQntuples(res);
+  FieldNameFunc* fn = field_namefunc(res);
+  ColumnBuilder* cols;
+  int* modes;
+  JSValue ret = JS_NULL;
+
+  if(opaque->row_index >= ntuples)
+    return JS_NULL;
+
+  end = ntuples - opaque->row_index > batch_size ? opaque->row_index + batch_size : ntuples;
+
+  if(!(cols = js_malloc(ctx, (sizeof(ColumnBuilder) + sizeof(int)) * (num_fields ? num_fields : 1))))
+    return JS_EXCEPTION;
+
+  modes = (int*)&cols[num_fields];
+
+  for(i = 0; i < num_fields; i++) {
+    column_init(&cols[i], ctx);
+
+    if(PQfformat(res, i))
+      modes[i] = COLUMN_PUT_BINARY;
+    else if(field_is_binary(res, i))
+      modes[i] = COLUMN_PUT_BYTEA;
+    else if(field_is_boolean(res, i))
+      modes[i] = COLUMN_PUT_BOOLEAN;
+    else if(field_is_number(res, i))
+      modes[i] = COLUMN_PUT_NUMBER;
+    else
+      modes[i] = COLUMN_PUT_TEXT;
+  }
+
+  for(row = opaque->row_index; row < end; row++)
+    for(i = 0; i < num_fields; i++) {
+      int r = PQgetisnull(res, row, i) ? column_put_null(&cols[i]) : result_column_put(&cols[i], modes[i], PQgetvalue(res, row, i), PQgetlength(res, row, i));
+
+      if(r) {
+        ret = JS_ThrowOutOfMemory(ctx);
+        goto fail;
+      }
+    }
+
+  opaque->row_index = end;
+  ret = JS_NewObjectProto(ctx, JS_NULL);
+
+  for(i = 0; i < num_fields; i++) {
+    char* id;
+
+    if((id = fn(ctx, opaque, i))) {
+      JS_SetPropertyStr(ctx, ret, id, column_value(&cols[i], ctx));
+      js_free(ctx, id);
+    }
+  }
+
+fail:
+  for(i = 0; i < num_fields; i++)
+    column_free(&cols[i]);
+
+  js_free(ctx, cols);
+  return ret;
+}
+
 static PGSQLResult*
 pgresult_new(JSContext* ctx) {
   PGSQLResult* res;
@@ -1602,6 +3570,7 @@ enum {
   METHOD_FETCH_FIELDS,
   METHOD_FETCH_ROW,
   METHOD_FETCH_ASSOC,
+  METHOD_FETCH_COLUMNS,
 };
 
 static JSValue
@@ -1673,6 +3642,17 @@ js_pgresult_functions(JSContext* ctx, JSValueConst this_val, int argc, JSValueCo
       ret = js_pgresult_next(ctx, this_val, argc, argv, &done, magic);
       break;
     }
+
+    case METHOD_FETCH_COLUMNS: {
+      uint32_t batch_size = UINT32_MAX;
+
+      if(argc > 0 && !JS_IsUndefined(argv[0]))
+        if(JS_ToUint32(ctx, &batch_size, argv[0]) || batch_size == 0)
+          return JS_ThrowRangeError(ctx, "argument 1 must be a positive batch size");
+
+      ret = result_columns(ctx, JS_GetOpaque(this_val, js_pgresult_class_id), batch_size);
+      break;
+    }
   }
 
   return ret;
@@ -1744,6 +3724,15 @@ js_pgresult_get(JSContext* ctx, JSValueConst this_val, int magic) {
       ret = JS_NewInt64(ctx, PQnfields(res));
       break;
     }
+
+    case PROP_CMD_TUPLES: {
+      PGSQLResult* opaque;
+
+      if((opaque = JS_GetOpaque(this_val, js_pgresult_class_id)))
+        ret = JS_NewInt64(ctx, pgresult_cmdtuples(opaque));
+
+      break;
+    }
   }
 
   return ret;
@@ -1855,10 +3844,13 @@ static const JSCFunctionListEntry js_pgresult_funcs[] = {
     // JS_ITERATOR_NEXT_DEF("next", 0, js_pgresult_next, METHOD_NEXT),
     JS_CGETSET_MAGIC_FLAGS_DEF("numRows", js_pgresult_get, 0, PROP_NUM_ROWS, JS_PROP_ENUMERABLE),
     JS_CGETSET_MAGIC_FLAGS_DEF("numFields", js_pgresult_get, 0, PROP_NUM_FIELDS, JS_PROP_ENUMERABLE),
+    JS_CGETSET_MAGIC_DEF("cmdTuples", js_pgresult_get, 0, PROP_CMD_TUPLES),
+    JS_CGETSET_MAGIC_DEF("affectedRows", js_pgresult_get, 0, PROP_CMD_TUPLES),
     JS_CFUNC_MAGIC_DEF("fetchField", 1, js_pgresult_functions, METHOD_FETCH_FIELD),
     JS_CFUNC_MAGIC_DEF("fetchFields", 0, js_pgresult_functions, METHOD_FETCH_FIELDS),
     JS_CFUNC_MAGIC_DEF("fetchRow", 0, js_pgresult_functions, METHOD_FETCH_ROW),
     JS_CFUNC_MAGIC_DEF("fetchAssoc", 0, js_pgresult_functions, METHOD_FETCH_ASSOC),
+    JS_CFUNC_MAGIC_DEF("fetchColumns", 1, js_pgresult_functions, METHOD_FETCH_COLUMNS),
     JS_CFUNC_DEF("[Symbol.iterator]", 0, js_pgresult_iterator),
     JS_PROP_STRING_DEF("[Symbol.toStringTag]", "PGresult", JS_PROP_CONFIGURABLE),
 };
@@ -2278,6 +4270,13 @@ js_pgsql_init(JSContext* ctx, JSModuleDef* m) {
   JS_SetClassProto(ctx, js_pgresult_class_id, pgresult_proto);
   JS_SetConstructor(ctx, pgresult_ctor, pgresult_proto);
 
+  JS_NewClassID(&js_pgstream_class_id);
+  JS_NewClass(JS_GetRuntime(ctx), js_pgstream_class_id, &js_pgstream_class);
+
+  pgstream_proto = JS_NewObject(ctx);
+  JS_SetPropertyFunctionList(ctx, pgstream_proto, js_pgstream_funcs, countof(js_pgstream_funcs));
+  JS_SetClassProto(ctx, js_pgstream_class_id, pgstream_proto);
+
   if(m) {
     JS_SetModuleExport(ctx, m, "PGconn", pgsql_ctor);
     JS_SetModuleExport(ctx, m, "PGerror", pgsqlerror_ctor);
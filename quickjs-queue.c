@@ -2,6 +2,7 @@
 #include "queue.h"
 #include "utils.h"
 #include "buffer-utils.h"
+#include <errno.h>
 
 /**
  * \defgroup quickjs-queue quickjs-queue: Queue reader
@@ -22,6 +23,38 @@ js_queue_data2(JSContext* ctx, JSValueConst value) {
   return JS_GetOpaque2(ctx, value, js_queue_class_id);
 }
 
+/* looks up the n-th readable span of a ring-mode queue and its start offset */
+static BOOL
+js_queue_span(Queue* queue, int64_t index, struct iovec* span, int64_t* start) {
+  struct iovec iov[2];
+  int n = queue_segments(queue, iov, countof(iov));
+
+  if(index < 0)
+    index += n;
+
+  if(index < 0 || index >= n)
+    return FALSE;
+
+  if(span)
+    *span = iov[index];
+
+  if(start)
+    *start = index > 0 ? iov[0].iov_len : 0;
+
+  return TRUE;
+}
+
+/* ring storage is overwritten as the queue advances, so spans are copied out */
+static JSValue
+js_queue_span_arraybuffer(JSContext* ctx, Queue* queue, int64_t index) {
+  struct iovec span;
+
+  if(!js_queue_span(queue, index, &span, 0))
+    return JS_NULL;
+
+  return JS_NewArrayBufferCopy(ctx, span.iov_base, span.iov_len);
+}
+
 static JSValue
 js_queue_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
   JSValue proto, obj = JS_UNDEFINED;
@@ -32,6 +65,18 @@ js_queue_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueC
 
   queue_init(queue);
 
+  if(argc > 0 && !JS_IsUndefined(argv[0])) {
+    uint64_t size = 0;
+
+    if(JS_ToIndex(ctx, &size, argv[0]))
+      goto fail;
+
+    if(queue_ring(queue, size, argc > 1 && JS_ToBool(ctx, argv[1]))) {
+      JS_ThrowInternalError(ctx, "queue_ring() failed: %s", strerror(errno));
+      goto fail;
+    }
+  }
+
   /* using new_target to get the prototype is necessary when the class is extended. */
   proto = JS_GetPropertyStr(ctx, new_target, "prototype");
   if(JS_IsException(proto))
@@ -49,6 +94,7 @@ js_queue_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueC
   return obj;
 
 fail:
+  queue_reset(queue);
   js_free(ctx, queue);
   JS_FreeValue(ctx, obj);
   return JS_EXCEPTION;
@@ -63,6 +109,8 @@ enum {
   QUEUE_NEXT,
   QUEUE_CHUNK,
   QUEUE_AT,
+  QUEUE_READV,
+  QUEUE_WRITEV,
 };
 
 static JSValue
@@ -133,6 +181,19 @@ js_queue_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst ar
 
       JS_ToInt64(ctx, &pos, argv[0]);
 
+      if(queue_is_ring(queue)) {
+        int64_t start = 0;
+
+        if(!returnPos)
+          ret = js_queue_span_arraybuffer(ctx, queue, pos);
+        else if(js_queue_span(queue, pos, 0, &start))
+          ret = JS_NewInt64(ctx, pos < 0 ? start - (int64_t)queue_size(queue) : start);
+        else
+          ret = JS_NULL;
+
+        break;
+      }
+
       if((chunk = queue_chunk(queue, pos))) {
         if(returnPos)
           ret = JS_NewInt64(ctx, pos < 0 ? chunk_headpos(chunk, queue) : chunk_tailpos(chunk, queue));
@@ -151,6 +212,29 @@ js_queue_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst ar
 
       JS_ToInt64(ctx, &offset, argv[0]);
 
+      if(queue_is_ring(queue)) {
+        int64_t size = queue_size(queue), start = 0;
+        int index;
+
+        if(offset < 0)
+          offset += size;
+
+        ret = JS_NULL;
+
+        if(offset < 0 || offset >= size)
+          break;
+
+        index = js_queue_span(queue, 1, 0, &start) && offset >= start ? 1 : 0;
+
+        if(index == 0)
+          start = 0;
+
+        ret = JS_NewArray(ctx);
+        JS_SetPropertyUint32(ctx, ret, 0, js_queue_span_arraybuffer(ctx, queue, index));
+        JS_SetPropertyUint32(ctx, ret, 1, JS_NewUint32(ctx, offset - start));
+        break;
+      }
+
       if((chunk = queue_at(queue, offset, &skip))) {
         ret = JS_NewArray(ctx);
         JS_SetPropertyUint32(ctx, ret, 0, chunk_arraybuffer(chunk, ctx));
@@ -160,6 +244,38 @@ js_queue_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst ar
 
       break;
     }
+
+#ifndef _WIN32
+    case QUEUE_READV: {
+      int32_t fd = -1;
+      uint64_t n = queue_is_ring(queue) ? queue_space(queue) : 65536;
+      ssize_t r;
+
+      if(JS_ToInt32(ctx, &fd, argv[0]))
+        return JS_EXCEPTION;
+
+      if(argc > 1 && !JS_IsUndefined(argv[1]))
+        if(JS_ToIndex(ctx, &n, argv[1]))
+          return JS_EXCEPTION;
+
+      r = queue_readv(queue, fd, n);
+      ret = JS_NewInt64(ctx, r < 0 ? -errno : r);
+      break;
+    }
+
+    case QUEUE_WRITEV: {
+      int32_t fd = -1;
+      ssize_t r;
+
+      if(JS_ToInt32(ctx, &fd, argv[0]))
+        return JS_EXCEPTION;
+
+      r = queue_writev(queue, fd);
+      ret = JS_NewInt64(ctx, r < 0 ? -errno : r);
+      break;
+    }
+#endif
+
   }
 
   return ret;
@@ -171,6 +287,9 @@ enum {
   QUEUE_HEAD,
   QUEUE_TAIL,
   QUEUE_CHUNKS,
+  QUEUE_RING,
+  QUEUE_CAPACITY,
+  QUEUE_MIRRORED,
 };
 
 static JSValue
@@ -195,7 +314,9 @@ js_queue_get(JSContext* ctx, JSValueConst this_val, int magic) {
     case QUEUE_HEAD: {
       Chunk* head;
 
-      if((head = queue_head(queue)))
+      if(queue_is_ring(queue))
+        ret = js_queue_span_arraybuffer(ctx, queue, -1);
+      else if((head = queue_head(queue)))
         ret = chunk_arraybuffer(head, ctx);
 
       break;
@@ -204,14 +325,31 @@ js_queue_get(JSContext* ctx, JSValueConst this_val, int magic) {
     case QUEUE_TAIL: {
       Chunk* head;
 
-      if((head = queue_tail(queue)))
+      if(queue_is_ring(queue))
+        ret = js_queue_span_arraybuffer(ctx, queue, 0);
+      else if((head = queue_tail(queue)))
         ret = chunk_arraybuffer(head, ctx);
 
       break;
     }
 
     case QUEUE_CHUNKS: {
-      ret = JS_NewUint32(ctx, queue->nchunks);
+      ret = JS_NewUint32(ctx, queue_nchunks(queue));
+      break;
+    }
+
+    case QUEUE_RING: {
+      ret = JS_NewBool(ctx, queue_is_ring(queue));
+      break;
+    }
+
+    case QUEUE_CAPACITY: {
+      ret = queue_is_ring(queue) ? JS_NewInt64(ctx, queue_capacity(queue)) : JS_NULL;
+      break;
+    }
+
+    case QUEUE_MIRRORED: {
+      ret = JS_NewBool(ctx, queue->ring.mirror);
       break;
     }
   }
@@ -232,7 +370,7 @@ js_queue_finalizer(JSRuntime* rt, JSValue val) {
   Queue* queue;
 
   if((queue = js_queue_data(val))) {
-    queue_clear(queue);
+    queue_reset(queue);
     js_free_rt(rt, queue);
   }
 }
@@ -251,11 +389,18 @@ static const JSCFunctionListEntry js_queue_funcs[] = {
     JS_CFUNC_MAGIC_DEF("next", 0, js_queue_method, QUEUE_NEXT),
     JS_CFUNC_MAGIC_DEF("chunk", 1, js_queue_method, QUEUE_CHUNK),
     JS_CFUNC_MAGIC_DEF("at", 1, js_queue_method, QUEUE_AT),
+#ifndef _WIN32
+    JS_CFUNC_MAGIC_DEF("readv", 1, js_queue_method, QUEUE_READV),
+    JS_CFUNC_MAGIC_DEF("writev", 1, js_queue_method, QUEUE_WRITEV),
+#endif
     JS_CGETSET_MAGIC_DEF("size", js_queue_get, 0, QUEUE_SIZE),
     JS_CGETSET_MAGIC_DEF("empty", js_queue_get, 0, QUEUE_EMPTY),
     JS_CGETSET_MAGIC_DEF("head", js_queue_get, 0, QUEUE_HEAD),
     JS_CGETSET_MAGIC_DEF("tail", js_queue_get, 0, QUEUE_TAIL),
     JS_CGETSET_MAGIC_DEF("chunks", js_queue_get, 0, QUEUE_CHUNKS),
+    JS_CGETSET_MAGIC_DEF("ring", js_queue_get, 0, QUEUE_RING),
+    JS_CGETSET_MAGIC_DEF("capacity", js_queue_get, 0, QUEUE_CAPACITY),
+    JS_CGETSET_MAGIC_DEF("mirrored", js_queue_get, 0, QUEUE_MIRRORED),
     JS_CFUNC_DEF("[Symbol.iterator]", 0, js_queue_iterator),
     JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Queue", JS_PROP_CONFIGURABLE),
 };
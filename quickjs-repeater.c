@@ -30,13 +30,28 @@ typedef struct {
   BOOL stop;
 } RepeaterItem;
 
+/* Values pushed in batched mode. 'head' and 'tail' are free-running,
+ * 'size' is a power of two. */
+typedef struct {
+  JSValue* values;
+  uint32_t size, head, tail;
+} RepeaterRing;
+
+#define REPEATER_FREE_ITEMS 32
+
 typedef struct {
   int ref_count;
-  JSValue executor, buffer, err;
+  JSValue executor, buffer, err, result;
   enum repeater_state state;
   struct list_head pushes, nexts;
   JSValue pending, execution;
   JSValue onnext, onstop;
+  struct list_head free_items;
+  uint32_t num_free;
+  RepeaterRing ring;
+  uint32_t batch, capacity;
+  BOOL flush_queued;
+  JSValue drain, drain_resolve;
 } Repeater;
 
 Repeater*
@@ -48,19 +63,81 @@ repeater_new(JSContext* ctx, JSValueConst executor) {
     rpt->executor = JS_DupValue(ctx, executor);
     rpt->buffer = JS_UNDEFINED;
     rpt->err = JS_UNDEFINED;
+    rpt->result = JS_UNDEFINED;
     rpt->state = REPEATER_INITIAL;
     rpt->pending = JS_UNDEFINED;
     rpt->execution = JS_UNDEFINED;
     rpt->onnext = JS_UNDEFINED;
     rpt->onstop = JS_UNDEFINED;
+    rpt->drain = JS_UNDEFINED;
+    rpt->drain_resolve = JS_UNDEFINED;
 
     init_list_head(&rpt->pushes);
     init_list_head(&rpt->nexts);
+    init_list_head(&rpt->free_items);
   }
 
   return rpt;
 }
 
+static inline uint32_t
+repeater_buffered(Repeater* rpt) {
+  return rpt->ring.tail - rpt->ring.head;
+}
+
+static BOOL
+repeater_ring_put(Repeater* rpt, JSContext* ctx, JSValueConst value) {
+  RepeaterRing* r = &rpt->ring;
+
+  if(r->tail - r->head == r->size) {
+    uint32_t i, n = r->tail - r->head, size = r->size ? r->size * 2 : 64;
+    JSValue* values;
+
+    if(!(values = js_malloc(ctx, sizeof(JSValue) * size)))
+      return FALSE;
+
+    for(i = 0; i < n; i++)
+      values[i] = r->values[(r->head + i) & (r->size - 1)];
+
+    js_free(ctx, r->values);
+    r->values = values;
+    r->size = size;
+    r->head = 0;
+    r->tail = n;
+  }
+
+  r->values[r->tail++ & (r->size - 1)] = JS_DupValue(ctx, value);
+  return TRUE;
+}
+
+/* moves up to 'batch' buffered values into a new array */
+static JSValue
+repeater_ring_take(Repeater* rpt, JSContext* ctx) {
+  RepeaterRing* r = &rpt->ring;
+  uint32_t i, n = repeater_buffered(rpt);
+  JSValue ret;
+
+  if(rpt->batch && n > rpt->batch)
+    n = rpt->batch;
+
+  ret = JS_NewArray(ctx);
+
+  for(i = 0; i < n; i++)
+    JS_SetPropertyUint32(ctx, ret, i, r->values[r->head++ & (r->size - 1)]);
+
+  if(!JS_IsUndefined(rpt->drain) && repeater_buffered(rpt) < rpt->capacity) {
+    JSValue result = JS_Call(ctx, rpt->drain_resolve, JS_UNDEFINED, 0, 0);
+
+    JS_FreeValue(ctx, result);
+    JS_FreeValue(ctx, rpt->drain);
+    JS_FreeValue(ctx, rpt->drain_resolve);
+    rpt->drain = JS_UNDEFINED;
+    rpt->drain_resolve = JS_UNDEFINED;
+  }
+
+  return ret;
+}
+
 static void
 repeater_decrement_refcount(void* opaque) {
   Repeater* rpt = opaque;
@@ -101,9 +178,26 @@ repeater_consume(Repeater* rpt, JSContext* ctx) {
 static void
 repeater_free(JSRuntime* rt, Repeater* rpt) {
   if(--rpt->ref_count == 0) {
+    struct list_head *el, *next;
+
     JS_FreeValueRT(rt, rpt->executor);
     JS_FreeValueRT(rt, rpt->buffer);
     JS_FreeValueRT(rt, rpt->err);
+    JS_FreeValueRT(rt, rpt->result);
+    JS_FreeValueRT(rt, rpt->drain);
+    JS_FreeValueRT(rt, rpt->drain_resolve);
+
+    while(rpt->ring.head != rpt->ring.tail)
+      JS_FreeValueRT(rt, rpt->ring.values[rpt->ring.head++ & (rpt->ring.size - 1)]);
+
+    if(rpt->ring.values)
+      js_free_rt(rt, rpt->ring.values);
+
+    list_for_each_safe(el, next, &rpt->free_items) {
+      RepeaterItem* item = list_entry(el, RepeaterItem, link);
+
+      js_free_rt(rt, item);
+    }
 
     js_free_rt(rt, rpt);
   }
@@ -183,22 +277,36 @@ resolvable_free(JSContext* ctx, Resolvable* rsva) {
   JS_FreeValue(ctx, rsva->resolve);
 }
 
+/* list nodes are recycled through a small per-repeater free-list */
 static RepeaterItem*
-item_new(JSContext* ctx) {
+item_new(JSContext* ctx, Repeater* rpt) {
   RepeaterItem* item;
 
-  if((item = js_mallocz(ctx, sizeof(RepeaterItem)))) {
-    item->resolvable.resolve = JS_UNDEFINED;
-    item->resolvable.value = JS_UNDEFINED;
+  if(!list_empty(&rpt->free_items)) {
+    item = list_entry(rpt->free_items.next, RepeaterItem, link);
+    list_del(&item->link);
+    --rpt->num_free;
+    memset(item, 0, sizeof(RepeaterItem));
+  } else if(!(item = js_mallocz(ctx, sizeof(RepeaterItem)))) {
+    return 0;
   }
 
+  item->resolvable.resolve = JS_UNDEFINED;
+  item->resolvable.value = JS_UNDEFINED;
+
   return item;
 }
 
 static void
-item_free(RepeaterItem* item, JSContext* ctx) {
+item_free(RepeaterItem* item, JSContext* ctx, Repeater* rpt) {
   resolvable_free(ctx, &item->resolvable);
-  js_free(ctx, item);
+
+  if(rpt->num_free < REPEATER_FREE_ITEMS) {
+    list_add(&item->link, &rpt->free_items);
+    ++rpt->num_free;
+  } else {
+    js_free(ctx, item);
+  }
 }
 
 static RepeaterItem*
@@ -277,6 +385,75 @@ js_repeater_create_iteration(JSContext* ctx, JSValueConst this_val, JSValueConst
   return ret;
 }
 
+/* hands buffered values to waiting next() calls, one array per call */
+static void
+repeater_flush(Repeater* rpt, JSContext* ctx) {
+  RepeaterItem* item;
+
+  while(!list_empty(&rpt->nexts)) {
+    JSValue result;
+
+    if(repeater_buffered(rpt) > 0) {
+      JSValue values = repeater_ring_take(rpt, ctx);
+
+      result = js_iterator_result(ctx, values, FALSE);
+      JS_FreeValue(ctx, values);
+    } else if(rpt->state >= REPEATER_STOPPED) {
+      result = js_iterator_result(ctx, rpt->result, TRUE);
+      rpt->state = REPEATER_DONE;
+    } else {
+      break;
+    }
+
+    item = list_shift(&rpt->nexts);
+    resolvable_call(ctx, &item->resolvable, result);
+    JS_FreeValue(ctx, result);
+    item_free(item, ctx, rpt);
+  }
+}
+
+static JSValue
+js_repeater_flush(JSContext* ctx, int argc, JSValueConst argv[]) {
+  Repeater* rpt;
+
+  if((rpt = JS_GetOpaque(argv[0], js_repeater_class_id))) {
+    rpt->flush_queued = FALSE;
+    repeater_flush(rpt, ctx);
+  }
+
+  return JS_UNDEFINED;
+}
+
+/* batched mode: the value goes into the ring. a waiting next() is resolved
+ * from a job, so that synchronous pushes until then end up in one batch.
+ * only above 'capacity' buffered values a promise is returned. */
+static JSValue
+repeater_push_batched(Repeater* rpt, JSContext* ctx, JSValueConst this_val, JSValueConst value) {
+  JSValue resolving_funcs[2];
+
+  if(rpt->state >= REPEATER_STOPPED)
+    return JS_UNDEFINED;
+
+  if(!repeater_ring_put(rpt, ctx, value))
+    return JS_EXCEPTION;
+
+  if(!list_empty(&rpt->nexts) && !rpt->flush_queued) {
+    rpt->flush_queued = TRUE;
+    JS_EnqueueJob(ctx, js_repeater_flush, 1, &this_val);
+  }
+
+  if(repeater_buffered(rpt) < rpt->capacity)
+    return JS_UNDEFINED;
+
+  if(JS_IsUndefined(rpt->drain)) {
+    rpt->drain = JS_NewPromiseCapability(ctx, resolving_funcs);
+    rpt->drain_resolve = resolving_funcs[0];
+    JS_FreeValue(ctx, resolving_funcs[1]);
+  }
+
+  return JS_DupValue(ctx, rpt->drain);
+}
+
 static JSValue
 js_repeater_push(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
   Repeater* rpt;
@@ -287,14 +464,17 @@ js_repeater_push(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst a
   if(!(rpt = JS_GetOpaque2(ctx, this_val, js_repeater_class_id)))
     return JS_EXCEPTION;
 
+  if(rpt->batch)
+    return repeater_push_batched(rpt, ctx, this_val, value);
+
   if((item = list_shift(&rpt->nexts))) {
     JSValue result = js_is_promise(ctx, value) ? JS_DupValue(ctx, value) : js_iterator_result(ctx, value, FALSE);
 
     ret = resolvable_resolve(ctx, &item->resolvable, result, TRUE);
     JS_FreeValue(ctx, result);
-    item_free(item, ctx);
+    item_free(item, ctx, rpt);
   } else if(rpt->state < REPEATER_STOPPED) {
-    if(!(item = item_new(ctx)))
+    if(!(item = item_new(ctx, rpt)))
       return JS_EXCEPTION;
 
     ret = resolvable_value(ctx, value, &item->resolvable);
@@ -326,10 +506,18 @@ js_repeater_stop(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst a
   if(js_is_null_or_undefined(rpt->err))
     rpt->err = argc >= 1 ? JS_DupValue(ctx, argv[0]) : JS_NewBool(ctx, TRUE);
 
+  /* buffered values are still delivered, waiting next() calls get them
+   * first and the rest the value passed to stop() */
+  if(rpt->batch) {
+    rpt->result = argc >= 1 ? JS_DupValue(ctx, argv[0]) : JS_UNDEFINED;
+    repeater_flush(rpt, ctx);
+    return JS_UNDEFINED;
+  }
+
   if(list_empty(&rpt->nexts)) {
     RepeaterItem* item;
 
-    if(!(item = item_new(ctx)))
+    if(!(item = item_new(ctx, rpt)))
       return JS_EXCEPTION;
 
     item->stop = TRUE;
@@ -347,7 +535,7 @@ js_repeater_stop(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst a
       JS_FreeValue(ctx, result);
 
       list_del(&item->link);
-      item_free(item, ctx);
+      item_free(item, ctx, rpt);
     }
 
     rpt->state = REPEATER_DONE;
@@ -367,6 +555,35 @@ js_repeater_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSVal
   if(!(rpt = repeater_new(ctx, argv[0])))
     goto fail;
 
+  if(argc > 1 && JS_IsObject(argv[1])) {
+    JSValue batch = JS_GetPropertyStr(ctx, argv[1], "batch");
+
+    if(JS_IsBool(batch))
+      rpt->batch = JS_ToBool(ctx, batch) ? UINT32_MAX : 0;
+    else if(!JS_IsUndefined(batch))
+      JS_ToUint32(ctx, &rpt->batch, batch);
+
+    JS_FreeValue(ctx, batch);
+
+    if(rpt->batch) {
+      JSValue capacity = JS_GetPropertyStr(ctx, argv[1], "capacity");
+      double d = 1024;
+
+      if(!JS_IsUndefined(capacity))
+        JS_ToFloat64(ctx, &d, capacity);
+
+      JS_FreeValue(ctx, capacity);
+
+      /* below 1, push() would wait for a drain that never comes */
+      if(!(d >= 1 && d <= UINT32_MAX)) {
+        JS_ThrowRangeError(ctx, "capacity must be between 1 and %" PRIu32, UINT32_MAX);
+        goto fail;
+      }
+
+      rpt->capacity = d;
+    }
+  }
+
   /* using new_target to get the prototype is necessary when the class is extended. */
   proto = JS_GetPropertyStr(ctx, new_target, "prototype");
   if(JS_IsException(proto))
@@ -407,7 +624,22 @@ js_repeater_next(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst a
   // printf("js_repeater_next done=%d pushes=%d nexts=%d\n", done, list_length(&rpt->pushes),
   // list_length(&rpt->nexts));
 
-  if((item = list_shift(&rpt->pushes))) {
+  if(rpt->batch && repeater_buffered(rpt) > 0 && list_empty(&rpt->nexts)) {
+    JSValue values = repeater_ring_take(rpt, ctx), result = js_iterator_result(ctx, values, FALSE);
+
+    ret = js_promise_resolve(ctx, result);
+    JS_FreeValue(ctx, result);
+    JS_FreeValue(ctx, values);
+  } else if(rpt->batch && rpt->state >= REPEATER_STOPPED && list_empty(&rpt->nexts)) {
+    JSValue it;
+
+    if(rpt->state < REPEATER_DONE)
+      rpt->state = REPEATER_DONE;
+
+    it = repeater_consume(rpt, ctx);
+    ret = js_repeater_create_iteration(ctx, this_val, it);
+    JS_FreeValue(ctx, it);
+  } else if(!rpt->batch && (item = list_shift(&rpt->pushes))) {
     JSValue it = resolvable_resolve(ctx, &item->resolvable, value, FALSE);
 
     if(item->stop)
@@ -416,14 +648,14 @@ js_repeater_next(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst a
     ret = js_repeater_create_iteration(ctx, this_val, it);
     JS_FreeValue(ctx, it);
 
-    item_free(item, ctx);
+    item_free(item, ctx, rpt);
   } else if(rpt->state >= REPEATER_STOPPED) {
     JSValue it = repeater_consume(rpt, ctx);
 
     ret = js_repeater_create_iteration(ctx, this_val, it);
     JS_FreeValue(ctx, it);
   } else {
-    if(!(item = item_new(ctx)))
+    if(!(item = item_new(ctx, rpt)))
       return JS_EXCEPTION;
 
     ret = resolvable_value(ctx, value, &item->resolvable);
@@ -440,7 +672,7 @@ js_repeater_iterator(JSContext* ctx, JSValueConst this_val, int argc, JSValueCon
   return JS_DupValue(ctx, this_val);
 }
 
-enum { PROP_STATE };
+enum { PROP_STATE, PROP_BATCH, PROP_BUFFERED };
 
 static JSValue
 js_repeater_get(JSContext* ctx, JSValueConst this_val, int magic) {
@@ -455,6 +687,16 @@ js_repeater_get(JSContext* ctx, JSValueConst this_val, int magic) {
       ret = JS_NewInt32(ctx, rpt->state);
       break;
     }
+
+    case PROP_BATCH: {
+      ret = rpt->batch ? JS_NewUint32(ctx, rpt->batch) : JS_FALSE;
+      break;
+    }
+
+    case PROP_BUFFERED: {
+      ret = JS_NewUint32(ctx, rpt->batch ? repeater_buffered(rpt) : list_size(&rpt->pushes));
+      break;
+    }
   }
 
   return ret;
@@ -476,6 +718,8 @@ static JSClassDef js_repeater_class = {
 static const JSCFunctionListEntry js_repeater_proto_funcs[] = {
     JS_CFUNC_DEF("next", 0, js_repeater_next),
     JS_CGETSET_MAGIC_DEF("state", js_repeater_get, 0, PROP_STATE),
+    JS_CGETSET_MAGIC_DEF("batch", js_repeater_get, 0, PROP_BATCH),
+    JS_CGETSET_MAGIC_DEF("buffered", js_repeater_get, 0, PROP_BUFFERED),
     JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Repeater", JS_PROP_CONFIGURABLE),
     JS_CFUNC_DEF("[Symbol.asyncIterator]", 0, js_repeater_iterator),
 };
@@ -6,19 +6,26 @@
 #include "js-utils.h"
 #include "iteration.h"
 #include "property-enumeration.h"
+#include "column-builder.h"
+#include "thread-pool.h"
 
 /**
  * \addtogroup quickjs-sqlite
  * @{
  */
 
-VISIBLE JSClassID js_sqliteerror_class_id = 0, js_sqlite_class_id = 0, js_sqliteresult_class_id = 0;
-static JSValue sqliteerror_proto, sqliteerror_ctor, sqlite_proto, sqlite_ctor, sqliteresult_proto, sqliteresult_ctor;
+VISIBLE JSClassID js_sqliteerror_class_id = 0, js_sqlite_class_id = 0, js_sqliteresult_class_id = 0, js_sqlitestatement_class_id = 0;
+static JSValue sqliteerror_proto, sqliteerror_ctor, sqlite_proto, sqlite_ctor, sqliteresult_proto, sqliteresult_ctor, sqlitestatement_proto, sqlitestatement_ctor,
+    statementiterator_proto;
 
 static JSValue js_sqliteerror_new(JSContext* ctx, const char* msg);
 
+/* number of prepared statements kept per connection by default */
+#define SQLITE_CACHE_SIZE 64
+
 struct SQLiteConnection;
 struct SQLiteResult;
+struct SQLiteStatement;
 
 struct SQLiteResult {
   int ref_count;
@@ -27,6 +34,28 @@ struct SQLiteResult {
   uint32_t row_index;
   BOOL done;
   BOOL has_columns;
+  struct SQLiteStatement* owner;
+};
+
+/* A prepared statement, possibly shared with the connection's cache, which
+ * holds one reference. 'conn' is not referenced: whoever uses the statement
+ * holds the connection instead, the cache is owned by it. */
+struct SQLiteStatement {
+  int ref_count;
+  sqlite3_stmt* stmt;
+  struct SQLiteConnection* conn;
+  struct list_head link;
+  char* sql;
+  size_t sql_len;
+  uint32_t hash;
+  BOOL cached, iterating;
+  uint32_t pending;
+};
+
+struct SQLiteStatementIterator {
+  struct SQLiteStatement* stmt;
+  int rtype;
+  BOOL done;
 };
 
 struct SQLiteResultIterator {
@@ -34,15 +63,25 @@ struct SQLiteResultIterator {
   struct SQLiteResult* result;
 };
 
+/* 'statements' is the LRU list of cached statements, most recent first.
+ * In async mode 'lane' is the worker thread all queries run on and
+ * 'pending' counts the queries which haven't completed yet. */
 struct SQLiteConnection {
   int ref_count;
   sqlite3* db;
   struct SQLiteResult* result;
+  struct list_head statements;
+  uint32_t num_cached, cache_size;
+  BOOL async, closing;
+  int lane;
+  uint32_t pending;
 };
 
 typedef struct SQLiteConnection SQLiteConnection;
 typedef struct SQLiteResult SQLiteResult;
 typedef struct SQLiteResultIterator SQLiteResultIterator;
+typedef struct SQLiteStatement SQLiteStatement;
+typedef struct SQLiteStatementIterator SQLiteStatementIterator;
 
 typedef JSValue RowValueFunc(JSContext*, SQLiteResult*, int);
 
@@ -55,9 +94,36 @@ static SQLiteResult* sqliteresult_dup(SQLiteResult*);
 static void sqliteresult_free(JSRuntime*, void*, void*);
 static void sqliteresult_set_conn(SQLiteResult*, SQLiteConnection*, JSContext*);
 static JSValue js_sqliteresult_new(JSContext*, JSValueConst, sqlite3_stmt*);
+static BOOL sqlite_check_idle(JSContext*, SQLiteConnection*);
+static JSValue js_sqlitestatement_wrap(JSContext*, JSValueConst, SQLiteStatement*);
 
 typedef void SQLitePrintFunction(JSContext*, SQLiteConnection*, DynBuf*, JSValueConst);
 
+/* Date -> 'YYYY-MM-DD HH:MM:SS.sss' */
+static char*
+js_sqlite_date_string(JSContext* ctx, JSValueConst value, size_t* lenp) {
+  size_t len;
+  char* str;
+  JSValue val = js_invoke(ctx, value, "toISOString", 0, 0);
+
+  str = js_tostringlen(ctx, &len, val);
+  JS_FreeValue(ctx, val);
+
+  if(!str)
+    return 0;
+
+  if(len >= 24)
+    if(str[23] == 'Z')
+      len = 23;
+
+  if(len >= 19)
+    if(str[10] == 'T')
+      str[10] = ' ';
+
+  *lenp = len;
+  return str;
+}
+
 static void
 js_sqlite_print_value(JSContext* ctx, SQLiteConnection* db, DynBuf* out, JSValueConst value) {
 
@@ -79,25 +145,14 @@ js_sqlite_print_value(JSContext* ctx, SQLiteConnection* db, DynBuf* out, JSValue
   } else if(js_is_date(ctx, value)) {
     size_t len;
     char* str;
-    JSValue val;
 
-    val = js_invoke(ctx, value, "toISOString", 0, 0);
-    str = js_tostringlen(ctx, &len, val);
-
-    if(len >= 24)
-      if(str[23] == 'Z')
-        len = 23;
-
-    if(len >= 19)
-      if(str[10] == 'T')
-        str[10] = ' ';
-
-    dbuf_putc(out, '\'');
-    dbuf_put(out, (const uint8_t*)str, len);
-    dbuf_putc(out, '\'');
+    if((str = js_sqlite_date_string(ctx, value, &len))) {
+      dbuf_putc(out, '\'');
+      dbuf_put(out, (const uint8_t*)str, len);
+      dbuf_putc(out, '\'');
 
-    js_free(ctx, str);
-    JS_FreeValue(ctx, val);
+      js_free(ctx, str);
+    }
   } else if(js_is_numeric(ctx, value)) {
     JSValue val = JS_IsNumber(value) ? JS_DupValue(ctx, value) : js_value_coerce(ctx, "Number", value);
     size_t len;
@@ -172,6 +227,123 @@ js_sqlite_print_values(JSContext* ctx, SQLiteConnection* db, DynBuf* out, JSValu
   js_sqlite_print_iterable(ctx, db, out, values, js_sqlite_print_value);
 }
 
+/* binds 'value' to parameter 'idx', returns the sqlite3_bind_*() result.
+ * 'blob_free' may be SQLITE_STATIC when 'value' outlives the next step */
+static int
+js_sqlite_bind_value(JSContext* ctx, sqlite3_stmt* stmt, int idx, JSValueConst value, sqlite3_destructor_type blob_free) {
+  int rc;
+
+  if(JS_IsNull(value) || JS_IsUndefined(value)) {
+    rc = sqlite3_bind_null(stmt, idx);
+  } else if(JS_IsBool(value)) {
+    rc = sqlite3_bind_int(stmt, idx, JS_ToBool(ctx, value));
+  } else if(JS_VALUE_GET_TAG(value) == JS_TAG_INT) {
+    rc = sqlite3_bind_int(stmt, idx, JS_VALUE_GET_INT(value));
+  } else if(JS_IsNumber(value)) {
+    double d;
+
+    JS_ToFloat64(ctx, &d, value);
+
+    /* integral doubles go in as INTEGER, so column affinity doesn't matter */
+    if(d >= -9007199254740991.0 && d <= 9007199254740991.0 && d == (double)(int64_t)d)
+      rc = sqlite3_bind_int64(stmt, idx, (int64_t)d);
+    else
+      rc = sqlite3_bind_double(stmt, idx, d);
+  } else if(JS_IsBigInt(ctx, value)) {
+    int64_t i = 0;
+
+    JS_ToBigInt64(ctx, &i, value);
+    rc = sqlite3_bind_int64(stmt, idx, i);
+  } else if(JS_IsString(value)) {
+    size_t len;
+    const char* str = JS_ToCStringLen(ctx, &len, value);
+
+    rc = sqlite3_bind_text64(stmt, idx, str, len, SQLITE_TRANSIENT, SQLITE_UTF8);
+    JS_FreeCString(ctx, str);
+  } else if(js_is_arraybuffer(ctx, value) || js_is_typedarray(ctx, value)) {
+    InputBuffer input = js_input_buffer(ctx, value);
+
+    rc = sqlite3_bind_blob64(stmt, idx, inputbuffer_data(&input), inputbuffer_length(&input), blob_free);
+    inputbuffer_free(&input, ctx);
+  } else if(js_is_date(ctx, value)) {
+    size_t len;
+    char* str;
+
+    if((str = js_sqlite_date_string(ctx, value, &len))) {
+      rc = sqlite3_bind_text64(stmt, idx, str, len, SQLITE_TRANSIENT, SQLITE_UTF8);
+      js_free(ctx, str);
+    } else {
+      rc = sqlite3_bind_null(stmt, idx);
+    }
+  } else {
+    JSValue str = JS_JSONStringify(ctx, value, JS_NULL, JS_NULL);
+
+    rc = js_sqlite_bind_value(ctx, stmt, idx, str, SQLITE_TRANSIENT);
+    JS_FreeValue(ctx, str);
+  }
+
+  return rc;
+}
+
+static BOOL
+js_sqlite_is_record(JSContext* ctx, JSValueConst value) {
+  return JS_IsObject(value) && !JS_IsArray(ctx, value) && !js_is_arraybuffer(ctx, value) && !js_is_typedarray(ctx, value) && !js_is_date(ctx, value);
+}
+
+/* Binds the parameters of 'stmt' from 'argv': a single array binds by
+ * position, a single plain object by name (':name', '@name' or '$name'
+ * look up 'name'), anything else binds the arguments in order.
+ * returns -1 with an exception pending on error. */
+static int
+js_sqlite_bind(JSContext* ctx, sqlite3_stmt* stmt, int argc, JSValueConst argv[]) {
+  int i, rc = SQLITE_OK, count = sqlite3_bind_parameter_count(stmt);
+
+  sqlite3_reset(stmt);
+
+  if(argc == 1 && JS_IsArray(ctx, argv[0])) {
+    int64_t n = js_array_length(ctx, argv[0]);
+
+    if(n > count) {
+      JS_ThrowRangeError(ctx, "too many parameters (%" PRId64 ", statement takes %d)", n, count);
+      return -1;
+    }
+
+    for(i = 0; i < n && rc == SQLITE_OK; i++) {
+      JSValue value = JS_GetPropertyUint32(ctx, argv[0], i);
+
+      rc = js_sqlite_bind_value(ctx, stmt, i + 1, value, SQLITE_TRANSIENT);
+      JS_FreeValue(ctx, value);
+    }
+  } else if(argc == 1 && js_sqlite_is_record(ctx, argv[0])) {
+    for(i = 1; i <= count && rc == SQLITE_OK; i++) {
+      const char* name = sqlite3_bind_parameter_name(stmt, i);
+      JSValue value;
+
+      if(!name || !name[1])
+        continue;
+
+      value = JS_GetPropertyStr(ctx, argv[0], name + 1);
+      rc = js_sqlite_bind_value(ctx, stmt, i, value, SQLITE_TRANSIENT);
+      JS_FreeValue(ctx, value);
+    }
+  } else {
+    if(argc > count) {
+      JS_ThrowRangeError(ctx, "too many parameters (%d, statement takes %d)", argc, count);
+      return -1;
+    }
+
+    for(i = 0; i < argc && rc == SQLITE_OK; i++)
+      rc = js_sqlite_bind_value(ctx, stmt, i + 1, argv[i], SQLITE_TRANSIENT);
+  }
+
+  if(rc != SQLITE_OK) {
+    JS_Throw(ctx, js_sqliteerror_new(ctx, sqlite3_errstr(rc)));
+    return -1;
+  }
+
+  return 0;
+}
+
 static SQLiteConnection*
 sqlite_new(JSContext* ctx) {
   SQLiteConnection* db;
@@ -181,9 +353,150 @@ sqlite_new(JSContext* ctx) {
 
   *db = (SQLiteConnection){1, NULL, NULL};
 
+  init_list_head(&db->statements);
+  db->num_cached = 0;
+  db->cache_size = SQLITE_CACHE_SIZE;
+  db->async = FALSE;
+  db->closing = FALSE;
+  db->lane = -1;
+  db->pending = 0;
+
   return db;
 }
 
+static uint32_t
+sqlite_hash(const char* sql, size_t len) {
+  uint32_t h = 2166136261u;
+
+  while(len--) {
+    h ^= (uint8_t)*sql++;
+    h *= 16777619u;
+  }
+
+  return h;
+}
+
+static SQLiteStatement*
+sqlitestmt_dup(SQLiteStatement* st) {
+  ++st->ref_count;
+  return st;
+}
+
+static void
+sqlitestmt_free(SQLiteStatement* st, JSRuntime* rt) {
+  if(--st->ref_count == 0) {
+    sqlite3_finalize(st->stmt);
+    js_free_rt(rt, st->sql);
+    js_free_rt(rt, st);
+  } else if(st->ref_count == 1 && st->cached) {
+    /* only the cache is left, ready for the next prepare() */
+    sqlite3_reset(st->stmt);
+    sqlite3_clear_bindings(st->stmt);
+  }
+}
+
+/* drops the least recently used statements beyond 'max' */
+static void
+sqlite_cache_trim(SQLiteConnection* db, uint32_t max, JSRuntime* rt) {
+  while(db->num_cached > max) {
+    SQLiteStatement* st = list_entry(db->statements.prev, SQLiteStatement, link);
+
+    list_del(&st->link);
+    st->cached = FALSE;
+    --db->num_cached;
+
+    sqlitestmt_free(st, rt);
+  }
+}
+
+/* takes over 'stmt', which is finalized on error */
+static SQLiteStatement*
+sqlitestmt_new(SQLiteConnection* db, sqlite3_stmt* stmt, const char* sql, size_t len, uint32_t hash, JSContext* ctx) {
+  SQLiteStatement* st;
+
+  if(!(st = js_mallocz(ctx, sizeof(SQLiteStatement))) || !(st->sql = js_strndup(ctx, sql, len))) {
+    if(st)
+      js_free(ctx, st);
+
+    sqlite3_finalize(stmt);
+    return 0;
+  }
+
+  st->ref_count = 1;
+  st->stmt = stmt;
+  st->conn = db;
+  st->sql_len = len;
+  st->hash = hash;
+  return st;
+}
+
+static SQLiteStatement*
+sqlite_cache_find(SQLiteConnection* db, const char* sql, size_t len, uint32_t hash) {
+  struct list_head* el;
+
+  list_for_each(el, &db->statements) {
+    SQLiteStatement* st = list_entry(el, SQLiteStatement, link);
+
+    if(st->hash == hash && st->sql_len == len && !memcmp(st->sql, sql, len))
+      return st;
+  }
+
+  return 0;
+}
+
+/* hands out a cached statement, which becomes the most recently used */
+static SQLiteStatement*
+sqlite_cache_use(SQLiteConnection* db, SQLiteStatement* st) {
+  list_del(&st->link);
+  list_add(&st->link, &db->statements);
+
+  return sqlitestmt_dup(st);
+}
+
+static void
+sqlite_cache_add(SQLiteConnection* db, SQLiteStatement* st, JSRuntime* rt) {
+  list_add(&sqlitestmt_dup(st)->link, &db->statements);
+  st->cached = TRUE;
+  ++db->num_cached;
+
+  sqlite_cache_trim(db, db->cache_size, rt);
+}
+
+/* Looks up 'sql' in the statement cache, preparing it on a miss. A cached
+ * statement is only handed out while nobody else is using it.
+ * returns -1 with an exception pending on error. *pst is NULL for empty sql */
+static int
+sqlite_prepare(SQLiteConnection* db, const char* sql, size_t len, SQLiteStatement** pst, JSContext* ctx) {
+  uint32_t hash = sqlite_hash(sql, len);
+  sqlite3_stmt* stmt = 0;
+  SQLiteStatement* st;
+  BOOL busy = FALSE;
+
+  *pst = 0;
+
+  if((st = sqlite_cache_find(db, sql, len, hash)) && !(busy = st->ref_count > 1)) {
+    *pst = sqlite_cache_use(db, st);
+    return 0;
+  }
+
+  if(sqlite3_prepare_v3(db->db, sql, (int)len, db->cache_size ? SQLITE_PREPARE_PERSISTENT : 0, &stmt, NULL) != SQLITE_OK) {
+    JS_Throw(ctx, js_sqliteerror_new(ctx, sqlite3_errmsg(db->db)));
+    return -1;
+  }
+
+  if(!stmt)
+    return 0;
+
+  if(!(st = sqlitestmt_new(db, stmt, sql, len, hash, ctx)))
+    return -1;
+
+  if(!busy && db->cache_size > 0)
+    sqlite_cache_add(db, st, JS_GetRuntime(ctx));
+
+  *pst = st;
+  return 0;
+}
+
 static SQLiteConnection*
 sqlite_dup(SQLiteConnection* db) {
   ++db->ref_count;
@@ -193,6 +506,8 @@ sqlite_dup(SQLiteConnection* db) {
 static void
 sqlite_free(SQLiteConnection* db, JSRuntime* rt) {
   if(--db->ref_count == 0) {
+    sqlite_cache_trim(db, 0, rt);
+
     if(db->result) {
       sqliteresult_free(rt, db->result, 0);
       db->result = 0;
@@ -292,6 +607,10 @@ enum {
   PROP_EOF,
   PROP_NUM_ROWS,
   PROP_NUM_FIELDS,
+  PROP_CACHE_SIZE,
+  PROP_CACHED,
+  PROP_ASYNC,
+  PROP_PENDING,
 };
 
 static JSValue
@@ -338,11 +657,65 @@ js_sqlite_get(JSContext* ctx, JSValueConst this_val, int magic) {
       ret = file && *file ? JS_NewString(ctx, file) : JS_NULL;
       break;
     }
+
+    case PROP_CACHE_SIZE: {
+      ret = JS_NewUint32(ctx, db->cache_size);
+      break;
+    }
+
+    case PROP_CACHED: {
+      ret = JS_NewUint32(ctx, db->num_cached);
+      break;
+    }
+
+    case PROP_ASYNC: {
+      ret = JS_NewBool(ctx, db->async);
+      break;
+    }
+
+    case PROP_PENDING: {
+      ret = JS_NewUint32(ctx, db->pending);
+      break;
+    }
   }
 
   return ret;
 }
 
+static JSValue
+js_sqlite_set(JSContext* ctx, JSValueConst this_val, JSValueConst value, int magic) {
+  SQLiteConnection* db;
+
+  if(!(db = js_sqlite_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case PROP_CACHE_SIZE: {
+      uint32_t size;
+
+      if(JS_ToUint32(ctx, &size, value))
+        return JS_EXCEPTION;
+
+      if(!sqlite_check_idle(ctx, db))
+        return JS_EXCEPTION;
+
+      db->cache_size = size;
+      sqlite_cache_trim(db, size, JS_GetRuntime(ctx));
+      break;
+    }
+
+    case PROP_ASYNC: {
+      if(!sqlite_check_idle(ctx, db))
+        return JS_EXCEPTION;
+
+      db->async = JS_ToBool(ctx, value);
+      break;
+    }
+  }
+
+  return JS_UNDEFINED;
+}
+
 static JSValue
 js_sqlite_value_string(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
   JSValue ret;
@@ -542,6 +915,9 @@ js_sqlite_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValue
             flags &= ~SQLITE_OPEN_CREATE;
         }
 
+        if(js_has_propertystr(ctx, argv[1], "async"))
+          db->async = js_get_propertystr_bool(ctx, argv[1], "async");
+
         if(js_has_propertystr(ctx, argv[1], "readonly")) {
           flags &= ~(SQLITE_OPEN_READONLY | SQLITE_OPEN_READWRITE);
 
@@ -568,83 +944,1111 @@ js_sqlite_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValue
 
   return obj;
 
-fail:
-  JS_FreeValue(ctx, obj);
-  return JS_EXCEPTION;
-}
+fail:
+  JS_FreeValue(ctx, obj);
+  return JS_EXCEPTION;
+}
+
+static JSValue
+js_sqlite_open(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  SQLiteConnection* db;
+  const char* filename;
+  int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+  int ret;
+
+  if(!(db = js_sqlite_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(!sqlite_check_idle(ctx, db))
+    return JS_EXCEPTION;
+
+  sqlite_cache_trim(db, 0, JS_GetRuntime(ctx));
+
+  if(db->db) {
+    sqlite3_close_v2(db->db);
+    db->db = 0;
+  }
+
+  if(!(filename = JS_ToCString(ctx, argv[0])))
+    return JS_ThrowTypeError(ctx, "argument 1 must be a filename string");
+
+  if(argc > 1)
+    JS_ToInt32(ctx, &flags, argv[1]);
+
+  ret = sqlite3_open_v2(filename, &db->db, flags, NULL);
+  JS_FreeCString(ctx, filename);
+
+  if(ret != SQLITE_OK)
+    return JS_Throw(ctx, js_sqliteerror_new(ctx, sqlite_error(db)));
+
+  return JS_NewBool(ctx, TRUE);
+}
+
+/* ---- async mode ---- */
+
+/* A bound parameter, copied out of its JS value so a worker thread can
+ * bind it. 'name' is set when binding by name (without the prefix) */
+typedef struct {
+  char* name;
+  int type;
+  union {
+    int64_t i;
+    double d;
+    struct {
+      char* ptr;
+      size_t len;
+    } s;
+  } u;
+} SQLiteParam;
+
+enum {
+  ASYNC_QUERY,
+  ASYNC_EXEC,
+  ASYNC_CLOSE,
+  ASYNC_RUN,
+  ASYNC_GET,
+  ASYNC_ALL,
+  ASYNC_PREPARE,
+};
+
+/* A query handed to the worker thread of the connection. The worker only
+ * uses sqlite3 and libc, everything else is done on the JS thread: the
+ * parameters are copied before, the rows (duplicated sqlite3_values) are
+ * converted after. query() and prepare() take 'st' from the statement
+ * cache when they are submitted, on a miss the worker prepares 'stmt' and
+ * it is cached when the job is done. */
+typedef struct {
+  ThreadJob job;
+  int op, rtype;
+  SQLiteConnection* conn;
+  SQLiteStatement* st;
+  sqlite3_stmt* stmt;
+  char* sql;
+  size_t sql_len;
+  uint32_t hash;
+  BOOL persistent;
+  SQLiteParam* params;
+  int num_params;
+  BOOL bind, named;
+  char* error;
+  int num_columns;
+  char** names;
+  sqlite3_value** values;
+  size_t num_rows, capacity;
+  int64_t changes, last_insert_rowid;
+  ResolveFunctions funcs;
+  JSValue this_obj;
+} SQLiteJob;
+
+static int
+sqlite_param_set(JSContext* ctx, SQLiteParam* p, JSValueConst value) {
+  const char* str = 0;
+  size_t len = 0;
+
+  p->type = SQLITE_NULL;
+
+  if(JS_IsNull(value) || JS_IsUndefined(value)) {
+    return 0;
+  } else if(JS_IsBool(value)) {
+    p->type = SQLITE_INTEGER;
+    p->u.i = JS_ToBool(ctx, value);
+  } else if(JS_VALUE_GET_TAG(value) == JS_TAG_INT) {
+    p->type = SQLITE_INTEGER;
+    p->u.i = JS_VALUE_GET_INT(value);
+  } else if(JS_IsNumber(value)) {
+    JS_ToFloat64(ctx, &p->u.d, value);
+    p->type = SQLITE_FLOAT;
+
+    if(p->u.d >= -9007199254740991.0 && p->u.d <= 9007199254740991.0 && p->u.d == (double)(int64_t)p->u.d) {
+      p->type = SQLITE_INTEGER;
+      p->u.i = (int64_t)p->u.d;
+    }
+  } else if(JS_IsBigInt(ctx, value)) {
+    p->type = SQLITE_INTEGER;
+    JS_ToBigInt64(ctx, &p->u.i, value);
+  } else if(js_is_arraybuffer(ctx, value) || js_is_typedarray(ctx, value)) {
+    InputBuffer input = js_input_buffer(ctx, value);
+
+    p->type = SQLITE_BLOB;
+    p->u.s.len = inputbuffer_length(&input);
+
+    if((p->u.s.ptr = js_malloc(ctx, p->u.s.len ? p->u.s.len : 1)))
+      memcpy(p->u.s.ptr, inputbuffer_data(&input), p->u.s.len);
+
+    inputbuffer_free(&input, ctx);
+    return p->u.s.ptr ? 0 : -1;
+  } else if(js_is_date(ctx, value)) {
+    char* date;
+
+    if((date = js_sqlite_date_string(ctx, value, &len))) {
+      p->type = SQLITE_TEXT;
+      p->u.s.ptr = js_strndup(ctx, date, len);
+      p->u.s.len = len;
+      js_free(ctx, date);
+      return p->u.s.ptr ? 0 : -1;
+    }
+  } else {
+    JSValue json = JS_IsString(value) ? JS_DupValue(ctx, value) : JS_JSONStringify(ctx, value, JS_NULL, JS_NULL);
+
+    if((str = JS_ToCStringLen(ctx, &len, json))) {
+      p->type = SQLITE_TEXT;
+      p->u.s.ptr = js_strndup(ctx, str, len);
+      p->u.s.len = len;
+      JS_FreeCString(ctx, str);
+    }
+
+    JS_FreeValue(ctx, json);
+    return str && p->u.s.ptr ? 0 : -1;
+  }
+
+  return 0;
+}
+
+static void
+sqlite_params_free(JSRuntime* rt, SQLiteParam* params, int n) {
+  for(int i = 0; i < n; i++) {
+    if(params[i].name)
+      js_free_rt(rt, params[i].name);
+
+    if(params[i].type == SQLITE_TEXT || params[i].type == SQLITE_BLOB)
+      js_free_rt(rt, params[i].u.s.ptr);
+  }
+
+  js_free_rt(rt, params);
+}
+
+/* copies the parameters the way js_sqlite_bind() takes them */
+static int
+sqlite_params_capture(JSContext* ctx, SQLiteJob* job, int argc, JSValueConst argv[]) {
+  JSPropertyEnum* props = 0;
+  uint32_t nprops = 0;
+  int i, n = argc;
+  BOOL array = argc == 1 && JS_IsArray(ctx, argv[0]);
+
+  job->bind = TRUE;
+
+  if(array) {
+    n = js_array_length(ctx, argv[0]);
+  } else if(argc == 1 && js_sqlite_is_record(ctx, argv[0])) {
+    if(JS_GetOwnPropertyNames(ctx, &props, &nprops, argv[0], JS_GPN_STRING_MASK | JS_GPN_ENUM_ONLY))
+      return -1;
+
+    n = nprops;
+    job->named = TRUE;
+  }
+
+  if(!(job->params = js_mallocz(ctx, sizeof(SQLiteParam) * (n ? n : 1))))
+    goto fail;
+
+  job->num_params = n;
+
+  for(i = 0; i < n; i++) {
+    JSValue value;
+    int r;
+
+    if(job->named) {
+      if(!(job->params[i].name = js_atom_tostring(ctx, props[i].atom)))
+        goto fail;
+
+      value = JS_GetProperty(ctx, argv[0], props[i].atom);
+    } else {
+      value = array ? JS_GetPropertyUint32(ctx, argv[0], i) : JS_DupValue(ctx, argv[i]);
+    }
+
+    r = sqlite_param_set(ctx, &job->params[i], value);
+    JS_FreeValue(ctx, value);
+
+    if(r)
+      goto fail;
+  }
+
+  if(props)
+    js_propertyenums_free(ctx, props, nprops);
+
+  return 0;
+
+fail:
+  if(props)
+    js_propertyenums_free(ctx, props, nprops);
+
+  return -1;
+}
+
+/* runs on the worker thread */
+static int
+sqlite_params_bind(SQLiteJob* job, sqlite3_stmt* stmt) {
+  int i, rc = SQLITE_OK, count = sqlite3_bind_parameter_count(stmt);
+
+  if(!job->named && job->num_params > count) {
+    job->error = sqlite3_mprintf("too many parameters (%d, statement takes %d)", job->num_params, count);
+    return -1;
+  }
+
+  for(i = 1; i <= count && rc == SQLITE_OK; i++) {
+    SQLiteParam* p = 0;
+
+    if(job->named) {
+      const char* name = sqlite3_bind_parameter_name(stmt, i);
+
+      for(int j = 0; name && name[0] && j < job->num_params; j++)
+        if(!strcmp(job->params[j].name, name + 1)) {
+          p = &job->params[j];
+          break;
+        }
+    } else if(i <= job->num_params) {
+      p = &job->params[i - 1];
+    }
+
+    switch(p ? p->type : SQLITE_NULL) {
+      case SQLITE_INTEGER: rc = sqlite3_bind_int64(stmt, i, p->u.i); break;
+      case SQLITE_FLOAT: rc = sqlite3_bind_double(stmt, i, p->u.d); break;
+      case SQLITE_TEXT: rc = sqlite3_bind_text64(stmt, i, p->u.s.ptr, p->u.s.len, SQLITE_STATIC, SQLITE_UTF8); break;
+      case SQLITE_BLOB: rc = sqlite3_bind_blob64(stmt, i, p->u.s.ptr, p->u.s.len, SQLITE_STATIC); break;
+      default: rc = sqlite3_bind_null(stmt, i); break;
+    }
+  }
+
+  if(rc != SQLITE_OK) {
+    job->error = sqlite3_mprintf("%s", sqlite3_errstr(rc));
+    return -1;
+  }
+
+  return 0;
+}
+
+/* runs on the worker thread */
+static int
+sqlite_job_row(SQLiteJob* job, sqlite3_stmt* stmt) {
+  int i, n = job->num_columns;
+
+  if(job->num_rows == job->capacity) {
+    size_t capacity = job->capacity ? job->capacity * 2 : 16;
+    sqlite3_value** values;
+
+    if(!(values = realloc(job->values, sizeof(sqlite3_value*) * n * capacity)))
+      return -1;
+
+    job->values = values;
+    job->capacity = capacity;
+  }
+
+  for(i = 0; i < n; i++)
+    job->values[job->num_rows * n + i] = sqlite3_value_dup(sqlite3_column_value(stmt, i));
+
+  job->num_rows++;
+  return 0;
+}
+
+/* runs on the worker thread */
+static void
+sqlite_job_step(SQLiteJob* job, sqlite3_stmt* stmt) {
+  sqlite3* db = sqlite3_db_handle(stmt);
+  int rc, i;
+
+  sqlite3_reset(stmt);
+
+  if(job->bind) {
+    sqlite3_clear_bindings(stmt);
+
+    if(sqlite_params_bind(job, stmt))
+      return;
+  }
+
+  if((job->num_columns = sqlite3_column_count(stmt)) && job->op != ASYNC_RUN)
+    if((job->names = calloc(job->num_columns, sizeof(char*))))
+      for(i = 0; i < job->num_columns; i++)
+        job->names[i] = strdup(sqlite3_column_name(stmt, i));
+
+  while((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    if(job->op == ASYNC_RUN)
+      continue;
+
+    if(sqlite_job_row(job, stmt)) {
+      job->error = sqlite3_mprintf("out of memory");
+      break;
+    }
+
+    if(job->op == ASYNC_GET)
+      break;
+  }
+
+  if(rc != SQLITE_DONE && rc != SQLITE_ROW && !job->error)
+    job->error = sqlite3_mprintf("%s", sqlite3_errmsg(db));
+
+  job->changes = sqlite3_changes(db);
+  job->last_insert_rowid = sqlite3_last_insert_rowid(db);
+
+  sqlite3_reset(stmt);
+
+  if(job->bind)
+    sqlite3_clear_bindings(stmt);
+}
+
+static void
+sqlite_job_work(ThreadJob* ptr) {
+  SQLiteJob* job = (SQLiteJob*)ptr;
+  sqlite3* db = job->conn->db;
+
+  switch(job->op) {
+    case ASYNC_QUERY:
+    case ASYNC_PREPARE: {
+      sqlite3_stmt* stmt;
+
+      if(!job->st && sqlite3_prepare_v3(db, job->sql, (int)job->sql_len, job->persistent ? SQLITE_PREPARE_PERSISTENT : 0, &job->stmt, 0) != SQLITE_OK) {
+        job->error = sqlite3_mprintf("%s", sqlite3_errmsg(db));
+        break;
+      }
+
+      if(!(stmt = job->st ? job->st->stmt : job->stmt)) {
+        if(job->op == ASYNC_PREPARE)
+          job->error = sqlite3_mprintf("argument 1 contains no SQL statement");
+
+        break;
+      }
+
+      if(job->op == ASYNC_QUERY)
+        sqlite_job_step(job, stmt);
+
+      break;
+    }
+
+    case ASYNC_EXEC: {
+      if(sqlite3_exec(db, job->sql, 0, 0, &job->error) != SQLITE_OK && !job->error)
+        job->error = sqlite3_mprintf("exec failed");
+
+      job->changes = sqlite3_changes(db);
+      break;
+    }
+
+    case ASYNC_RUN:
+    case ASYNC_GET:
+    case ASYNC_ALL: {
+      sqlite_job_step(job, job->st->stmt);
+      break;
+    }
+
+    /* only waits for the queries queued before */
+    case ASYNC_CLOSE: break;
+  }
+}
+
+static JSValue
+sqlite_job_value(JSContext* ctx, sqlite3_value* value, int rtype) {
+  int type = sqlite3_value_type(value);
+
+  if(rtype & RESULT_STRING) {
+    const char* text;
+
+    if(type == SQLITE_NULL)
+      return JS_NewString(ctx, "NULL");
+
+    text = (const char*)sqlite3_value_text(value);
+    return JS_NewStringLen(ctx, text ? text : "", text ? sqlite3_value_bytes(value) : 0);
+  }
+
+  switch(type) {
+    case SQLITE_INTEGER: {
+      sqlite3_int64 v = sqlite3_value_int64(value);
+
+      return (v >= INT32_MIN && v <= INT32_MAX) ? JS_NewInt32(ctx, (int32_t)v) : JS_NewInt64(ctx, v);
+    }
+
+    case SQLITE_FLOAT: return JS_NewFloat64(ctx, sqlite3_value_double(value));
+
+    case SQLITE_TEXT: {
+      const char* text = (const char*)sqlite3_value_text(value);
+
+      return JS_NewStringLen(ctx, text ? text : "", text ? sqlite3_value_bytes(value) : 0);
+    }
+
+    case SQLITE_BLOB: return JS_NewArrayBufferCopy(ctx, sqlite3_value_blob(value), sqlite3_value_bytes(value));
+  }
+
+  return JS_NULL;
+}
+
+static JSValue
+sqlite_job_row_value(JSContext* ctx, SQLiteJob* job, size_t row) {
+  sqlite3_value** values = &job->values[row * job->num_columns];
+  JSValue ret = (job->rtype & RESULT_OBJECT) ? JS_NewObjectProto(ctx, JS_NULL) : JS_NewArray(ctx);
+
+  for(int i = 0; i < job->num_columns; i++) {
+    JSValue value = sqlite_job_value(ctx, values[i], job->rtype);
+
+    if(!(job->rtype & RESULT_OBJECT))
+      JS_SetPropertyUint32(ctx, ret, i, value);
+    else if(job->names && job->names[i])
+      JS_SetPropertyStr(ctx, ret, job->names[i], value);
+    else
+      JS_FreeValue(ctx, value);
+  }
+
+  return ret;
+}
+
+static JSValue
+sqlite_job_result(JSContext* ctx, SQLiteJob* job) {
+  JSValue ret = JS_UNDEFINED;
+
+  switch(job->op) {
+    case ASYNC_QUERY:
+      if(job->num_columns == 0) {
+        ret = JS_NewInt64(ctx, job->changes);
+        break;
+      }
+      /* fall through */
+    case ASYNC_ALL: {
+      ret = JS_NewArray(ctx);
+
+      for(size_t i = 0; i < job->num_rows; i++)
+        JS_SetPropertyUint32(ctx, ret, i, sqlite_job_row_value(ctx, job, i));
+      break;
+    }
+
+    case ASYNC_GET: {
+      if(job->num_rows > 0)
+        ret = sqlite_job_row_value(ctx, job, 0);
+      break;
+    }
+
+    case ASYNC_EXEC: {
+      ret = JS_NewInt64(ctx, job->changes);
+      break;
+    }
+
+    case ASYNC_PREPARE: {
+      ret = js_sqlitestatement_wrap(ctx, sqlitestatement_proto, sqlitestmt_dup(job->st));
+      break;
+    }
+
+    case ASYNC_RUN: {
+      ret = JS_NewObjectProto(ctx, JS_NULL);
+      JS_SetPropertyStr(ctx, ret, "changes", JS_NewInt64(ctx, job->changes));
+      JS_SetPropertyStr(ctx, ret, "lastInsertRowid", JS_NewInt64(ctx, job->last_insert_rowid));
+      break;
+    }
+
+    case ASYNC_CLOSE: {
+      SQLiteConnection* db = job->conn;
+
+      sqlite_cache_trim(db, 0, JS_GetRuntime(ctx));
+
+      if(db->db) {
+        sqlite3_close_v2(db->db);
+        db->db = 0;
+      }
+
+      db->closing = FALSE;
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static void
+sqlite_job_free(JSRuntime* rt, SQLiteJob* job) {
+  size_t i;
+
+  for(i = 0; i < job->num_rows * job->num_columns; i++)
+    sqlite3_value_free(job->values[i]);
+
+  free(job->values);
+
+  if(job->names) {
+    for(i = 0; i < (size_t)job->num_columns; i++)
+      free(job->names[i]);
+
+    free(job->names);
+  }
+
+  if(job->params)
+    sqlite_params_free(rt, job->params, job->num_params);
+
+  if(job->stmt)
+    sqlite3_finalize(job->stmt);
+
+  if(job->sql)
+    js_free_rt(rt, job->sql);
+
+  if(job->error)
+    sqlite3_free(job->error);
+
+  if(job->st) {
+    --job->st->pending;
+    sqlitestmt_free(job->st, rt);
+  }
+
+  sqlite_free(job->conn, rt);
+
+  promise_free_funcs(rt, &job->funcs);
+  JS_FreeValueRT(rt, job->this_obj);
+  js_free_rt(rt, job);
+}
+
+/* a statement the worker prepared goes into the cache, unless the same
+ * sql was cached by another job in the meantime */
+static void
+sqlite_job_cache(JSContext* ctx, SQLiteJob* job) {
+  SQLiteConnection* db = job->conn;
+  sqlite3_stmt* stmt = job->stmt;
+
+  job->stmt = 0;
+
+  if(!(job->st = sqlitestmt_new(db, stmt, job->sql, job->sql_len, job->hash, ctx))) {
+    if(!job->error)
+      job->error = sqlite3_mprintf("out of memory");
+
+    return;
+  }
+
+  ++job->st->pending;
+
+  if(db->cache_size > 0 && db->db && !db->closing && !sqlite_cache_find(db, job->sql, job->sql_len, job->hash))
+    sqlite_cache_add(db, job->st, JS_GetRuntime(ctx));
+}
+
+/* called on the JS thread once the worker is finished with the job */
+static void
+sqlite_job_done(JSContext* ctx, ThreadJob* ptr) {
+  SQLiteJob* job = (SQLiteJob*)ptr;
+  JSValue ret;
+
+  --job->conn->pending;
+
+  if(job->stmt)
+    sqlite_job_cache(ctx, job);
+
+  if(job->error) {
+    ret = js_sqliteerror_new(ctx, job->error);
+    promise_reject(ctx, &job->funcs, ret);
+  } else {
+    ret = sqlite_job_result(ctx, job);
+    promise_resolve(ctx, &job->funcs, ret);
+  }
+
+  JS_FreeValue(ctx, ret);
+  sqlite_job_free(JS_GetRuntime(ctx), job);
+}
+
+/* queues 'op' on the worker thread of the connection, returns a Promise */
+static JSValue
+sqlite_job_submit(JSContext* ctx, JSValueConst this_val, SQLiteConnection* db, SQLiteStatement* st, int op, JSValueConst sql, int argc, JSValueConst argv[]) {
+  SQLiteStatement* cached;
+  SQLiteJob* job;
+  JSValue ret;
+
+  if(!db->db || db->closing) {
+    JSValue err = js_sqliteerror_new(ctx, "no database");
+
+    ret = js_promise_reject(ctx, err);
+    JS_FreeValue(ctx, err);
+    return ret;
+  }
+
+  if(!(job = js_mallocz(ctx, sizeof(SQLiteJob))))
+    return JS_EXCEPTION;
+
+  job->job.work = sqlite_job_work;
+  job->job.done = sqlite_job_done;
+  job->op = op;
+  job->rtype = js_get_propertystr_int32(ctx, this_val, "resultType");
+  job->funcs.resolve = job->funcs.reject = JS_UNDEFINED;
+  job->this_obj = JS_DupValue(ctx, this_val);
+
+  if(st) {
+    job->st = sqlitestmt_dup(st);
+    ++st->pending;
+  }
+
+  job->conn = sqlite_dup(db);
+
+  if(!JS_IsUndefined(sql)) {
+    size_t len;
+    const char* str;
+
+    if(!(str = JS_ToCStringLen(ctx, &len, sql))) {
+      sqlite_job_free(JS_GetRuntime(ctx), job);
+      return JS_ThrowTypeError(ctx, "argument 1 must be string");
+    }
+
+    job->sql = js_strndup(ctx, str, len);
+    job->sql_len = len;
+    JS_FreeCString(ctx, str);
+
+    if(!job->sql) {
+      sqlite_job_free(JS_GetRuntime(ctx), job);
+      return JS_EXCEPTION;
+    }
+  }
+
+  /* a cached statement is shared with the queries queued before, which run
+   * one after the other on the same worker, but not with statement objects
+   * or results */
+  if(op == ASYNC_QUERY || op == ASYNC_PREPARE) {
+    job->hash = sqlite_hash(job->sql, job->sql_len);
+    job->persistent = db->cache_size > 0;
+
+    if((cached = sqlite_cache_find(db, job->sql, job->sql_len, job->hash)) && cached->ref_count == 1 + (int)cached->pending) {
+      job->st = sqlite_cache_use(db, cached);
+      ++cached->pending;
+    }
+  }
+
+  if(argc > 0 && !(argc == 1 && js_is_null_or_undefined(argv[0])))
+    if(sqlite_params_capture(ctx, job, argc, argv)) {
+      sqlite_job_free(JS_GetRuntime(ctx), job);
+      return JS_EXCEPTION;
+    }
+
+  if(db->lane == -1)
+    db->lane = thread_pool_lane();
+
+  ret = promise_create(ctx, &job->funcs);
+
+  if(thread_pool_submit(ctx, &job->job, db->lane)) {
+    JS_FreeValue(ctx, ret);
+    sqlite_job_free(JS_GetRuntime(ctx), job);
+    return JS_EXCEPTION;
+  }
+
+  if(op == ASYNC_CLOSE)
+    db->closing = TRUE;
+
+  ++db->pending;
+  return ret;
+}
+
+/* synchronous calls would race with the worker thread */
+static BOOL
+sqlite_check_idle(JSContext* ctx, SQLiteConnection* db) {
+  if(db->pending == 0)
+    return TRUE;
+
+  JS_ThrowTypeError(ctx, "SQLite3 connection is busy with %" PRIu32 " async queries", db->pending);
+  return FALSE;
+}
+
+/* query(sql, [params]) - the statement comes from the statement cache */
+static JSValue
+js_sqlite_query(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  SQLiteConnection* db;
+  SQLiteStatement* st;
+  const char* sql;
+  size_t sql_len;
+  JSValue ret;
+  int r;
+
+  if(!(db = js_sqlite_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(db->async)
+    return sqlite_job_submit(ctx, this_val, db, 0, ASYNC_QUERY, argv[0], argc > 1 ? 1 : 0, argv + 1);
+
+  if(!db->db)
+    return JS_Throw(ctx, js_sqliteerror_new(ctx, "no database"));
+
+  if(!(sql = JS_ToCStringLen(ctx, &sql_len, argv[0])))
+    return JS_ThrowTypeError(ctx, "argument 1 must be string");
+
+  r = sqlite_prepare(db, sql, sql_len, &st, ctx);
+  JS_FreeCString(ctx, sql);
+
+  if(r == -1)
+    return JS_EXCEPTION;
+
+  if(st == NULL)
+    return JS_NULL;
+
+  if(argc > 1 && !js_is_null_or_undefined(argv[1]))
+    if(js_sqlite_bind(ctx, st->stmt, 1, &argv[1]) == -1) {
+      sqlitestmt_free(st, JS_GetRuntime(ctx));
+      return JS_EXCEPTION;
+    }
+
+  if(sqlite3_column_count(st->stmt) == 0) {
+    int rc = sqlite3_step(st->stmt);
+
+    ret = (rc != SQLITE_DONE && rc != SQLITE_ROW) ? JS_Throw(ctx, js_sqliteerror_new(ctx, sqlite_error(db))) : JS_NewInt32(ctx, sqlite3_changes(db->db));
+
+    sqlite3_reset(st->stmt);
+    sqlitestmt_free(st, JS_GetRuntime(ctx));
+    return ret;
+  }
+
+  ret = sqlite_result(db, st->stmt, ctx);
+
+  /* the result resets the statement instead of finalizing it */
+  ((SQLiteResult*)JS_GetOpaque(ret, js_sqliteresult_class_id))->owner = st;
+
+  JS_DefinePropertyValueStr(ctx, ret, "handle", JS_DupValue(ctx, this_val), JS_PROP_CONFIGURABLE);
+
+  return ret;
+}
+
+enum {
+  COLUMN_VALUES = 0,
+  COLUMN_INT8,
+  COLUMN_UINT8,
+  COLUMN_INT16,
+  COLUMN_UINT16,
+  COLUMN_INT32,
+  COLUMN_UINT32,
+  COLUMN_BIGINT64,
+  COLUMN_BIGUINT64,
+  COLUMN_FLOAT32,
+  COLUMN_FLOAT64,
+};
+
+static const struct {
+  const char* name;
+  int type, size;
+} insert_column_types[] = {
+    {"Int8Array", COLUMN_INT8, 1},
+    {"Uint8Array", COLUMN_UINT8, 1},
+    {"Uint8ClampedArray", COLUMN_UINT8, 1},
+    {"Int16Array", COLUMN_INT16, 2},
+    {"Uint16Array", COLUMN_UINT16, 2},
+    {"Int32Array", COLUMN_INT32, 4},
+    {"Uint32Array", COLUMN_UINT32, 4},
+    {"BigInt64Array", COLUMN_BIGINT64, 8},
+    {"BigUint64Array", COLUMN_BIGUINT64, 8},
+    {"Float32Array", COLUMN_FLOAT32, 4},
+    {"Float64Array", COLUMN_FLOAT64, 8},
+};
+
+/* a column of values for insertMany(): typed array elements are bound
+ * straight from its memory, anything else element by element */
+typedef struct {
+  int type, size;
+  const uint8_t* data;
+  JSValue values;
+  InputBuffer input;
+} InsertColumn;
+
+/* takes ownership of 'value', returns the number of rows or -1 */
+static int64_t
+insert_column_init(JSContext* ctx, InsertColumn* col, JSValue value) {
+  col->type = COLUMN_VALUES;
+  col->values = value;
+
+  if(js_is_typedarray(ctx, value)) {
+    const char* tag = js_get_tostringtag_cstr(ctx, value);
+
+    for(size_t i = 0; tag && i < countof(insert_column_types); i++)
+      if(!strcmp(tag, insert_column_types[i].name)) {
+        col->type = insert_column_types[i].type;
+        col->size = insert_column_types[i].size;
+        break;
+      }
+
+    if(tag)
+      JS_FreeCString(ctx, tag);
+
+    if(col->type != COLUMN_VALUES) {
+      col->input = js_input_buffer(ctx, value);
+      col->data = inputbuffer_data(&col->input);
+
+      return inputbuffer_length(&col->input) / col->size;
+    }
+  }
+
+  if(JS_IsArray(ctx, value) || js_is_typedarray(ctx, value))
+    return js_array_length(ctx, value);
+
+  JS_ThrowTypeError(ctx, "column must be an array or typed array");
+  return -1;
+}
+
+static void
+insert_column_free(JSContext* ctx, InsertColumn* col) {
+  if(col->type != COLUMN_VALUES)
+    inputbuffer_free(&col->input, ctx);
+
+  JS_FreeValue(ctx, col->values);
+  col->values = JS_UNDEFINED;
+}
+
+/* binds row 'row' of 'col', values taken out of arrays are kept in '*held'
+ * until the statement has been stepped */
+static int
+insert_column_bind(JSContext* ctx, sqlite3_stmt* stmt, int idx, InsertColumn* col, uint32_t row, JSValue* held) {
+  const uint8_t* ptr = col->data + (size_t)row * col->size;
+
+  switch(col->type) {
+    case COLUMN_INT8: return sqlite3_bind_int(stmt, idx, *(const int8_t*)ptr);
+    case COLUMN_UINT8: return sqlite3_bind_int(stmt, idx, *(const uint8_t*)ptr);
+    case COLUMN_INT16: return sqlite3_bind_int(stmt, idx, *(const int16_t*)ptr);
+    case COLUMN_UINT16: return sqlite3_bind_int(stmt, idx, *(const uint16_t*)ptr);
+    case COLUMN_INT32: return sqlite3_bind_int(stmt, idx, *(const int32_t*)ptr);
+    case COLUMN_UINT32: return sqlite3_bind_int64(stmt, idx, *(const uint32_t*)ptr);
+    case COLUMN_BIGINT64: return sqlite3_bind_int64(stmt, idx, *(const int64_t*)ptr);
+    case COLUMN_BIGUINT64: return sqlite3_bind_int64(stmt, idx, (sqlite3_int64) * (const uint64_t*)ptr);
+    case COLUMN_FLOAT32: return sqlite3_bind_double(stmt, idx, *(const float*)ptr);
+    case COLUMN_FLOAT64: return sqlite3_bind_double(stmt, idx, *(const double*)ptr);
+  }
+
+  *held = JS_GetPropertyUint32(ctx, col->values, row);
+  return js_sqlite_bind_value(ctx, stmt, idx, *held, SQLITE_STATIC);
+}
+
+/* binds one row given as an array, a typed array or an object keyed by column */
+static int
+insert_row_bind(JSContext* ctx, sqlite3_stmt* stmt, int n, JSAtom* columns, JSValueConst row, JSValue* held) {
+  int rc = SQLITE_OK;
+
+  if(js_is_typedarray(ctx, row)) {
+    InsertColumn col;
+    int64_t len = insert_column_init(ctx, &col, JS_DupValue(ctx, row));
+
+    for(int i = 0; i < n && rc == SQLITE_OK; i++)
+      rc = i < len ? insert_column_bind(ctx, stmt, i + 1, &col, i, &held[i]) : sqlite3_bind_null(stmt, i + 1);
+
+    insert_column_free(ctx, &col);
+    return rc;
+  }
+
+  BOOL is_array = JS_IsArray(ctx, row);
+
+  for(int i = 0; i < n && rc == SQLITE_OK; i++) {
+    held[i] = is_array ? JS_GetPropertyUint32(ctx, row, i) : JS_GetProperty(ctx, row, columns[i]);
+    rc = js_sqlite_bind_value(ctx, stmt, i + 1, held[i], SQLITE_STATIC);
+  }
+
+  return rc;
+}
+
+static int
+insert_step(JSContext* ctx, sqlite3_stmt* stmt, int rc, int n, JSValue* held) {
+  if(rc == SQLITE_OK)
+    rc = sqlite3_step(stmt);
+
+  if(rc != SQLITE_DONE)
+    JS_Throw(ctx, js_sqliteerror_new(ctx, rc == SQLITE_ROW ? "insert returned rows" : sqlite3_errmsg(sqlite3_db_handle(stmt))));
+
+  sqlite3_reset(stmt);
+
+  for(int i = 0; i < n; i++) {
+    JS_FreeValue(ctx, held[i]);
+    held[i] = JS_UNDEFINED;
+  }
+
+  return rc == SQLITE_DONE ? 0 : -1;
+}
+
+/* insertMany(table, columns, source) - inserts all rows of 'source' with
+ * one prepared statement inside a savepoint, so either all rows or none get
+ * inserted. 'source' is an array or an iterable of rows, or an object
+ * mapping column names to (typed) arrays. returns the number of rows */
+static JSValue
+js_sqlite_insert_many(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  SQLiteConnection* db;
+  SQLiteStatement* st = 0;
+  JSValueConst source = argv[2];
+  JSAtom* columns = 0;
+  JSValue* held = 0;
+  InsertColumn* cols = 0;
+  int64_t n, count = 0;
+  const char* tbl;
+  DynBuf buf;
+  int r, ok = -1;
+
+  if(!(db = js_sqlite_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(!db->db)
+    return JS_Throw(ctx, js_sqliteerror_new(ctx, "no database"));
+
+  if(!sqlite_check_idle(ctx, db))
+    return JS_EXCEPTION;
+
+  if(!JS_IsArray(ctx, argv[1]) || (n = js_array_length(ctx, argv[1])) < 1)
+    return JS_ThrowTypeError(ctx, "argument 2 must be a non-empty array of column names");
+
+  if(!(tbl = JS_ToCString(ctx, argv[0])))
+    return JS_EXCEPTION;
+
+  dbuf_init2(&buf, 0, 0);
+  dbuf_printf(&buf, "INSERT INTO %s ", tbl);
+  JS_FreeCString(ctx, tbl);
+
+  js_sqlite_print_iterable(ctx, db, &buf, argv[1], js_sqlite_print_field);
+  dbuf_putstr(&buf, " VALUES (");
+
+  for(int64_t i = 0; i < n; i++)
+    dbuf_putstr(&buf, i ? ", ?" : "?");
+
+  dbuf_putc(&buf, ')');
+
+  r = sqlite_prepare(db, (const char*)buf.buf, buf.size, &st, ctx);
+  dbuf_free(&buf);
+
+  if(r == -1)
+    return JS_EXCEPTION;
+
+  if(!(columns = js_mallocz(ctx, sizeof(JSAtom) * n)) || !(held = js_mallocz(ctx, sizeof(JSValue) * n)))
+    goto done;
+
+  for(int64_t i = 0; i < n; i++) {
+    JSValue name = JS_GetPropertyUint32(ctx, argv[1], i);
+
+    columns[i] = JS_ValueToAtom(ctx, name);
+    held[i] = JS_UNDEFINED;
+    JS_FreeValue(ctx, name);
+  }
+
+  if(sqlite3_exec(db->db, "SAVEPOINT insert_many", NULL, NULL, NULL) != SQLITE_OK) {
+    JS_Throw(ctx, js_sqliteerror_new(ctx, sqlite_error(db)));
+    goto done;
+  }
+
+  if(js_sqlite_is_record(ctx, source) && !js_is_iterable(ctx, source)) {
+    int64_t rows = INT64_MAX;
+
+    if(!(cols = js_mallocz(ctx, sizeof(InsertColumn) * n)))
+      goto rollback;
+
+    for(int64_t i = 0; i < n; i++) {
+      int64_t len = insert_column_init(ctx, &cols[i], JS_GetProperty(ctx, source, columns[i]));
+
+      if(len < 0)
+        goto rollback;
+
+      if(len < rows)
+        rows = len;
+    }
+
+    for(count = 0; count < rows; count++) {
+      int rc = SQLITE_OK;
+
+      for(int64_t i = 0; i < n && rc == SQLITE_OK; i++)
+        rc = insert_column_bind(ctx, st->stmt, i + 1, &cols[i], count, &held[i]);
+
+      if(insert_step(ctx, st->stmt, rc, n, held))
+        goto rollback;
+    }
+  } else if(JS_IsArray(ctx, source)) {
+    int64_t rows = js_array_length(ctx, source);
+
+    for(count = 0; count < rows; count++) {
+      JSValue row = JS_GetPropertyUint32(ctx, source, count);
+      int rc = insert_row_bind(ctx, st->stmt, n, columns, row, held);
+
+      JS_FreeValue(ctx, row);
+
+      if(insert_step(ctx, st->stmt, rc, n, held))
+        goto rollback;
+    }
+  } else {
+    Iteration iter = ITERATION_INIT();
+
+    if(!iteration_method_symbol(&iter, ctx, source, "iterator") && !iteration_init(&iter, ctx, JS_DupValue(ctx, source))) {
+      JS_ThrowTypeError(ctx, "argument 3 must be an array, an iterable or an object of columns");
+      goto rollback;
+    }
+
+    for(;;) {
+      JSValue row;
+      int rc;
+
+      if(iteration_next(&iter, ctx))
+        break;
+
+      if(JS_IsException(iter.data)) {
+        iteration_reset(&iter, ctx);
+        goto rollback;
+      }
+
+      row = iteration_value(&iter, ctx);
+      rc = insert_row_bind(ctx, st->stmt, n, columns, row, held);
+      JS_FreeValue(ctx, row);
+
+      if(insert_step(ctx, st->stmt, rc, n, held)) {
+        iteration_reset(&iter, ctx);
+        goto rollback;
+      }
+
+      count++;
+    }
+
+    iteration_reset(&iter, ctx);
+  }
+
+  if(sqlite3_exec(db->db, "RELEASE insert_many", NULL, NULL, NULL) != SQLITE_OK) {
+    JS_Throw(ctx, js_sqliteerror_new(ctx, sqlite_error(db)));
+    goto rollback;
+  }
+
+  ok = 0;
+  goto done;
 
-static JSValue
-js_sqlite_open(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
-  SQLiteConnection* db;
-  const char* filename;
-  int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
-  int ret;
+rollback:
+  sqlite3_exec(db->db, "ROLLBACK TO insert_many; RELEASE insert_many", NULL, NULL, NULL);
 
-  if(!(db = js_sqlite_data2(ctx, this_val)))
-    return JS_EXCEPTION;
+done:
+  if(cols) {
+    /* zeroed entries (type COLUMN_VALUES) free nothing */
+    for(int64_t i = 0; i < n; i++)
+      insert_column_free(ctx, &cols[i]);
 
-  if(db->db) {
-    sqlite3_close_v2(db->db);
-    db->db = 0;
+    js_free(ctx, cols);
   }
 
-  if(!(filename = JS_ToCString(ctx, argv[0])))
-    return JS_ThrowTypeError(ctx, "argument 1 must be a filename string");
+  if(held) {
+    for(int64_t i = 0; i < n; i++)
+      JS_FreeValue(ctx, held[i]);
 
-  if(argc > 1)
-    JS_ToInt32(ctx, &flags, argv[1]);
+    js_free(ctx, held);
+  }
 
-  ret = sqlite3_open_v2(filename, &db->db, flags, NULL);
-  JS_FreeCString(ctx, filename);
+  if(columns) {
+    for(int64_t i = 0; i < n; i++)
+      if(columns[i] != JS_ATOM_NULL)
+        JS_FreeAtom(ctx, columns[i]);
 
-  if(ret != SQLITE_OK)
-    return JS_Throw(ctx, js_sqliteerror_new(ctx, sqlite_error(db)));
+    js_free(ctx, columns);
+  }
 
-  return JS_NewBool(ctx, TRUE);
+  if(st)
+    sqlitestmt_free(st, JS_GetRuntime(ctx));
+
+  return ok ? JS_EXCEPTION : JS_NewInt64(ctx, count);
 }
 
 static JSValue
-js_sqlite_query(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+js_sqlite_prepare(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
   SQLiteConnection* db;
+  SQLiteStatement* st;
   const char* sql;
   size_t sql_len;
-  sqlite3_stmt* stmt = NULL;
-  JSValue ret;
+  int r;
 
   if(!(db = js_sqlite_data2(ctx, this_val)))
     return JS_EXCEPTION;
 
+  /* queued behind the other queries, resolves with the statement */
+  if(db->async)
+    return sqlite_job_submit(ctx, this_val, db, 0, ASYNC_PREPARE, argv[0], 0, 0);
+
   if(!db->db)
     return JS_Throw(ctx, js_sqliteerror_new(ctx, "no database"));
 
+  if(!sqlite_check_idle(ctx, db))
+    return JS_EXCEPTION;
+
   if(!(sql = JS_ToCStringLen(ctx, &sql_len, argv[0])))
     return JS_ThrowTypeError(ctx, "argument 1 must be string");
 
-  if(sqlite3_prepare_v2(db->db, sql, (int)sql_len, &stmt, NULL) != SQLITE_OK) {
-    JSValue err = js_sqliteerror_new(ctx, sqlite_error(db));
-    JS_FreeCString(ctx, sql);
-    return JS_Throw(ctx, err);
-  }
-
+  r = sqlite_prepare(db, sql, sql_len, &st, ctx);
   JS_FreeCString(ctx, sql);
 
-  if(stmt == NULL)
-    return JS_NULL;
-
-  if(sqlite3_column_count(stmt) == 0) {
-    int rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-
-    if(rc != SQLITE_DONE && rc != SQLITE_ROW)
-      return JS_Throw(ctx, js_sqliteerror_new(ctx, sqlite_error(db)));
-
-    return JS_NewInt32(ctx, sqlite3_changes(db->db));
-  }
+  if(r == -1)
+    return JS_EXCEPTION;
 
-  ret = sqlite_result(db, stmt, ctx);
-  JS_DefinePropertyValueStr(ctx, ret, "handle", JS_DupValue(ctx, this_val), JS_PROP_CONFIGURABLE);
+  if(st == NULL)
+    return JS_ThrowSyntaxError(ctx, "argument 1 contains no SQL statement");
 
-  return ret;
+  return js_sqlitestatement_wrap(ctx, sqlitestatement_proto, st);
 }
 
 static JSValue
@@ -656,6 +2060,9 @@ js_sqlite_exec(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst arg
   if(!(db = js_sqlite_data2(ctx, this_val)))
     return JS_EXCEPTION;
 
+  if(db->async)
+    return sqlite_job_submit(ctx, this_val, db, 0, ASYNC_EXEC, argv[0], 0, 0);
+
   if(!db->db)
     return JS_Throw(ctx, js_sqliteerror_new(ctx, "no database"));
 
@@ -684,6 +2091,12 @@ js_sqlite_close(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst ar
   if(!(db = js_sqlite_data2(ctx, this_val)))
     return JS_EXCEPTION;
 
+  /* closes after the queries queued before */
+  if(db->async && db->db)
+    return sqlite_job_submit(ctx, this_val, db, 0, ASYNC_CLOSE, JS_UNDEFINED, 0, 0);
+
+  sqlite_cache_trim(db, 0, JS_GetRuntime(ctx));
+
   if(db->db) {
     sqlite3_close_v2(db->db);
     db->db = 0;
@@ -714,8 +2127,14 @@ static const JSCFunctionListEntry js_sqlite_funcs[] = {
     JS_CGETSET_MAGIC_DEF("errorMessage", js_sqlite_get, 0, PROP_ERROR_MESSAGE),
     JS_CGETSET_MAGIC_DEF("errorCode", js_sqlite_get, 0, PROP_ERROR_CODE),
     JS_CGETSET_MAGIC_DEF("filename", js_sqlite_get, 0, PROP_FILENAME),
+    JS_CGETSET_MAGIC_DEF("cacheSize", js_sqlite_get, js_sqlite_set, PROP_CACHE_SIZE),
+    JS_CGETSET_MAGIC_DEF("cachedStatements", js_sqlite_get, 0, PROP_CACHED),
+    JS_CGETSET_MAGIC_DEF("async", js_sqlite_get, js_sqlite_set, PROP_ASYNC),
+    JS_CGETSET_MAGIC_DEF("pending", js_sqlite_get, 0, PROP_PENDING),
     JS_CFUNC_DEF("open", 1, js_sqlite_open),
     JS_CFUNC_DEF("query", 1, js_sqlite_query),
+    JS_CFUNC_DEF("prepare", 1, js_sqlite_prepare),
+    JS_CFUNC_DEF("insertMany", 3, js_sqlite_insert_many),
     JS_CFUNC_DEF("exec", 1, js_sqlite_exec),
     JS_CFUNC_DEF("close", 0, js_sqlite_close),
     JS_ALIAS_DEF("execute", "query"),
@@ -827,8 +2246,7 @@ result_blob_free(JSRuntime* rt, void* opaque, void* ptr) {
 }
 
 static JSValue
-result_column_value(JSContext* ctx, SQLiteResult* res, int col, int rtype) {
-  sqlite3_stmt* stmt = res->stmt;
+result_column_value(JSContext* ctx, sqlite3_stmt* stmt, int col, int rtype) {
   int type = sqlite3_column_type(stmt, col);
 
   if(rtype & RESULT_STRING) {
@@ -883,34 +2301,34 @@ result_column_value(JSContext* ctx, SQLiteResult* res, int col, int rtype) {
 }
 
 static JSValue
-result_array(JSContext* ctx, SQLiteResult* res, int rtype) {
+result_array(JSContext* ctx, sqlite3_stmt* stmt, int rtype) {
   JSValue ret = JS_NewArray(ctx);
-  int i, n = sqlite3_column_count(res->stmt);
+  int i, n = sqlite3_column_count(stmt);
 
   for(i = 0; i < n; i++)
-    JS_SetPropertyUint32(ctx, ret, i, result_column_value(ctx, res, i, rtype));
+    JS_SetPropertyUint32(ctx, ret, i, result_column_value(ctx, stmt, i, rtype));
 
   return ret;
 }
 
 static JSValue
-result_object(JSContext* ctx, SQLiteResult* res, int rtype) {
+result_object(JSContext* ctx, sqlite3_stmt* stmt, int rtype) {
   JSValue ret = JS_NewObjectProto(ctx, JS_NULL);
-  int i, n = sqlite3_column_count(res->stmt);
+  int i, n = sqlite3_column_count(stmt);
 
   for(i = 0; i < n; i++) {
-    const char* name = sqlite3_column_name(res->stmt, i);
+    const char* name = sqlite3_column_name(stmt, i);
 
     if(name)
-      JS_SetPropertyStr(ctx, ret, name, result_column_value(ctx, res, i, rtype));
+      JS_SetPropertyStr(ctx, ret, name, result_column_value(ctx, stmt, i, rtype));
   }
 
   return ret;
 }
 
 static JSValue
-result_row(JSContext* ctx, SQLiteResult* res, int rtype) {
-  return (rtype & RESULT_OBJECT) ? result_object(ctx, res, rtype) : result_array(ctx, res, rtype);
+result_row(JSContext* ctx, sqlite3_stmt* stmt, int rtype) {
+  return (rtype & RESULT_OBJECT) ? result_object(ctx, stmt, rtype) : result_array(ctx, stmt, rtype);
 }
 
 static SQLiteResult*
@@ -920,7 +2338,7 @@ sqliteresult_new(JSContext* ctx) {
   if(!(res = js_malloc(ctx, sizeof(SQLiteResult))))
     return 0;
 
-  *res = (SQLiteResult){1, NULL, NULL, 0, FALSE, FALSE};
+  *res = (SQLiteResult){1, NULL, NULL, 0, FALSE, FALSE, NULL};
 
   return res;
 }
@@ -936,7 +2354,11 @@ sqliteresult_free(JSRuntime* rt, void* ptr, void* mem) {
   SQLiteResult* res = ptr;
 
   if(--res->ref_count == 0) {
-    if(res->stmt) {
+    if(res->owner) {
+      sqlitestmt_free(res->owner, rt);
+      res->owner = 0;
+      res->stmt = 0;
+    } else if(res->stmt) {
       sqlite3_finalize(res->stmt);
       res->stmt = 0;
     }
@@ -995,6 +2417,7 @@ enum {
   METHOD_FETCH_FIELDS,
   METHOD_FETCH_ROW,
   METHOD_FETCH_ASSOC,
+  METHOD_FETCH_COLUMNS,
   METHOD_RESET,
 };
 
@@ -1022,7 +2445,7 @@ js_sqliteresult_next(JSContext* ctx, SQLiteResult* res, BOOL* pdone, int rtype)
   if(rc == SQLITE_ROW) {
     *pdone = FALSE;
     res->row_index++;
-    return result_row(ctx, res, rtype);
+    return result_row(ctx, res->stmt, rtype);
   }
 
   res->done = TRUE;
@@ -1034,6 +2457,93 @@ js_sqliteresult_next(JSContext* ctx, SQLiteResult* res, BOOL* pdone, int rtype)
   return JS_UNDEFINED;
 }
 
+/* steps through up to 'batch_size' rows and collects them column-wise,
+ * returns null when there are no rows left */
+static JSValue
+js_sqliteresult_columns(JSContext* ctx, SQLiteResult* res, uint32_t batch_size) {
+  ColumnBuilder* cols;
+  JSValue ret = JS_NULL;
+  uint32_t rows = 0;
+  int i, n;
+
+  if(!res->stmt || res->done)
+    return JS_NULL;
+
+  n = sqlite3_column_count(res->stmt);
+
+  if(!(cols = js_malloc(ctx, sizeof(ColumnBuilder) * (n ? n : 1))))
+    return JS_EXCEPTION;
+
+  for(i = 0; i < n; i++)
+    column_init(&cols[i], ctx);
+
+  while(rows < batch_size) {
+    int rc = sqlite3_step(res->stmt);
+
+    if(rc != SQLITE_ROW) {
+      res->done = TRUE;
+
+      if(rc != SQLITE_DONE && res->conn && res->conn->db) {
+        ret = JS_Throw(ctx, js_sqliteerror_new(ctx, sqlite3_errmsg(res->conn->db)));
+        goto fail;
+      }
+
+      break;
+    }
+
+    for(i = 0; i < n; i++) {
+      int r = 0;
+
+      switch(sqlite3_column_type(res->stmt, i)) {
+        case SQLITE_NULL: r = column_put_null(&cols[i]); break;
+        case SQLITE_INTEGER: r = column_put_int64(&cols[i], sqlite3_column_int64(res->stmt, i)); break;
+        case SQLITE_FLOAT: r = column_put_float64(&cols[i], sqlite3_column_double(res->stmt, i)); break;
+        case SQLITE_TEXT: {
+          const unsigned char* text = sqlite3_column_text(res->stmt, i);
+
+          r = column_put_text(&cols[i], text, sqlite3_column_bytes(res->stmt, i), FALSE);
+          break;
+        }
+        case SQLITE_BLOB: {
+          const void* blob = sqlite3_column_blob(res->stmt, i);
+
+          r = column_put_text(&cols[i], blob, sqlite3_column_bytes(res->stmt, i), TRUE);
+          break;
+        }
+      }
+
+      if(r) {
+        ret = JS_ThrowOutOfMemory(ctx);
+        goto fail;
+      }
+    }
+
+    res->row_index++;
+    rows++;
+  }
+
+  if(rows > 0) {
+    ret = JS_NewObjectProto(ctx, JS_NULL);
+
+    for(i = 0; i < n; i++) {
+      const char* name = sqlite3_column_name(res->stmt, i);
+      JSValue column = column_value(&cols[i], ctx);
+
+      if(name)
+        JS_SetPropertyStr(ctx, ret, name, column);
+      else
+        JS_SetPropertyUint32(ctx, ret, i, column);
+    }
+  }
+
+fail:
+  for(i = 0; i < n; i++)
+    column_free(&cols[i]);
+
+  js_free(ctx, cols);
+  return ret;
+}
+
 static JSValue
 js_sqliteresult_functions(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
   SQLiteResult* res;
@@ -1082,6 +2592,17 @@ js_sqliteresult_functions(JSContext* ctx, JSValueConst this_val, int argc, JSVal
       break;
     }
 
+    case METHOD_FETCH_COLUMNS: {
+      uint32_t batch_size = UINT32_MAX;
+
+      if(argc > 0 && !JS_IsUndefined(argv[0]))
+        if(JS_ToUint32(ctx, &batch_size, argv[0]) || batch_size == 0)
+          return JS_ThrowRangeError(ctx, "argument 1 must be a positive batch size");
+
+      ret = js_sqliteresult_columns(ctx, res, batch_size);
+      break;
+    }
+
     case METHOD_RESET: {
       if(res->stmt) {
         sqlite3_reset(res->stmt);
@@ -1230,11 +2751,343 @@ static const JSCFunctionListEntry js_sqliteresult_funcs[] = {
     JS_CFUNC_MAGIC_DEF("fetchFields", 0, js_sqliteresult_functions, METHOD_FETCH_FIELDS),
     JS_CFUNC_MAGIC_DEF("fetchRow", 0, js_sqliteresult_functions, METHOD_FETCH_ROW),
     JS_CFUNC_MAGIC_DEF("fetchAssoc", 0, js_sqliteresult_functions, METHOD_FETCH_ASSOC),
+    JS_CFUNC_MAGIC_DEF("fetchColumns", 1, js_sqliteresult_functions, METHOD_FETCH_COLUMNS),
     JS_CFUNC_MAGIC_DEF("reset", 0, js_sqliteresult_functions, METHOD_RESET),
     JS_CFUNC_DEF("[Symbol.iterator]", 0, js_sqliteresult_iterator),
     JS_PROP_STRING_DEF("[Symbol.toStringTag]", "SQLite3Result", JS_PROP_CONFIGURABLE),
 };
 
+/* ---- SQLite3Statement ---- */
+
+enum {
+  STATEMENT_BIND,
+  STATEMENT_RUN,
+  STATEMENT_GET,
+  STATEMENT_ALL,
+  STATEMENT_ITERATE,
+  STATEMENT_RESET,
+};
+
+enum {
+  STATEMENT_SQL,
+  STATEMENT_EXPANDED_SQL,
+  STATEMENT_PARAM_COUNT,
+  STATEMENT_COLUMN_COUNT,
+  STATEMENT_READONLY,
+  STATEMENT_BUSY,
+};
+
+static SQLiteStatement*
+js_sqlitestatement_data2(JSContext* ctx, JSValueConst value) {
+  return JS_GetOpaque2(ctx, value, js_sqlitestatement_class_id);
+}
+
+/* the wrapper holds the connection, which owns the statement cache */
+static JSValue
+js_sqlitestatement_wrap(JSContext* ctx, JSValueConst proto, SQLiteStatement* st) {
+  JSValue obj;
+
+  if(js_sqlitestatement_class_id == 0)
+    js_sqlite_init(ctx, 0);
+
+  obj = JS_NewObjectProtoClass(ctx, proto, js_sqlitestatement_class_id);
+
+  if(JS_IsException(obj)) {
+    sqlitestmt_free(st, JS_GetRuntime(ctx));
+    return JS_EXCEPTION;
+  }
+
+  sqlite_dup(st->conn);
+  JS_SetOpaque(obj, st);
+  return obj;
+}
+
+static void
+sqlitestmt_release(SQLiteStatement* st, JSRuntime* rt) {
+  SQLiteConnection* conn = st->conn;
+
+  sqlitestmt_free(st, rt);
+  sqlite_free(conn, rt);
+}
+
+static JSValue
+js_sqlitestatement_error(JSContext* ctx, SQLiteStatement* st) {
+  JSValue err = js_sqliteerror_new(ctx, sqlite3_errmsg(sqlite3_db_handle(st->stmt)));
+
+  sqlite3_reset(st->stmt);
+  return JS_Throw(ctx, err);
+}
+
+static JSValue
+js_sqlitestatement_iterator_next(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  SQLiteStatementIterator* it = ptr;
+  SQLiteStatement* st = it->stmt;
+  JSValue row, ret;
+  int rc;
+
+  if(it->done)
+    return js_iterator_result(ctx, JS_UNDEFINED, TRUE);
+
+  if((rc = sqlite3_step(st->stmt)) == SQLITE_ROW) {
+    row = result_row(ctx, st->stmt, it->rtype);
+    ret = js_iterator_result(ctx, row, FALSE);
+    JS_FreeValue(ctx, row);
+    return ret;
+  }
+
+  it->done = TRUE;
+  st->iterating = FALSE;
+
+  if(rc != SQLITE_DONE)
+    return js_sqlitestatement_error(ctx, st);
+
+  sqlite3_reset(st->stmt);
+  return js_iterator_result(ctx, JS_UNDEFINED, TRUE);
+}
+
+static void
+js_sqlitestatement_iterator_free(JSRuntime* rt, void* ptr) {
+  SQLiteStatementIterator* it = ptr;
+
+  if(!it->done) {
+    it->stmt->iterating = FALSE;
+    sqlite3_reset(it->stmt->stmt);
+  }
+
+  sqlitestmt_release(it->stmt, rt);
+  js_free_rt(rt, it);
+}
+
+static JSValue
+js_sqlitestatement_iterator(JSContext* ctx, SQLiteStatement* st, int rtype) {
+  SQLiteStatementIterator* it;
+  JSValue ret;
+
+  if(!(it = js_malloc(ctx, sizeof(SQLiteStatementIterator))))
+    return JS_EXCEPTION;
+
+  *it = (SQLiteStatementIterator){sqlitestmt_dup(st), rtype, FALSE};
+  sqlite_dup(st->conn);
+  st->iterating = TRUE;
+
+  ret = JS_NewObjectProto(ctx, statementiterator_proto);
+  JS_SetPropertyStr(ctx, ret, "next", js_function_cclosure(ctx, js_sqlitestatement_iterator_next, 0, 0, it, js_sqlitestatement_iterator_free));
+  return ret;
+}
+
+static JSValue
+js_sqlitestatement_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  SQLiteStatement* st;
+  JSValue ret = JS_UNDEFINED;
+  int rc;
+
+  if(!(st = js_sqlitestatement_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(st->iterating && magic != STATEMENT_RESET)
+    return JS_ThrowTypeError(ctx, "statement is busy with an iterator");
+
+  if(st->conn->async)
+    switch(magic) {
+      case STATEMENT_RUN: return sqlite_job_submit(ctx, this_val, st->conn, st, ASYNC_RUN, JS_UNDEFINED, argc, argv);
+      case STATEMENT_GET: return sqlite_job_submit(ctx, this_val, st->conn, st, ASYNC_GET, JS_UNDEFINED, argc, argv);
+      case STATEMENT_ALL: return sqlite_job_submit(ctx, this_val, st->conn, st, ASYNC_ALL, JS_UNDEFINED, argc, argv);
+      case STATEMENT_ITERATE: return JS_ThrowTypeError(ctx, "iterate() is not available in async mode, use all()");
+    }
+
+  if(!sqlite_check_idle(ctx, st->conn))
+    return JS_EXCEPTION;
+
+  if(magic != STATEMENT_RESET && (argc > 0 || magic == STATEMENT_BIND))
+    if(js_sqlite_bind(ctx, st->stmt, argc, argv) == -1)
+      return JS_EXCEPTION;
+
+  switch(magic) {
+    case STATEMENT_BIND: {
+      ret = JS_DupValue(ctx, this_val);
+      break;
+    }
+
+    case STATEMENT_RUN: {
+      sqlite3* db = sqlite3_db_handle(st->stmt);
+
+      sqlite3_reset(st->stmt);
+
+      while((rc = sqlite3_step(st->stmt)) == SQLITE_ROW)
+        ;
+
+      if(rc != SQLITE_DONE)
+        return js_sqlitestatement_error(ctx, st);
+
+      sqlite3_reset(st->stmt);
+
+      ret = JS_NewObjectProto(ctx, JS_NULL);
+      JS_SetPropertyStr(ctx, ret, "changes", JS_NewInt32(ctx, sqlite3_changes(db)));
+      JS_SetPropertyStr(ctx, ret, "lastInsertRowid", JS_NewInt64(ctx, sqlite3_last_insert_rowid(db)));
+      break;
+    }
+
+    case STATEMENT_GET: {
+      sqlite3_reset(st->stmt);
+
+      if((rc = sqlite3_step(st->stmt)) == SQLITE_ROW)
+        ret = result_row(ctx, st->stmt, sqliteresult_rtype(ctx, this_val));
+      else if(rc != SQLITE_DONE)
+        return js_sqlitestatement_error(ctx, st);
+
+      sqlite3_reset(st->stmt);
+      break;
+    }
+
+    case STATEMENT_ALL: {
+      int rtype = sqliteresult_rtype(ctx, this_val);
+      uint32_t i = 0;
+
+      sqlite3_reset(st->stmt);
+      ret = JS_NewArray(ctx);
+
+      while((rc = sqlite3_step(st->stmt)) == SQLITE_ROW)
+        JS_SetPropertyUint32(ctx, ret, i++, result_row(ctx, st->stmt, rtype));
+
+      if(rc != SQLITE_DONE) {
+        JS_FreeValue(ctx, ret);
+        return js_sqlitestatement_error(ctx, st);
+      }
+
+      sqlite3_reset(st->stmt);
+      break;
+    }
+
+    case STATEMENT_ITERATE: {
+      sqlite3_reset(st->stmt);
+      ret = js_sqlitestatement_iterator(ctx, st, sqliteresult_rtype(ctx, this_val));
+      break;
+    }
+
+    case STATEMENT_RESET: {
+      if(!st->iterating)
+        sqlite3_reset(st->stmt);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static JSValue
+js_sqlitestatement_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  SQLiteStatement* st;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(st = js_sqlitestatement_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case STATEMENT_SQL: {
+      ret = JS_NewStringLen(ctx, st->sql, st->sql_len);
+      break;
+    }
+
+    case STATEMENT_EXPANDED_SQL: {
+      char* sql;
+
+      if((sql = sqlite3_expanded_sql(st->stmt))) {
+        ret = JS_NewString(ctx, sql);
+        sqlite3_free(sql);
+      } else {
+        ret = JS_NULL;
+      }
+      break;
+    }
+
+    case STATEMENT_PARAM_COUNT: {
+      ret = JS_NewInt32(ctx, sqlite3_bind_parameter_count(st->stmt));
+      break;
+    }
+
+    case STATEMENT_COLUMN_COUNT: {
+      ret = JS_NewInt32(ctx, sqlite3_column_count(st->stmt));
+      break;
+    }
+
+    case STATEMENT_READONLY: {
+      ret = JS_NewBool(ctx, sqlite3_stmt_readonly(st->stmt));
+      break;
+    }
+
+    case STATEMENT_BUSY: {
+      ret = JS_NewBool(ctx, sqlite3_stmt_busy(st->stmt));
+      break;
+    }
+  }
+
+  return ret;
+}
+
+/* new SQLite3Statement(db, sql) is the same as db.prepare(sql) */
+static JSValue
+js_sqlitestatement_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  JSValue proto, obj, tmp;
+
+  if(!js_sqlite_data2(ctx, argv[0]))
+    return JS_EXCEPTION;
+
+  if(JS_IsException((tmp = js_sqlite_prepare(ctx, argv[0], argc - 1, argv + 1))))
+    return JS_EXCEPTION;
+
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+
+  if(JS_IsException(proto)) {
+    JS_FreeValue(ctx, tmp);
+    return JS_EXCEPTION;
+  }
+
+  /* move the statement over to an object with the subclass' prototype */
+  obj = js_sqlitestatement_wrap(ctx, proto, sqlitestmt_dup(JS_GetOpaque(tmp, js_sqlitestatement_class_id)));
+  JS_FreeValue(ctx, proto);
+  JS_FreeValue(ctx, tmp);
+  return obj;
+}
+
+static void
+js_sqlitestatement_finalizer(JSRuntime* rt, JSValue val) {
+  SQLiteStatement* st;
+
+  if((st = JS_GetOpaque(val, js_sqlitestatement_class_id)))
+    sqlitestmt_release(st, rt);
+}
+
+static JSValue
+js_sqlitestatement_self(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  return JS_DupValue(ctx, this_val);
+}
+
+static JSClassDef js_sqlitestatement_class = {
+    .class_name = "SQLite3Statement",
+    .finalizer = js_sqlitestatement_finalizer,
+};
+
+static const JSCFunctionListEntry js_sqlitestatement_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("bind", 0, js_sqlitestatement_method, STATEMENT_BIND),
+    JS_CFUNC_MAGIC_DEF("run", 0, js_sqlitestatement_method, STATEMENT_RUN),
+    JS_CFUNC_MAGIC_DEF("get", 0, js_sqlitestatement_method, STATEMENT_GET),
+    JS_CFUNC_MAGIC_DEF("all", 0, js_sqlitestatement_method, STATEMENT_ALL),
+    JS_CFUNC_MAGIC_DEF("iterate", 0, js_sqlitestatement_method, STATEMENT_ITERATE),
+    JS_CFUNC_MAGIC_DEF("reset", 0, js_sqlitestatement_method, STATEMENT_RESET),
+    JS_CGETSET_MAGIC_FLAGS_DEF("sql", js_sqlitestatement_get, 0, STATEMENT_SQL, JS_PROP_ENUMERABLE),
+    JS_CGETSET_MAGIC_DEF("expandedSql", js_sqlitestatement_get, 0, STATEMENT_EXPANDED_SQL),
+    JS_CGETSET_MAGIC_FLAGS_DEF("paramCount", js_sqlitestatement_get, 0, STATEMENT_PARAM_COUNT, JS_PROP_ENUMERABLE),
+    JS_CGETSET_MAGIC_FLAGS_DEF("columnCount", js_sqlitestatement_get, 0, STATEMENT_COLUMN_COUNT, JS_PROP_ENUMERABLE),
+    JS_CGETSET_MAGIC_DEF("readonly", js_sqlitestatement_get, 0, STATEMENT_READONLY),
+    JS_CGETSET_MAGIC_DEF("busy", js_sqlitestatement_get, 0, STATEMENT_BUSY),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "SQLite3Statement", JS_PROP_CONFIGURABLE),
+};
+
+static const JSCFunctionListEntry js_statementiterator_funcs[] = {
+    JS_CFUNC_DEF("[Symbol.iterator]", 0, js_sqlitestatement_self),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "SQLite3StatementIterator", JS_PROP_CONFIGURABLE),
+};
+
 int
 js_sqlite_init(JSContext* ctx, JSModuleDef* m) {
   JS_NewClassID(&js_sqlite_class_id);
@@ -1279,10 +3132,24 @@ js_sqlite_init(JSContext* ctx, JSModuleDef* m) {
   JS_SetClassProto(ctx, js_sqliteresult_class_id, sqliteresult_proto);
   JS_SetConstructor(ctx, sqliteresult_ctor, sqliteresult_proto);
 
+  JS_NewClassID(&js_sqlitestatement_class_id);
+  JS_NewClass(JS_GetRuntime(ctx), js_sqlitestatement_class_id, &js_sqlitestatement_class);
+
+  sqlitestatement_ctor = JS_NewCFunction2(ctx, js_sqlitestatement_constructor, "SQLite3Statement", 2, JS_CFUNC_constructor, 0);
+  sqlitestatement_proto = JS_NewObject(ctx);
+
+  JS_SetPropertyFunctionList(ctx, sqlitestatement_proto, js_sqlitestatement_funcs, countof(js_sqlitestatement_funcs));
+  JS_SetClassProto(ctx, js_sqlitestatement_class_id, sqlitestatement_proto);
+  JS_SetConstructor(ctx, sqlitestatement_ctor, sqlitestatement_proto);
+
+  statementiterator_proto = JS_NewObject(ctx);
+  JS_SetPropertyFunctionList(ctx, statementiterator_proto, js_statementiterator_funcs, countof(js_statementiterator_funcs));
+
   if(m) {
     JS_SetModuleExport(ctx, m, "SQLite3", sqlite_ctor);
     JS_SetModuleExport(ctx, m, "SQLite3Error", sqliteerror_ctor);
     JS_SetModuleExport(ctx, m, "SQLite3Result", sqliteresult_ctor);
+    JS_SetModuleExport(ctx, m, "SQLite3Statement", sqlitestatement_ctor);
   }
 
   return 0;
@@ -1302,6 +3169,7 @@ JS_INIT_MODULE(JSContext* ctx, const char* module_name) {
     JS_AddModuleExport(ctx, m, "SQLite3");
     JS_AddModuleExport(ctx, m, "SQLite3Error");
     JS_AddModuleExport(ctx, m, "SQLite3Result");
+    JS_AddModuleExport(ctx, m, "SQLite3Statement");
   }
 
   return m;
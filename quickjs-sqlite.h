@@ -19,7 +19,7 @@ sqlite3* js_sqliteresult_handle(JSContext*, JSValueConst);
 int js_sqlite_init(JSContext*, JSModuleDef*);
 JSModuleDef* js_init_module_sqlite(JSContext*, const char* module_name);
 
-extern VISIBLE JSClassID js_sqlite_class_id, js_sqliteresult_class_id;
+extern VISIBLE JSClassID js_sqlite_class_id, js_sqliteresult_class_id, js_sqlitestatement_class_id;
 
 /**
  * @}
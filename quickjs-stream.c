@@ -1089,6 +1089,30 @@ reader_source_pull(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
   return ret;
 }
 
+/**
+ * @brief      Constructs a ReadableStream with `source` as its underlying
+ *             source, for C modules which enqueue their own chunks (e.g.
+ *             views instead of copies) from a pull() closure.
+ *
+ * @param      ctx     The JSContext
+ * @param[in]  source  The underlying source object (ownership transferred)
+ *
+ * @return     A new ReadableStream instance, or JS_EXCEPTION
+ */
+JSValue
+js_readable_stream_from_source(JSContext* ctx, JSValue source) {
+  JSValue stream;
+
+  if(JS_IsUndefined(readable_stream_ctor)) {
+    JS_FreeValue(ctx, source);
+    return JS_ThrowInternalError(ctx, "stream module not initialized");
+  }
+
+  stream = JS_CallConstructor(ctx, readable_stream_ctor, 1, &source);
+  JS_FreeValue(ctx, source);
+  return stream;
+}
+
 /**
  * @brief      Wraps a stream-utils.h Reader as a ReadableStream, pulling
  *             chunk_size bytes at a time into a fresh ArrayBuffer per pull(),
@@ -1107,7 +1131,7 @@ reader_source_pull(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
 JSValue
 js_readable_stream_from_reader(JSContext* ctx, Reader reader, size_t chunk_size) {
   ReaderSource* rs;
-  JSValue pull_fn, source, args[1], stream;
+  JSValue pull_fn, source;
 
   if(JS_IsUndefined(readable_stream_ctor)) {
     reader_free(&reader);
@@ -1127,10 +1151,7 @@ js_readable_stream_from_reader(JSContext* ctx, Reader reader, size_t chunk_size)
   source = JS_NewObject(ctx);
   JS_SetPropertyStr(ctx, source, "pull", pull_fn);
 
-  args[0] = source;
-  stream = JS_CallConstructor(ctx, readable_stream_ctor, 1, args);
-  JS_FreeValue(ctx, source);
-  return stream;
+  return js_readable_stream_from_source(ctx, source);
 }
 
 /* ReadableStream.fromReader(source, chunkSize): dispatches `source` through
@@ -17,6 +17,11 @@ JSModuleDef* js_init_module_stream(JSContext*, const char*);
  * without writing their own pull-loop shim. Takes ownership of `reader`. */
 VISIBLE JSValue js_readable_stream_from_reader(JSContext*, Reader, size_t chunk_size);
 
+/* Constructs a ReadableStream over an underlying source object with a
+ * pull(controller) method, for modules enqueuing their own chunks. Takes
+ * ownership of `source`. */
+VISIBLE JSValue js_readable_stream_from_source(JSContext*, JSValue source);
+
 /**
  * @}
  */
@@ -2,6 +2,7 @@
 #include "char-utils.h"
 #include "buffer-utils.h"
 #include "utils.h"
+#include <errno.h>
 #ifdef _WIN32
 #include <windows.h>
 #elif defined(HAVE_TERMIOS_H)
@@ -633,6 +634,35 @@ block_free(MemoryBlock* mb, JSRuntime* rt) {
   }
 }
 
+/* maps all of 'fd', an empty file gives an empty block. private mappings
+ * are copy-on-write, writing to them doesn't touch the file */
+int
+block_mmap_fd(MemoryBlock* mb, int fd, BOOL shared) {
+#if defined(HAVE_FSTAT) && !defined(_WIN32)
+  struct stat st;
+  void* ptr;
+
+  block_zero(mb);
+
+  if(fstat(fd, &st) == -1)
+    return -1;
+
+  if(st.st_size == 0)
+    return 0;
+
+  if((ptr = mmap(0, st.st_size, PROT_READ | (shared ? 0 : PROT_WRITE), shared ? MAP_SHARED : MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+    return -1;
+
+  mb->base = ptr;
+  mb->size = st.st_size;
+  return 0;
+#else
+  block_zero(mb);
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
 MemoryBlock
 block_mmap(const char* filename, BOOL shared) {
   MemoryBlock mb = BLOCK_INIT();
@@ -641,13 +671,7 @@ block_mmap(const char* filename, BOOL shared) {
   int fd;
 
   if((fd = open(filename, O_RDONLY)) != -1) {
-    struct stat st;
-
-    if(fstat(fd, &st) != -1) {
-      mb.size = st.st_size;
-      if((mb.base = mmap(0, mb.size, PROT_READ, shared ? MAP_SHARED : MAP_PRIVATE, fd, 0)) == (void*)-1)
-        mb.base = 0;
-    }
+    block_mmap_fd(&mb, fd, shared);
     close(fd);
   }
 #else
@@ -659,7 +683,9 @@ block_mmap(const char* filename, BOOL shared) {
 
 void
 block_munmap(MemoryBlock* mb) {
-  munmap(mb->base, mb->size);
+  if(mb->base)
+    munmap(mb->base, mb->size);
+
   mb->base = 0;
   mb->size = 0;
 }
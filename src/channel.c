@@ -0,0 +1,284 @@
+#define _GNU_SOURCE
+#include "channel.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+/**
+ * \addtogroup channel
+ * @{
+ */
+
+/* Channels are shared by name between all runtimes (threads) of the process.
+ * The registry is only touched on open/free, so a spinlock will do. */
+static Channel* channel_list = 0;
+static atomic_flag channel_lock = ATOMIC_FLAG_INIT;
+
+static inline void
+channel_registry_lock(void) {
+  while(atomic_flag_test_and_set_explicit(&channel_lock, memory_order_acquire))
+    ;
+}
+
+static inline void
+channel_registry_unlock(void) {
+  atomic_flag_clear_explicit(&channel_lock, memory_order_release);
+}
+
+static size_t
+channel_roundup(size_t n) {
+  size_t r = 2;
+
+  while(r < n)
+    r <<= 1;
+
+  return r;
+}
+
+static Channel*
+channel_new(const char* name, size_t capacity, int spsc) {
+  Channel* chan;
+  size_t size = channel_roundup(capacity);
+
+  if(posix_memalign((void**)&chan, 64, sizeof(Channel) + size * sizeof(ChannelSlot)))
+    return 0;
+
+  memset(chan, 0, sizeof(Channel));
+
+  if(!(chan->name = strdup(name))) {
+    free(chan);
+    return 0;
+  }
+
+  chan->capacity = size;
+  chan->mask = size - 1;
+  chan->spsc = !!spsc;
+
+  for(size_t i = 0; i < size; i++) {
+    atomic_init(&chan->slots[i].seq, i);
+    chan->slots[i].chunk = 0;
+  }
+
+  atomic_init(&chan->ref_count, 1);
+  atomic_init(&chan->closed, 0);
+  atomic_init(&chan->waiting_recv, 0);
+  atomic_init(&chan->waiting_send, 0);
+  atomic_init(&chan->head, 0);
+  atomic_init(&chan->tail, 0);
+
+  chan->fd_recv = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  chan->fd_send = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  if(chan->fd_recv == -1 || chan->fd_send == -1) {
+    int err = errno;
+
+    if(chan->fd_recv != -1)
+      close(chan->fd_recv);
+    if(chan->fd_send != -1)
+      close(chan->fd_send);
+
+    free(chan->name);
+    free(chan);
+    errno = err;
+    return 0;
+  }
+
+  return chan;
+}
+
+/* returns the channel called 'name', creating it when it doesn't exist yet.
+ * 'capacity' and 'spsc' only apply on creation. */
+Channel*
+channel_open(const char* name, size_t capacity, int spsc) {
+  Channel* chan;
+
+  channel_registry_lock();
+
+  for(chan = channel_list; chan; chan = chan->next)
+    if(!strcmp(chan->name, name))
+      break;
+
+  if(chan)
+    channel_dup(chan);
+  else if((chan = channel_new(name, capacity, spsc))) {
+    chan->next = channel_list;
+    channel_list = chan;
+  }
+
+  channel_registry_unlock();
+
+  return chan;
+}
+
+Channel*
+channel_dup(Channel* chan) {
+  atomic_fetch_add_explicit(&chan->ref_count, 1, memory_order_relaxed);
+  return chan;
+}
+
+void
+channel_free(Channel* chan) {
+  Channel** ptr;
+
+  channel_registry_lock();
+
+  /* the count is only ever raised from 0 under the lock (in channel_open) */
+  if(atomic_fetch_sub_explicit(&chan->ref_count, 1, memory_order_acq_rel) > 1) {
+    channel_registry_unlock();
+    return;
+  }
+
+  for(ptr = &channel_list; *ptr; ptr = &(*ptr)->next)
+    if(*ptr == chan) {
+      *ptr = chan->next;
+      break;
+    }
+
+  channel_registry_unlock();
+
+  for(size_t i = 0; i < chan->capacity; i++)
+    if(chan->slots[i].chunk)
+      chunk_free(chan->slots[i].chunk);
+
+  close(chan->fd_recv);
+  close(chan->fd_send);
+  free(chan->name);
+  free(chan);
+}
+
+void
+channel_signal(int fd) {
+  uint64_t one = 1;
+
+  /* EAGAIN means the counter is saturated, which still wakes everyone */
+  while(write(fd, &one, sizeof(one)) == -1 && errno == EINTR)
+    ;
+}
+
+void
+channel_drain(int fd) {
+  uint64_t count;
+
+  while(read(fd, &count, sizeof(count)) == sizeof(count))
+    ;
+}
+
+/* enqueues 'chunk', handing its reference over to the channel.
+ * returns 0 on success, -1 with errno EAGAIN when full, EPIPE when closed */
+int
+channel_send(Channel* chan, Chunk* chunk, int type) {
+  ChannelSlot* slot;
+  size_t pos, seq;
+
+  if(channel_closed(chan)) {
+    errno = EPIPE;
+    return -1;
+  }
+
+  pos = atomic_load_explicit(&chan->head, memory_order_relaxed);
+
+  for(;;) {
+    ptrdiff_t diff;
+
+    slot = &chan->slots[pos & chan->mask];
+    seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    diff = (ptrdiff_t)seq - (ptrdiff_t)pos;
+
+    if(diff == 0) {
+      if(chan->spsc) {
+        atomic_store_explicit(&chan->head, pos + 1, memory_order_relaxed);
+        break;
+      }
+
+      if(atomic_compare_exchange_weak_explicit(&chan->head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+        break;
+    } else if(diff < 0) {
+      errno = EAGAIN;
+      return -1;
+    } else {
+      pos = atomic_load_explicit(&chan->head, memory_order_relaxed);
+    }
+  }
+
+  slot->chunk = chunk;
+  slot->type = type;
+  atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+
+  /* pairs with the fence after a receiver announced itself waiting */
+  atomic_thread_fence(memory_order_seq_cst);
+
+  if(atomic_load_explicit(&chan->waiting_recv, memory_order_relaxed) > 0)
+    channel_signal(chan->fd_recv);
+
+  return 0;
+}
+
+/* dequeues the oldest message, the caller owns the returned reference.
+ * returns NULL with errno EAGAIN when empty, EPIPE when closed and empty */
+Chunk*
+channel_recv(Channel* chan, int* type) {
+  ChannelSlot* slot;
+  Chunk* chunk;
+  size_t pos, seq;
+
+  pos = atomic_load_explicit(&chan->tail, memory_order_relaxed);
+
+  for(;;) {
+    ptrdiff_t diff;
+
+    slot = &chan->slots[pos & chan->mask];
+    seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    diff = (ptrdiff_t)seq - (ptrdiff_t)(pos + 1);
+
+    if(diff == 0) {
+      if(chan->spsc) {
+        atomic_store_explicit(&chan->tail, pos + 1, memory_order_relaxed);
+        break;
+      }
+
+      if(atomic_compare_exchange_weak_explicit(&chan->tail, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+        break;
+    } else if(diff < 0) {
+      errno = channel_closed(chan) ? EPIPE : EAGAIN;
+      return 0;
+    } else {
+      pos = atomic_load_explicit(&chan->tail, memory_order_relaxed);
+    }
+  }
+
+  chunk = slot->chunk;
+  slot->chunk = 0;
+
+  if(type)
+    *type = slot->type;
+
+  atomic_store_explicit(&slot->seq, pos + chan->mask + 1, memory_order_release);
+
+  atomic_thread_fence(memory_order_seq_cst);
+
+  if(atomic_load_explicit(&chan->waiting_send, memory_order_relaxed) > 0)
+    channel_signal(chan->fd_send);
+
+  /* another receiver may have consumed the wakeup meant for this message */
+  if(atomic_load_explicit(&chan->waiting_recv, memory_order_relaxed) > 0 && channel_size(chan) > 0)
+    channel_signal(chan->fd_recv);
+
+  return chunk;
+}
+
+/* marks the channel closed: queued messages can still be received,
+ * further sends fail and all waiters get woken up */
+void
+channel_close(Channel* chan) {
+  if(atomic_exchange_explicit(&chan->closed, 1, memory_order_acq_rel))
+    return;
+
+  channel_signal(chan->fd_recv);
+  channel_signal(chan->fd_send);
+}
+
+/**
+ * @}
+ */
@@ -36,6 +36,18 @@
 #ifdef HAVE_SYS_WAIT_H
 #include <sys/wait.h>
 #endif
+#ifdef HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/* glibc declares P_PIDFD in an enum (2.36+), others not at all */
+#if defined(__linux__) && defined(HAVE_SYS_WAIT_H) && defined(SYS_pidfd_open)
+#define HAVE_WAITID_PIDFD 1
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+#endif
 
 /* If WIFEXITED(STATUS), the low-order 8 bits of the status.  */
 #ifndef WEXITSTATUS
@@ -106,8 +118,50 @@ child_process_signalcode(JSContext* ctx, ChildProcess* cp) {
   return JS_NULL;
 }
 
+/* { exitCode, signalCode } */
+JSValue
+child_process_exitstatus(JSContext* ctx, ChildProcess* cp) {
+  JSValue ret = JS_NewObjectProto(ctx, JS_NULL);
+
+  JS_SetPropertyStr(ctx, ret, "exitCode", child_process_exitcode(ctx, cp));
+  JS_SetPropertyStr(ctx, ret, "signalCode", child_process_signalcode(ctx, cp));
+  return ret;
+}
+
+/* returns a promise for the exit status */
+JSValue
+child_process_done(JSContext* ctx, ChildProcess* cp) {
+  if(cp->exited || cp->signaled) {
+    JSValue status = child_process_exitstatus(ctx, cp);
+    JSValue ret = js_promise_resolve(ctx, status);
+
+    JS_FreeValue(ctx, status);
+    return ret;
+  }
+
+  if(JS_IsUndefined(cp->done)) {
+    JSValue resolving_funcs[2];
+
+    cp->done = js_promise_new(ctx, resolving_funcs);
+    cp->done_resolve = resolving_funcs[0];
+    JS_FreeValue(ctx, resolving_funcs[1]);
+  }
+
+  return JS_DupValue(ctx, cp->done);
+}
+
 void
 child_process_notify(JSContext* ctx, ChildProcess* cp) {
+  if(!JS_IsUndefined(cp->done_resolve)) {
+    JSValue status = child_process_exitstatus(ctx, cp);
+    JSValue ret = JS_Call(ctx, cp->done_resolve, JS_UNDEFINED, 1, &status);
+
+    JS_FreeValue(ctx, ret);
+    JS_FreeValue(ctx, status);
+    JS_FreeValue(ctx, cp->done_resolve);
+    cp->done_resolve = JS_UNDEFINED;
+  }
+
   if(js_is_null_or_undefined(cp->onexit))
     return;
 
@@ -121,19 +175,20 @@ child_process_notify(JSContext* ctx, ChildProcess* cp) {
   JS_FreeValue(ctx, signalcode);
 }
 
+/* Fallback where pidfds are unavailable. Only our own children are waited
+ * for, waitpid(-1) would steal exit statuses from other code. */
 static JSValue
 child_process_sigchld(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
 #ifdef HAVE_WAITPID
-  int status = 0, pid;
-  ChildProcess* cp;
-
-  if((pid = waitpid(-1, &status, WNOHANG)) != -1)
-    if((cp = child_process_get(pid))) {
-      if(child_process_status(cp, status)) {
-        child_process_remove(cp, ctx);
-        child_process_notify(ctx, cp);
-      }
-    }
+  struct list_head *el, *next;
+
+  list_for_each_safe(el, next, &child_process_list) {
+    ChildProcess* cp = list_entry(el, ChildProcess, link);
+
+    /* children with a pidfd are reaped from its read handler */
+    if(cp->pidfd == -1)
+      child_process_reap(cp, ctx);
+  }
 
   return JS_UNDEFINED;
 #else
@@ -141,6 +196,16 @@ child_process_sigchld(JSContext* ctx, JSValueConst this_val, int argc, JSValueCo
 #endif
 }
 
+void
+child_process_sigchld_handler(JSContext* ctx) {
+  if(!child_process_handler) {
+    JSValue fn = JS_NewCFunction(ctx, child_process_sigchld, "sigchld", 0);
+    child_process_signal(ctx, fn);
+    JS_FreeValue(ctx, fn);
+    child_process_handler = TRUE;
+  }
+}
+
 ChildProcess*
 child_process_get(int pid) {
   struct list_head* el;
@@ -171,19 +236,15 @@ child_process_new(JSContext* ctx) {
 
     child->uid = -1;
     child->gid = -1;
+    child->pidfd = -1;
 
     child->num_fds = 0;
 
     child->child_fds = child->parent_fds = child->pipe_fds = NULL;
 
     child->onexit = JS_UNDEFINED;
-
-    if(!child_process_handler) {
-      JSValue fn = JS_NewCFunction(ctx, child_process_sigchld, "sigchld", 0);
-      child_process_signal(ctx, fn);
-      JS_FreeValue(ctx, fn);
-      child_process_handler = TRUE;
-    }
+    child->done = JS_UNDEFINED;
+    child->done_resolve = JS_UNDEFINED;
   }
 
   return child;
@@ -191,9 +252,13 @@ child_process_new(JSContext* ctx) {
 
 void
 child_process_remove(ChildProcess* cp, JSContext* ctx) {
+  /* may already have been removed by whoever reaped it first */
+  if(!cp->link.next)
+    return;
+
   list_del(&cp->link);
 
-  if(list_empty(&child_process_list)) {
+  if(list_empty(&child_process_list) && child_process_handler) {
     child_process_signal(ctx, JS_NULL);
     child_process_handler = FALSE;
   }
@@ -386,7 +451,14 @@ child_process_spawn(ChildProcess* cp) {
 
   list_add_tail(&cp->link, &child_process_list);
 
-  return cp->pid = pid;
+  cp->pid = pid;
+
+#ifndef _WIN32
+  /* before the event loop runs, so nobody can have reaped it yet */
+  child_process_pidfd(cp);
+#endif
+
+  return pid;
 }
 
 bool
@@ -469,6 +541,84 @@ child_process_kill(ChildProcess* cp, int signum) {
 #endif
 }
 
+/* returns a pidfd for the child (opened on first use), which becomes
+ * readable once the child terminates, or -1 if unsupported */
+int
+child_process_pidfd(ChildProcess* cp) {
+#ifdef SYS_pidfd_open
+  if(cp->pidfd == -1 && cp->pid > 0 && !cp->exited && !cp->signaled)
+    cp->pidfd = syscall(SYS_pidfd_open, (pid_t)cp->pid, 0);
+
+  return cp->pidfd;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+/* the child has been reaped by someone else (e.g. os.waitpid(-1)), so its
+ * exit status is unknown: settle with exitCode and signalCode null */
+void
+child_process_lost(ChildProcess* cp, JSContext* ctx) {
+  if(cp->exited || cp->signaled)
+    return;
+
+  cp->exited = true;
+  cp->exitcode = -1;
+  child_process_remove(cp, ctx);
+  child_process_notify(ctx, cp);
+}
+
+#ifdef HAVE_WAITID_PIDFD
+/* waitid() on the pidfd, which can't mistake a recycled pid for the child */
+static int
+child_process_waitid(ChildProcess* cp) {
+  siginfo_t info;
+
+  memset(&info, 0, sizeof(info));
+
+  /* EINVAL before Linux 5.4, then waitpid() it is */
+  if(waitid(P_PIDFD, cp->pidfd, &info, WEXITED | WNOHANG) == -1)
+    return errno == EINVAL ? child_process_wait(cp, WNOHANG) : -1;
+
+  if(info.si_pid == 0)
+    return 0;
+
+  /* encoded as waitpid() does */
+  child_process_status(cp, info.si_code == CLD_EXITED ? (info.si_status & 0xff) << 8 : (info.si_status & 0x7f) | (info.si_code == CLD_DUMPED ? 0x80 : 0));
+  return cp->pid;
+}
+#endif
+
+/* collects the exit status without blocking and fires onExit.
+ * returns true once the child has terminated */
+bool
+child_process_reap(ChildProcess* cp, JSContext* ctx) {
+  int pid;
+
+  if(cp->exited || cp->signaled)
+    return true;
+
+#ifdef HAVE_WAITID_PIDFD
+  if(cp->pidfd != -1)
+    pid = child_process_waitid(cp);
+  else
+#endif
+    pid = child_process_wait(cp, WNOHANG);
+
+  if(pid == -1 && errno == ECHILD) {
+    child_process_lost(cp, ctx);
+    return true;
+  }
+
+  if(pid != cp->pid || !(cp->exited || cp->signaled))
+    return false;
+
+  child_process_remove(cp, ctx);
+  child_process_notify(ctx, cp);
+  return true;
+}
+
 void
 child_process_free(ChildProcess* cp, JSContext* ctx) {
   child_process_free_rt(cp, JS_GetRuntime(ctx));
@@ -510,7 +660,12 @@ child_process_free_rt(ChildProcess* cp, JSRuntime* rt) {
   if(cp->pipe_fds)
     js_free_rt(rt, cp->pipe_fds);
 
+  if(cp->pidfd != -1)
+    close(cp->pidfd);
+
   JS_FreeValueRT(rt, cp->onexit);
+  JS_FreeValueRT(rt, cp->done);
+  JS_FreeValueRT(rt, cp->done_resolve);
 
   js_free_rt(rt, cp);
 }
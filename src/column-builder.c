@@ -0,0 +1,370 @@
+#include "column-builder.h"
+#include "buffer-utils.h"
+#include "utils.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * \addtogroup column-builder
+ * @{
+ */
+
+static const int column_bits[] = {
+    [COLUMN_KIND_EMPTY] = 0,
+    [COLUMN_KIND_INT32] = 32,
+    [COLUMN_KIND_INT64] = 64,
+    [COLUMN_KIND_FLOAT64] = 64,
+    [COLUMN_KIND_TEXT] = 0,
+};
+
+static inline int
+column_put_u32(DynBuf* db, uint32_t v) {
+  return dbuf_put(db, (const uint8_t*)&v, sizeof(v));
+}
+
+static inline int
+column_put_u64(DynBuf* db, uint64_t v) {
+  return dbuf_put(db, (const uint8_t*)&v, sizeof(v));
+}
+
+static void
+column_buffer_free(JSRuntime* rt, void* opaque, void* ptr) {
+  js_free_rt(rt, ptr);
+}
+
+static inline BOOL
+column_is_null(ColumnBuilder* cb, uint32_t row) {
+  return cb->has_nulls && cb->nulls.buf[row];
+}
+
+static double
+column_float64_at(ColumnBuilder* cb, uint32_t row) {
+  if(column_is_null(cb, row))
+    return NAN;
+
+  switch(cb->kind) {
+    case COLUMN_KIND_INT32: return ((int32_t*)cb->values.buf)[row];
+    case COLUMN_KIND_INT64: return ((int64_t*)cb->values.buf)[row];
+    case COLUMN_KIND_FLOAT64: return ((double*)cb->values.buf)[row];
+    default: return NAN;
+  }
+}
+
+static size_t
+column_format_float64(char* buf, size_t len, double d) {
+  size_t n = snprintf(buf, len, "%.15g", d);
+
+  /* use the shortest representation that reads back the same */
+  if(strtod(buf, 0) != d)
+    n = snprintf(buf, len, "%.17g", d);
+
+  return n;
+}
+
+static size_t
+column_format(char* buf, size_t len, ColumnBuilder* cb, uint32_t row) {
+  if(column_is_null(cb, row))
+    return 0;
+
+  switch(cb->kind) {
+    case COLUMN_KIND_INT32: return snprintf(buf, len, "%" PRId32, ((int32_t*)cb->values.buf)[row]);
+    case COLUMN_KIND_INT64: return snprintf(buf, len, "%" PRId64, ((int64_t*)cb->values.buf)[row]);
+    case COLUMN_KIND_FLOAT64: return column_format_float64(buf, len, ((double*)cb->values.buf)[row]);
+    default: return 0;
+  }
+}
+
+/* converts everything collected so far to the wider representation 'kind' */
+static int
+column_widen(ColumnBuilder* cb, ColumnKind kind) {
+  DynBuf values;
+  uint32_t i;
+
+  if(kind == cb->kind)
+    return 0;
+
+  dbuf_init2(&values, cb->values.opaque, cb->values.realloc_func);
+
+  for(i = 0; i < cb->rows; i++) {
+    switch(kind) {
+      case COLUMN_KIND_INT64: {
+        int64_t v = cb->kind == COLUMN_KIND_INT32 ? ((int32_t*)cb->values.buf)[i] : 0;
+
+        dbuf_put(&values, (const uint8_t*)&v, sizeof(v));
+        break;
+      }
+
+      case COLUMN_KIND_FLOAT64: {
+        double d = column_float64_at(cb, i);
+
+        dbuf_put(&values, (const uint8_t*)&d, sizeof(d));
+        break;
+      }
+
+      case COLUMN_KIND_TEXT: {
+        char buf[32];
+        size_t n = column_format(buf, sizeof(buf), cb, i);
+
+        if(i == 0)
+          column_put_u32(&cb->offsets, 0);
+
+        dbuf_put(&cb->bytes, (const uint8_t*)buf, n);
+        column_put_u32(&cb->offsets, cb->bytes.size);
+        break;
+      }
+
+      default: {
+        int32_t v = 0;
+
+        dbuf_put(&values, (const uint8_t*)&v, sizeof(v));
+        break;
+      }
+    }
+  }
+
+  if(kind == COLUMN_KIND_TEXT && cb->rows == 0)
+    column_put_u32(&cb->offsets, 0);
+
+  if(values.error || cb->offsets.error || cb->bytes.error) {
+    dbuf_free(&values);
+    return -1;
+  }
+
+  dbuf_free(&cb->values);
+  cb->values = values;
+  cb->kind = kind;
+  return 0;
+}
+
+static int
+column_mark(ColumnBuilder* cb, BOOL null) {
+  if(null && !cb->has_nulls) {
+    if(cb->rows) {
+      if(!dbuf_reserve(&cb->nulls, cb->rows))
+        return -1;
+
+      memset(cb->nulls.buf, 0, cb->rows);
+      cb->nulls.size = cb->rows;
+    }
+
+    cb->has_nulls = TRUE;
+  }
+
+  if(cb->has_nulls)
+    if(dbuf_putc(&cb->nulls, null))
+      return -1;
+
+  cb->rows++;
+  return 0;
+}
+
+void
+column_init(ColumnBuilder* cb, JSContext* ctx) {
+  memset(cb, 0, sizeof(ColumnBuilder));
+
+  dbuf_init_ctx(ctx, &cb->values);
+  dbuf_init_ctx(ctx, &cb->offsets);
+  dbuf_init_ctx(ctx, &cb->bytes);
+  dbuf_init_ctx(ctx, &cb->nulls);
+}
+
+/* starts a new batch, the storage type is kept so batches stay alike */
+void
+column_reset(ColumnBuilder* cb) {
+  cb->rows = 0;
+  cb->has_nulls = FALSE;
+  cb->values.size = 0;
+  cb->offsets.size = 0;
+  cb->bytes.size = 0;
+  cb->nulls.size = 0;
+
+  if(cb->kind == COLUMN_KIND_TEXT)
+    column_put_u32(&cb->offsets, 0);
+}
+
+void
+column_free(ColumnBuilder* cb) {
+  dbuf_free(&cb->values);
+  dbuf_free(&cb->offsets);
+  dbuf_free(&cb->bytes);
+  dbuf_free(&cb->nulls);
+}
+
+int
+column_put_null(ColumnBuilder* cb) {
+  switch(cb->kind) {
+    case COLUMN_KIND_EMPTY: break;
+    case COLUMN_KIND_INT32: column_put_u32(&cb->values, 0); break;
+    case COLUMN_KIND_INT64: column_put_u64(&cb->values, 0); break;
+    case COLUMN_KIND_FLOAT64: {
+      double d = NAN;
+
+      dbuf_put(&cb->values, (const uint8_t*)&d, sizeof(d));
+      break;
+    }
+    case COLUMN_KIND_TEXT: column_put_u32(&cb->offsets, cb->bytes.size); break;
+  }
+
+  if(cb->values.error || cb->offsets.error)
+    return -1;
+
+  return column_mark(cb, TRUE);
+}
+
+int
+column_put_int64(ColumnBuilder* cb, int64_t v) {
+  if(cb->kind == COLUMN_KIND_EMPTY || (cb->kind == COLUMN_KIND_INT32 && (v < INT32_MIN || v > INT32_MAX)))
+    if(column_widen(cb, v >= INT32_MIN && v <= INT32_MAX ? COLUMN_KIND_INT32 : COLUMN_KIND_INT64))
+      return -1;
+
+  switch(cb->kind) {
+    case COLUMN_KIND_INT32: column_put_u32(&cb->values, (uint32_t)(int32_t)v); break;
+    case COLUMN_KIND_INT64: column_put_u64(&cb->values, (uint64_t)v); break;
+    case COLUMN_KIND_FLOAT64: return column_put_float64(cb, (double)v);
+    case COLUMN_KIND_TEXT: {
+      char buf[32];
+
+      return column_put_text(cb, buf, snprintf(buf, sizeof(buf), "%" PRId64, v), FALSE);
+    }
+    default: break;
+  }
+
+  if(cb->values.error)
+    return -1;
+
+  return column_mark(cb, FALSE);
+}
+
+int
+column_put_float64(ColumnBuilder* cb, double d) {
+  if(cb->kind != COLUMN_KIND_TEXT && cb->kind != COLUMN_KIND_FLOAT64)
+    if(column_widen(cb, COLUMN_KIND_FLOAT64))
+      return -1;
+
+  if(cb->kind == COLUMN_KIND_TEXT) {
+    char buf[32];
+
+    return column_put_text(cb, buf, column_format_float64(buf, sizeof(buf), d), FALSE);
+  }
+
+  if(dbuf_put(&cb->values, (const uint8_t*)&d, sizeof(d)))
+    return -1;
+
+  return column_mark(cb, FALSE);
+}
+
+int
+column_put_text(ColumnBuilder* cb, const void* data, size_t len, BOOL binary) {
+  if(cb->kind != COLUMN_KIND_TEXT)
+    if(column_widen(cb, COLUMN_KIND_TEXT))
+      return -1;
+
+  if(binary)
+    cb->binary = TRUE;
+
+  if(cb->bytes.size + len > UINT32_MAX)
+    return -1;
+
+  if(len)
+    dbuf_put(&cb->bytes, data, len);
+
+  column_put_u32(&cb->offsets, cb->bytes.size);
+
+  if(cb->bytes.error || cb->offsets.error)
+    return -1;
+
+  return column_mark(cb, FALSE);
+}
+
+/* stores the textual representation of a number (as returned by the text
+ * protocols of libpq and libmysqlclient) as integer or double */
+int
+column_put_number(ColumnBuilder* cb, const char* str, size_t len) {
+  char buf[64], *end;
+
+  if(len > 0 && len < sizeof(buf) && cb->kind != COLUMN_KIND_TEXT) {
+    memcpy(buf, str, len);
+    buf[len] = '\0';
+
+    if(cb->kind != COLUMN_KIND_FLOAT64) {
+      long long v;
+
+      errno = 0;
+      v = strtoll(buf, &end, 10);
+
+      if(end == buf + len && errno == 0)
+        return column_put_int64(cb, v);
+    }
+
+    double d = strtod(buf, &end);
+
+    if(end == buf + len)
+      return column_put_float64(cb, d);
+  }
+
+  return column_put_text(cb, str, len, FALSE);
+}
+
+static JSValue
+column_buffer(JSContext* ctx, DynBuf* db) {
+  JSValue buf = JS_NewArrayBuffer(ctx, db->buf, db->size, column_buffer_free, 0, FALSE);
+
+  /* the memory now belongs to the ArrayBuffer */
+  if(!JS_IsException(buf))
+    dbuf_init2(db, db->opaque, db->realloc_func);
+
+  return buf;
+}
+
+static JSValue
+column_typedarray(JSContext* ctx, DynBuf* db, int bits, BOOL floating, BOOL sign) {
+  JSValue ret, buf = column_buffer(ctx, db);
+
+  if(JS_IsException(buf))
+    return buf;
+
+  ret = js_typedarray_new(ctx, bits, floating, sign, buf);
+  JS_FreeValue(ctx, buf);
+  return ret;
+}
+
+/* returns the batch as typed array, integer columns containing NULLs as
+ * Float64Array with NaN in their place. Text and blob columns turn into
+ * { offsets: Uint32Array, bytes: Uint8Array, nulls?: Uint8Array }, where
+ * value i is bytes[offsets[i]] up to bytes[offsets[i + 1]]. Afterwards the
+ * builder is reset for the next batch. */
+JSValue
+column_value(ColumnBuilder* cb, JSContext* ctx) {
+  JSValue ret;
+
+  if(cb->kind == COLUMN_KIND_EMPTY || (cb->has_nulls && (cb->kind == COLUMN_KIND_INT32 || cb->kind == COLUMN_KIND_INT64)))
+    if(column_widen(cb, COLUMN_KIND_FLOAT64))
+      return JS_ThrowOutOfMemory(ctx);
+
+  if(cb->kind == COLUMN_KIND_TEXT) {
+    ret = JS_NewObjectProto(ctx, JS_NULL);
+
+    JS_SetPropertyStr(ctx, ret, "offsets", column_typedarray(ctx, &cb->offsets, 32, FALSE, FALSE));
+    JS_SetPropertyStr(ctx, ret, "bytes", column_typedarray(ctx, &cb->bytes, 8, FALSE, FALSE));
+
+    if(cb->has_nulls)
+      JS_SetPropertyStr(ctx, ret, "nulls", column_typedarray(ctx, &cb->nulls, 8, FALSE, FALSE));
+
+    if(cb->binary)
+      JS_SetPropertyStr(ctx, ret, "binary", JS_TRUE);
+
+  } else {
+    ret = column_typedarray(ctx, &cb->values, column_bits[cb->kind], cb->kind == COLUMN_KIND_FLOAT64, TRUE);
+  }
+
+  column_reset(cb);
+  return ret;
+}
+
+/**
+ * @}
+ */
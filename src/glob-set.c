@@ -0,0 +1,653 @@
+#include "glob-set.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * \addtogroup glob-set
+ * @{
+ */
+
+/* upper limit of '{a,b}' and '**' alternatives per pattern */
+#define GLOBSET_MAX_EXPANSION 1024
+#define GLOBSET_STACK_STATES 256
+
+enum {
+  GLOBSET_ROOT = 0,
+  GLOBSET_CHAR,
+  GLOBSET_ANY,
+  GLOBSET_CLASS,
+  GLOBSET_STAR,
+  GLOBSET_DEEP,
+  /* '**' followed by '/', only in token lists: either nothing or
+   * GLOBSET_DEEP followed by a '/' */
+  GLOBSET_DIRS,
+};
+
+/* roots of the main trie */
+enum {
+  GLOBSET_PATH = 0,
+  GLOBSET_BASE = 1,
+};
+
+typedef struct {
+  uint8_t op, c;
+  uint8_t set[32];
+} GlobToken;
+
+/* 'op' describes the edge leading into the node. STAR and DEEP children
+ * are entered without consuming input, after which the node loops */
+typedef struct {
+  uint8_t op, c, stars;
+  uint32_t cls;
+  uint32_t child, next;
+  uint32_t accept;
+} GlobNode;
+
+typedef struct {
+  uint32_t id, next;
+} GlobLink;
+
+typedef struct {
+  GlobNode* nodes;
+  uint32_t size, capacity;
+} GlobTrie;
+
+struct glob_set {
+  GlobTrie trie, suffix;
+  GlobLink* links;
+  uint32_t num_links, cap_links;
+  uint8_t (*classes)[32];
+  uint32_t num_classes, cap_classes;
+  uint32_t count, expansions;
+};
+
+/* scratch state of a match, two sparse sets over the trie nodes */
+typedef struct {
+  uint32_t *cur, *next, *mark;
+  uint32_t ncur, nnext, gen;
+} GlobRun;
+
+static int
+globset_reserve(void** ptr, uint32_t* capacity, uint32_t n, size_t size) {
+  uint32_t c = *capacity ? *capacity : 16;
+  void* p;
+
+  if(n <= *capacity)
+    return 0;
+
+  while(c < n)
+    c *= 2;
+
+  if(!(p = realloc(*ptr, c * size)))
+    return -1;
+
+  *ptr = p;
+  *capacity = c;
+  return 0;
+}
+
+static uint32_t
+trie_node(GlobTrie* t, uint8_t op, uint8_t c) {
+  if(globset_reserve((void**)&t->nodes, &t->capacity, t->size + 1, sizeof(GlobNode)))
+    return 0;
+
+  t->nodes[t->size] = (GlobNode){.op = op, .c = c};
+  return t->size++;
+}
+
+/* returns the child of 'parent' for 'tok', created if necessary, 0 on error */
+static uint32_t
+trie_child(GlobSet* s, GlobTrie* t, uint32_t parent, const GlobToken* tok) {
+  uint32_t i;
+
+  for(i = t->nodes[parent].child; i; i = t->nodes[i].next) {
+    GlobNode* n = &t->nodes[i];
+
+    if(n->op == tok->op && n->c == tok->c && (n->op != GLOBSET_CLASS || !memcmp(s->classes[n->cls], tok->set, 32)))
+      return i;
+  }
+
+  if(!(i = trie_node(t, tok->op, tok->c)))
+    return 0;
+
+  if(tok->op == GLOBSET_CLASS) {
+    if(globset_reserve((void**)&s->classes, &s->cap_classes, s->num_classes + 1, 32))
+      return 0;
+
+    memcpy(s->classes[s->num_classes], tok->set, 32);
+    t->nodes[i].cls = s->num_classes++;
+  }
+
+  t->nodes[i].next = t->nodes[parent].child;
+  t->nodes[parent].child = i;
+
+  if(tok->op == GLOBSET_STAR || tok->op == GLOBSET_DEEP)
+    t->nodes[parent].stars = 1;
+
+  return i;
+}
+
+static int
+trie_accept(GlobSet* s, GlobTrie* t, uint32_t node, uint32_t id) {
+  uint32_t i;
+
+  for(i = t->nodes[node].accept; i; i = s->links[i].next)
+    if(s->links[i].id == id)
+      return 0;
+
+  /* link 0 terminates the lists */
+  if(globset_reserve((void**)&s->links, &s->cap_links, (s->num_links ? s->num_links : 1) + 1, sizeof(GlobLink)))
+    return -1;
+
+  if(s->num_links == 0)
+    s->num_links = 1;
+
+  s->links[s->num_links] = (GlobLink){id, t->nodes[node].accept};
+  t->nodes[node].accept = s->num_links++;
+  return 0;
+}
+
+GlobSet*
+globset_new(void) {
+  GlobSet* s;
+
+  if(!(s = calloc(1, sizeof(GlobSet))))
+    return 0;
+
+  /* node 0 of the main trie is the root of path patterns, node 1 the one
+   * of name patterns. node 0 of the suffix trie is its root */
+  if(trie_node(&s->trie, GLOBSET_ROOT, 0) != GLOBSET_PATH || trie_node(&s->trie, GLOBSET_ROOT, 0) != GLOBSET_BASE ||
+     trie_node(&s->suffix, GLOBSET_ROOT, 0) != 0) {
+    globset_free(s);
+    return 0;
+  }
+
+  return s;
+}
+
+void
+globset_free(GlobSet* s) {
+  free(s->trie.nodes);
+  free(s->suffix.nodes);
+  free(s->links);
+  free(s->classes);
+  free(s);
+}
+
+uint32_t
+globset_count(const GlobSet* s) {
+  return s->count;
+}
+
+/* returns the end of the bracket expression at 'p' (after '['), or 0 */
+static const char*
+globset_class_end(const char* p, const char* end) {
+  if(p < end && (*p == '!' || *p == '^'))
+    ++p;
+
+  if(p < end && *p == ']')
+    ++p;
+
+  for(; p < end; ++p) {
+    if(*p == '\\' && p + 1 < end)
+      ++p;
+    else if(*p == ']')
+      return p + 1;
+  }
+
+  return 0;
+}
+
+static const char*
+globset_class(GlobToken* tok, const char* p, const char* end) {
+  int neg = 0;
+
+  memset(tok->set, 0, sizeof(tok->set));
+  tok->op = GLOBSET_CLASS;
+  tok->c = 0;
+
+  if(*p == '!' || *p == '^') {
+    neg = 1;
+    ++p;
+  }
+
+  for(const char* start = p; *p != ']' || p == start; ++p) {
+    uint8_t lo, hi;
+
+    if(*p == '\\')
+      ++p;
+
+    lo = hi = *p;
+
+    if(p + 2 < end && p[1] == '-' && p[2] != ']') {
+      p += 2;
+
+      if(*p == '\\')
+        ++p;
+
+      hi = *p;
+    }
+
+    for(unsigned c = lo; c <= hi; c++)
+      tok->set[c >> 3] |= 1 << (c & 7);
+  }
+
+  if(neg)
+    for(size_t i = 0; i < sizeof(tok->set); i++)
+      tok->set[i] = ~tok->set[i];
+
+  /* like '*' and '?', a class never matches a separator */
+  tok->set['/' >> 3] &= ~(1 << ('/' & 7));
+
+  return p + 1;
+}
+
+/* splits 'pattern' into tokens, returns their number */
+static size_t
+globset_tokenize(GlobToken* toks, const char* pattern, size_t len) {
+  const char *p = pattern, *end = pattern + len, *q;
+  size_t n = 0;
+
+  while(p < end) {
+    GlobToken* tok = &toks[n];
+
+    switch(*p) {
+      case '\\': {
+        if(p + 1 < end)
+          ++p;
+
+        *tok = (GlobToken){.op = GLOBSET_CHAR, .c = *p++};
+        break;
+      }
+
+      case '?': {
+        *tok = (GlobToken){.op = GLOBSET_ANY};
+        ++p;
+        break;
+      }
+
+      case '[': {
+        if((q = globset_class_end(p + 1, end))) {
+          globset_class(tok, p + 1, end);
+          p = q;
+        } else {
+          *tok = (GlobToken){.op = GLOBSET_CHAR, .c = *p++};
+        }
+
+        break;
+      }
+
+      case '*': {
+        int segment = p == pattern || p[-1] == '/';
+
+        for(q = p; q < end && *q == '*'; ++q)
+          ;
+
+        if(q - p >= 2 && segment && (q == end || *q == '/')) {
+          *tok = (GlobToken){.op = q == end ? GLOBSET_DEEP : GLOBSET_DIRS};
+          p = q + (q < end);
+        } else {
+          *tok = (GlobToken){.op = GLOBSET_STAR};
+          p = q;
+        }
+
+        /* adjacent stars collapse */
+        if(n > 0 && toks[n - 1].op == GLOBSET_STAR && tok->op == GLOBSET_STAR)
+          continue;
+
+        break;
+      }
+
+      default: {
+        *tok = (GlobToken){.op = GLOBSET_CHAR, .c = *p++};
+        break;
+      }
+    }
+
+    ++n;
+  }
+
+  return n;
+}
+
+static int
+globset_insert(GlobSet* s, uint32_t node, const GlobToken* toks, size_t n, uint32_t id) {
+  for(; n > 0; ++toks, --n) {
+    if(toks->op == GLOBSET_DIRS) {
+      static const GlobToken deep = {.op = GLOBSET_DEEP}, slash = {.op = GLOBSET_CHAR, .c = '/'};
+
+      if(++s->expansions > GLOBSET_MAX_EXPANSION) {
+        errno = E2BIG;
+        return -1;
+      }
+
+      /* zero directories */
+      if(globset_insert(s, node, toks + 1, n - 1, id))
+        return -1;
+
+      if(!(node = trie_child(s, &s->trie, node, &deep)) || !(node = trie_child(s, &s->trie, node, &slash)))
+        return -1;
+    } else if(!(node = trie_child(s, &s->trie, node, toks))) {
+      return -1;
+    }
+  }
+
+  return trie_accept(s, &s->trie, node, id);
+}
+
+static int
+globset_compile(GlobSet* s, const char* pattern, size_t len, uint32_t id) {
+  GlobToken* toks;
+  size_t i, n;
+  const char* slash = memchr(pattern, '/', len);
+  uint32_t root = slash ? GLOBSET_PATH : GLOBSET_BASE;
+  int ret = -1;
+
+  if(!(toks = malloc(sizeof(GlobToken) * (len + 1))))
+    return -1;
+
+  n = globset_tokenize(toks, pattern, len);
+
+  /* '**' followed by a name pattern is the same as the name pattern */
+  if(n > 1 && toks[0].op == GLOBSET_DIRS && !memchr(slash + 1, '/', pattern + len - slash - 1)) {
+    memmove(toks, toks + 1, sizeof(GlobToken) * --n);
+    root = GLOBSET_BASE;
+  }
+
+  /* names don't contain a '/', so '**' is just a '*' there */
+  if(root == GLOBSET_BASE)
+    for(i = 0; i < n; i++)
+      if(toks[i].op == GLOBSET_DEEP)
+        toks[i].op = GLOBSET_STAR;
+
+  if(root == GLOBSET_BASE && n > 1 && toks[0].op == GLOBSET_STAR) {
+    for(i = 1; i < n; i++)
+      if(toks[i].op != GLOBSET_CHAR)
+        break;
+
+    /* '*<literal>' goes into the suffix trie, reversed */
+    if(i == n) {
+      uint32_t node = 0;
+
+      for(i = n - 1; i > 0; i--)
+        if(!(node = trie_child(s, &s->suffix, node, &toks[i])))
+          goto done;
+
+      ret = trie_accept(s, &s->suffix, node, id);
+      goto done;
+    }
+  }
+
+  ret = globset_insert(s, root, toks, n, id);
+
+done:
+  free(toks);
+  return ret;
+}
+
+/* finds the first top-level '{...}' with a ',' in it */
+static const char*
+globset_brace(const char* p, const char* end, const char** close) {
+  for(; p < end; ++p) {
+    const char* q;
+
+    if(*p == '\\') {
+      ++p;
+    } else if(*p == '[') {
+      if((q = globset_class_end(p + 1, end)))
+        p = q - 1;
+    } else if(*p == '{') {
+      int depth = 0, comma = 0;
+
+      for(q = p + 1; q < end; ++q) {
+        if(*q == '\\')
+          ++q;
+        else if(*q == '{')
+          ++depth;
+        else if(*q == ',' && depth == 0)
+          comma = 1;
+        else if(*q == '}' && depth-- == 0)
+          break;
+      }
+
+      if(q < end && comma) {
+        *close = q;
+        return p;
+      }
+    }
+  }
+
+  return 0;
+}
+
+static int
+globset_expand(GlobSet* s, const char* pattern, size_t len, uint32_t id) {
+  const char *end = pattern + len, *open, *close, *alt, *p;
+  int depth = 0;
+  char* buf;
+
+  if(!(open = globset_brace(pattern, end, &close)))
+    return globset_compile(s, pattern, len, id);
+
+  if(!(buf = malloc(len)))
+    return -1;
+
+  memcpy(buf, pattern, open - pattern);
+
+  for(alt = p = open + 1; p <= close; ++p) {
+    if(*p == '\\') {
+      ++p;
+    } else if(*p == '{') {
+      ++depth;
+    } else if((*p == ',' && depth == 0) || p == close) {
+      size_t n = open - pattern;
+
+      if(++s->expansions > GLOBSET_MAX_EXPANSION) {
+        errno = E2BIG;
+        break;
+      }
+
+      memcpy(buf + n, alt, p - alt);
+      n += p - alt;
+      memcpy(buf + n, close + 1, end - close - 1);
+      n += end - close - 1;
+
+      if(globset_expand(s, buf, n, id))
+        break;
+
+      alt = p + 1;
+    } else if(*p == '}') {
+      --depth;
+    }
+  }
+
+  free(buf);
+  return p > close ? 0 : -1;
+}
+
+/* adds a pattern, returns its index or -1 on error */
+int
+globset_add(GlobSet* s, const char* pattern, size_t len) {
+  uint32_t id = s->count;
+
+  s->expansions = 0;
+
+  if(globset_expand(s, pattern, len, id))
+    return -1;
+
+  return s->count++;
+}
+
+static void
+globset_enter(const GlobSet* s, GlobRun* r, uint32_t i) {
+  const GlobNode* n;
+
+  if(r->mark[i] == r->gen)
+    return;
+
+  r->mark[i] = r->gen;
+  r->next[r->nnext++] = i;
+
+  if((n = &s->trie.nodes[i])->stars)
+    for(uint32_t j = n->child; j; j = s->trie.nodes[j].next)
+      if(s->trie.nodes[j].op == GLOBSET_STAR || s->trie.nodes[j].op == GLOBSET_DEEP)
+        globset_enter(s, r, j);
+}
+
+static void
+globset_swap(GlobRun* r) {
+  uint32_t* tmp = r->cur;
+
+  r->cur = r->next;
+  r->next = tmp;
+  r->ncur = r->nnext;
+  r->nnext = 0;
+  r->gen++;
+}
+
+static void
+globset_step(const GlobSet* s, GlobRun* r, uint8_t c) {
+  const GlobNode* nodes = s->trie.nodes;
+
+  for(uint32_t k = 0; k < r->ncur; k++) {
+    uint32_t i = r->cur[k];
+    const GlobNode* n = &nodes[i];
+
+    if(n->op == GLOBSET_DEEP || (n->op == GLOBSET_STAR && c != '/'))
+      globset_enter(s, r, i);
+
+    for(uint32_t j = n->child; j; j = nodes[j].next) {
+      const GlobNode* child = &nodes[j];
+      int match;
+
+      switch(child->op) {
+        case GLOBSET_CHAR: match = child->c == c; break;
+        case GLOBSET_ANY: match = c != '/'; break;
+        case GLOBSET_CLASS: match = (s->classes[child->cls][c >> 3] >> (c & 7)) & 1; break;
+        default: match = 0; break;
+      }
+
+      if(match)
+        globset_enter(s, r, j);
+    }
+  }
+}
+
+/* records the patterns accepted by 'node', returns the number of new ones.
+ * without 'hits' only tells whether there are any */
+static int
+globset_hits(const GlobSet* s, const GlobTrie* t, uint32_t node, uint8_t* hits) {
+  int ret = 0;
+
+  for(uint32_t i = t->nodes[node].accept; i; i = s->links[i].next) {
+    if(!hits)
+      return 1;
+
+    if(!hits[s->links[i].id]) {
+      hits[s->links[i].id] = 1;
+      ++ret;
+    }
+  }
+
+  return ret;
+}
+
+static int
+globset_run(const GlobSet* s, const char* path, size_t len, uint8_t* hits) {
+  uint32_t stack[GLOBSET_STACK_STATES * 3], *mem = stack, size = s->trie.size;
+  const char* base;
+  GlobRun r;
+  size_t pos;
+  int ret = 0;
+
+  for(base = path + len; base > path && base[-1] != '/'; --base)
+    ;
+
+  /* extensions: walk the suffix trie from the end of the name */
+  if(s->suffix.size > 1) {
+    uint32_t node = 0;
+
+    for(const char* p = path + len; p > base;) {
+      uint8_t c = *--p;
+      uint32_t j;
+
+      for(j = s->suffix.nodes[node].child; j; j = s->suffix.nodes[j].next)
+        if(s->suffix.nodes[j].c == c)
+          break;
+
+      if(!(node = j))
+        break;
+
+      if((ret += globset_hits(s, &s->suffix, node, hits)) && !hits)
+        return ret;
+    }
+  }
+
+  if(!s->trie.nodes[GLOBSET_PATH].child && !s->trie.nodes[GLOBSET_BASE].child && !s->trie.nodes[GLOBSET_PATH].accept && !s->trie.nodes[GLOBSET_BASE].accept)
+    return ret;
+
+  if(size > GLOBSET_STACK_STATES && !(mem = malloc(sizeof(uint32_t) * size * 3)))
+    return -1;
+
+  r = (GlobRun){mem, mem + size, mem + size * 2, 0, 0, 1};
+  memset(r.mark, 0, sizeof(uint32_t) * size);
+
+  globset_enter(s, &r, GLOBSET_PATH);
+
+  if(base == path)
+    globset_enter(s, &r, GLOBSET_BASE);
+
+  globset_swap(&r);
+
+  for(pos = 0; pos < len; pos++) {
+    uint8_t c = path[pos];
+
+    globset_step(s, &r, c);
+
+    /* name patterns start over after each separator */
+    if(c == '/' && path + pos + 1 == base)
+      globset_enter(s, &r, GLOBSET_BASE);
+
+    globset_swap(&r);
+
+    /* no state left: skip to the name, if not already there */
+    if(r.ncur == 0) {
+      if(path + pos + 1 >= base)
+        break;
+
+      pos = base - path - 1;
+      globset_enter(s, &r, GLOBSET_BASE);
+      globset_swap(&r);
+    }
+  }
+
+  for(uint32_t k = 0; k < r.ncur; k++)
+    if((ret += globset_hits(s, &s->trie, r.cur[k], hits)) && !hits)
+      break;
+
+  if(mem != stack)
+    free(mem);
+
+  return ret;
+}
+
+/* sets hits[i] for each pattern i that matches 'path', 'hits' has
+ * globset_count() bytes. returns the number of matches or -1 */
+int
+globset_match(const GlobSet* s, const char* path, size_t len, uint8_t* hits) {
+  memset(hits, 0, s->count);
+  return globset_run(s, path, len, hits);
+}
+
+/* returns 1 if any pattern matches, 0 if none, -1 on error */
+int
+globset_test(const GlobSet* s, const char* path, size_t len) {
+  int ret = globset_run(s, path, len, 0);
+
+  return ret > 0 ? 1 : ret;
+}
+
+/**
+ * @}
+ */
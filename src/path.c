@@ -130,79 +130,137 @@ path_append3(const char* x, size_t len, DynBuf* db) {
 
 size_t
 path_normalize3(const char* path, size_t n, DynBuf* db) {
-  size_t ret;
   dbuf_claim(db, n + 1 - db->size);
-  memcpy(db->buf, path, n);
 
-  db->buf[n] = '\0';
-
-  ret = db->size = path_normalize2((char*)db->buf, n);
-
-  dbuf_0(db);
-
-  return ret;
+  return db->size = path_normalize4(path, n, (char*)db->buf, n + 1);
 }
 
 size_t
 path_normalize1(char* path) {
-  return path_normalize2(path, strlen(path));
+  size_t len = strlen(path);
+
+  return path_normalize4(path, len, path, len + 1);
 }
 
 size_t
 path_normalize2(char* path, size_t nb) {
-  ssize_t i = 0, j, len;
-  len = nb;
-
-again:
-  i = path_separator2(path, len);
+  return path_normalize4(path, nb, path, nb);
+}
 
-  if(i > 1) {
-    byte_copy(&path[1], len - i, &path[i]);
-    len -= i - 1;
-    i = 1;
+/* Normalizes 'len' bytes at 'path' into 'out' in one pass, without
+ * allocating: separators collapse, '.' is dropped (but for a leading one)
+ * and '..' removes the name before it. 'out' needs 'len' bytes and may be
+ * 'path', a '\0' is appended when 'size' leaves room. */
+size_t
+path_normalize4(const char* path, size_t len, char* out, size_t size) {
+  const char *p = path, *end = path + len;
+  size_t n = 0, base = 0;
+  char sep = PATHSEP_C;
+  BOOL dir = FALSE;
+
+  /* a root, which '..' doesn't remove */
+  if(p < end && path_issep(*p)) {
+    out[n++] = sep = *p;
+    p += path_separator2(p, end - p);
+    base = n;
   }
 
-  while(i < len) {
-    size_t k;
-    j = i + path_skip3(&path[i], &k, len - i);
-    if(j == i) {
-      len = j;
-      break;
-    }
+  while(p < end) {
+    const char* name = p;
+    size_t nlen;
+    char next = sep;
 
-    if(i > 0 && path_isdot(&path[i])) {
-      ssize_t clen = len - j;
-      assert(clen >= 0);
+    while(p < end && !path_issep(*p))
+      ++p;
 
-      if(clen > 0)
-        byte_copy(&path[i], clen, &path[j]);
+    nlen = p - name;
 
-      path[i + clen] = '\0';
-      len = i + clen;
-      goto again;
+    if((dir = p < end)) {
+      next = *p;
+      p += path_separator2(p, end - p);
     }
 
-    if(!path_isdotdot(&path[i]) && (len - j) >= 2 && path_isdotdot(&path[j])) {
-      j += (len - j) == 2 || path[j + 2] == '\0' ? 2 : 3;
-      ssize_t clen = len - j;
-      assert(clen >= 0);
+    if(path_isdot2(name, nlen)) {
+      if(n == 0)
+        out[n++] = '.';
+      else
+        dir = TRUE;
+    } else if(path_isdotdot2(name, nlen) && n > base && !(n == 1 && out[0] == '.')) {
+      while(n > base && !path_issep(out[n - 1]))
+        --n;
+
+      if(n > base)
+        --n;
+
+      dir = TRUE;
+    } else {
+      BOOL dotdot = path_isdotdot2(name, nlen);
+
+      /* './..' is '..' */
+      if(n == 1 && out[0] == '.' && dotdot)
+        n = 0;
+
+      if(n > 0 && !path_issep(out[n - 1]))
+        out[n++] = sep;
 
-      if(clen > 0)
-        byte_copy(&path[i], clen, &path[j]);
+      /* in place, this overwrites 'name' */
+      memmove(&out[n], name, nlen);
+      n += nlen;
 
-      path[i + clen] = '\0';
-      len = i + clen;
-      goto again;
+      /* what '..' can't remove */
+      if(dotdot)
+        base = n;
     }
 
-    if((i += k + 1) < j) {
-      if(j < len)
-        byte_copy(&path[i], len - j, &path[j]);
+    sep = next;
+  }
+
+  if(dir && n > 0 && !path_issep(out[n - 1]))
+    out[n++] = sep;
+
+  if(n < size)
+    out[n] = '\0';
+
+  return n;
+}
+
+/* Joins 'n' parts, from the last absolute one on, and normalizes them into
+ * 'out' without a trailing separator. Returns the length, which doesn't fit
+ * when it is 'size' or more: nothing is written then. */
+size_t
+path_resolve5(const char* const parts[], const size_t lens[], int n, char* out, size_t size) {
+  size_t len = 0, pos = 0;
+  int i, first = 0;
 
-      len -= j - i;
+  for(i = n - 1; i >= 0; i--)
+    if(path_isabsolute2(parts[i], lens[i])) {
+      first = i;
+      break;
     }
+
+  for(i = first; i < n; i++)
+    len += lens[i] + 1;
+
+  if(len >= size)
+    return len;
+
+  for(i = first; i < n; i++) {
+    if(lens[i] == 0)
+      continue;
+
+    if(pos > 0 && !path_issep(out[pos - 1]))
+      out[pos++] = PATHSEP_C;
+
+    memcpy(&out[pos], parts[i], lens[i]);
+    pos += lens[i];
   }
 
+  len = path_normalize4(out, pos, out, size);
+
+  while(len > 1 && path_issep(out[len - 1]))
+    --len;
+
+  out[len] = '\0';
   return len;
 }
 
@@ -1,7 +1,15 @@
+#define _GNU_SOURCE
 #include "queue.h"
 #include <assert.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 #include "debug.h"
 
 /**
@@ -69,18 +77,183 @@ chunk_headpos(Chunk* ch, Queue* q) {
   return pos;
 }
 
+static size_t
+ring_roundup(size_t n) {
+  size_t size = 1;
+
+  while(size < n)
+    size <<= 1;
+
+  return size;
+}
+
+static int
+ring_alloc(Ring* r, size_t size, int mirror) {
+#if defined(HAVE_MEMFD_CREATE) && defined(HAVE_SYS_MMAN_H)
+  if(mirror) {
+    size_t pagesize = sysconf(_SC_PAGESIZE);
+    uint8_t* base;
+    int fd;
+
+    if(size < pagesize)
+      size = pagesize;
+
+    if((fd = memfd_create("queue", MFD_CLOEXEC)) != -1) {
+      if(ftruncate(fd, size) != -1 && (base = mmap(0, size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) != MAP_FAILED) {
+        if(mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED &&
+           mmap(base + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED) {
+          close(fd);
+
+          r->data = base;
+          r->size = size;
+          r->mirror = 1;
+          return 0;
+        }
+
+        munmap(base, size * 2);
+      }
+
+      close(fd);
+    }
+  }
+#endif
+
+  if(!(r->data = malloc(size)))
+    return -1;
+
+  r->size = size;
+  r->mirror = 0;
+  return 0;
+}
+
+static void
+ring_release(Ring* r) {
+#if defined(HAVE_MEMFD_CREATE) && defined(HAVE_SYS_MMAN_H)
+  if(r->mirror)
+    munmap(r->data, r->size * 2);
+  else
+#endif
+    free(r->data);
+
+  memset(r, 0, sizeof(Ring));
+}
+
+static inline size_t
+ring_offset(Ring* r, size_t pos) {
+  return pos & (r->size - 1);
+}
+
+static void
+ring_copyout(Ring* r, size_t pos, void* x, size_t n) {
+  size_t offset = ring_offset(r, pos), n1 = r->mirror ? n : MIN_NUM(n, r->size - offset);
+
+  memcpy(x, r->data + offset, n1);
+
+  if(n1 < n)
+    memcpy((uint8_t*)x + n1, r->data, n - n1);
+}
+
+static void
+ring_copyin(Ring* r, size_t pos, const void* x, size_t n) {
+  size_t offset = ring_offset(r, pos), n1 = r->mirror ? n : MIN_NUM(n, r->size - offset);
+
+  memcpy(r->data + offset, x, n1);
+
+  if(n1 < n)
+    memcpy(r->data, (const uint8_t*)x + n1, n - n1);
+}
+
+/* Fills 'iov' with up to two spans of 'n' bytes starting at 'pos' */
+static int
+ring_spans(Ring* r, size_t pos, size_t n, struct iovec* iov, int iovcnt) {
+  size_t offset = ring_offset(r, pos), n1 = r->mirror ? n : MIN_NUM(n, r->size - offset);
+  int i = 0;
+
+  if(n1 > 0) {
+    if(i < iovcnt)
+      iov[i] = (struct iovec){r->data + offset, n1};
+    ++i;
+  }
+
+  if(n1 < n) {
+    if(i < iovcnt)
+      iov[i] = (struct iovec){r->data, n - n1};
+    ++i;
+  }
+
+  return iov ? MIN_NUM(i, iovcnt) : i;
+}
+
 void
 queue_init(Queue* q) {
   init_list_head(&q->list);
 
   q->nbytes = 0;
   q->nchunks = 0;
+
+  memset(&q->ring, 0, sizeof(Ring));
+}
+
+/**
+ * Switches the queue into ring-buffer mode with (at least) 'size' bytes of
+ * contiguous storage, rounded up to a power of two. If 'mirror' is set and
+ * memfd_create() is available, the storage is double-mapped.
+ *
+ * Data already in the queue is carried over. Calling it again resizes the ring.
+ *
+ * @return  0 on success, -1 on error (errno set)
+ */
+int
+queue_ring(Queue* q, size_t size, int mirror) {
+  Ring r;
+
+  size = ring_roundup(MAX_NUM(size, 1));
+
+  if(size < q->nbytes) {
+    errno = ENOSPC;
+    return -1;
+  }
+
+  if(ring_alloc(&r, size, mirror))
+    return -1;
+
+  r.rpos = 0;
+  r.wpos = queue_peek(q, r.data, q->nbytes);
+
+  if(queue_is_ring(q))
+    ring_release(&q->ring);
+  else
+    queue_clear(q);
+
+  q->ring = r;
+  q->nbytes = r.wpos;
+  return 0;
+}
+
+/**
+ * Clears the queue and releases ring storage, returning it to chunk mode
+ */
+void
+queue_reset(Queue* q) {
+  queue_clear(q);
+
+  if(queue_is_ring(q))
+    ring_release(&q->ring);
 }
 
 ssize_t
 queue_write(Queue* q, const void* x, size_t n) {
   Chunk* b;
 
+  if(queue_is_ring(q)) {
+    n = MIN_NUM(n, queue_space(q));
+
+    ring_copyin(&q->ring, q->ring.wpos, x, n);
+    q->ring.wpos += n;
+    q->nbytes += n;
+    return n;
+  }
+
   if((b = chunk_alloc(n))) {
     list_add(&b->link, &q->list);
 
@@ -103,6 +276,15 @@ queue_read(Queue* q, void* x, size_t n) {
   ssize_t ret = 0;
   uint8_t* p = x;
 
+  if(queue_is_ring(q)) {
+    n = MIN_NUM(n, q->nbytes);
+
+    ring_copyout(&q->ring, q->ring.rpos, x, n);
+    q->ring.rpos += n;
+    q->nbytes -= n;
+    return n;
+  }
+
   while(n > 0 && (b = queue_tail(q))) {
     size_t bytes = MIN_NUM((b->size - b->pos), n);
     memcpy(p, &b->data[b->pos], bytes);
@@ -129,6 +311,13 @@ queue_peek(Queue* q, void* x, size_t n) {
   uint8_t* p = x;
   struct list_head* el;
 
+  if(queue_is_ring(q)) {
+    n = MIN_NUM(n, q->nbytes);
+
+    ring_copyout(&q->ring, q->ring.rpos, x, n);
+    return n;
+  }
+
   list_for_each_prev(el, &q->list) {
     if(n == 0)
       break;
@@ -153,6 +342,14 @@ queue_skip(Queue* q, size_t n) {
   Chunk* b;
   ssize_t ret = 0;
 
+  if(queue_is_ring(q)) {
+    n = MIN_NUM(n, q->nbytes);
+
+    q->ring.rpos += n;
+    q->nbytes -= n;
+    return n;
+  }
+
   while(n > 0 && (b = queue_tail(q))) {
     size_t bytes = MIN_NUM((b->size - b->pos), n);
 
@@ -177,6 +374,20 @@ Chunk*
 queue_next(Queue* q) {
   Chunk* chunk;
 
+  if(queue_is_ring(q)) {
+    struct iovec iov;
+
+    /* ring storage is reused, so hand out a copy of the first contiguous span */
+    if(!queue_segments(q, &iov, 1) || !(chunk = chunk_alloc(iov.iov_len)))
+      return 0;
+
+    memcpy(chunk->data, iov.iov_base, iov.iov_len);
+    chunk->size = iov.iov_len;
+
+    queue_skip(q, iov.iov_len);
+    return chunk;
+  }
+
   if(!(chunk = queue_tail(q)))
     return 0;
 
@@ -192,6 +403,12 @@ void
 queue_clear(Queue* q) {
   struct list_head *el, *el1;
 
+  if(queue_is_ring(q)) {
+    q->ring.rpos = q->ring.wpos = 0;
+    q->nbytes = 0;
+    return;
+  }
+
   list_for_each_prev_safe(el, el1, &q->list) {
     Chunk* chunk = list_entry(el, Chunk, link);
 
@@ -273,6 +490,149 @@ queue_at(Queue* q, ssize_t offset, size_t* skip) {
   return NULL;
 }
 
+/**
+ * Fills 'iov' with the readable data of the queue, from head to tail: one
+ * entry per chunk, or one or two entries (wrap-around) in ring mode.
+ *
+ * @return  number of entries filled, or the total needed if 'iov' is NULL
+ */
+int
+queue_segments(Queue* q, struct iovec* iov, int iovcnt) {
+  struct list_head* el;
+  int i = 0;
+
+  if(queue_is_ring(q))
+    return ring_spans(&q->ring, q->ring.rpos, q->nbytes, iov, iovcnt);
+
+  list_for_each_prev(el, &q->list) {
+    Chunk* chunk = list_entry(el, Chunk, link);
+
+    if(iov) {
+      if(i == iovcnt)
+        break;
+
+      iov[i] = (struct iovec){&chunk->data[chunk->pos], chunk->size - chunk->pos};
+    }
+
+    ++i;
+  }
+
+  return i;
+}
+
+/**
+ * Fills 'iov' with the free space of a ring-mode queue (one or two entries).
+ * Data written there becomes part of the queue by calling queue_commit().
+ *
+ * @return  number of entries filled, -1 when not in ring mode
+ */
+int
+queue_reserve(Queue* q, struct iovec* iov, int iovcnt) {
+  if(!queue_is_ring(q)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return ring_spans(&q->ring, q->ring.wpos, queue_space(q), iov, iovcnt);
+}
+
+ssize_t
+queue_commit(Queue* q, size_t n) {
+  if(!queue_is_ring(q)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  n = MIN_NUM(n, queue_space(q));
+
+  q->ring.wpos += n;
+  q->nbytes += n;
+  return n;
+}
+
+#ifndef _WIN32
+/**
+ * Reads up to 'n' bytes from 'fd' straight into the queue. In ring mode this
+ * is a single readv() into the free space, in chunk mode the data lands in a
+ * newly allocated chunk.
+ *
+ * @return  bytes read, 0 on EOF, -1 on error (errno set)
+ */
+ssize_t
+queue_readv(Queue* q, int fd, size_t n) {
+  ssize_t r;
+
+  if(queue_is_ring(q)) {
+    struct iovec iov[2];
+    int i, iovcnt = queue_reserve(q, iov, 2);
+    size_t total = 0;
+
+    for(i = 0; i < iovcnt; i++) {
+      if(total + iov[i].iov_len > n)
+        iov[i].iov_len = n - total;
+
+      total += iov[i].iov_len;
+    }
+
+    if(total == 0) {
+      errno = ENOBUFS;
+      return -1;
+    }
+
+    if((r = readv(fd, iov, iovcnt)) > 0)
+      queue_commit(q, r);
+
+    return r;
+  }
+
+  Chunk* b;
+
+  if(!(b = chunk_alloc(n)))
+    return -1;
+
+  if((r = read(fd, b->data, n)) <= 0) {
+    chunk_free(b);
+    return r;
+  }
+
+  if((size_t)r < n) {
+    Chunk* b2;
+
+    if((b2 = realloc(b, sizeof(Chunk) + r)))
+      b = b2;
+  }
+
+  b->size = r;
+
+  list_add(&b->link, &q->list);
+
+  q->nbytes += r;
+  q->nchunks++;
+  return r;
+}
+
+/**
+ * Writes as much of the queue as possible to 'fd' with a single writev()
+ * gathering all chunks (or both ring spans), and consumes what was written.
+ *
+ * @return  bytes written, -1 on error (errno set)
+ */
+ssize_t
+queue_writev(Queue* q, int fd) {
+  struct iovec vec[64];
+  int iovcnt;
+  ssize_t r;
+
+  if((iovcnt = queue_segments(q, vec, countof(vec))) == 0)
+    return 0;
+
+  if((r = writev(fd, vec, iovcnt)) > 0)
+    queue_skip(q, r);
+
+  return r;
+}
+#endif
+
 /**
  * @}
  */
@@ -0,0 +1,403 @@
+#include "read-cache.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * \addtogroup read-cache
+ * @{
+ */
+
+#define READCACHE_MIN_BUCKETS 64
+
+typedef struct cache_path {
+  struct cache_path* next;
+  uint32_t hash;
+  int32_t layer;
+  int64_t offset;
+  size_t len;
+  char path[];
+} CachePath;
+
+/* 'newer' and 'older' link the LRU list */
+typedef struct cache_body {
+  struct cache_body *next, *newer, *older;
+  uint32_t hash;
+  int32_t layer;
+  int64_t offset;
+  size_t size;
+  uint8_t data[];
+} CacheBody;
+
+struct read_cache {
+  CachePath** paths;
+  CacheBody** bodies;
+  uint32_t num_path_buckets, num_body_buckets;
+  uint32_t num_paths, num_bodies;
+  CacheBody *newest, *oldest;
+  size_t bytes, budget;
+  uint64_t hits, misses, evictions;
+};
+
+static uint32_t
+path_hash(const char* path, size_t len) {
+  uint32_t h = 2166136261u;
+
+  for(size_t i = 0; i < len; i++)
+    h = (h ^ (uint8_t)path[i]) * 16777619u;
+
+  return h;
+}
+
+static uint32_t
+address_hash(int32_t layer, int64_t offset) {
+  uint64_t x = ((uint64_t)(uint32_t)layer << 48) ^ (uint64_t)offset;
+
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return (uint32_t)(x ^ (x >> 31));
+}
+
+static CachePath**
+path_find(const ReadCache* c, const char* path, size_t len, uint32_t hash) {
+  CachePath** pp = &c->paths[hash & (c->num_path_buckets - 1)];
+
+  for(; *pp; pp = &(*pp)->next)
+    if((*pp)->hash == hash && (*pp)->len == len && !memcmp((*pp)->path, path, len))
+      break;
+
+  return pp;
+}
+
+static CacheBody**
+body_find(const ReadCache* c, int32_t layer, int64_t offset, uint32_t hash) {
+  CacheBody** pb = &c->bodies[hash & (c->num_body_buckets - 1)];
+
+  for(; *pb; pb = &(*pb)->next)
+    if((*pb)->layer == layer && (*pb)->offset == offset)
+      break;
+
+  return pb;
+}
+
+static int
+paths_grow(ReadCache* c) {
+  uint32_t n = c->num_path_buckets * 2;
+  CachePath** buckets;
+
+  if(!(buckets = calloc(n, sizeof(CachePath*))))
+    return -1;
+
+  for(uint32_t i = 0; i < c->num_path_buckets; i++) {
+    CachePath* p;
+
+    while((p = c->paths[i])) {
+      c->paths[i] = p->next;
+      p->next = buckets[p->hash & (n - 1)];
+      buckets[p->hash & (n - 1)] = p;
+    }
+  }
+
+  free(c->paths);
+  c->paths = buckets;
+  c->num_path_buckets = n;
+  return 0;
+}
+
+static int
+bodies_grow(ReadCache* c) {
+  uint32_t n = c->num_body_buckets * 2;
+  CacheBody** buckets;
+
+  if(!(buckets = calloc(n, sizeof(CacheBody*))))
+    return -1;
+
+  for(uint32_t i = 0; i < c->num_body_buckets; i++) {
+    CacheBody* b;
+
+    while((b = c->bodies[i])) {
+      c->bodies[i] = b->next;
+      b->next = buckets[b->hash & (n - 1)];
+      buckets[b->hash & (n - 1)] = b;
+    }
+  }
+
+  free(c->bodies);
+  c->bodies = buckets;
+  c->num_body_buckets = n;
+  return 0;
+}
+
+static void
+lru_unlink(ReadCache* c, CacheBody* b) {
+  if(b->newer)
+    b->newer->older = b->older;
+  else
+    c->newest = b->older;
+
+  if(b->older)
+    b->older->newer = b->newer;
+  else
+    c->oldest = b->newer;
+
+  b->newer = b->older = 0;
+}
+
+static void
+lru_push(ReadCache* c, CacheBody* b) {
+  b->newer = 0;
+  b->older = c->newest;
+
+  if(c->newest)
+    c->newest->newer = b;
+  else
+    c->oldest = b;
+
+  c->newest = b;
+}
+
+/* unlinks *pb from its bucket and the LRU list */
+static void
+body_delete(ReadCache* c, CacheBody** pb) {
+  CacheBody* b = *pb;
+
+  *pb = b->next;
+  lru_unlink(c, b);
+  c->bytes -= b->size;
+  --c->num_bodies;
+  free(b);
+}
+
+static void
+evict(ReadCache* c, size_t size) {
+  while(c->oldest && c->bytes + size > c->budget) {
+    CacheBody* b = c->oldest;
+
+    body_delete(c, body_find(c, b->layer, b->offset, b->hash));
+    ++c->evictions;
+  }
+}
+
+ReadCache*
+readcache_new(size_t budget) {
+  ReadCache* c;
+
+  if(!(c = calloc(1, sizeof(ReadCache))))
+    return 0;
+
+  c->num_path_buckets = c->num_body_buckets = READCACHE_MIN_BUCKETS;
+  c->budget = budget;
+
+  if(!(c->paths = calloc(c->num_path_buckets, sizeof(CachePath*))) || !(c->bodies = calloc(c->num_body_buckets, sizeof(CacheBody*)))) {
+    readcache_free(c);
+    return 0;
+  }
+
+  return c;
+}
+
+void
+readcache_free(ReadCache* c) {
+  if(c->paths && c->bodies)
+    readcache_clear(c);
+
+  free(c->paths);
+  free(c->bodies);
+  free(c);
+}
+
+/* records where the contents of 'path' are, returns -1 when out of memory */
+int
+readcache_locate(ReadCache* c, const char* path, size_t len, int32_t layer, int64_t offset) {
+  uint32_t hash = path_hash(path, len);
+  CachePath **pp = path_find(c, path, len, hash), *p;
+
+  if((p = *pp)) {
+    p->layer = layer;
+    p->offset = offset;
+    return 0;
+  }
+
+  if(c->num_paths >= c->num_path_buckets && paths_grow(c) == 0)
+    pp = path_find(c, path, len, hash);
+
+  if(!(p = malloc(sizeof(CachePath) + len + 1)))
+    return -1;
+
+  p->next = 0;
+  p->hash = hash;
+  p->layer = layer;
+  p->offset = offset;
+  p->len = len;
+  memcpy(p->path, path, len);
+  p->path[len] = '\0';
+
+  *pp = p;
+  ++c->num_paths;
+  return 0;
+}
+
+/* returns 1 when the location of 'path' is known */
+int
+readcache_location(const ReadCache* c, const char* path, size_t len, int32_t* layer, int64_t* offset) {
+  CachePath* p;
+
+  if(!(p = *path_find(c, path, len, path_hash(path, len))))
+    return 0;
+
+  *layer = p->layer;
+  *offset = p->offset;
+  return 1;
+}
+
+/* stores the contents for the location of 'path', returns 1 when they
+ * exceed the budget and aren't stored, -1 when the location is unknown */
+int
+readcache_put(ReadCache* c, const char* path, size_t len, const void* data, size_t size) {
+  CachePath* p;
+  CacheBody **pb, *b;
+  uint32_t hash;
+
+  if(!(p = *path_find(c, path, len, path_hash(path, len)))) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  hash = address_hash(p->layer, p->offset);
+
+  if(*(pb = body_find(c, p->layer, p->offset, hash)))
+    body_delete(c, pb);
+
+  if(size > c->budget)
+    return 1;
+
+  evict(c, size);
+
+  if(!(b = malloc(sizeof(CacheBody) + size)))
+    return -1;
+
+  if(c->num_bodies >= c->num_body_buckets)
+    bodies_grow(c);
+
+  pb = &c->bodies[hash & (c->num_body_buckets - 1)];
+  b->next = *pb;
+  b->hash = hash;
+  b->layer = p->layer;
+  b->offset = p->offset;
+  b->size = size;
+
+  if(size)
+    memcpy(b->data, data, size);
+
+  *pb = b;
+  lru_push(c, b);
+  c->bytes += size;
+  ++c->num_bodies;
+  return 0;
+}
+
+/* the contents of 'path', counted as hit or miss */
+const void*
+readcache_get(ReadCache* c, const char* path, size_t len, size_t* size) {
+  CachePath* p;
+  CacheBody* b;
+
+  if(!(p = *path_find(c, path, len, path_hash(path, len))) || !(b = *body_find(c, p->layer, p->offset, address_hash(p->layer, p->offset)))) {
+    ++c->misses;
+    return 0;
+  }
+
+  if(c->newest != b) {
+    lru_unlink(c, b);
+    lru_push(c, b);
+  }
+
+  ++c->hits;
+  *size = b->size;
+  return b->data;
+}
+
+/* forgets 'path' and the contents at its location */
+int
+readcache_remove(ReadCache* c, const char* path, size_t len) {
+  CachePath **pp = path_find(c, path, len, path_hash(path, len)), *p;
+  CacheBody** pb;
+
+  if(!(p = *pp))
+    return 0;
+
+  if(*(pb = body_find(c, p->layer, p->offset, address_hash(p->layer, p->offset))))
+    body_delete(c, pb);
+
+  *pp = p->next;
+  --c->num_paths;
+  free(p);
+  return 1;
+}
+
+/* forgets everything in 'layer', returns the number of paths */
+uint32_t
+readcache_invalidate(ReadCache* c, int32_t layer) {
+  uint32_t n = 0;
+
+  for(uint32_t i = 0; i < c->num_body_buckets; i++)
+    for(CacheBody** pb = &c->bodies[i]; *pb;)
+      if((*pb)->layer == layer)
+        body_delete(c, pb);
+      else
+        pb = &(*pb)->next;
+
+  for(uint32_t i = 0; i < c->num_path_buckets; i++)
+    for(CachePath** pp = &c->paths[i]; *pp;)
+      if((*pp)->layer == layer) {
+        CachePath* p = *pp;
+
+        *pp = p->next;
+        free(p);
+        --c->num_paths;
+        ++n;
+      } else {
+        pp = &(*pp)->next;
+      }
+
+  return n;
+}
+
+void
+readcache_clear(ReadCache* c) {
+  for(uint32_t i = 0; i < c->num_body_buckets; i++)
+    while(c->bodies[i])
+      body_delete(c, &c->bodies[i]);
+
+  for(uint32_t i = 0; i < c->num_path_buckets; i++) {
+    CachePath* p;
+
+    while((p = c->paths[i])) {
+      c->paths[i] = p->next;
+      free(p);
+    }
+  }
+
+  c->num_paths = 0;
+}
+
+void
+readcache_budget(ReadCache* c, size_t budget) {
+  c->budget = budget;
+  evict(c, 0);
+}
+
+void
+readcache_stats(const ReadCache* c, ReadCacheStats* st) {
+  st->hits = c->hits;
+  st->misses = c->misses;
+  st->evictions = c->evictions;
+  st->bytes = c->bytes;
+  st->budget = c->budget;
+  st->paths = c->num_paths;
+  st->bodies = c->num_bodies;
+}
+
+/**
+ * @}
+ */
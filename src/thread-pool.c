@@ -0,0 +1,264 @@
+#define _GNU_SOURCE
+#include "thread-pool.h"
+#include "utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * \addtogroup thread-pool
+ * @{
+ */
+
+#define THREAD_POOL_SIZE 4
+
+/* Completion queue of one JS thread. Workers append finished jobs to
+ * 'done' and write a byte into the pipe, whose read end is registered
+ * with the event loop for as long as jobs are outstanding. */
+typedef struct thread_queue {
+  pthread_mutex_t lock;
+  struct list_head done;
+  int fd[2];
+  uint32_t pending;
+  BOOL armed;
+} ThreadQueue;
+
+/* 'lanes' holds one job list per worker, 'shared' is served by all of
+ * them. The workers are started on first use and live until exit. */
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  struct list_head shared;
+  struct list_head* lanes;
+  int size, next;
+} pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+
+static _Thread_local ThreadQueue* thread_queue = 0;
+
+static void
+thread_queue_complete(ThreadQueue* q, ThreadJob* job) {
+  char c = 0;
+
+  pthread_mutex_lock(&q->lock);
+  list_add_tail(&job->link, &q->done);
+  pthread_mutex_unlock(&q->lock);
+
+  /* a full pipe already guarantees a wakeup */
+  while(write(q->fd[1], &c, 1) == -1 && errno == EINTR)
+    ;
+}
+
+static void*
+thread_pool_worker(void* arg) {
+  struct list_head* lane = arg;
+
+  for(;;) {
+    ThreadJob* job;
+
+    pthread_mutex_lock(&pool.lock);
+
+    while(list_empty(lane) && list_empty(&pool.shared))
+      pthread_cond_wait(&pool.cond, &pool.lock);
+
+    job = list_entry(list_empty(lane) ? pool.shared.next : lane->next, ThreadJob, link);
+    list_del(&job->link);
+
+    pthread_mutex_unlock(&pool.lock);
+
+    job->work(job);
+    thread_queue_complete(job->queue, job);
+  }
+
+  return 0;
+}
+
+/* must be called with the pool locked */
+static int
+thread_pool_start(void) {
+  const char* env;
+  sigset_t set, old;
+  int i, size = THREAD_POOL_SIZE;
+
+  if(pool.size)
+    return 0;
+
+  if((env = getenv("THREADPOOL_SIZE")) && (i = atoi(env)) > 0)
+    size = i > 64 ? 64 : i;
+
+  if(!(pool.lanes = malloc(sizeof(struct list_head) * size)))
+    return -1;
+
+  init_list_head(&pool.shared);
+
+  /* signals are for the JS threads, workers inherit a blocked mask */
+  sigfillset(&set);
+  pthread_sigmask(SIG_SETMASK, &set, &old);
+
+  for(i = 0; i < size; i++) {
+    pthread_t thread;
+
+    init_list_head(&pool.lanes[i]);
+
+    if(pthread_create(&thread, 0, thread_pool_worker, &pool.lanes[i]))
+      break;
+
+    pthread_detach(thread);
+  }
+
+  pthread_sigmask(SIG_SETMASK, &old, 0);
+
+  if(i == 0) {
+    free(pool.lanes);
+    pool.lanes = 0;
+    return -1;
+  }
+
+  pool.size = i;
+  return 0;
+}
+
+static ThreadQueue*
+thread_queue_get(void) {
+  ThreadQueue* q;
+
+  if((q = thread_queue))
+    return q;
+
+  if(!(q = calloc(1, sizeof(ThreadQueue))))
+    return 0;
+
+  if(pipe(q->fd) == -1) {
+    free(q);
+    return 0;
+  }
+
+  for(int i = 0; i < 2; i++) {
+    fcntl(q->fd[i], F_SETFL, fcntl(q->fd[i], F_GETFL) | O_NONBLOCK);
+    fcntl(q->fd[i], F_SETFD, FD_CLOEXEC);
+  }
+
+  pthread_mutex_init(&q->lock, 0);
+  init_list_head(&q->done);
+
+  return thread_queue = q;
+}
+
+static JSValue js_thread_queue_ready(JSContext*, JSValueConst, int, JSValueConst[]);
+
+static void
+thread_queue_arm(JSContext* ctx, ThreadQueue* q, BOOL enable) {
+  JSValue set_handler;
+
+  if(q->armed == enable)
+    return;
+
+  set_handler = js_iohandler_fn(ctx, FALSE, "os");
+  js_iohandler_set(ctx, set_handler, q->fd[0], enable ? JS_NewCFunction(ctx, js_thread_queue_ready, "ready", 0) : JS_NULL);
+  JS_FreeValue(ctx, set_handler);
+
+  q->armed = enable;
+}
+
+/* read handler: runs the 'done' callbacks of all finished jobs */
+static JSValue
+js_thread_queue_ready(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  ThreadQueue* q = thread_queue;
+  char buf[64];
+
+  while(read(q->fd[0], buf, sizeof(buf)) > 0)
+    ;
+
+  for(;;) {
+    ThreadJob* job = 0;
+
+    pthread_mutex_lock(&q->lock);
+
+    if(!list_empty(&q->done)) {
+      job = list_entry(q->done.next, ThreadJob, link);
+      list_del(&job->link);
+    }
+
+    pthread_mutex_unlock(&q->lock);
+
+    if(!job)
+      break;
+
+    --q->pending;
+    job->done(ctx, job);
+  }
+
+  /* a 'done' callback may have submitted further jobs */
+  if(q->pending == 0)
+    thread_queue_arm(ctx, q, FALSE);
+
+  return JS_UNDEFINED;
+}
+
+int
+thread_pool_size(void) {
+  int size;
+
+  pthread_mutex_lock(&pool.lock);
+  size = thread_pool_start() ? 0 : pool.size;
+  pthread_mutex_unlock(&pool.lock);
+
+  return size;
+}
+
+/* returns a lane for a client whose jobs must not overlap, round robin */
+int
+thread_pool_lane(void) {
+  int lane = 0;
+
+  pthread_mutex_lock(&pool.lock);
+
+  if(!thread_pool_start())
+    lane = pool.next++ % pool.size;
+
+  pthread_mutex_unlock(&pool.lock);
+
+  return lane;
+}
+
+/* queues 'job', whose 'done' callback will be called from the event loop
+ * of the calling thread. returns -1 with an exception pending on error */
+int
+thread_pool_submit(JSContext* ctx, ThreadJob* job, int lane) {
+  ThreadQueue* q;
+
+  if(!(q = thread_queue_get())) {
+    JS_ThrowInternalError(ctx, "thread pool: %s", strerror(errno));
+    return -1;
+  }
+
+  pthread_mutex_lock(&pool.lock);
+
+  if(thread_pool_start()) {
+    pthread_mutex_unlock(&pool.lock);
+    JS_ThrowInternalError(ctx, "thread pool: failed starting worker threads");
+    return -1;
+  }
+
+  job->queue = q;
+  list_add_tail(&job->link, lane == THREAD_LANE_ANY ? &pool.shared : &pool.lanes[lane % pool.size]);
+
+  pthread_cond_broadcast(&pool.cond);
+  pthread_mutex_unlock(&pool.lock);
+
+  ++q->pending;
+  thread_queue_arm(ctx, q, TRUE);
+  return 0;
+}
+
+/* number of jobs submitted from this thread which haven't completed */
+uint32_t
+thread_pool_pending(void) {
+  return thread_queue ? thread_queue->pending : 0;
+}
+
+/**
+ * @}
+ */
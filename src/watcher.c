@@ -0,0 +1,912 @@
+#define _GNU_SOURCE
+#include "watcher.h"
+
+#if HAVE_INOTIFY_INIT1
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * \addtogroup watcher
+ * @{
+ */
+
+#define WATCHER_MASK (IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_EXCL_UNLINK)
+#define WATCHER_MIN_BUCKETS 64
+
+typedef struct watch_dir {
+  struct watch_dir* next;
+  int wd;
+  int file;
+  char* path;
+} WatchDir;
+
+/* what is known about a path since the last delivery */
+typedef struct watch_pending {
+  struct watch_pending* next;
+  uint32_t hash;
+  WatchEventType type;
+  int directory;
+  char* from;
+  uint64_t first, last, seq;
+  char path[];
+} WatchPending;
+
+/* an IN_MOVED_FROM waiting for its IN_MOVED_TO. 'before' is what was
+ * pending for the path, 'from' where it was renamed from before */
+typedef struct watch_move {
+  struct watch_move* next;
+  uint32_t cookie;
+  WatchEventType before;
+  int directory;
+  char *path, *from;
+  uint64_t time;
+} WatchMove;
+
+struct watcher {
+  int fd, timer;
+  uint32_t delay, max_delay;
+  WatchDir** dirs;
+  uint32_t num_dir_buckets, num_dirs;
+  WatchPending** pending;
+  uint32_t num_pending_buckets, num_pending;
+  WatchMove* moves;
+  uint64_t seq;
+  char** roots;
+  uint32_t num_roots;
+};
+
+static uint64_t
+now_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint32_t
+path_hash(const char* path) {
+  uint32_t h = 2166136261u;
+
+  while(*path)
+    h = (h ^ (uint8_t)*path++) * 16777619u;
+
+  return h;
+}
+
+static char*
+path_join(const char* dir, const char* name) {
+  size_t dlen = strlen(dir), nlen = strlen(name);
+  char* path;
+
+  if((path = malloc(dlen + nlen + 2))) {
+    memcpy(path, dir, dlen);
+    path[dlen] = '/';
+    memcpy(path + dlen + 1, name, nlen + 1);
+  }
+
+  return path;
+}
+
+/* whether 'path' is 'dir' or below it */
+static int
+path_below(const char* path, const char* dir) {
+  size_t len = strlen(dir);
+
+  return !strncmp(path, dir, len) && (path[len] == '\0' || path[len] == '/');
+}
+
+static WatchDir**
+dir_find(const Watcher* w, int wd) {
+  WatchDir** pd = &w->dirs[(uint32_t)wd & (w->num_dir_buckets - 1)];
+
+  for(; *pd; pd = &(*pd)->next)
+    if((*pd)->wd == wd)
+      break;
+
+  return pd;
+}
+
+static void
+dirs_grow(Watcher* w) {
+  uint32_t n = w->num_dir_buckets * 2;
+  WatchDir** buckets;
+
+  if(!(buckets = calloc(n, sizeof(WatchDir*))))
+    return;
+
+  for(uint32_t i = 0; i < w->num_dir_buckets; i++) {
+    WatchDir* d;
+
+    while((d = w->dirs[i])) {
+      w->dirs[i] = d->next;
+      d->next = buckets[(uint32_t)d->wd & (n - 1)];
+      buckets[(uint32_t)d->wd & (n - 1)] = d;
+    }
+  }
+
+  free(w->dirs);
+  w->dirs = buckets;
+  w->num_dir_buckets = n;
+}
+
+/* returns 1 for a new watch, 0 for a known one, -1 when out of memory */
+static int
+dir_set(Watcher* w, int wd, const char* path, int file) {
+  WatchDir **pd = dir_find(w, wd), *d;
+  char* s;
+
+  if(!(s = strdup(path)))
+    return -1;
+
+  if((d = *pd)) {
+    free(d->path);
+    d->path = s;
+    return 0;
+  }
+
+  if(!(d = malloc(sizeof(WatchDir)))) {
+    free(s);
+    return -1;
+  }
+
+  if(w->num_dirs >= w->num_dir_buckets) {
+    dirs_grow(w);
+    pd = dir_find(w, wd);
+  }
+
+  d->next = 0;
+  d->wd = wd;
+  d->file = file;
+  d->path = s;
+  *pd = d;
+  ++w->num_dirs;
+  return 1;
+}
+
+static void
+dir_delete(Watcher* w, WatchDir** pd) {
+  WatchDir* d = *pd;
+
+  *pd = d->next;
+  free(d->path);
+  free(d);
+  --w->num_dirs;
+}
+
+/* renames the watched directories at and below 'from' */
+static void
+dirs_rename(Watcher* w, const char* from, const char* to) {
+  size_t flen = strlen(from), tlen = strlen(to);
+
+  for(uint32_t i = 0; i < w->num_dir_buckets; i++)
+    for(WatchDir* d = w->dirs[i]; d; d = d->next)
+      if(path_below(d->path, from)) {
+        size_t rest = strlen(d->path + flen);
+        char* s;
+
+        if((s = malloc(tlen + rest + 1))) {
+          memcpy(s, to, tlen);
+          memcpy(s + tlen, d->path + flen, rest + 1);
+          free(d->path);
+          d->path = s;
+        }
+      }
+}
+
+/* removes the watches at and below 'path' */
+static void
+dirs_unwatch(Watcher* w, const char* path) {
+  for(uint32_t i = 0; i < w->num_dir_buckets; i++)
+    for(WatchDir** pd = &w->dirs[i]; *pd;)
+      if(path_below((*pd)->path, path)) {
+        inotify_rm_watch(w->fd, (*pd)->wd);
+        dir_delete(w, pd);
+      } else {
+        pd = &(*pd)->next;
+      }
+}
+
+static WatchPending**
+pending_find(const Watcher* w, const char* path, uint32_t hash) {
+  WatchPending** pp = &w->pending[hash & (w->num_pending_buckets - 1)];
+
+  for(; *pp; pp = &(*pp)->next)
+    if((*pp)->hash == hash && !strcmp((*pp)->path, path))
+      break;
+
+  return pp;
+}
+
+static void
+pending_grow(Watcher* w) {
+  uint32_t n = w->num_pending_buckets * 2;
+  WatchPending** buckets;
+
+  if(!(buckets = calloc(n, sizeof(WatchPending*))))
+    return;
+
+  for(uint32_t i = 0; i < w->num_pending_buckets; i++) {
+    WatchPending* p;
+
+    while((p = w->pending[i])) {
+      w->pending[i] = p->next;
+      p->next = buckets[p->hash & (n - 1)];
+      buckets[p->hash & (n - 1)] = p;
+    }
+  }
+
+  free(w->pending);
+  w->pending = buckets;
+  w->num_pending_buckets = n;
+}
+
+/* the pending entry of 'path', a new one with type 0 if there is none */
+static WatchPending*
+pending_get(Watcher* w, const char* path, uint64_t now) {
+  uint32_t hash = path_hash(path);
+  WatchPending **pp = pending_find(w, path, hash), *p;
+  size_t len;
+
+  if((p = *pp))
+    return p;
+
+  if(w->num_pending >= w->num_pending_buckets) {
+    pending_grow(w);
+    pp = pending_find(w, path, hash);
+  }
+
+  len = strlen(path);
+
+  if(!(p = malloc(sizeof(WatchPending) + len + 1)))
+    return 0;
+
+  memset(p, 0, sizeof(WatchPending));
+  p->hash = hash;
+  p->first = now;
+  p->seq = w->seq++;
+  memcpy(p->path, path, len + 1);
+
+  *pp = p;
+  ++w->num_pending;
+  return p;
+}
+
+static void
+pending_delete(Watcher* w, WatchPending** pp) {
+  WatchPending* p = *pp;
+
+  *pp = p->next;
+  free(p->from);
+  free(p);
+  --w->num_pending;
+}
+
+/* takes the pending entry of 'path' out, returns its type and origin */
+static WatchEventType
+pending_take(Watcher* w, const char* path, char** from) {
+  WatchPending** pp = pending_find(w, path, path_hash(path));
+  WatchEventType type = 0;
+
+  *from = 0;
+
+  if(*pp) {
+    type = (*pp)->type;
+    *from = (*pp)->from;
+    (*pp)->from = 0;
+    pending_delete(w, pp);
+  }
+
+  return type;
+}
+
+/* merges an event into what is pending for 'path' */
+static void
+watcher_event(Watcher* w, const char* path, WatchEventType type, int directory, uint64_t now) {
+  WatchPending* p;
+
+  if(type == WATCH_DELETE) {
+    char* from;
+    WatchEventType before = pending_take(w, path, &from);
+
+    /* renamed and then deleted: the original is gone */
+    if(before == WATCH_RENAME && from) {
+      watcher_event(w, from, WATCH_DELETE, directory, now);
+      free(from);
+      return;
+    }
+
+    free(from);
+
+    /* created and deleted in between: nothing happened */
+    if(before == WATCH_CREATE)
+      return;
+  }
+
+  if(!(p = pending_get(w, path, now)))
+    return;
+
+  p->last = now;
+  p->directory = directory;
+
+  switch(type) {
+    case WATCH_CREATE: {
+      p->type = p->type == WATCH_DELETE ? WATCH_CHANGE : p->type ? p->type : WATCH_CREATE;
+      break;
+    }
+
+    case WATCH_CHANGE: {
+      if(!p->type || p->type == WATCH_DELETE)
+        p->type = WATCH_CHANGE;
+
+      break;
+    }
+
+    case WATCH_DELETE:
+    case WATCH_RESCAN: {
+      p->type = type;
+      break;
+    }
+
+    case WATCH_RENAME: {
+      break;
+    }
+  }
+}
+
+/* watches 'path' and the directories below it, returns the number of new
+ * watches. with 'report', everything found is pending as created: the
+ * contents of a new directory, from before its watch existed */
+static int
+watcher_scan(Watcher* w, const char* path, int report, uint64_t now) {
+  int wd, r, n;
+  DIR* dir;
+  struct dirent* de;
+
+  if((wd = inotify_add_watch(w->fd, path, WATCHER_MASK | IN_ONLYDIR | IN_DONT_FOLLOW)) == -1)
+    return -1;
+
+  if((n = dir_set(w, wd, path, 0)) == -1)
+    return -1;
+
+  if(!(dir = opendir(path)))
+    return n;
+
+  while((de = readdir(dir))) {
+    char* child;
+    int directory;
+
+    if(de->d_name[0] == '.' && (de->d_name[1] == '\0' || (de->d_name[1] == '.' && de->d_name[2] == '\0')))
+      continue;
+
+    if(!(child = path_join(path, de->d_name)))
+      break;
+
+    if(de->d_type == DT_UNKNOWN) {
+      struct stat st;
+
+      directory = lstat(child, &st) == 0 && S_ISDIR(st.st_mode);
+    } else {
+      directory = de->d_type == DT_DIR;
+    }
+
+    if(report)
+      watcher_event(w, child, WATCH_CREATE, directory, now);
+
+    if(directory) {
+      if((r = watcher_scan(w, child, report, now)) > 0)
+        n += r;
+
+      /* out of watches: stop, a deleted or unreadable one doesn't matter */
+      if(r == -1 && (errno == ENOSPC || errno == ENOMEM)) {
+        free(child);
+        closedir(dir);
+        return -1;
+      }
+    }
+
+    free(child);
+  }
+
+  closedir(dir);
+  return n;
+}
+
+static void
+move_free(WatchMove* m) {
+  free(m->path);
+  free(m->from);
+  free(m);
+}
+
+/* completes a move, 'to' is 0 when it went out of the watched trees */
+static void
+watcher_moved(Watcher* w, WatchMove* m, const char* to, uint64_t now) {
+  const char* origin = m->from ? m->from : m->path;
+  WatchPending* p;
+
+  if(m->directory) {
+    if(to)
+      dirs_rename(w, m->path, to);
+    else
+      dirs_unwatch(w, m->path);
+  }
+
+  if(!to) {
+    if(m->before != WATCH_CREATE)
+      watcher_event(w, origin, WATCH_DELETE, m->directory, m->time);
+
+    return;
+  }
+
+  if(!(p = pending_get(w, to, now)))
+    return;
+
+  p->last = now;
+  p->directory = m->directory;
+
+  /* a new file moved over 'to', like an editor saving it */
+  if(m->before == WATCH_CREATE) {
+    p->type = p->type == WATCH_CREATE ? WATCH_CREATE : WATCH_CHANGE;
+    return;
+  }
+
+  /* moved back */
+  if(!strcmp(origin, to)) {
+    if(m->before == WATCH_CHANGE || p->type)
+      p->type = p->type ? p->type : WATCH_CHANGE;
+    else
+      pending_delete(w, pending_find(w, to, p->hash));
+
+    return;
+  }
+
+  free(p->from);
+  p->from = strdup(origin);
+  p->type = WATCH_RENAME;
+}
+
+static void
+watcher_rescan(Watcher* w, uint64_t now) {
+  for(uint32_t i = 0; i < w->num_roots; i++) {
+    struct stat st;
+
+    if(lstat(w->roots[i], &st) == 0 && S_ISDIR(st.st_mode))
+      watcher_scan(w, w->roots[i], 0, now);
+
+    watcher_event(w, w->roots[i], WATCH_RESCAN, 1, now);
+  }
+}
+
+static int
+watcher_is_root(const Watcher* w, const char* path) {
+  for(uint32_t i = 0; i < w->num_roots; i++)
+    if(!strcmp(w->roots[i], path))
+      return 1;
+
+  return 0;
+}
+
+/* whether another root contains 'path' */
+static int
+watcher_is_enclosed(const Watcher* w, const char* path) {
+  for(uint32_t i = 0; i < w->num_roots; i++)
+    if(strcmp(w->roots[i], path) && path_below(path, w->roots[i]))
+      return 1;
+
+  return 0;
+}
+
+static void
+watcher_handle(Watcher* w, const struct inotify_event* ev, uint64_t now) {
+  WatchDir** pd;
+  char* path;
+  int directory = !!(ev->mask & IN_ISDIR);
+
+  if(ev->mask & IN_Q_OVERFLOW) {
+    watcher_rescan(w, now);
+    return;
+  }
+
+  if(!*(pd = dir_find(w, ev->wd)))
+    return;
+
+  if(ev->mask & IN_IGNORED) {
+    dir_delete(w, pd);
+    return;
+  }
+
+  /* only roots report on themselves, the others through their parent */
+  if(ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT)) {
+    if(watcher_is_root(w, (*pd)->path))
+      watcher_event(w, (*pd)->path, WATCH_DELETE, !(*pd)->file, now);
+
+    return;
+  }
+
+  if(ev->len == 0 || ev->name[0] == '\0') {
+    if((*pd)->file)
+      watcher_event(w, (*pd)->path, WATCH_CHANGE, 0, now);
+
+    return;
+  }
+
+  if(!(path = path_join((*pd)->path, ev->name)))
+    return;
+
+  if(ev->mask & IN_MOVED_FROM) {
+    WatchMove* m;
+
+    if((m = calloc(1, sizeof(WatchMove)))) {
+      m->cookie = ev->cookie;
+      m->directory = directory;
+      m->path = path;
+      m->time = now;
+      m->before = pending_take(w, path, &m->from);
+      m->next = w->moves;
+      w->moves = m;
+      return;
+    }
+  } else if(ev->mask & IN_MOVED_TO) {
+    WatchMove** pm;
+
+    for(pm = &w->moves; *pm; pm = &(*pm)->next)
+      if((*pm)->cookie == ev->cookie)
+        break;
+
+    if(*pm) {
+      WatchMove* m = *pm;
+
+      *pm = m->next;
+      watcher_moved(w, m, path, now);
+      move_free(m);
+    } else {
+      watcher_event(w, path, WATCH_CREATE, directory, now);
+
+      if(directory)
+        watcher_scan(w, path, 1, now);
+    }
+  } else if(ev->mask & IN_CREATE) {
+    watcher_event(w, path, WATCH_CREATE, directory, now);
+
+    if(directory)
+      watcher_scan(w, path, 1, now);
+  } else if(ev->mask & IN_DELETE) {
+    watcher_event(w, path, WATCH_DELETE, directory, now);
+  } else if(ev->mask & (IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB)) {
+    watcher_event(w, path, WATCH_CHANGE, directory, now);
+  }
+
+  free(path);
+}
+
+static uint64_t
+pending_due(const Watcher* w, const WatchPending* p) {
+  uint64_t quiet = p->last + w->delay, limit = p->first + w->max_delay;
+
+  return quiet < limit ? quiet : limit;
+}
+
+/* sets the timer to the earliest time something is due */
+static void
+watcher_arm(Watcher* w) {
+  struct itimerspec its = {{0, 0}, {0, 0}};
+  uint64_t due = UINT64_MAX;
+
+  for(uint32_t i = 0; i < w->num_pending_buckets; i++)
+    for(WatchPending* p = w->pending[i]; p; p = p->next) {
+      uint64_t t = pending_due(w, p);
+
+      if(t < due)
+        due = t;
+    }
+
+  for(WatchMove* m = w->moves; m; m = m->next)
+    if(m->time + w->delay < due)
+      due = m->time + w->delay;
+
+  /* 0 disarms, so the earliest is 1ns */
+  if(due != UINT64_MAX) {
+    its.it_value.tv_sec = due / 1000;
+    its.it_value.tv_nsec = (due % 1000) * 1000000 + 1;
+  }
+
+  timerfd_settime(w->timer, TFD_TIMER_ABSTIME, &its, 0);
+}
+
+Watcher*
+watcher_new(uint32_t delay, uint32_t max_delay) {
+  Watcher* w;
+
+  if(!(w = calloc(1, sizeof(Watcher))))
+    return 0;
+
+  w->fd = w->timer = -1;
+  w->delay = delay;
+  w->max_delay = max_delay < delay ? delay : max_delay;
+  w->num_dir_buckets = w->num_pending_buckets = WATCHER_MIN_BUCKETS;
+
+  if(!(w->dirs = calloc(w->num_dir_buckets, sizeof(WatchDir*))) || !(w->pending = calloc(w->num_pending_buckets, sizeof(WatchPending*))))
+    goto fail;
+
+  if((w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1)
+    goto fail;
+
+  if((w->timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) == -1)
+    goto fail;
+
+  return w;
+
+fail:
+  watcher_free(w);
+  return 0;
+}
+
+void
+watcher_free(Watcher* w) {
+  int err = errno;
+
+  if(w->dirs)
+    for(uint32_t i = 0; i < w->num_dir_buckets; i++)
+      while(w->dirs[i])
+        dir_delete(w, &w->dirs[i]);
+
+  if(w->pending)
+    for(uint32_t i = 0; i < w->num_pending_buckets; i++)
+      while(w->pending[i])
+        pending_delete(w, &w->pending[i]);
+
+  while(w->moves) {
+    WatchMove* m = w->moves;
+
+    w->moves = m->next;
+    move_free(m);
+  }
+
+  for(uint32_t i = 0; i < w->num_roots; i++)
+    free(w->roots[i]);
+
+  if(w->fd != -1)
+    close(w->fd);
+  if(w->timer != -1)
+    close(w->timer);
+
+  free(w->roots);
+  free(w->dirs);
+  free(w->pending);
+  free(w);
+  errno = err;
+}
+
+int
+watcher_fd(const Watcher* w) {
+  return w->fd;
+}
+
+int
+watcher_timer(const Watcher* w) {
+  return w->timer;
+}
+
+/* watches 'path', a directory recursively. returns the number of new
+ * watches, -1 with errno set */
+int
+watcher_add(Watcher* w, const char* path) {
+  struct stat st;
+  char *root, **roots;
+  size_t len = strlen(path);
+  int n;
+
+  while(len > 1 && path[len - 1] == '/')
+    --len;
+
+  if(!(root = strndup(path, len)))
+    return -1;
+
+  if(stat(root, &st) == -1)
+    goto fail;
+
+  if(S_ISDIR(st.st_mode)) {
+    n = watcher_scan(w, root, 0, now_ms());
+  } else {
+    int wd;
+
+    if((wd = inotify_add_watch(w->fd, root, WATCHER_MASK)) == -1)
+      goto fail;
+
+    n = dir_set(w, wd, root, 1);
+  }
+
+  if(n == -1)
+    goto fail;
+
+  if(watcher_is_root(w, root)) {
+    free(root);
+    return n;
+  }
+
+  if(!(roots = realloc(w->roots, (w->num_roots + 1) * sizeof(char*)))) {
+    errno = ENOMEM;
+    goto fail;
+  }
+
+  w->roots = roots;
+  w->roots[w->num_roots++] = root;
+  return n;
+
+fail:
+  free(root);
+  return -1;
+}
+
+/* stops watching a path given to watcher_add(), returns 1 if it was one */
+int
+watcher_remove(Watcher* w, const char* path) {
+  size_t len = strlen(path);
+
+  while(len > 1 && path[len - 1] == '/')
+    --len;
+
+  for(uint32_t i = 0; i < w->num_roots; i++)
+    if(strlen(w->roots[i]) == len && !strncmp(w->roots[i], path, len)) {
+      char* root = w->roots[i];
+
+      memmove(&w->roots[i], &w->roots[i + 1], (w->num_roots - i - 1) * sizeof(char*));
+      --w->num_roots;
+
+      /* the directories are still watched for the enclosing root, a file
+       * watch only exists for this one */
+      if(watcher_is_enclosed(w, root)) {
+        for(uint32_t j = 0; j < w->num_dir_buckets; j++)
+          for(WatchDir** pd = &w->dirs[j]; *pd;)
+            if((*pd)->file && !strcmp((*pd)->path, root)) {
+              inotify_rm_watch(w->fd, (*pd)->wd);
+              dir_delete(w, pd);
+            } else {
+              pd = &(*pd)->next;
+            }
+
+        free(root);
+        return 1;
+      }
+
+      dirs_unwatch(w, root);
+
+      /* another root may be below this one */
+      for(uint32_t j = 0; j < w->num_roots; j++)
+        if(path_below(w->roots[j], root))
+          watcher_add(w, w->roots[j]);
+
+      free(root);
+      return 1;
+    }
+
+  return 0;
+}
+
+/* reads and merges the queued events, returns how many or -1 */
+int
+watcher_read(Watcher* w) {
+  char buf[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+  uint64_t now = now_ms();
+  ssize_t r;
+  int n = 0;
+
+  while((r = read(w->fd, buf, sizeof(buf))) > 0 || (r == -1 && errno == EINTR))
+    for(char* ptr = buf; r > 0 && ptr < buf + r;) {
+      const struct inotify_event* ev = (const struct inotify_event*)ptr;
+
+      watcher_handle(w, ev, now);
+      ptr += sizeof(struct inotify_event) + ev->len;
+      ++n;
+    }
+
+  watcher_arm(w);
+
+  return r == -1 && errno != EAGAIN ? -1 : n;
+}
+
+static int
+event_compare(const void* a, const void* b) {
+  const WatchPending *const *x = a, *const *y = b;
+
+  return (*x)->seq < (*y)->seq ? -1 : (*x)->seq > (*y)->seq;
+}
+
+/* returns the events that are due, in the order of their first event */
+size_t
+watcher_take(Watcher* w, WatchEvent** events) {
+  uint64_t now = now_ms(), buf;
+  WatchPending** due = 0;
+  size_t n = 0, i;
+
+  *events = 0;
+
+  while(read(w->timer, &buf, sizeof(buf)) > 0)
+    ;
+
+  /* moves without a counterpart went out of the trees */
+  for(WatchMove** pm = &w->moves; *pm;) {
+    WatchMove* m = *pm;
+
+    if(m->time + w->delay <= now) {
+      *pm = m->next;
+      watcher_moved(w, m, 0, now);
+      move_free(m);
+    } else {
+      pm = &m->next;
+    }
+  }
+
+  if(w->num_pending && !(due = malloc(w->num_pending * sizeof(WatchPending*))))
+    goto end;
+
+  for(i = 0; i < w->num_pending_buckets; i++)
+    for(WatchPending** pp = &w->pending[i]; *pp; pp = &(*pp)->next)
+      if(pending_due(w, *pp) <= now)
+        due[n++] = *pp;
+
+  if(n == 0 || !(*events = calloc(n, sizeof(WatchEvent)))) {
+    n = 0;
+    goto end;
+  }
+
+  qsort(due, n, sizeof(WatchPending*), event_compare);
+
+  for(i = 0; i < n; i++) {
+    WatchPending* p = due[i];
+
+    (*events)[i].type = p->type;
+    (*events)[i].directory = p->directory;
+    (*events)[i].path = strdup(p->path);
+    (*events)[i].from = p->from;
+    p->from = 0;
+
+    pending_delete(w, pending_find(w, p->path, p->hash));
+  }
+
+end:
+  free(due);
+  watcher_arm(w);
+  return n;
+}
+
+void
+watcher_events_free(WatchEvent* events, size_t n) {
+  for(size_t i = 0; i < n; i++) {
+    free(events[i].path);
+    free(events[i].from);
+  }
+
+  free(events);
+}
+
+/* number of watched directories and files */
+uint32_t
+watcher_count(const Watcher* w) {
+  return w->num_dirs;
+}
+
+/* number of paths with pending events */
+uint32_t
+watcher_pending(const Watcher* w) {
+  return w->num_pending;
+}
+
+uint32_t
+watcher_roots(const Watcher* w, const char*** roots) {
+  *roots = (const char**)w->roots;
+  return w->num_roots;
+}
+
+/**
+ * @}
+ */
+#endif /* HAVE_INOTIFY_INIT1 */
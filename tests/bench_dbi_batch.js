@@ -0,0 +1,53 @@
+import { Database } from '../lib/dbi.js';
+
+/* Statements per second with and without dbi batching, issuing 'batch'
+ * INSERTs per tick and awaiting them together:
+ *
+ *   qjsm tests/bench_dbi_batch.js mysql [host] [user] [password] [database] [count] [batch]
+ *   qjsm tests/bench_dbi_batch.js pgsql [host] [user] [password] [database] [count] [batch]
+ */
+function optionsFor(driver, [host, user, password, database]) {
+  switch(driver) {
+    case 'mysql': return { host: host ?? 'localhost', user: user ?? 'roman', password: password ?? '', database: database ?? 'test' };
+    case 'pgsql': return { host: host ?? 'localhost', user: user ?? 'roman', password: password ?? '', database: database ?? 'roman' };
+    default: throw new Error(`unsupported driver: ${driver}`);
+  }
+}
+
+async function run(driver, options, count, batch) {
+  const db = await Database.connect(driver, options);
+
+  await db.exec('DROP TABLE IF EXISTS bench_batch');
+  await db.exec('CREATE TABLE bench_batch (id INTEGER, name VARCHAR(32))');
+
+  const start = Date.now();
+
+  for(let i = 0; i < count; i += batch) {
+    const pending = [];
+    for(let j = i; j < Math.min(i + batch, count); j++) pending.push(db.exec(`INSERT INTO bench_batch VALUES (${j}, 'row${j}')`));
+    await Promise.all(pending);
+  }
+
+  const secs = Math.max(Date.now() - start, 1) / 1000,
+    { roundTrips } = db.batchStats;
+
+  await db.exec('DROP TABLE bench_batch');
+  await db.close();
+
+  return [count / secs, roundTrips];
+}
+
+async function main(driver = 'pgsql', host, user, password, database, count = 10000, batch = 100) {
+  const options = optionsFor(driver, [host, user, password, database]);
+
+  count = +count;
+  batch = +batch;
+
+  const [single] = await run(driver, options, count, batch);
+  const [batched, roundTrips] = await run(driver, { ...options, batch: true }, count, batch);
+
+  console.log(`unbatched: ${Math.round(single)} statements/s, ${count} round trips`);
+  console.log(`batched: ${Math.round(batched)} statements/s (${(batched / single).toFixed(1)}x), ${roundTrips} round trips`);
+}
+
+main(...scriptArgs.slice(1));
@@ -0,0 +1,86 @@
+import * as fs from 'fs';
+import * as path from 'path';
+import { asyncReadFile } from 'misc';
+import * as os from 'os';
+import { getenv } from 'std';
+
+/* Lateness of a 1 ms timer while files are read concurrently, with reads
+ * on the event loop (what fs.readFile() used to do) vs. on the thread pool:
+ *
+ *   qjsm tests/bench_fs_jitter.js [files] [megabytes] [rounds]
+ */
+const DIR = path.join(getenv('TMPDIR') ?? '/tmp', `qjs-fs-jitter-${Date.now()}`);
+
+function makeFiles(n, size) {
+  const chunk = new Uint8Array(1 << 20).map((_, i) => i & 0xff);
+  const files = [];
+
+  fs.mkdirSync(DIR);
+
+  for(let i = 0; i < n; i++) {
+    const file = path.join(DIR, `file${i}`);
+    const fd = os.open(file, os.O_WRONLY | os.O_CREAT | os.O_TRUNC, 0o644);
+
+    for(let j = 0; j < size; j++) os.write(fd, chunk.buffer, 0, chunk.byteLength);
+
+    os.close(fd);
+    files.push(file);
+  }
+
+  return files;
+}
+
+/* starts a timer which re-arms itself every ms and records how late it fires */
+function ticker() {
+  const late = [];
+  let last = Date.now(),
+    timer;
+
+  const tick = () => {
+    const now = Date.now();
+
+    late.push(Math.max(now - last - 1, 0));
+    last = now;
+    timer = os.setTimeout(tick, 1);
+  };
+
+  timer = os.setTimeout(tick, 1);
+
+  return () => (os.clearTimeout(timer), late);
+}
+
+const sleep = ms => new Promise(resolve => os.setTimeout(resolve, ms));
+
+async function run(name, files, rounds, read) {
+  const stop = ticker();
+  const start = Date.now();
+  let bytes = 0;
+
+  await sleep(10);
+
+  for(let i = 0; i < rounds; i++) for (const data of await Promise.all(files.map(read))) bytes += data.byteLength;
+
+  const secs = Math.max(Date.now() - start, 1) / 1000;
+
+  await sleep(10);
+
+  const late = stop().sort((a, b) => a - b);
+  const p99 = late[Math.floor(late.length * 0.99)] ?? 0;
+
+  console.log(`${name.padEnd(12)} ${(bytes / secs / 1048576).toFixed(0).padStart(6)} MB/s   ticks ${String(late.length).padStart(5)}   p99 ${p99} ms   max ${late[late.length - 1] ?? 0} ms`);
+}
+
+async function main(n = 8, size = 32, rounds = 3) {
+  const files = makeFiles(+n, +size);
+
+  try {
+    await run('event loop', files, +rounds, async file => fs.readFileSync(file));
+    await run('thread pool', files, +rounds, file => asyncReadFile(file));
+  } finally {
+    for(const file of files) fs.unlinkSync(file);
+
+    fs.unlinkSync(DIR);
+  }
+}
+
+main(...scriptArgs.slice(1));
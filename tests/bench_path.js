@@ -0,0 +1,47 @@
+import * as path from 'path';
+
+/* Calls per second of the path functions the module loader and lib/fs.js
+ * use most, on a set of module-like paths:
+ *
+ *   qjsm tests/bench_path.js [count] [filter]
+ */
+function makePaths(n) {
+  const dirs = ['lib', 'src', 'node_modules/pkg/lib', '../shared', './tests', 'lib/../src/util'];
+  const paths = [];
+
+  for(let i = 0; i < n; i++) paths.push(`${dirs[i % dirs.length]}/./${i % 7 == 0 ? '../' : ''}module${i % 97}.js`);
+
+  return paths;
+}
+
+function bench(name, paths, count, fn) {
+  const start = Date.now();
+  let calls = 0;
+
+  while(calls < count) calls += fn(paths);
+
+  const secs = Math.max(Date.now() - start, 1) / 1000;
+
+  console.log(`${name.padEnd(24)} ${Math.round(calls / secs)} paths/s`);
+}
+
+function main(count = 200000, filter) {
+  count = +count;
+
+  const paths = makePaths(1000);
+  const cwd = path.getcwd();
+  const suites = {
+    normalize: ps => (ps.forEach(p => path.normalize(p)), ps.length),
+    normalizeMany: ps => (path.normalizeMany(ps), ps.length),
+    intern: ps => (ps.forEach(p => path.intern(p)), ps.length),
+    resolve: ps => (ps.forEach(p => path.resolve(p)), ps.length),
+    'resolve(cwd, p)': ps => (ps.forEach(p => path.resolve(cwd, p)), ps.length),
+    relative: ps => (ps.forEach(p => path.relative(cwd, p)), ps.length),
+    join: ps => (ps.forEach(p => path.join(cwd, p)), ps.length),
+    components: ps => (ps.forEach(p => path.components(p)), ps.length),
+  };
+
+  for(const [name, fn] of Object.entries(suites)) if(!filter || name.includes(filter)) bench(name, paths, count, fn);
+}
+
+main(...scriptArgs.slice(1));
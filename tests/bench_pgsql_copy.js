@@ -0,0 +1,68 @@
+import { PGconn } from 'pgsql';
+import { getenv } from 'std';
+import { ReadableStream } from '../lib/stream.js';
+
+/* Bulk load rate, multi-row INSERT statements of 'batch' rows vs.
+ * copyFrom() from a string and from a ReadableStream producing 'batch'
+ * rows per chunk (PGTEST_CONNINFO selects the server):
+ *
+ *   qjsm tests/bench_pgsql_copy.js [rows] [batch]
+ */
+async function setup() {
+  const pg = new PGconn();
+  pg.connect(getenv('PGTEST_CONNINFO') ?? 'host=localhost dbname=postgres');
+  if(pg.errorMessage) throw new Error(pg.errorMessage);
+  pg.nonblocking = true;
+  await pg.query('DROP TABLE IF EXISTS bench; CREATE UNLOGGED TABLE bench (id int4, name text, value float8)');
+  return pg;
+}
+
+async function measure(rows, load) {
+  const pg = await setup();
+  const start = Date.now();
+
+  await load(pg);
+  pg.close();
+
+  return rows / (Math.max(Date.now() - start, 1) / 1000);
+}
+
+const line = i => `${i}\trow${i}\t${i * 0.5}\n`;
+
+async function main(rows = 200000, batch = 1000) {
+  rows = +rows;
+  batch = +batch;
+
+  const inserts = await measure(rows, async pg => {
+    for(let i = 0; i < rows; i += batch) {
+      const values = [];
+      for(let j = i; j < Math.min(i + batch, rows); j++) values.push(`(${j}, 'row${j}', ${j * 0.5})`);
+      await pg.query(`INSERT INTO bench VALUES ${values.join(', ')}`);
+    }
+  });
+
+  const string = await measure(rows, async pg => {
+    let data = '';
+    for(let i = 0; i < rows; i++) data += line(i);
+    await pg.copyFrom('COPY bench FROM STDIN', data);
+  });
+
+  const stream = await measure(rows, async pg => {
+    let i = 0;
+    const source = new ReadableStream({
+      pull(controller) {
+        if(i >= rows) return controller.close();
+        let chunk = '';
+        for(const end = Math.min(i + batch, rows); i < end; i++) chunk += line(i);
+        controller.enqueue(chunk);
+      },
+    });
+    await pg.copyFrom('COPY bench FROM STDIN', source);
+  });
+
+  console.log(`INSERT x ${batch}: ${Math.round(inserts)} rows/s`);
+  console.log(`copyFrom(string): ${Math.round(string)} rows/s (${(string / inserts).toFixed(1)}x)`);
+  console.log(`copyFrom(ReadableStream): ${Math.round(stream)} rows/s (${(stream / inserts).toFixed(1)}x)`);
+}
+
+main(...scriptArgs.slice(1));
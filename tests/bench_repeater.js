@@ -0,0 +1,39 @@
+import { Repeater } from 'repeater';
+
+/* Pushes per second through a Repeater, per-item promises vs. batched mode:
+ *
+ *   qjsm tests/bench_repeater.js [count] [batch]
+ */
+async function run(count, options) {
+  let received = 0;
+  const rpt = new Repeater(async (push, stop) => {
+    for(let i = 0; i < count; i++) {
+      const p = push(i);
+      if(p) await p;
+    }
+    stop();
+  }, options);
+
+  const start = Date.now();
+
+  for await(const value of rpt) received += options ? value.length : 1;
+
+  const secs = Math.max(Date.now() - start, 1) / 1000;
+
+  if(received != count) throw new Error(`received ${received} of ${count} values`);
+
+  return count / secs;
+}
+
+async function main(count = 100000, batch = 256) {
+  count = +count;
+  batch = +batch;
+
+  const single = await run(count);
+  const batched = await run(count, { batch });
+
+  console.log(`per-item: ${Math.round(single)} pushes/s`);
+  console.log(`batch=${batch}: ${Math.round(batched)} pushes/s (${(batched / single).toFixed(1)}x)`);
+}
+
+main(...scriptArgs.slice(1));
@@ -0,0 +1,50 @@
+import { SQLite3 } from 'sqlite';
+
+/* Bulk insert rate, interpolated SQL strings vs. a prepared statement vs.
+ * insertMany() over typed arrays (on a file, the database runs in WAL mode):
+ *
+ *   qjsm tests/bench_sqlite.js [rows] [file]
+ */
+function setup(file) {
+  const db = new SQLite3(file);
+  if(file != ':memory:') db.exec(`PRAGMA journal_mode = WAL; PRAGMA synchronous = NORMAL`);
+  db.exec(`DROP TABLE IF EXISTS bench; CREATE TABLE bench (id INTEGER PRIMARY KEY, name TEXT, value REAL)`);
+  return db;
+}
+
+function measure(db, rows, insert) {
+  const start = Date.now();
+
+  db.exec('BEGIN');
+  for(let i = 0; i < rows; i++) insert(i, 'row' + i, i * 0.5);
+  db.exec('COMMIT');
+
+  return rows / (Math.max(Date.now() - start, 1) / 1000);
+}
+
+function main(rows = 100000, file = ':memory:') {
+  rows = +rows;
+
+  let db = setup(file);
+  const strings = measure(db, rows, (...row) => db.query(db.insertQuery('bench', ['id', 'name', 'value'], row)));
+  db.close();
+
+  db = setup(file);
+  const st = db.prepare('INSERT INTO bench (id, name, value) VALUES (?, ?, ?)');
+  const prepared = measure(db, rows, (...row) => st.run(...row));
+  db.close();
+
+  db = setup(file);
+  const id = new Float64Array(rows).map((_, i) => i);
+  const value = id.map(i => i * 0.5);
+  const start = Date.now();
+  db.insertMany('bench', ['id', 'value'], { id, value });
+  const many = rows / (Math.max(Date.now() - start, 1) / 1000);
+  db.close();
+
+  console.log(`insertQuery(): ${Math.round(strings)} rows/s`);
+  console.log(`prepare().run(): ${Math.round(prepared)} rows/s (${(prepared / strings).toFixed(1)}x)`);
+  console.log(`insertMany(): ${Math.round(many)} rows/s (${(many / strings).toFixed(1)}x)`);
+}
+
+main(...scriptArgs.slice(1));
@@ -1,10 +1,45 @@
 import * as os from 'os';
 import * as std from 'std';
-import { Archive, ArchiveEntry, ArchiveMatch } from 'archive';
+import { Archive, ArchiveCache, ArchiveEntry, ArchiveIndex, ArchiveMatch } from 'archive';
 import { assert, eq, tests } from './tinytest.js';
 
 const TAR = 'test_archive.tar';
 const TARGZ = 'test_archive.tar.gz';
+const ZIP = 'test_archive.zip';
+const EXTRACT_DIR = 'test_archive_index_dir';
+const CREATED = ['test_archive_created.tar.gz', 'test_archive_created.tar'];
+const FILES = [
+  ['a.txt', 'first'],
+  ['sub/b.txt', 'second entry'],
+  ['sub/c.txt', 'x'.repeat(100000)],
+  ['d.txt', 'last'],
+];
+
+function writeArchive(file) {
+  const w = Archive.write(file);
+
+  for(const [name, data] of FILES) {
+    const e = new ArchiveEntry(name, data.length);
+    e.mode = 0o100644;
+    w.write(e, data);
+  }
+
+  w.close();
+}
+
+function removeExtracted() {
+  for(const [name] of FILES) {
+    try {
+      os.remove(EXTRACT_DIR + '/' + name);
+    } catch(e) {}
+  }
+
+  for(const dir of [EXTRACT_DIR + '/sub', EXTRACT_DIR]) {
+    try {
+      os.remove(dir);
+    } catch(e) {}
+  }
+}
 
 function readWhole(path) {
   const f = std.open(path, 'r');
@@ -18,7 +53,9 @@ function readWhole(path) {
 }
 
 function cleanup() {
-  for(const f of [TAR, TARGZ]) {
+  removeExtracted();
+
+  for(const f of [TAR, TARGZ, ZIP, ...CREATED]) {
     try {
       os.remove(f);
     } catch(e) {}
@@ -262,6 +299,131 @@ tests({
     assert(Archive.prototype === Object.getPrototypeOf(a));
   },
 
+  'ArchiveIndex lookup and random access'() {
+    writeArchive(TAR);
+
+    for(const file of [TAR, ZIP]) {
+      if(file == ZIP) writeArchive(ZIP);
+
+      const index = new ArchiveIndex(file);
+      eq(index.size, FILES.length);
+      eq(index.file, file);
+      assert(index.seekable, `${file} should be seekable`);
+      eq(index.paths.join(), FILES.map(([name]) => name).join());
+
+      assert(index.has('sub/b.txt'));
+      assert(!index.has('missing.txt'));
+      eq(index.get('sub/c.txt').size, 100000);
+      eq(index.get('missing.txt'), undefined);
+      eq(index.open('missing.txt'), null);
+
+      for(const [name, data] of FILES.slice().reverse()) {
+        const ar = index.open(name);
+        eq(ar.entry.pathname, name);
+        const buf = new ArrayBuffer(data.length);
+        eq(ar.read(buf), data.length);
+        eq(String.fromCharCode(...new Uint8Array(buf, 0, 16)), data.slice(0, 16));
+        ar.close();
+      }
+    }
+
+    const gz = new ArchiveIndex(TARGZ);
+    assert(!gz.seekable);
+    eq(gz.paths.join(), 'data.txt');
+  },
+
+  async 'ArchiveIndex.extract()'() {
+    removeExtracted();
+
+    for(const file of [TAR, ZIP, TARGZ]) {
+      const index = new ArchiveIndex(file);
+      eq(await index.extract(EXTRACT_DIR, { concurrency: 3 }), index.size);
+    }
+
+    for(const [name, data] of FILES) eq(std.loadFile(EXTRACT_DIR + '/' + name), data);
+    eq(std.loadFile(EXTRACT_DIR + '/data.txt'), 'hello gzip!');
+    os.remove(EXTRACT_DIR + '/data.txt');
+    removeExtracted();
+
+    eq(await new ArchiveIndex(ZIP).extract(EXTRACT_DIR, { paths: ['d.txt'] }), 1);
+    eq(std.loadFile(EXTRACT_DIR + '/d.txt'), 'last');
+    eq(std.loadFile(EXTRACT_DIR + '/a.txt'), null);
+    removeExtracted();
+
+    let error;
+    try {
+      await new ArchiveIndex(ZIP).extract(EXTRACT_DIR, { paths: ['missing.txt'] });
+    } catch(e) {
+      error = e;
+    }
+    assert(error instanceof Error);
+    removeExtracted();
+  },
+
+  async 'Archive.create()'() {
+    removeExtracted();
+    eq(await new ArchiveIndex(TAR).extract(EXTRACT_DIR), FILES.length);
+
+    const entries = FILES.map(([name]) => ({ file: EXTRACT_DIR + '/' + name, pathname: name }));
+
+    for(const file of CREATED) {
+      const bytes = await Archive.create(file, entries, { blockSize: 65536 });
+      eq(bytes, os.stat(file)[0].size);
+
+      const index = new ArchiveIndex(file);
+      eq(index.paths.join(), FILES.map(([name]) => name).join());
+
+      for(const [name, data] of FILES) {
+        const ar = index.open(name);
+        const buf = new ArrayBuffer(data.length);
+        eq(ar.read(buf), data.length);
+        eq(String.fromCharCode(...new Uint8Array(buf, Math.max(0, data.length - 16))), data.slice(-16));
+        ar.close();
+      }
+    }
+
+    assert(new Uint8Array(readWhole(CREATED[0]), 0, 2).join() == '31,139', 'gzip output');
+
+    let error;
+    try {
+      await Archive.create(CREATED[0], [EXTRACT_DIR + '/missing.txt']);
+    } catch(e) {
+      error = e;
+    }
+    assert(error instanceof Error);
+    removeExtracted();
+  },
+
+  'ArchiveCache'() {
+    const cache = new ArchiveCache(100);
+    const data = new Uint8Array(40).fill(65).buffer;
+
+    eq(cache.set('a', 0, 1, data), true);
+    eq(cache.set('alias', 0, 1), false);
+    eq(cache.set('b', 1, 1, data), true);
+    eq(cache.locate('alias').join(), '0,1');
+    eq(cache.get('alias').byteLength, 40);
+    eq(cache.get('missing'), undefined);
+    eq(cache.hits, 1);
+    eq(cache.misses, 1);
+
+    /* 'a' was used last, 'b' goes */
+    eq(cache.set('c', 1, 2, data), true);
+    eq(cache.evictions, 1);
+    eq(cache.get('b'), undefined);
+    assert(cache.get('a') instanceof ArrayBuffer);
+    eq(cache.size, 80);
+    eq(cache.set('huge', 2, 0, new ArrayBuffer(101)), false);
+
+    eq(cache.invalidate(0), 2);
+    eq(cache.count, 1);
+    eq(cache.paths, 3);
+    cache.budget = 0;
+    eq(cache.size, 0);
+    cache.clear();
+    eq(cache.paths, 0);
+  },
+
   'teardown'() {
     cleanup();
   },
@@ -2,6 +2,9 @@ import { ReadableStream } from 'stream';
 import { assert_equals, assert_throws_js, assert_true, promise_test, test } from '../lib/testharnessreport.js';
 import { Blob } from 'blob';
 import { TextEncoder } from 'textcode';
+import { File } from '../lib/file.js';
+import * as std from 'std';
+import * as os from 'os';
 
 test(() => {
   const blob = new Blob();
@@ -397,4 +400,119 @@ promise_test(async () => {
 
   assert_true(done);
   assert_equals(chunk, undefined);
-}, '.stream() returned ReadableStream can be cancelled');
\ No newline at end of file
+}, '.stream() returned ReadableStream can be cancelled');
+function tempFile(content) {
+  const filename = `${std.getenv('TMPDIR') ?? '/tmp'}/qjs-blob-test-${Date.now()}-${Math.floor(Math.random() * 1e6)}.txt`;
+  const file = std.open(filename, 'w');
+  file.puts(content);
+  file.close();
+  return filename;
+}
+
+promise_test(async () => {
+  const filename = tempFile('0123456789'.repeat(10000));
+
+  try {
+    const blob = Blob.fromFile(filename, { type: 'text/plain' });
+
+    assert_equals(blob.size, 100000);
+    assert_equals(blob.type, 'text/plain');
+    assert_equals((await blob.text()).slice(0, 12), '012345678901');
+
+    const slice = blob.slice(99990);
+    assert_equals(await slice.text(), '0123456789');
+    assert_equals(await blob.slice(5, 8).text(), '567');
+
+    const bytes = await blob.bytes();
+    assert_equals(bytes.length, 100000);
+    assert_equals(bytes[99999], 0x39);
+
+    const copy = new Blob([blob.slice(0, 3), 'x', blob.slice(3, 5)]);
+    assert_equals(await copy.text(), '012x34');
+  } finally {
+    os.remove(filename);
+  }
+}, 'Blob.fromFile() maps the file, slices are views');
+
+promise_test(async () => {
+  const filename = tempFile('abc'.repeat(50000));
+
+  try {
+    const reader = Blob.fromFile(filename).stream().getReader();
+    let length = 0, chunks = 0;
+
+    for(;;) {
+      const { done, value } = await reader.read();
+      if(done) break;
+      length += value.length;
+      chunks++;
+    }
+
+    assert_equals(length, 150000);
+    assert_true(chunks > 1);
+  } finally {
+    os.remove(filename);
+  }
+}, 'Blob.fromFile() streams in chunks');
+
+promise_test(async () => {
+  const filename = tempFile('0123456789'.repeat(1000));
+
+  try {
+    const blob = Blob.fromFile(filename);
+    const slice = blob.slice(4097, 4100);
+
+    new Uint8Array(await blob.arrayBuffer()).fill(0x41);
+    (await slice.bytes())[0] = 0x42;
+
+    const { value } = await blob.stream().getReader().read();
+    value[0] = 0x43;
+
+    assert_equals((await blob.text()).slice(0, 4), '0123');
+    assert_equals(await slice.text(), '789');
+    assert_equals(new Uint8Array(await blob.arrayBuffer())[0], 0x30);
+    assert_equals((await blob.bytes())[4097], 0x37);
+
+    const memory = new Blob(['abc']);
+    new Uint8Array(await memory.arrayBuffer())[0] = 0x41;
+    assert_equals(await memory.text(), 'abc');
+  } finally {
+    os.remove(filename);
+  }
+}, 'Buffers from Blob.fromFile() are copies');
+
+promise_test(async () => {
+  const filename = tempFile('');
+
+  try {
+    const blob = Blob.fromFile(filename);
+    assert_equals(blob.size, 0);
+    assert_equals(await blob.text(), '');
+  } finally {
+    os.remove(filename);
+  }
+
+  let error;
+  try {
+    Blob.fromFile(filename);
+  } catch(e) {
+    error = e;
+  }
+  assert_true(error instanceof Error);
+}, 'Blob.fromFile() with empty and missing files');
+
+promise_test(async () => {
+  const filename = tempFile('hello');
+
+  try {
+    const file = File.fromFile(filename, { type: 'text/plain' });
+
+    assert_true(file instanceof File);
+    assert_equals(file.name, filename.replace(/.*\//, ''));
+    assert_equals(file.size, 5);
+    assert_equals(file.type, 'text/plain');
+    assert_equals(await file.text(), 'hello');
+  } finally {
+    os.remove(filename);
+  }
+}, 'File.fromFile() is file-backed');
@@ -0,0 +1,63 @@
+import { Channel } from 'channel';
+import { assert, eq, tests } from './tinytest.js';
+
+const array = buf => [...new Uint8Array(buf)].join(',');
+
+tests({
+  'shared by name'() {
+    const a = new Channel('test-shared', 3);
+    const b = new Channel('test-shared');
+    eq(a.name, 'test-shared');
+    eq(b.capacity, 4);
+    eq(a.trySend({ x: 1, y: [2, 3] }), true);
+    eq(b.size, 1);
+    eq(JSON.stringify(b.tryRecv()), '{"x":1,"y":[2,3]}');
+    eq(b.tryRecv(), undefined);
+  },
+  'binary messages'() {
+    const ch = new Channel('test-binary');
+    ch.trySend(new Uint8Array([1, 2, 3]));
+    ch.trySend(new Uint16Array([0x0504]).buffer);
+    const first = ch.tryRecv();
+    assert(first instanceof ArrayBuffer);
+    eq(array(first), '1,2,3');
+    eq(array(ch.tryRecv()), '4,5');
+  },
+  'bounded'() {
+    const ch = new Channel('test-bounded', 2, { spsc: true });
+    assert(ch.spsc);
+    eq(ch.trySend(1), true);
+    eq(ch.trySend(2), true);
+    eq(ch.trySend(3), false);
+    eq(ch.tryRecv(), 1);
+    eq(ch.trySend(3), true);
+  },
+  async 'send/recv'() {
+    const tx = new Channel('test-async', 2);
+    const rx = new Channel('test-async');
+    const pending = rx.recv();
+    await tx.send('a');
+    eq(await pending, 'a');
+    await tx.send('b');
+    await tx.send('c');
+    const blocked = tx.send('d');
+    eq(rx.tryRecv(), 'b');
+    await blocked;
+    eq(await rx.recv(), 'c');
+    eq(await rx.recv(), 'd');
+  },
+  async 'close'() {
+    const ch = new Channel('test-close');
+    ch.trySend(1);
+    ch.trySend(2);
+    ch.close();
+    assert(ch.closed);
+    eq(ch.trySend(3), false);
+    const values = [];
+    for await(const value of new Channel('test-close')) values.push(value);
+    eq(values.join(','), '1,2');
+    let error;
+    await ch.recv().catch(e => (error = e));
+    assert(error instanceof TypeError);
+  },
+});
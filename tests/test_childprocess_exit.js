@@ -0,0 +1,42 @@
+import { spawn, exec } from 'child_process';
+import { waitpid } from 'os';
+import { assert, eq, tests } from './tinytest.js';
+
+tests({
+  async 'done resolves with the exit status'() {
+    const child = spawn('sh', ['-c', 'exit 7']);
+    const { exitCode, signalCode } = await child.done;
+    eq(exitCode, 7);
+    eq(signalCode, null);
+    eq(child.exitCode, 7);
+  },
+  async 'onExit fires once per child'() {
+    const codes = [];
+    const children = [1, 2, 3].map(n => {
+      const child = exec(`exit ${n}`);
+      child.onExit = code => codes.push(code);
+      return child;
+    });
+    await Promise.all(children.map(child => child.done));
+    eq(codes.sort().join(','), '1,2,3');
+  },
+  async 'killed child'() {
+    const child = spawn('sleep', ['10']);
+    assert(child.kill('SIGTERM'));
+    const { signalCode } = await child.done;
+    eq(signalCode, 'SIGTERM');
+    eq(child.killed, true);
+  },
+  async 'done after exit'() {
+    const child = spawn('true', []);
+    await child.done;
+    eq((await child.done).exitCode, 0);
+  },
+  async 'child reaped elsewhere'() {
+    const child = spawn('true', []);
+    eq(waitpid(child.pid, 0)[0], child.pid);
+    const { exitCode, signalCode } = await child.done;
+    eq(exitCode, null);
+    eq(signalCode, null);
+  },
+});
@@ -100,6 +100,12 @@ async function main(driver = 'sqlite', ...args) {
   }
   console.log('[dbi] row count =', count);
 
+  /* 4b. stream in batches */
+  const batchSizes = [];
+  for await(const batch of db.stream(`SELECT id, name FROM ${table} ORDER BY id;`, 2)) batchSizes.push(batch.length);
+  console.log('[dbi] stream batch sizes =', batchSizes);
+  if(batchSizes.join() != '2,1') throw new Error(`stream(): unexpected batch sizes ${batchSizes}`);
+
   /* 5. update */
   const updateSql = `UPDATE ${table} SET score = score + 10 WHERE name = ${db.quote('alice')};`;
   console.log(`[dbi] \x1b[33m${updateSql}\x1b[0m`);
@@ -0,0 +1,81 @@
+import { Database } from '../lib/dbi.js';
+import { assert, eq, tests } from './tinytest.js';
+
+/* sqlite has no batch(), so this covers the queueing and the fallback of
+ * running each statement on its own, the adapter path is exercised with a
+ * stub registered below */
+class StubAdapter {
+  constructor() {
+    this.sent = [];
+  }
+
+  async connect() {}
+
+  async query(sql) {
+    this.sent.push([sql]);
+    if(/fail/.test(sql)) throw new Error(sql);
+    return { rows: [[sql]] };
+  }
+
+  async batch(sqls) {
+    const results = [];
+
+    this.sent.push(sqls);
+
+    for(const sql of sqls) {
+      if(/fail/.test(sql)) {
+        results.push({ error: new Error(sql) });
+        break;
+      }
+      results.push({ raw: { rows: [[sql]] }, affectedRows: sql.length });
+    }
+
+    return results;
+  }
+}
+
+Database.register('stub', StubAdapter);
+
+tests({
+  async 'queries of one tick share a round trip'() {
+    const db = await Database.connect('stub', { batch: true });
+    const counts = await Promise.all(['a', 'bb', 'ccc;'].map(sql => db.exec(sql)));
+    eq(counts.join(), '1,2,3');
+    eq(JSON.stringify(db._adapter.sent), '[["a","bb","ccc"]]');
+    eq(db.batchStats.roundTrips, 1);
+    eq(db.batchStats.queries, 3);
+  },
+  async 'a failing statement rejects alone'() {
+    const db = await Database.connect('stub', { batch: true });
+    const results = await Promise.all(['a', 'fail', 'b', 'c'].map(sql => db.exec(sql).catch(e => e)));
+    assert(results[1] instanceof Error);
+    eq(results[0], 1);
+    eq(results[3], 1);
+    eq(JSON.stringify(db._adapter.sent), '[["a","fail","b","c"],["b","c"]]');
+  },
+  async 'multi-statement strings are sent on their own'() {
+    const db = await Database.connect('stub', { batch: true });
+    await Promise.all([db.exec('a'), db.exec('b; c')]);
+    eq(JSON.stringify(db._adapter.sent), '[["a"],["b; c"]]');
+  },
+  async 'queries during a batch form the next one'() {
+    const db = await Database.connect('stub', { batch: true });
+    const first = db.exec('a');
+    await Promise.resolve();
+    const rest = [db.exec('b'), db.exec('c')];
+    await Promise.all([first, ...rest]);
+    eq(JSON.stringify(db._adapter.sent), '[["a"],["b","c"]]');
+  },
+  async 'sqlite runs queued statements one by one'() {
+    const db = await Database.connect('sqlite', { filename: ':memory:', batch: true });
+    assert(db.batching);
+    await db.exec('CREATE TABLE t (id INTEGER PRIMARY KEY, name TEXT)');
+    const counts = await Promise.all([1, 2, 3].map(i => db.exec(`INSERT INTO t (name) VALUES ('n${i}')`)));
+    eq(counts.join(), '1,1,1');
+    const [[count]] = await (await db.query('SELECT count(*) FROM t')).all();
+    eq(count, 3);
+    eq(db.batchStats.batches, 0);
+    eq(db.batchStats.queries, 5);
+    await db.close();
+  },
+});
@@ -0,0 +1,101 @@
+import { Database, Pool } from '../lib/dbi.js';
+import { setTimeout } from 'os';
+import { assert, eq, tests } from './tinytest.js';
+
+const sleep = ms => new Promise(resolve => setTimeout(resolve, ms));
+
+tests({
+  async 'min and max size'() {
+    const pool = await Database.pool('sqlite', ':memory:', { min: 2, max: 3 });
+    eq(pool.stats.size, 2);
+    eq(pool.stats.idle, 2);
+    const conns = await Promise.all([pool.acquire(), pool.acquire(), pool.acquire()]);
+    eq(pool.stats.size, 3);
+    eq(pool.stats.busy, 3);
+    eq(pool.stats.utilization, 1);
+    for(const db of conns) db.release();
+    eq(pool.stats.idle, 3);
+    await pool.close();
+  },
+  async 'waiters are served in order'() {
+    const pool = new Pool('sqlite', ':memory:', { max: 1 });
+    const first = await pool.acquire();
+    const order = [];
+    const waiting = [1, 2, 3].map(i => pool.acquire().then(db => (order.push(i), db.release())));
+    eq(pool.stats.waiting, 3);
+    first.release();
+    await Promise.all(waiting);
+    eq(order.join(), '1,2,3');
+    eq(pool.stats.acquires, 4);
+    assert(pool.stats.maxWaitTime >= 0);
+    await pool.close();
+  },
+  async 'acquire timeout'() {
+    const pool = new Pool('sqlite', ':memory:', { max: 1, acquireTimeout: 20 });
+    const db = await pool.acquire();
+    let error;
+    await pool.acquire().catch(e => (error = e));
+    assert(error);
+    eq(pool.stats.timeouts, 1);
+    eq(pool.stats.waiting, 0);
+    db.release();
+    await pool.close();
+  },
+  async 'connections opened for timed out waiters are kept'() {
+    const pool = new Pool('sqlite', ':memory:', { max: 1, acquireTimeout: 40 });
+    const db = await pool.acquire();
+    const create = pool._create.bind(pool);
+    pool._create = async () => (await sleep(80), create());
+    const errors = [];
+    const first = pool.acquire().catch(e => errors.push(e));
+    await sleep(20);
+    const second = pool.acquire().catch(e => errors.push(e));
+    pool.release(db, true);
+    await sleep(30);
+    eq(errors.length, 1);
+    eq(pool.stats.waiting, 1);
+    await Promise.all([first, second, sleep(60)]);
+    eq(errors.length, 2);
+    eq(pool.stats.size, 1);
+    eq(pool.stats.idle, 1);
+    pool._create = create;
+    (await pool.acquire()).release();
+    eq(pool.stats.acquires, 2);
+    await pool.close();
+  },
+  async 'statements stay cached across acquires'() {
+    const pool = new Pool('sqlite', ':memory:', { max: 1 });
+    const stmt = await pool.use(async db => {
+      await db.exec('CREATE TABLE t (x INTEGER)');
+      eq(await db.exec('INSERT INTO t VALUES (?)', [7]), 1);
+      return db.prepare('SELECT x * ? FROM t');
+    });
+    await pool.use(async db => {
+      assert((await db.prepare('SELECT x * ? FROM t')) === stmt);
+      const rows = await (await db.query('SELECT x * ? FROM t', [6])).all();
+      eq(rows[0][0], 42);
+    });
+    await pool.close();
+  },
+  async 'broken connections are replaced'() {
+    const pool = new Pool('sqlite', ':memory:', { max: 1, pingAfter: 0 });
+    const db = await pool.acquire();
+    db._adapter.db.close();
+    db.release();
+    const other = await pool.acquire();
+    assert(other !== db);
+    eq(pool.stats.pingFailures, 1);
+    eq(pool.stats.size, 1);
+    other.release();
+    await pool.close();
+  },
+  async 'idle connections time out'() {
+    const pool = await Database.pool('sqlite', ':memory:', { min: 1, max: 3, idleTimeout: 10 });
+    const conns = await Promise.all([pool.acquire(), pool.acquire(), pool.acquire()]);
+    for(const db of conns) db.release();
+    await sleep(50);
+    eq(pool.stats.size, 1);
+    eq(pool.stats.destroyed, 2);
+    await pool.close();
+  },
+});
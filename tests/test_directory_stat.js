@@ -0,0 +1,86 @@
+import * as fs from 'fs';
+import * as path from 'path';
+import { Directory, walk } from 'directory';
+import { getenv } from 'std';
+import { TextDecoder } from 'textcode';
+import { assert, eq, tests } from './tinytest.js';
+
+const ROOT = path.join(getenv('TMPDIR') ?? '/tmp', `qjs-dirstat-test-${Date.now()}-${Math.floor(Math.random() * 1e6)}`);
+const decoder = new TextDecoder();
+
+function buildFixture() {
+  fs.mkdirSync(ROOT);
+  fs.mkdirSync(path.join(ROOT, 'sub'));
+  for(let i = 0; i < 100; i++) fs.writeFileSync(path.join(ROOT, `f${i}`), 'x'.repeat(i));
+  fs.writeFileSync(path.join(ROOT, 'sub', 'big'), 'y'.repeat(10000));
+}
+
+function rmrf(p) {
+  let st;
+  try {
+    st = fs.lstatSync(p);
+  } catch(e) {
+    return;
+  }
+  if(st.isDirectory()) for(const name of fs.readdirSync(p)) if(name != '.' && name != '..') rmrf(path.join(p, name));
+  fs.unlinkSync(p);
+}
+
+const name = ({ offsets, bytes }, i) => decoder.decode(bytes.subarray(offsets[i], offsets[i + 1]));
+
+buildFixture();
+
+try {
+  await tests({
+    'readBatch() returns columns'() {
+      const dir = new Directory(ROOT);
+      let batch,
+        count = 0,
+        total = 0;
+
+      while((batch = dir.readBatch(16, Directory.STAT_SIZE | Directory.STAT_MODE | Directory.STAT_INO))) {
+        assert(batch.length <= 16);
+        assert(batch.size instanceof Float64Array);
+        assert(batch.ino instanceof BigUint64Array);
+        eq(batch.mtime, undefined);
+
+        for(let i = 0; i < batch.length; i++) {
+          const st = fs.lstatSync(path.join(ROOT, name(batch, i)));
+          eq(batch.mode[i], st.mode);
+          eq(batch.ino[i], BigInt(st.ino));
+          if(batch.types[i] == Directory.TYPE_REG) total += batch.size[i];
+        }
+
+        count += batch.length;
+      }
+
+      eq(count, 101);
+      eq(total, 4950);
+      eq(dir.readBatch(), null);
+    },
+    'readBatch() without stat and with a type mask'() {
+      const dir = new Directory(ROOT, Directory.BOTH, Directory.TYPE_DIR);
+      const batch = dir.readBatch();
+      eq(batch.length, 1);
+      eq(name(batch, 0), 'sub');
+      eq(batch.size, undefined);
+      eq(dir.readBatch(), null);
+    },
+    async 'walk() with stat columns'() {
+      let total = 0,
+        mtime = 0;
+
+      for await(const batch of walk(ROOT, { types: Directory.TYPE_REG, stat: Directory.STAT_ALL, batchSize: 32 }))
+        for(let i = 0; i < batch.length; i++) {
+          total += batch.size[i];
+          mtime = Math.max(mtime, batch.mtime[i]);
+          assert(batch.blocks[i] >= 0);
+        }
+
+      eq(total, 4950 + 10000);
+      assert(Math.abs(mtime - Date.now()) < 3600e3);
+    },
+  });
+} finally {
+  rmrf(ROOT);
+}
@@ -0,0 +1,81 @@
+import * as fs from 'fs';
+import * as path from 'path';
+import { Directory, walk } from 'directory';
+import { getenv } from 'std';
+import { TextDecoder } from 'textcode';
+import { assert, eq, tests } from './tinytest.js';
+
+const ROOT = path.join(getenv('TMPDIR') ?? '/tmp', `qjs-walk-test-${Date.now()}-${Math.floor(Math.random() * 1e6)}`);
+const decoder = new TextDecoder();
+
+function buildFixture() {
+  for(const dir of ['', 'a', 'a/b', 'a/b/c', 'node_modules', 'node_modules/x', 'many']) fs.mkdirSync(path.join(ROOT, dir));
+  for(const file of ['top.txt', 'a/one.txt', 'a/b/two.js', 'a/b/c/three.txt', 'node_modules/x/index.js']) fs.writeFileSync(path.join(ROOT, file), file);
+  for(let i = 0; i < 500; i++) fs.writeFileSync(path.join(ROOT, 'many', `f${i}.txt`), '');
+}
+
+function rmrf(p) {
+  let st;
+  try {
+    st = fs.lstatSync(p);
+  } catch(e) {
+    return;
+  }
+  if(st.isDirectory()) for(const name of fs.readdirSync(p)) if(name != '.' && name != '..') rmrf(path.join(p, name));
+  fs.unlinkSync(p);
+}
+
+async function collect(options) {
+  const entries = [];
+
+  for await(const { length, offsets, bytes, types } of walk(ROOT, options))
+    for(let i = 0; i < length; i++) entries.push([decoder.decode(bytes.subarray(offsets[i], offsets[i + 1])), types[i]]);
+
+  return entries.sort(([a], [b]) => (a < b ? -1 : a > b ? 1 : 0));
+}
+
+const names = entries => entries.filter(([name]) => !name.startsWith('many/')).map(([name]) => name);
+
+buildFixture();
+
+try {
+  await tests({
+    async 'every entry exactly once'() {
+      const entries = await collect({ batchSize: 7 });
+      eq(entries.length, 511);
+      eq(new Set(entries.map(([name]) => name)).size, 511);
+      eq(names(entries).join(), 'a,a/b,a/b/c,a/b/c/three.txt,a/b/two.js,a/one.txt,many,node_modules,node_modules/x,node_modules/x/index.js,top.txt');
+      for(const [name, type] of entries) eq(type, name.includes('.') ? Directory.TYPE_REG : Directory.TYPE_DIR);
+    },
+    async 'filters'() {
+      eq(names(await collect({ include: '*.txt', exclude: ['node_modules', 'many'] })).join(), 'a/b/c/three.txt,a/one.txt,top.txt');
+      eq(names(await collect({ include: 'a/*', types: Directory.TYPE_REG })).join(), 'a/one.txt');
+      eq(names(await collect({ maxDepth: 2, exclude: 'many' })).join(), 'a,a/b,a/one.txt,node_modules,node_modules/x,top.txt');
+    },
+    async 'glob sets'() {
+      eq(names(await collect({ include: 'a/**/*.{js,txt}' })).join(), 'a/b/c/three.txt,a/b/two.js,a/one.txt');
+      eq(names(await collect({ include: new path.GlobSet(['**/*.js']), exclude: new path.GlobSet('node_modules') })).join(), 'a/b/two.js');
+    },
+    async 'return() stops early'() {
+      const it = walk(ROOT, { batchSize: 10, concurrency: 1 });
+      const { value, done } = await it.next();
+      assert(!done);
+      eq(value.length, 10);
+      eq(value.offsets.length, 11);
+      await it.return();
+      eq((await it.next()).done, true);
+      eq(it.errors, 0);
+    },
+    'missing root throws'() {
+      let error;
+      try {
+        walk(path.join(ROOT, 'missing'));
+      } catch(e) {
+        error = e;
+      }
+      assert(error);
+    },
+  });
+} finally {
+  rmrf(ROOT);
+}
@@ -0,0 +1,97 @@
+import * as fs from 'fs';
+import * as path from 'path';
+import { Watcher } from 'directory';
+import { getenv } from 'std';
+import { assert, eq, tests } from './tinytest.js';
+
+const ROOT = path.join(getenv('TMPDIR') ?? '/tmp', `qjs-watcher-test-${Date.now()}-${Math.floor(Math.random() * 1e6)}`);
+
+function rmrf(p) {
+  let st;
+  try {
+    st = fs.lstatSync(p);
+  } catch(e) {
+    return;
+  }
+  if(st.isDirectory()) for(const name of fs.readdirSync(p)) if(name != '.' && name != '..') rmrf(path.join(p, name));
+  fs.unlinkSync(p);
+}
+
+let watcher, waiting;
+
+/* runs 'fn' and resolves with the next batch of events */
+function batch(fn) {
+  const promise = new Promise(resolve => (waiting = resolve));
+  fn();
+  return promise;
+}
+
+function received(events) {
+  const resolve = waiting;
+  waiting = null;
+  resolve?.(events.map(({ type, path: p, from }) => [type, path.relative(ROOT, p), from && path.relative(ROOT, from)].filter(Boolean).join(' ')));
+}
+
+fs.mkdirSync(ROOT);
+
+try {
+  await tests({
+    'watches the tree'() {
+      fs.mkdirSync(path.join(ROOT, 'a'));
+      fs.mkdirSync(path.join(ROOT, 'a/b'));
+      const w = new Watcher(ROOT, () => {});
+      eq(w.size, 3);
+      eq(w.paths.join(), ROOT);
+      assert(w.remove(ROOT));
+      eq(w.size, 0);
+      w.close();
+      rmrf(path.join(ROOT, 'a'));
+    },
+    'removing a nested root keeps its watches'() {
+      fs.mkdirSync(path.join(ROOT, 'n'));
+      fs.mkdirSync(path.join(ROOT, 'n/m'));
+      const w = new Watcher(path.join(ROOT, 'n'), () => {});
+      w.add(path.join(ROOT, 'n/m'));
+      eq(w.size, 2);
+      assert(w.remove(path.join(ROOT, 'n/m')));
+      eq(w.size, 2);
+      eq(w.paths.join(), path.join(ROOT, 'n'));
+      w.close();
+      rmrf(path.join(ROOT, 'n'));
+    },
+    'start'() {
+      watcher = new Watcher(ROOT, received, { delay: 20 });
+      eq(watcher.size, 1);
+    },
+    async 'create and modify is one create'() {
+      eq((await batch(() => (fs.writeFileSync(path.join(ROOT, 'f'), '1'), fs.writeFileSync(path.join(ROOT, 'f'), '2')))).join(), 'create f');
+    },
+    async 'create and delete is nothing'() {
+      eq((await batch(() => (fs.writeFileSync(path.join(ROOT, 't'), '1'), fs.unlinkSync(path.join(ROOT, 't')), fs.writeFileSync(path.join(ROOT, 'f'), '3')))).join(), 'change f');
+    },
+    async 'atomic save is a change'() {
+      eq((await batch(() => (fs.writeFileSync(path.join(ROOT, '.f.tmp'), '4'), fs.renameSync(path.join(ROOT, '.f.tmp'), path.join(ROOT, 'f'))))).join(), 'change f');
+    },
+    async 'rename pairs'() {
+      eq((await batch(() => fs.renameSync(path.join(ROOT, 'f'), path.join(ROOT, 'g')))).join(), 'rename g f');
+    },
+    async 'new directories are watched'() {
+      const events = await batch(() => (fs.mkdirSync(path.join(ROOT, 'x')), fs.mkdirSync(path.join(ROOT, 'x/y')), fs.writeFileSync(path.join(ROOT, 'x/y/z'), '')));
+      eq(events.join(), 'create x,create x/y,create x/y/z');
+    },
+    async 'moved directories keep their watches'() {
+      eq((await batch(() => fs.renameSync(path.join(ROOT, 'x'), path.join(ROOT, 'w')))).join(), 'rename w x');
+      eq((await batch(() => fs.writeFileSync(path.join(ROOT, 'w/y/z'), '1'))).join(), 'change w/y/z');
+      eq(watcher.size, 3);
+    },
+    async 'removed trees are unwatched'() {
+      eq((await batch(() => rmrf(path.join(ROOT, 'w')))).join(), 'delete w/y/z,delete w/y,delete w');
+      eq(watcher.size, 1);
+      eq(watcher.pending, 0);
+      watcher.close();
+      eq(watcher.size, 0);
+    },
+  });
+} finally {
+  rmrf(ROOT);
+}
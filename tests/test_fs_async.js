@@ -0,0 +1,73 @@
+import * as fs from 'fs';
+import * as path from 'path';
+import { asyncClose, asyncFsync, asyncOpen, asyncRead, asyncReadFile, asyncStat, asyncWrite, asyncWriteFile, toString } from 'misc';
+import { O_CREAT, O_RDWR } from 'os';
+import { Error as Errors, getenv } from 'std';
+import { SyscallError } from 'syscallerror';
+import { assert, eq, tests } from './tinytest.js';
+
+const ROOT = path.join(getenv('TMPDIR') ?? '/tmp', `qjs-fs-async-test-${Date.now()}-${Math.floor(Math.random() * 1e6)}`);
+const FILE = path.join(ROOT, 'data.txt');
+
+fs.mkdirSync(ROOT);
+
+try {
+  await tests({
+    async 'writeFile and readFile round trip'() {
+      eq(await asyncWriteFile(FILE, 'hello async world'), 17);
+      eq(toString(await asyncReadFile(FILE)), 'hello async world');
+      eq(await fs.readFile(FILE, 'utf-8'), 'hello async world');
+    },
+    async 'readFile of a large file'() {
+      const data = new Uint8Array(1 << 20).map((_, i) => i & 0xff);
+      await fs.writeFile(path.join(ROOT, 'large'), data);
+      const buf = new Uint8Array(await fs.readFile(path.join(ROOT, 'large')));
+      eq(buf.length, data.length);
+      assert(buf.every((c, i) => c == data[i]), 'contents differ');
+    },
+    async 'read and write at a position'() {
+      const fd = await asyncOpen(FILE, O_RDWR);
+      const buf = new Uint8Array(8);
+      eq(await asyncRead(fd, buf, 2, 5, 6), 5);
+      eq(toString(buf.buffer, 2, 5), 'async');
+      eq(await asyncWrite(fd, 'ASYNC', 0, 5, 6), 5);
+      await asyncFsync(fd);
+      await asyncClose(fd);
+      eq(toString(await asyncReadFile(FILE)), 'hello ASYNC world');
+    },
+    async 'stat'() {
+      const st = await asyncStat(FILE);
+      eq(st.size, 17);
+      eq(st.mode & 0o170000, 0o100000);
+      const stats = await fs.stat(FILE);
+      assert(stats.isFile(), 'not a file');
+      eq(stats.size, 17);
+      const big = await fs.stat(FILE, { bigint: true });
+      eq(big.size, 17n);
+      eq(typeof big.mtimeMs, 'bigint');
+      eq(big.mtime.getTime(), stats.mtime.getTime());
+      const fd = await asyncOpen(path.join(ROOT, 'empty'), O_RDWR | O_CREAT);
+      eq((await asyncStat(fd)).size, 0);
+      await asyncClose(fd);
+    },
+    async 'errors reject with a SyscallError'() {
+      let error;
+      try {
+        await asyncReadFile(path.join(ROOT, 'missing'));
+      } catch(e) {
+        error = e;
+      }
+      assert(error instanceof SyscallError, 'not a SyscallError');
+      eq(error.syscall, 'open');
+      eq(error.errno, Errors.ENOENT);
+    },
+    async 'concurrent reads'() {
+      const results = await Promise.all([...Array(16)].map(() => fs.readFile(FILE, 'utf-8')));
+      eq(results.length, 16);
+      assert(results.every(s => s == 'hello ASYNC world'), 'contents differ');
+    },
+  });
+} finally {
+  for(const name of ['data.txt', 'large', 'empty']) if(fs.existsSync(path.join(ROOT, name))) fs.unlinkSync(path.join(ROOT, name));
+  fs.unlinkSync(ROOT);
+}
@@ -0,0 +1,59 @@
+import { GlobSet } from 'path';
+import { assert, eq, tests } from './tinytest.js';
+
+tests({
+  'names and paths'() {
+    const set = new GlobSet(['*.c', '*.h', 'src/**/*.c', 'Makefile', '*.tar.gz']);
+    eq(set.size, 5);
+    eq(set.match('src/a/b/x.c').join(), '0,2');
+    eq(set.match('src/x.c').join(), '0,2');
+    eq(set.match('lib/Makefile').join(), '3');
+    eq(set.match('dist/a.tar.gz').join(), '4');
+    eq(set.match('a.c/b').join(), '');
+    assert(set.test('include/x.h'));
+    assert(!set.test('README'));
+  },
+  'wildcards'() {
+    const set = new GlobSet(['src/*.c', '[a-c]?.txt', '[!a-c]*.txt', 'a*b*c', '\\*']);
+    eq(set.match('src/x.c').join(), '0');
+    eq(set.match('src/a/x.c').join(), '');
+    eq(set.match('b1.txt').join(), '1');
+    eq(set.match('d12.txt').join(), '2');
+    eq(set.match('aXbYbc').join(), '3');
+    eq(set.match('aXbYbcd').join(), '');
+    eq(set.match('x/*').join(), '4');
+  },
+  'globstar'() {
+    const set = new GlobSet(['a/**/b', 'build/**', '**/test/*.js']);
+    eq(set.match('a/b').join(), '0');
+    eq(set.match('a/x/y/b').join(), '0');
+    eq(set.match('a/x/y/bc').join(), '');
+    eq(set.match('build/x/y').join(), '1');
+    eq(set.match('build').join(), '');
+    eq(set.match('test/t.js').join(), '2');
+    eq(set.match('x/y/test/t.js').join(), '2');
+  },
+  'braces'() {
+    const set = new GlobSet(['*.{c,h}', '{src,lib}/**', '{a,b{c,d}}.x']);
+    eq(set.match('z.h').join(), '0');
+    eq(set.match('z.hh').join(), '');
+    eq(set.match('lib/q').join(), '1');
+    eq(set.match('bd.x').join(), '2');
+    eq(set.match('b.x').join(), '');
+  },
+  'add, patterns and filter'() {
+    const set = new GlobSet();
+    eq(set.add('*.js'), 0);
+    eq(set.add('docs/*'), 1);
+    eq(set.patterns.join(), '*.js,docs/*');
+    eq(set.filter(['a.js', 'b.c', 'docs/x.md', 'docs/y/z.md', 'lib/c.js']).join(), 'a.js,docs/x.md,lib/c.js');
+  },
+  'many patterns'() {
+    const patterns = [];
+    for(let i = 0; i < 500; i++) patterns.push(`dir${i}/**/*.ext${i % 7}`, `*.x${i}`);
+    const set = new GlobSet(patterns);
+    eq(set.match('dir42/a/b/c.ext0').join(), '84');
+    eq(set.match('deep/path/file.x499').join(), '999');
+    eq(set.match('dir42/c.ext1').join(), '');
+  },
+});
@@ -0,0 +1,89 @@
+/**
+ * Needs a server, set MYSQLTEST_HOST, MYSQLTEST_USER, MYSQLTEST_PASSWORD
+ * and MYSQLTEST_DB. Skipped when the connection fails.
+ */
+import { MySQL } from 'mysql';
+import { getenv } from 'std';
+import { assert, eq, tests } from './tinytest.js';
+
+const params = {
+  host: getenv('MYSQLTEST_HOST') ?? 'localhost',
+  user: getenv('MYSQLTEST_USER') ?? 'root',
+  password: getenv('MYSQLTEST_PASSWORD') ?? '',
+  db: getenv('MYSQLTEST_DB') ?? 'test',
+};
+
+async function connect() {
+  const my = new MySQL();
+  my.setOption(MySQL.OPT_NONBLOCK, true);
+  return (await my.connect(params).catch(() => false)) ? my : null;
+}
+
+const probe = await connect();
+
+if(!probe) {
+  console.log(`mysql: skipped, cannot connect to '${params.user}@${params.host}/${params.db}'`);
+} else {
+  probe.close();
+
+  tests({
+    async 'binary results'() {
+      const my = await connect();
+      const st = await my.prepare('SELECT ? + 1, ? * 2, ?, CAST(? AS UNSIGNED), LENGTH(?), NULL');
+      eq(st.paramCount, 6);
+      await st.execute(41, 1.25, 'x', 2n ** 60n, new Uint8Array([1, 2, 3]));
+      const [row] = await st.fetchRows();
+      eq(row[0], 42);
+      eq(row[1], 2.5);
+      eq(row[2], 'x');
+      eq(row[3], 2n ** 60n);
+      eq(row[4], 3);
+      eq(row[5], null);
+      eq(await st.fetchRows(), null);
+      st.close();
+      my.close();
+    },
+    async 'execute again with new parameters'() {
+      const my = await connect();
+      await my.query('CREATE TEMPORARY TABLE stmt_t (id INT UNSIGNED AUTO_INCREMENT PRIMARY KEY, name TEXT, data BLOB)');
+      const ins = await my.prepare('INSERT INTO stmt_t (name, data) VALUES (?, ?)');
+      const long = 'y'.repeat(5000);
+      for(const name of ['a', 'b', long]) {
+        await ins.execute([name, new Uint8Array(name.length)]);
+        eq(ins.affectedRows, 1);
+      }
+      eq(ins.insertId, 3);
+      const sel = await my.prepare('SELECT id, name, data FROM stmt_t WHERE id >= ? ORDER BY id');
+      await sel.execute(1);
+      const sizes = [];
+      let rows,
+        all = [];
+      while((rows = await sel.fetchRows(2))) {
+        sizes.push(rows.length);
+        all.push(...rows);
+      }
+      eq(sizes.join(), '2,1');
+      eq(all.map(r => r[0]).join(), '1,2,3');
+      eq(all[2][1], long);
+      assert(all[2][2] instanceof ArrayBuffer);
+      eq(all[2][2].byteLength, 5000);
+      eq(sel.fetchFields()[1][0], 'name');
+      my.close();
+    },
+    async 'errors reject'() {
+      const my = await connect();
+      let error;
+      await my.prepare('SELECT * FROM missing_table').catch(e => (error = e));
+      assert(error);
+      const st = await my.prepare('SELECT ?');
+      error = undefined;
+      try {
+        st.execute();
+      } catch(e) {
+        error = e;
+      }
+      assert(error instanceof RangeError);
+      my.close();
+    },
+  });
+}
@@ -11,6 +11,26 @@ tests({
   },
   'normalize()'() {
     eq(path.normalize('////tmp////other//..//test'), '/tmp/test');
+    eq(path.normalize('a/b/../../c'), 'c');
+    eq(path.normalize('a/./b/'), 'a/b/');
+    eq(path.normalize('./a'), './a');
+    eq(path.normalize('./../a'), '../a');
+    eq(path.normalize('x/../../y'), '../y');
+    eq(path.normalize('a//./.'), 'a/');
+    eq(path.normalize('.'), '.');
+    eq(path.normalize('a/'.repeat(3000) + '..'), 'a/'.repeat(2999));
+  },
+  'normalizeMany()'() {
+    const paths = path.normalizeMany(['a//b', 'a/./b', '/tmp/../x', 'a/b/c/..']);
+    eq(paths.join(), 'a/b,a/b,/x,a/b/');
+    eq(path.intern('a/c/../b'), paths[0]);
+    let error;
+    try {
+      path.normalizeMany(['a', 1]);
+    } catch(e) {
+      error = e;
+    }
+    assert(error instanceof TypeError);
   },
   'dirname()'() {
     eq(path.dirname('/tmp/../'), '/tmp');
@@ -173,6 +193,10 @@ tests({
   'resolve()'() {
     eq(path.resolve('/proc', 'self', 'cwd'), '/proc/self/cwd');
     eq(path.resolve('/proc', 'self', '/tmp', 'test'), '/tmp/test');
+    eq(path.resolve('/tmp/', 'a/', '../b/'), '/tmp/b');
+    eq(path.resolve('/'), '/');
+    eq(path.resolve('a', 'b'), path.getcwd() + '/a/b');
+    eq(path.resolve(...'abcdefghijkl'.split('')), path.getcwd() + '/a/b/c/d/e/f/g/h/i/j/k/l');
   },
   'isin()'() {
     assert(path.isin('/tmp/test.obj', '/tmp'));
@@ -0,0 +1,103 @@
+/**
+ * Needs a server, set PGTEST_CONNINFO (default: host=localhost
+ * dbname=postgres). Skipped when the connection fails.
+ */
+import { PGconn } from 'pgsql';
+import { getenv } from 'std';
+import { TextDecoder } from 'textcode';
+import { ReadableStream, WritableStream } from '../lib/stream.js';
+import { assert, eq, tests } from './tinytest.js';
+
+const conninfo = getenv('PGTEST_CONNINFO') ?? 'host=localhost dbname=postgres connect_timeout=2';
+const decoder = new TextDecoder();
+
+function connect(nonblocking = true) {
+  const pg = new PGconn();
+  pg.connect(conninfo);
+  if(pg.errorMessage) return null;
+  pg.nonblocking = nonblocking;
+  return pg;
+}
+
+async function setup(nonblocking) {
+  const pg = connect(nonblocking);
+  await pg.query('CREATE TEMP TABLE points (x int4, y text)');
+  return pg;
+}
+
+const probe = connect();
+
+if(!probe) {
+  console.log(`pgsql: skipped, cannot connect to '${conninfo}'`);
+} else {
+  probe.close();
+
+  tests({
+    async 'copy from string and back'() {
+      const pg = await setup();
+      eq(await pg.copyFrom('COPY points FROM STDIN (FORMAT csv)', '1,a\n2,b\n3,c\n'), 3);
+      const data = await pg.copyTo('COPY (SELECT * FROM points ORDER BY x) TO STDOUT (FORMAT csv)');
+      assert(data instanceof ArrayBuffer);
+      eq(decoder.decode(data), '1,a\n2,b\n3,c\n');
+      pg.close();
+    },
+    async 'copy from streams'() {
+      const pg = await setup();
+      let i = 0;
+      const stream = new ReadableStream({
+        pull(controller) {
+          if(i < 1000) controller.enqueue(`${i++},row\n`);
+          else controller.close();
+        },
+      });
+      eq(await pg.copyFrom('COPY points FROM STDIN', stream), 1000);
+      async function* rows() {
+        for(let j = 0; j < 10; j++) yield `${j}\tgen\n`;
+      }
+      eq(await pg.copyFrom('COPY points FROM STDIN', rows()), 10);
+      eq(+(await pg.query('SELECT sum(x) FROM points')).fetchRow()[0], 499500 + 45);
+      pg.close();
+    },
+    async 'copy to WritableStream'() {
+      const pg = await setup();
+      const chunks = [];
+      const stream = new WritableStream({
+        write(chunk) {
+          chunks.push(decoder.decode(chunk));
+        },
+      });
+      eq(await pg.copyTo('COPY (SELECT g, g::text FROM generate_series(1, 500) g) TO STDOUT', stream), 500);
+      eq(chunks.length, 500);
+      eq(chunks[499], '500\t500\n');
+      pg.close();
+    },
+    async 'errors reject'() {
+      const pg = await setup();
+      let error;
+      await pg.copyFrom('COPY points FROM STDIN (FORMAT csv)', 'x,y\n').catch(e => (error = e));
+      assert(error);
+      error = undefined;
+      const failing = new ReadableStream({
+        pull(controller) {
+          controller.error(new Error('source broke'));
+        },
+      });
+      await pg.copyFrom('COPY points FROM STDIN', failing).catch(e => (error = e));
+      assert(/source broke/.test(error?.message));
+      error = undefined;
+      await pg.copyFrom('SELECT 1', '').catch(e => (error = e));
+      assert(error);
+      eq(+(await pg.query('SELECT $1::int4 + 1', [1])).fetchRow()[0], 2);
+      pg.close();
+    },
+    'blocking copy'() {
+      const pg = connect(false);
+      pg.query('CREATE TEMP TABLE points (x int4, y text)');
+      eq(pg.copyFrom('COPY points FROM STDIN', new Uint8Array([...'7\tz\n'].map(c => c.charCodeAt(0)))), 1);
+      const out = [];
+      eq(pg.copyTo('COPY points TO STDOUT', (buf, len) => (out.push(decoder.decode(buf.slice(0, len))), len)), 1);
+      eq(out.join(''), '7\tz\n');
+      pg.close();
+    },
+  });
+}
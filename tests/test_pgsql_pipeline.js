@@ -0,0 +1,63 @@
+/**
+ * Needs a server, set PGTEST_CONNINFO (default: host=localhost
+ * dbname=postgres). Skipped when the connection fails.
+ */
+import { PGconn } from 'pgsql';
+import { getenv } from 'std';
+import { assert, eq, tests } from './tinytest.js';
+
+const conninfo = getenv('PGTEST_CONNINFO') ?? 'host=localhost dbname=postgres connect_timeout=2';
+
+function connect() {
+  const pg = new PGconn();
+  pg.connect(conninfo);
+  if(pg.errorMessage) return null;
+  pg.nonblocking = true;
+  return pg;
+}
+
+const probe = connect();
+
+if(!probe) {
+  console.log(`pgsql: skipped, cannot connect to '${conninfo}'`);
+} else {
+  probe.close();
+
+  tests({
+    async 'query with binary parameters'() {
+      const pg = connect();
+      const res = await pg.query('SELECT $1::int4 + 1, $2::float8 * 2, $3::text, $4::bool, length($5::bytea), $6::int8', [41, 1.25, 'x', true, new Uint8Array([1, 2, 3]), 2n ** 40n]);
+      eq(res.fetchRow().join(), '42,2.5,x,true,3,1099511627776');
+      pg.close();
+    },
+    async 'prepared statements'() {
+      const pg = connect();
+      const desc = await pg.prepare('add', 'SELECT $1::int2 + $2::int8, $3::float4');
+      assert(desc);
+      const res = await pg.execPrepared('add', [1, 2, 0.5]);
+      eq(res.fetchRow().join(), '3,0.5');
+      let error;
+      await pg.execPrepared('missing', []).catch(e => (error = e));
+      assert(error);
+      pg.close();
+    },
+    async 'pipeline resolves in order'() {
+      const pg = connect();
+      pg.pipeline = true;
+      assert(pg.pipeline);
+      const prepared = pg.prepare('sq', 'SELECT $1::int4 * $1::int4');
+      const pending = [];
+      for(let i = 0; i < 100; i++) pending.push(pg.execPrepared('sq', [i]));
+      pending.push(pg.query('SELECT 1/0', []).catch(e => e));
+      pending.push(pg.query('SELECT $1::text', ['after']));
+      await prepared;
+      const results = await Promise.all(pending);
+      for(let i = 0; i < 100; i++) eq(+results[i].fetchRow()[0], i * i);
+      assert(results[100] instanceof Error);
+      eq(results[101].fetchRow()[0], 'after');
+      eq(pg.pending, 0);
+      pg.pipeline = false;
+      pg.close();
+    },
+  });
+}
@@ -0,0 +1,83 @@
+/**
+ * Needs a server, set PGTEST_CONNINFO (default: host=localhost
+ * dbname=postgres). Skipped when the connection fails.
+ */
+import { PGconn } from 'pgsql';
+import { getenv } from 'std';
+import { assert, eq, tests } from './tinytest.js';
+
+const conninfo = getenv('PGTEST_CONNINFO') ?? 'host=localhost dbname=postgres connect_timeout=2';
+
+function connect(nonblocking = true) {
+  const pg = new PGconn();
+  pg.connect(conninfo);
+  if(pg.errorMessage) return null;
+  pg.nonblocking = nonblocking;
+  return pg;
+}
+
+const series = 'SELECT g, g::text FROM generate_series(1, $1::int4) g';
+
+const probe = connect();
+
+if(!probe) {
+  console.log(`pgsql: skipped, cannot connect to '${conninfo}'`);
+} else {
+  probe.close();
+
+  tests({
+    async 'batches'() {
+      const pg = connect();
+      const sizes = [];
+      let sum = 0;
+      for await(const batch of pg.stream(series, [2500], 1000)) {
+        sizes.push(batch.length);
+        for(const [n] of batch) sum += n;
+      }
+      eq(sizes.join(), '1000,1000,500');
+      eq(sum, 2500 * 2501 / 2);
+      eq(pg.pending, 0);
+      pg.close();
+    },
+    async 'queued with other commands'() {
+      const pg = connect();
+      const before = pg.query('SELECT 1');
+      const stream = pg.stream(series, [10], 3);
+      const after = pg.query('SELECT $1::text', ['after']);
+      eq((await before).fetchRow()[0], 1);
+      const rows = [];
+      for await(const batch of stream) rows.push(...batch);
+      eq(rows.length, 10);
+      eq(rows[9][1], '10');
+      eq((await after).fetchRow()[0], 'after');
+      pg.close();
+    },
+    async 'break discards the rest'() {
+      const pg = connect();
+      for await(const batch of pg.stream(series, [100000], 100)) {
+        eq(batch.length, 100);
+        break;
+      }
+      eq((await pg.query('SELECT $1::int4', [7])).fetchRow()[0], 7);
+      pg.close();
+    },
+    async 'errors reject'() {
+      const pg = connect();
+      let error;
+      try {
+        for await(const batch of pg.stream('SELECT 1/(g - 50) FROM generate_series(1, 100) g', null, 10)) assert(batch.length);
+      } catch(e) {
+        error = e;
+      }
+      assert(/division by zero/.test(error?.message));
+      pg.close();
+    },
+    async 'blocking connection'() {
+      const pg = connect(false);
+      let n = 0;
+      for await(const batch of pg.stream(series, [42], 10)) n += batch.length;
+      eq(n, 42);
+      pg.close();
+    },
+  });
+}
@@ -0,0 +1,54 @@
+import { pipeline } from 'child_process';
+import { pipe, close, read, write } from 'os';
+import { assert, eq, tests } from './tinytest.js';
+
+const decode = (buf, n) => String.fromCharCode(...new Uint8Array(buf, 0, n));
+
+function readAll(pl) {
+  const buf = new ArrayBuffer(4096);
+  let s = '',
+    n;
+  while((n = pl.read(buf)) > 0) s += decode(buf, n);
+  eq(n, 0);
+  return s;
+}
+
+tests({
+  async 'output of the last stage'() {
+    const pl = pipeline([
+      ['printf', 'c\\na\\nb\\n'],
+      ['sort'],
+      ['tr', 'a-z', 'A-Z'],
+    ]);
+    eq(pl.processes.length, 3);
+    eq(pl.stdin, null);
+    eq(readAll(pl), 'A\nB\nC\n');
+    const statuses = await pl.wait();
+    eq(statuses.map(s => s.exitCode).join(','), '0,0,0');
+  },
+  async 'stdin pipe'() {
+    const pl = pipeline([['cat'], ['wc', '-c']], { stdin: 'pipe' });
+    assert(pl.stdin >= 0);
+    write(pl.stdin, new Uint8Array([104, 105, 10]).buffer, 0, 3);
+    pl.close();
+    eq(readAll(pl).trim(), '3');
+    await pl.wait();
+  },
+  async 'exit statuses'() {
+    const pl = pipeline([['sh', '-c', 'exit 3'], ['true']]);
+    readAll(pl);
+    const [first, second] = await pl.wait();
+    eq(first.exitCode, 3);
+    eq(second.exitCode, 0);
+  },
+  async 'tee to output fd'() {
+    const [rd, wr] = pipe();
+    const pl = pipeline([['echo', 'hello']], { output: wr, tee: true });
+    eq(readAll(pl), 'hello\n');
+    close(wr);
+    const buf = new ArrayBuffer(64);
+    eq(decode(buf, read(rd, buf, 0, 64)), 'hello\n');
+    close(rd);
+    await pl.wait();
+  },
+});
@@ -0,0 +1,62 @@
+import { Queue } from 'queue';
+import { pipe, close } from 'os';
+import { assert, eq, tests } from './tinytest.js';
+
+const bytes = (...args) => new Uint8Array(args).buffer;
+const array = buf => [...new Uint8Array(buf)].join(',');
+
+tests({
+  'chunk mode'() {
+    const q = new Queue();
+    eq(q.ring, false);
+    eq(q.write(bytes(1, 2, 3)), 3);
+    eq(q.write(bytes(4, 5)), 2);
+    eq(q.size, 5);
+    eq(q.chunks, 2);
+    eq(array(q.chunk(0)), '1,2,3');
+    const buf = new ArrayBuffer(4);
+    eq(q.read(buf), 4);
+    eq(array(buf), '1,2,3,4');
+    eq(q.size, 1);
+  },
+  'ring mode'() {
+    const q = new Queue(6);
+    assert(q.ring);
+    eq(q.capacity, 8);
+    eq(q.write(bytes(1, 2, 3, 4, 5, 6)), 6);
+    const buf = new ArrayBuffer(4);
+    eq(q.read(buf), 4);
+    eq(q.write(bytes(7, 8, 9, 10, 11, 12)), 6);
+    eq(q.write(bytes(13)), 0);
+    eq(q.size, 8);
+    const out = new ArrayBuffer(8);
+    eq(q.peek(out), 8);
+    eq(array(out), '5,6,7,8,9,10,11,12');
+  },
+  'ring chunk/at'() {
+    const q = new Queue(8);
+    q.write(bytes(0, 0, 0, 0, 0, 0));
+    q.skip(6);
+    q.write(bytes(1, 2, 3, 4));
+    const n = q.chunks;
+    assert(n >= 1 && n <= 2);
+    eq(array(q.chunk(0)) + (n > 1 ? ',' + array(q.chunk(1)) : ''), '1,2,3,4');
+    const [ab, skip] = q.at(3);
+    eq(new Uint8Array(ab)[skip], 4);
+  },
+  'readv/writev'() {
+    for(const q of [new Queue(), new Queue(4096, true)]) {
+      const [rd, wr] = pipe();
+      q.write(bytes(1, 2, 3));
+      q.write(bytes(4, 5));
+      eq(q.writev(wr), 5);
+      eq(q.size, 0);
+      eq(q.readv(rd), 5);
+      const buf = new ArrayBuffer(5);
+      q.read(buf);
+      eq(array(buf), '1,2,3,4,5');
+      close(rd);
+      close(wr);
+    }
+  },
+});
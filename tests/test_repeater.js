@@ -1,4 +1,5 @@
 import { Console } from 'console';
+import { setTimeout } from 'os';
 import { Repeater } from 'repeater';
 import { err as stderr } from 'std';
 
@@ -56,6 +57,34 @@ async function combinators() {
   console.log('Repeater.latest([])', await collect(Repeater.latest([])));
 }
 
+async function batched() {
+  const r = new Repeater(
+    async (push, stop) => {
+      for(let i = 0; i < 10; i++) push(i);
+      await push(10);
+      stop();
+    },
+    { batch: 4, capacity: 8 },
+  );
+  const batches = [];
+  for await(const values of r) batches.push(values);
+  console.log('Repeater batch', r.batch, batches);
+
+  if(batches.flat().join(',') != '0,1,2,3,4,5,6,7,8,9,10' || batches.some(b => b.length > 4)) throw new Error('batched mode delivered ' + JSON.stringify(batches));
+
+  const stopped = new Repeater(async (push, stop) => void setTimeout(() => stop('end'), 1), { batch: true });
+  const result = await stopped.next();
+  if(!result.done || result.value !== 'end') throw new Error('batched stop() resolved with ' + JSON.stringify(result));
+
+  let error;
+  try {
+    new Repeater(async () => {}, { batch: 4, capacity: 0 });
+  } catch(e) {
+    error = e;
+  }
+  if(!(error instanceof RangeError)) throw new Error('capacity 0 was accepted');
+}
+
 async function main(...args) {
   globalThis.console = new Console(stderr, {
     inspectOptions: {
@@ -111,6 +140,7 @@ async function main(...args) {
   console.log(`r`, r, r.state);
 
   await combinators();
+  await batched();
 }
 
 main();
\ No newline at end of file
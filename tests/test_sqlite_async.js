@@ -0,0 +1,115 @@
+import { SQLite3 } from 'sqlite';
+import { setTimeout } from 'os';
+import { assert, eq, tests } from './tinytest.js';
+
+async function open() {
+  const db = new SQLite3(':memory:', { async: true });
+  await db.exec(`CREATE TABLE t (id INTEGER PRIMARY KEY, name TEXT, score REAL)`);
+  return db;
+}
+
+const sleep = ms => new Promise(resolve => setTimeout(resolve, ms));
+
+tests({
+  async 'query and exec resolve'() {
+    const db = await open();
+    assert(db.async);
+    eq(await db.exec(`INSERT INTO t (name, score) VALUES ('a', 1), ('b', 2)`), 2);
+    const rows = await db.query('SELECT name, score FROM t WHERE score > ? ORDER BY id', [0]);
+    eq(JSON.stringify(rows), '[["a",1],["b",2]]');
+    eq(db.pending, 0);
+    await db.close();
+  },
+  async 'statements'() {
+    const db = await open();
+    const ins = await db.prepare('INSERT INTO t (name, score) VALUES (?, ?)');
+    const info = await ins.run('x', 0.5);
+    eq(info.changes, 1);
+    eq(info.lastInsertRowid, 1);
+    await Promise.all([ins.run('y', 1.5), ins.run(['z', 2.5])]);
+    const sel = await db.prepare('SELECT name FROM t WHERE score > :min ORDER BY id');
+    eq((await sel.all({ min: 1 })).map(r => r[0]).join(','), 'y,z');
+    eq((await sel.get({ min: 2 }))[0], 'z');
+    eq(await sel.get({ min: 3 }), undefined);
+    await db.close();
+  },
+  async 'queries run in submission order'() {
+    const db = await open();
+    const pending = [];
+    for(let i = 1; i <= 20; i++) pending.push(db.exec(`INSERT INTO t (id, name) VALUES (${i}, 'n${i}')`));
+    pending.push(db.query('SELECT count(*) FROM t'));
+    eq(db.pending, 21);
+    const results = await Promise.all(pending);
+    eq(results[20][0][0], 20);
+    await db.close();
+  },
+  async 'synchronous calls are refused while busy'() {
+    const db = await open();
+    const p = db.exec(`INSERT INTO t (name) VALUES ('q')`);
+    let error;
+    try {
+      db.cacheSize = 8;
+    } catch(e) {
+      error = e;
+    }
+    assert(error instanceof TypeError);
+    await p;
+    db.cacheSize = 8;
+    await db.close();
+  },
+  async 'prepare() and query() use the statement cache while busy'() {
+    const db = await open();
+    const ins = db.exec(`INSERT INTO t (name, score) VALUES ('a', 1), ('b', 2)`);
+    const sel = db.prepare('SELECT name FROM t WHERE score > ? ORDER BY id');
+    assert(sel instanceof Promise);
+    eq(db.pending, 2);
+    await ins;
+    eq((await (await sel).all(1)).map(r => r[0]).join(','), 'b');
+    const sql = 'SELECT count(*) FROM t WHERE score >= ?';
+    const counts = await Promise.all([0, 1, 2, 3].map(min => db.query(sql, [min])));
+    eq(counts.map(([[n]]) => n).join(), '2,2,1,0');
+    eq(db.cachedStatements, 2);
+    for(let i = 0; i < 5; i++) eq((await db.query(sql, [2]))[0][0], 1);
+    eq(db.cachedStatements, 2);
+    let error;
+    await db.prepare('SELECT * FROM missing').catch(e => (error = e));
+    assert(/missing/.test(error?.message));
+    await db.close();
+  },
+  async 'errors reject'() {
+    const db = await open();
+    let error;
+    await db.query('SELECT * FROM missing').catch(e => (error = e));
+    assert(error);
+    assert(/missing/.test(error.message));
+    await db.close();
+  },
+  async 'event loop keeps running during a long query'() {
+    const db = await open();
+    let ticks = 0,
+      done = false;
+    const timer = async () => {
+      while(!done) {
+        await sleep(5);
+        ticks++;
+      }
+    };
+    const t = timer();
+    const [[n]] = await db.query('WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c WHERE x < 3000000) SELECT count(*) FROM c');
+    done = true;
+    await t;
+    eq(n, 3000000);
+    assert(ticks > 0);
+    await db.close();
+  },
+  async 'close waits for queued queries'() {
+    const db = await open();
+    const p = db.query('SELECT 42');
+    const c = db.close();
+    let error;
+    await db.query('SELECT 1').catch(e => (error = e));
+    assert(error);
+    eq((await p)[0][0], 42);
+    await c;
+  },
+});
@@ -0,0 +1,69 @@
+import { SQLite3 } from 'sqlite';
+import { TextDecoder } from 'textcode';
+import { Database } from '../lib/dbi.js';
+import { assert, eq, tests } from './tinytest.js';
+
+const decoder = new TextDecoder();
+const text = (column, i) => decoder.decode(column.bytes.subarray(column.offsets[i], column.offsets[i + 1]));
+
+function open() {
+  const db = new SQLite3(':memory:');
+  db.exec(`CREATE TABLE t (id INTEGER, big INTEGER, value REAL, name TEXT, maybe INTEGER)`);
+  db.insertMany('t', ['id', 'big', 'value', 'name', 'maybe'], [
+    [1, 2 ** 40, 0.5, 'one', 1],
+    [2, 2 ** 41, 1.5, 'two', null],
+    [3, 2 ** 42, 2.5, null, 3],
+  ]);
+  return db;
+}
+
+tests({
+  'column types'() {
+    const cols = open().query('SELECT * FROM t').fetchColumns();
+    assert(cols.id instanceof Int32Array);
+    assert(cols.big instanceof BigInt64Array);
+    assert(cols.value instanceof Float64Array);
+    assert(cols.maybe instanceof Float64Array);
+    eq([...cols.id].join(), '1,2,3');
+    eq(cols.big[2], 2n ** 42n);
+    eq([...cols.value].join(), '0.5,1.5,2.5');
+    assert(isNaN(cols.maybe[1]));
+    eq(cols.maybe[2], 3);
+  },
+  'text columns'() {
+    const { name } = open().query('SELECT name FROM t').fetchColumns();
+    assert(name.offsets instanceof Uint32Array);
+    eq(name.offsets.length, 4);
+    eq(text(name, 0), 'one');
+    eq(text(name, 1), 'two');
+    eq([...name.nulls].join(), '0,0,1');
+  },
+  'batches'() {
+    const db = new SQLite3(':memory:');
+    db.exec('CREATE TABLE n (x INTEGER)');
+    db.insertMany('n', ['x'], { x: new Int32Array(1000).map((_, i) => i) });
+    const res = db.query('SELECT x FROM n ORDER BY x');
+    let batch,
+      sizes = [],
+      sum = 0;
+    while((batch = res.fetchColumns(300))) {
+      sizes.push(batch.x.length);
+      for(const x of batch.x) sum += x;
+    }
+    eq(sizes.join(), '300,300,300,100');
+    eq(sum, 499500);
+    eq(res.fetchColumns(300), null);
+  },
+  async 'dbi columns'() {
+    const db = await Database.connect('sqlite', ':memory:');
+    await db.exec('CREATE TABLE t (a INTEGER, b TEXT)');
+    await db.exec("INSERT INTO t VALUES (1, 'x'), (2, 'yy'), (3, 'zzz')");
+    const res = await db.query('SELECT a, b FROM t');
+    const batches = [];
+    for await(const batch of res.columns(2)) batches.push(batch);
+    eq(batches.length, 2);
+    eq([...batches[0].a].join(), '1,2');
+    eq(text(batches[1].b, 0), 'zzz');
+    await db.close();
+  },
+});
@@ -0,0 +1,64 @@
+import { SQLite3 } from 'sqlite';
+import { assert, eq, tests } from './tinytest.js';
+
+function open() {
+  const db = new SQLite3(':memory:');
+  db.exec(`CREATE TABLE t (id INTEGER PRIMARY KEY, name TEXT, value REAL)`);
+  return db;
+}
+
+const dump = db =>
+  db
+    .prepare('SELECT id, name, value FROM t ORDER BY id')
+    .all()
+    .map(row => row.join(':'))
+    .join(',');
+
+tests({
+  'array of rows'() {
+    const db = open();
+    eq(
+      db.insertMany('t', ['id', 'name', 'value'], [
+        [1, 'a', 0.5],
+        [2, 'b', 1.5],
+      ]),
+      2,
+    );
+    eq(dump(db), '1:a:0.5,2:b:1.5');
+  },
+  'objects from an iterator'() {
+    const db = open();
+    function* rows() {
+      for(let id = 1; id <= 3; id++) yield { id, name: 'n' + id, value: id / 4 };
+    }
+    eq(db.insertMany('t', ['id', 'name', 'value'], rows()), 3);
+    eq(dump(db), '1:n1:0.25,2:n2:0.5,3:n3:0.75');
+  },
+  'columnar typed arrays'() {
+    const db = open();
+    const count = 1000;
+    const id = new Int32Array(count).map((_, i) => i + 1);
+    const value = new Float64Array(count).map((_, i) => i * 2);
+    eq(db.insertMany('t', ['id', 'value'], { id, value }), count);
+    eq(db.prepare('SELECT count(*), sum(id), max(value) FROM t').get().join(','), '1000,500500,1998');
+  },
+  'typed array rows'() {
+    const db = open();
+    db.insertMany('t', ['id', 'value'], [new Float64Array([1, 0.5]), new Float64Array([2, 2.5])]);
+    eq(dump(db), '1::0.5,2::2.5');
+  },
+  'rolls back on error'() {
+    const db = open();
+    let error;
+    try {
+      db.insertMany('t', ['id', 'name'], [
+        [1, 'a'],
+        [1, 'duplicate'],
+      ]);
+    } catch(e) {
+      error = e;
+    }
+    assert(error);
+    eq(db.prepare('SELECT count(*) FROM t').get()[0], 0);
+  },
+});
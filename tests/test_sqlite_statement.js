@@ -0,0 +1,76 @@
+import { SQLite3, SQLite3Statement } from 'sqlite';
+import { assert, eq, tests } from './tinytest.js';
+
+function open() {
+  const db = new SQLite3(':memory:');
+  db.exec(`CREATE TABLE t (id INTEGER PRIMARY KEY, name TEXT, score REAL, data BLOB)`);
+  return db;
+}
+
+tests({
+  'run binds positional parameters'() {
+    const db = open();
+    const st = db.prepare('INSERT INTO t (name, score) VALUES (?, ?)');
+    assert(st instanceof SQLite3Statement);
+    eq(st.paramCount, 2);
+    const info = st.run('a', 1.5);
+    eq(info.changes, 1);
+    eq(info.lastInsertRowid, 1);
+    st.run(['b', 2]);
+    eq(db.prepare('SELECT count(*) FROM t').get()[0], 2);
+  },
+  'named parameters'() {
+    const db = open();
+    db.prepare('INSERT INTO t (name, score) VALUES (:name, $score)').run({ name: 'x', score: 3 });
+    const st = db.prepare('SELECT name, score FROM t WHERE name = @name');
+    st.resultType = SQLite3.RESULT_OBJECT;
+    eq(JSON.stringify(st.get({ name: 'x' })), '{"name":"x","score":3}');
+  },
+  'all and iterate'() {
+    const db = open();
+    const ins = db.prepare('INSERT INTO t (id, name) VALUES (?, ?)');
+    for(let i = 1; i <= 5; i++) ins.run(i, 'n' + i);
+    const sel = db.prepare('SELECT id FROM t WHERE id > ? ORDER BY id');
+    eq(sel.all(2).map(r => r[0]).join(','), '3,4,5');
+    const ids = [];
+    for(const [id] of sel.iterate(3)) ids.push(id);
+    eq(ids.join(','), '4,5');
+    eq(sel.get(5), undefined);
+  },
+  'blobs from typed arrays'() {
+    const db = open();
+    const bytes = new Uint8Array([0, 1, 2, 3, 4, 5]);
+    db.prepare('INSERT INTO t (data) VALUES (?)').run(bytes.subarray(2, 5));
+    const [buf] = db.prepare('SELECT data FROM t').get();
+    eq([...new Uint8Array(buf)].join(','), '2,3,4');
+  },
+  'statement cache'() {
+    const db = open();
+    db.cacheSize = 2;
+    for(let i = 0; i < 10; i++) db.query('INSERT INTO t (name) VALUES (?)', ['q' + i]);
+    eq(db.query('SELECT count(*) FROM t').fetchRow()[0], 10);
+    db.prepare('SELECT 1');
+    db.prepare('SELECT 2');
+    db.prepare('SELECT 3');
+    eq(db.cachedStatements, 2);
+    db.cacheSize = 0;
+    eq(db.cachedStatements, 0);
+  },
+  'busy while iterating'() {
+    const db = open();
+    db.query('INSERT INTO t (name) VALUES (?), (?)', ['a', 'b']);
+    const st = db.prepare('SELECT name FROM t');
+    const it = st.iterate();
+    it.next();
+    let error;
+    try {
+      st.all();
+    } catch(e) {
+      error = e;
+    }
+    assert(error instanceof TypeError);
+    it.next();
+    it.next();
+    eq(st.all().length, 2);
+  },
+});
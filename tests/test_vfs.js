@@ -52,6 +52,15 @@ function buildFixture() {
   ar.close();
 }
 
+function writeTar(file, entries) {
+  const ar = Archive.write(file);
+  for(const [name, content] of entries) {
+    ar.write(new ArchiveEntry(name, { type: 'file', perm: 0o644, size: content.length }));
+    ar.write(content);
+  }
+  ar.close();
+}
+
 function rmrf(p) {
   let st;
   try {
@@ -298,6 +307,29 @@ try {
       eq(content, CONTENT_A_FILE1);
     },
 
+    'UnionFS with a cache counts hits and sees changed files'() {
+      const vfs = new UnionFS({ cache: 1 << 20 });
+      vfs.appendPath(DIR_B);
+      vfs.appendPath(DIR_A);
+
+      eq(vfs.readFileSync('file2.txt', 'utf-8'), CONTENT_B_FILE2);
+      eq(vfs.readFileSync('file2.txt', 'utf-8'), CONTENT_B_FILE2);
+      eq(vfs.readFileSync('sub/nested.txt', 'utf-8'), CONTENT_A_NESTED);
+      eq(vfs.cache.hits, 1);
+      eq(vfs.cache.misses, 2);
+      eq(vfs.cache.count, 2);
+
+      const p = path.join(DIR_A, 'cached.txt');
+      fs.writeFileSync(p, 'before');
+      eq(vfs.readFileSync('cached.txt', 'utf-8'), 'before');
+      fs.writeFileSync(p, 'after, longer');
+      eq(vfs.readFileSync('cached.txt', 'utf-8'), 'after, longer');
+
+      vfs.writeFileSync('cached.txt', 'written through the union');
+      eq(vfs.readFileSync('cached.txt', 'utf-8'), 'written through the union');
+      fs.unlinkSync(p);
+    },
+
     /* --- ArchiveFS --- */
 
     'ArchiveFS default constructor (no explicit read flag) reads by default'() {
@@ -360,6 +392,25 @@ try {
       stream.close();
     },
 
+    'ArchiveFS with a cache reads the archive again when it changes'() {
+      const file = path.join(ROOT, 'cached.tar');
+      writeTar(file, [['one.txt', 'first']]);
+
+      const afs = new ArchiveFS(file, false, { cache: true });
+      eq(afs.readFileSync('one.txt', 'utf-8'), 'first');
+      eq(afs.readFileSync('one.txt', 'utf-8'), 'first');
+      eq(afs.cache.hits, 1);
+      eq(afs.cache.misses, 1);
+
+      writeTar(file, [
+        ['zero.txt', 'new entry'],
+        ['one.txt', 'second'],
+      ]);
+      eq(afs.readFileSync('one.txt', 'utf-8'), 'second');
+      eq(afs.readFileSync('zero.txt', 'utf-8'), 'new entry');
+      eq(afs.cache.hits, 1);
+    },
+
     'ArchiveFS write mode works via either constructor form'() {
       const writeTarget1 = path.join(ROOT, 'attempt1.tar');
       const writeTarget2 = path.join(ROOT, 'attempt2.tar');